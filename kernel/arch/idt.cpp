@@ -1,4 +1,6 @@
 #include "idt.h"
+#include "irq.h"
+#include "lapic.h"
 
 __attribute__((aligned(0x10)))
 static struct idt_entry idt[IDT_ENTRIES];
@@ -35,6 +37,7 @@ void idt_set_descriptor_with_ist(uint8_t vector, void* isr, uint8_t flags, uint8
 
 extern "C" void load_idt(struct idt_descriptor* idtr);
 extern "C" void isr128();
+extern "C" void lapic_spurious_stub();
 
 void idt_init() {
     idtr.size = sizeof(idt) - 1;
@@ -49,11 +52,14 @@ void idt_init() {
     // This ensures we have a valid stack even if the kernel stack overflowed
     idt_set_descriptor_with_ist(8, isr_stub_table[8], 0x8E, 1);
 
-    // IRQs (32-47)
-    for (uint8_t vector = 0; vector < 16; vector++) {
+    // IRQs (32-47) and MSI vectors (48-55)
+    for (uint8_t vector = 0; vector < IRQ_STUB_COUNT; vector++) {
         idt_set_descriptor(vector + 32, irq_stub_table[vector], 0x8E);
     }
 
+    // Local APIC spurious vector
+    idt_set_descriptor(LAPIC_SPURIOUS_VECTOR, (void*)lapic_spurious_stub, 0x8E);
+
     // Syscall (int 0x80) - Ring 3 callable
     idt_set_descriptor(0x80, (void*)isr128, 0xEE); // 0xEE = Present, Ring3, Interrupt
 
@@ -162,6 +162,21 @@ IRQ 13, 45
 IRQ 14, 46
 IRQ 15, 47
 
+; Message-signalled interrupts (MSI/MSI-X via the local APIC -> vectors 48-55)
+IRQ 16, 48
+IRQ 17, 49
+IRQ 18, 50
+IRQ 19, 51
+IRQ 20, 52
+IRQ 21, 53
+IRQ 22, 54
+IRQ 23, 55
+
+; Local APIC spurious interrupt: no EOI, nothing to do
+global lapic_spurious_stub
+lapic_spurious_stub:
+    iretq
+
 global isr_stub_table
 isr_stub_table:
     dq isr0, isr1, isr2, isr3, isr4, isr5, isr6, isr7
@@ -173,6 +188,7 @@ global irq_stub_table
 irq_stub_table:
     dq irq0, irq1, irq2, irq3, irq4, irq5, irq6, irq7
     dq irq8, irq9, irq10, irq11, irq12, irq13, irq14, irq15
+    dq irq16, irq17, irq18, irq19, irq20, irq21, irq22, irq23
 
 global load_idt
 load_idt:
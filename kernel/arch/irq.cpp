@@ -0,0 +1,90 @@
+#include "irq.h"
+#include "pic.h"
+#include "lapic.h"
+#include "spinlock.h"
+
+struct IrqSlot {
+    IrqHandler handler;
+    void* ctx;
+};
+
+static IrqSlot irq_slots[16][IRQ_MAX_HANDLERS_PER_LINE];
+static IrqSlot msi_slots[IRQ_MSI_COUNT];
+static Spinlock irq_lock = SPINLOCK_INIT;
+
+bool irq_register_handler(uint8_t irq, IrqHandler handler, void* ctx) {
+    // 0 (timer), 2 (cascade) and 255 (no line assigned) are never shared
+    if (irq >= 16 || irq == 0 || irq == 2 || !handler) return false;
+
+    spinlock_acquire(&irq_lock);
+    for (int i = 0; i < IRQ_MAX_HANDLERS_PER_LINE; i++) {
+        if (irq_slots[irq][i].handler) continue;
+        irq_slots[irq][i].handler = handler;
+        irq_slots[irq][i].ctx = ctx;
+
+        if (irq >= 8) pic_clear_mask(2);  // Slave PIC reaches the CPU through IRQ2
+        pic_clear_mask(irq);
+        spinlock_release(&irq_lock);
+        return true;
+    }
+    spinlock_release(&irq_lock);
+    return false;
+}
+
+void irq_unregister_handler(uint8_t irq, IrqHandler handler, void* ctx) {
+    if (irq >= 16) return;
+
+    spinlock_acquire(&irq_lock);
+    bool any_left = false;
+    for (int i = 0; i < IRQ_MAX_HANDLERS_PER_LINE; i++) {
+        IrqSlot* slot = &irq_slots[irq][i];
+        if (slot->handler == handler && slot->ctx == ctx) {
+            slot->handler = nullptr;
+            slot->ctx = nullptr;
+        } else if (slot->handler) {
+            any_left = true;
+        }
+    }
+    if (!any_left) pic_set_mask(irq);
+    spinlock_release(&irq_lock);
+}
+
+int irq_alloc_msi(IrqHandler handler, void* ctx) {
+    if (!handler || !lapic_available()) return -1;
+
+    spinlock_acquire(&irq_lock);
+    for (int i = 0; i < IRQ_MSI_COUNT; i++) {
+        if (msi_slots[i].handler) continue;
+        msi_slots[i].handler = handler;
+        msi_slots[i].ctx = ctx;
+        spinlock_release(&irq_lock);
+        return IRQ_MSI_BASE + i;
+    }
+    spinlock_release(&irq_lock);
+    return -1;
+}
+
+void irq_free_msi(int irq) {
+    if (irq < IRQ_MSI_BASE || irq >= IRQ_STUB_COUNT) return;
+
+    spinlock_acquire(&irq_lock);
+    msi_slots[irq - IRQ_MSI_BASE].handler = nullptr;
+    msi_slots[irq - IRQ_MSI_BASE].ctx = nullptr;
+    spinlock_release(&irq_lock);
+}
+
+void irq_dispatch(uint8_t irq) {
+    if (irq >= IRQ_MSI_BASE) {
+        if (irq >= IRQ_STUB_COUNT) return;
+        IrqSlot slot = msi_slots[irq - IRQ_MSI_BASE];
+        if (slot.handler) slot.handler(slot.ctx);
+        return;
+    }
+
+    // Already in interrupt context (IF=0); slots are only written under the
+    // lock with interrupts off, so a plain read is consistent
+    for (int i = 0; i < IRQ_MAX_HANDLERS_PER_LINE; i++) {
+        IrqSlot slot = irq_slots[irq][i];
+        if (slot.handler) slot.handler(slot.ctx);
+    }
+}
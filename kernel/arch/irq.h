@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+
+// ============================================================================
+// Hardware IRQ Dispatch
+// ============================================================================
+// Drivers that use legacy PCI INTx register a handler for their PIC line.
+// Lines can be shared, so every handler on a line is called and must check
+// its own device's interrupt status. Handlers run with interrupts disabled
+// after the EOI has been sent. MSI IRQs are never shared.
+// ============================================================================
+
+#define IRQ_MAX_HANDLERS_PER_LINE 4
+
+// MSI/MSI-X interrupts get their own IRQ numbers above the 16 PIC lines
+// (vectors 48-55, acknowledged at the local APIC)
+#define IRQ_MSI_BASE    16
+#define IRQ_MSI_COUNT   8
+#define IRQ_STUB_COUNT  (IRQ_MSI_BASE + IRQ_MSI_COUNT)
+#define IRQ_VECTOR(irq) ((uint8_t)(32 + (irq)))
+
+typedef void (*IrqHandler)(void* ctx);
+
+// Register a handler and unmask the line. Returns false if the line is full
+bool irq_register_handler(uint8_t irq, IrqHandler handler, void* ctx);
+
+// Remove a handler; the line is masked again once it has none
+void irq_unregister_handler(uint8_t irq, IrqHandler handler, void* ctx);
+
+// Reserve an MSI IRQ for one handler. Returns the IRQ number (use
+// IRQ_VECTOR() for the message data) or -1 if none are free or there is
+// no local APIC
+int irq_alloc_msi(IrqHandler handler, void* ctx);
+void irq_free_msi(int irq);
+
+// Called from irq_handler for lines without a built-in handler
+void irq_dispatch(uint8_t irq);
@@ -0,0 +1,74 @@
+#include "lapic.h"
+#include "vmm.h"
+#include "io.h"
+#include "debug.h"
+
+static volatile uint8_t* lapic_base = nullptr;
+static bool lapic_x2apic = false;
+static bool lapic_ready = false;
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t low, high;
+    asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static uint32_t lapic_read(uint32_t reg) {
+    if (lapic_x2apic) return (uint32_t)rdmsr(0x800 + (reg >> 4));
+    return mmio_read32(lapic_base + reg);
+}
+
+static void lapic_write(uint32_t reg, uint32_t value) {
+    if (lapic_x2apic) {
+        wrmsr(0x800 + (reg >> 4), value);
+    } else {
+        mmio_write32(lapic_base + reg, value);
+    }
+}
+
+bool lapic_init() {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if (!(edx & (1 << 9))) {
+        DEBUG_WARN("LAPIC: Not present, MSI disabled");
+        return false;
+    }
+
+    uint64_t base = rdmsr(IA32_APIC_BASE_MSR);
+    if (!(base & APIC_BASE_ENABLE)) {
+        base |= APIC_BASE_ENABLE;
+        wrmsr(IA32_APIC_BASE_MSR, base);
+    }
+    lapic_x2apic = (base & APIC_BASE_X2APIC) != 0;
+
+    if (!lapic_x2apic) {
+        lapic_base = (volatile uint8_t*)vmm_map_mmio(base & 0xFFFFF000ULL, 0x1000);
+        if (!lapic_base) return false;
+    }
+
+    // Software-enable (keeps LINT0 virtual wire for the PIC untouched)
+    uint32_t svr = lapic_read(LAPIC_REG_SVR);
+    lapic_write(LAPIC_REG_SVR, (svr & ~0xFFu) | LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+
+    lapic_ready = true;
+    DEBUG_INFO("LAPIC: id %u (%s)", lapic_id(), lapic_x2apic ? "x2APIC" : "xAPIC");
+    return true;
+}
+
+bool lapic_available() {
+    return lapic_ready;
+}
+
+uint32_t lapic_id() {
+    if (!lapic_ready) return 0;
+    uint32_t id = lapic_read(LAPIC_REG_ID);
+    return lapic_x2apic ? id : (id >> 24);
+}
+
+void lapic_eoi() {
+    if (lapic_ready) lapic_write(LAPIC_REG_EOI, 0);
+}
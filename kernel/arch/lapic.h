@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+
+// ============================================================================
+// Local APIC (minimal)
+// ============================================================================
+// Only what MSI/MSI-X delivery needs: the 8259 PIC still drives the timer
+// and legacy IRQs through the LAPIC's virtual-wire mode, which is left as
+// the firmware configured it. MSI vectors must be acknowledged here instead
+// of at the PIC.
+// ============================================================================
+
+#define LAPIC_SPURIOUS_VECTOR   0xFF
+
+// Register offsets (xAPIC MMIO; x2APIC MSR = 0x800 + offset / 16)
+#define LAPIC_REG_ID            0x020
+#define LAPIC_REG_EOI           0x0B0
+#define LAPIC_REG_SVR           0x0F0
+
+#define LAPIC_SVR_ENABLE        (1u << 8)
+
+#define IA32_APIC_BASE_MSR      0x1B
+#define APIC_BASE_X2APIC        (1ull << 10)
+#define APIC_BASE_ENABLE        (1ull << 11)
+
+// MSI message address for fixed delivery to one APIC
+#define MSI_ADDRESS_BASE        0xFEE00000u
+
+// Map the LAPIC and make sure it is software-enabled. Returns false if the
+// CPU has no APIC (MSI unavailable)
+bool lapic_init();
+bool lapic_available();
+uint32_t lapic_id();
+void lapic_eoi();
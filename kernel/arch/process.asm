@@ -1,5 +1,6 @@
 global switch_to_task
 global init_fpu_state
+global enter_user_mode
 
 section .text
 
@@ -47,6 +48,22 @@ switch_to_task:
     
     ret
 
+; void enter_user_mode()
+; Reached via switch_to_task's `ret` on a kernel stack prepared by
+; process_exec/process_fork. Stack layout (low -> high):
+;   r15, r14, r13, r12, rbp, rbx   (same order isr128 saves them)
+;   RIP, CS, RFLAGS, RSP, SS       (iretq frame)
+; RAX is cleared so a forked child sees fork() return 0.
+enter_user_mode:
+    xor eax, eax
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    iretq
+
 ; void init_fpu_state(uint8_t* fpu_buffer)
 ; RDI = pointer to 512-byte aligned buffer
 ; Initializes FPU state to default values
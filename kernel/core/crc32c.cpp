@@ -0,0 +1,82 @@
+#include "crc32c.h"
+
+#define CRC32C_POLY     0x82F63B78u
+
+static uint32_t tables[8][256];
+static bool tables_ready = false;
+static int hardware = -1;       // Unknown until the first call
+
+// tables[0] is the byte-at-a-time table; tables[k][b] is the CRC of b
+// followed by k zero bytes, so eight table lookups consume eight bytes
+static void build_tables() {
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t crc = b;
+        for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+        tables[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+        for (int k = 1; k < 8; k++) {
+            tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+        }
+    }
+    tables_ready = true;
+}
+
+static uint32_t crc_sw(uint32_t crc, const uint8_t* p, size_t len) {
+    if (!tables_ready) build_tables();
+    while (len && ((uintptr_t)p & 7)) {
+        crc = (crc >> 8) ^ tables[0][(crc ^ *p++) & 0xFF];
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t word = *(const uint64_t*)p ^ crc;
+        crc = tables[7][word & 0xFF] ^
+              tables[6][(word >> 8) & 0xFF] ^
+              tables[5][(word >> 16) & 0xFF] ^
+              tables[4][(word >> 24) & 0xFF] ^
+              tables[3][(word >> 32) & 0xFF] ^
+              tables[2][(word >> 40) & 0xFF] ^
+              tables[1][(word >> 48) & 0xFF] ^
+              tables[0][word >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc = (crc >> 8) ^ tables[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+static uint32_t crc_hw(uint32_t crc, const uint8_t* p, size_t len) {
+    while (len && ((uintptr_t)p & 7)) {
+        asm("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+        p++;
+        len--;
+    }
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        asm("crc32q %1, %0" : "+r"(crc64) : "rm"(*(const uint64_t*)p));
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (len--) {
+        asm("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+        p++;
+    }
+    return crc;
+}
+
+bool crc32c_is_hardware() {
+    if (hardware < 0) {
+        uint32_t eax, ebx, ecx, edx;
+        asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+        hardware = (ecx & (1 << 20)) != 0;  // SSE4.2
+    }
+    return hardware != 0;
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    crc = crc32c_is_hardware() ? crc_hw(crc, p, len) : crc_sw(crc, p, len);
+    return ~crc;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// CRC32C
+// ============================================================================
+// Castagnoli CRC (reflected polynomial 0x82F63B78, as in iSCSI and ext4).
+// Uses the SSE4.2 crc32 instruction when the CPU has it; it works on
+// general-purpose registers, so the kernel's -mno-sse does not get in the
+// way. Other CPUs get slicing-by-8 over tables built on first use.
+//
+// Start from crc = 0 and pass the previous result to continue over the next
+// piece: crc32c(crc32c(0, a, n), b, m) is the CRC of a followed by b.
+// crc32c(0, "123456789", 9) == 0xE3069283.
+// ============================================================================
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t len);
+
+// True if crc32c() uses the crc32 instruction
+bool crc32c_is_hardware();
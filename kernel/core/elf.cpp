@@ -3,6 +3,7 @@
 #include "pmm.h"
 #include "heap.h"
 #include "kstring.h"
+#include "image_cache.h"
 #include <stddef.h>
 
 // Use kstring memory utilities
@@ -92,10 +93,12 @@ uint64_t elf_load(const uint8_t* data, uint64_t size) {
 }
 
 // Load ELF for Ring 3 execution (with user flag on all pages)
-uint64_t elf_load_user(const uint8_t* data, uint64_t size) {
+uint64_t elf_load_user(uint64_t* pml4, const uint8_t* data, uint64_t size, const ExecImage* image) {
     if (!elf_validate(data, size)) return 0;
     
     const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*)data;
+    // Bounds checks are written so that a huge field cannot wrap them
+    if (ehdr->e_phoff > size || ehdr->e_phnum > (size - ehdr->e_phoff) / sizeof(Elf64_Phdr)) return 0;
     const Elf64_Phdr* phdr = (const Elf64_Phdr*)(data + ehdr->e_phoff);
     
     // Load each PT_LOAD segment
@@ -107,7 +110,26 @@ uint64_t elf_load_user(const uint8_t* data, uint64_t size) {
         uint64_t memsz = phdr[i].p_memsz;
         uint64_t offset = phdr[i].p_offset;
         
-        uint64_t num_pages = (memsz + 0xFFF) / 0x1000;
+        // Reject segments outside the file or the user half
+        const uint64_t limit = USER_STACK_TOP - USER_STACK_PAGES * 0x1000;
+        if (offset > size || filesz > size - offset || filesz > memsz) return 0;
+        if (vaddr >= limit || memsz > limit - vaddr) return 0;
+        
+        // Cached read-only segment: map the image's frames
+        const SharedSegment* shared = image_cache_find_segment(image, i);
+        if (shared) {
+            for (uint64_t p = 0; p < shared->page_count; p++) {
+                vmm_map_page_in(pml4, shared->vaddr + p * 0x1000, shared->frames[p],
+                                PTE_PRESENT | PTE_USER | PTE_SHARED);
+            }
+            continue;
+        }
+        
+        // Always set USER flag for Ring 3; text/rodata stay read-only
+        uint64_t flags = PTE_PRESENT | PTE_USER;
+        if (phdr[i].p_flags & PF_W) flags |= PTE_WRITABLE;
+        
+        uint64_t num_pages = ((vaddr & 0xFFF) + memsz + 0xFFF) / 0x1000;
         uint64_t bytes_copied = 0;
         
         for (uint64_t p = 0; p < num_pages; p++) {
@@ -115,10 +137,7 @@ uint64_t elf_load_user(const uint8_t* data, uint64_t size) {
             if (!frame) return 0;
             
             uint64_t page_vaddr = (vaddr & ~0xFFF) + (p * 0x1000);
-            // Always set USER flag for Ring 3
-            uint64_t flags = PTE_PRESENT | PTE_WRITABLE | PTE_USER;
-            
-            vmm_map_page(page_vaddr, (uint64_t)frame, flags);
+            vmm_map_page_in(pml4, page_vaddr, (uint64_t)frame, flags);
             
             void* dest = (void*)vmm_phys_to_virt((uint64_t)frame);
             memset(dest, 0, 0x1000);
@@ -138,12 +157,13 @@ uint64_t elf_load_user(const uint8_t* data, uint64_t size) {
         }
     }
     
-    // Also map a user stack at 0x7FFF0000
-    void* stack_frame = pmm_alloc_frame();
-    if (stack_frame) {
-        vmm_map_page(0x7FFF0000, (uint64_t)stack_frame, PTE_PRESENT | PTE_WRITABLE | PTE_USER);
-        void* stack_dest = (void*)vmm_phys_to_virt((uint64_t)stack_frame);
-        memset(stack_dest, 0, 0x1000);
+    // Map the user stack just below USER_STACK_TOP
+    for (uint64_t p = 1; p <= USER_STACK_PAGES; p++) {
+        void* stack_frame = pmm_alloc_frame();
+        if (!stack_frame) return 0;
+        vmm_map_page_in(pml4, USER_STACK_TOP - p * 0x1000, (uint64_t)stack_frame,
+                        PTE_PRESENT | PTE_WRITABLE | PTE_USER);
+        memset((void*)vmm_phys_to_virt((uint64_t)stack_frame), 0, 0x1000);
     }
     
     return ehdr->e_entry;
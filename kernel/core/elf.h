@@ -58,7 +58,17 @@ struct Elf64_Phdr {
     uint64_t p_align;   // Segment alignment
 } __attribute__((packed));
 
+// User stack (grows down from USER_STACK_TOP)
+#define USER_STACK_TOP   0x80000000ULL
+#define USER_STACK_PAGES 16  // 64KB
+
 // ELF Loader functions
 bool elf_validate(const uint8_t* data, uint64_t size);
 uint64_t elf_load(const uint8_t* data, uint64_t size);
-uint64_t elf_load_user(const uint8_t* data, uint64_t size);
+
+// Load ELF into a user address space (pml4 = HHDM pointer) and map its stack.
+// Returns entry point, or 0 on failure (partially mapped pages are left for
+// vmm_free_address_space to release).
+// Segments found in `image` (see image_cache.h) are mapped shared instead of copied.
+struct ExecImage;
+uint64_t elf_load_user(uint64_t* pml4, const uint8_t* data, uint64_t size, const ExecImage* image = nullptr);
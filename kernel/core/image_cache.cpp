@@ -0,0 +1,266 @@
+#include "image_cache.h"
+#include "elf.h"
+#include "vfs.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "heap.h"
+#include "timer.h"
+#include "spinlock.h"
+#include "kstring.h"
+#include "debug.h"
+
+static ExecImage image_cache[IMAGE_CACHE_SIZE];
+static Spinlock image_cache_lock = SPINLOCK_INIT;
+static uint64_t cache_hits = 0;
+static uint64_t cache_misses = 0;
+
+// ============================================================================
+// Internal Helpers
+// ============================================================================
+
+static void free_image(ExecImage* image) {
+    for (uint32_t s = 0; s < image->segment_count; s++) {
+        SharedSegment* seg = &image->segments[s];
+        if (!seg->frames) continue;
+        for (uint64_t p = seg->direct_pages; p < seg->page_count; p++) {
+            if (seg->frames[p]) pmm_free_frame((void*)seg->frames[p]);
+        }
+        free(seg->frames);
+        seg->frames = nullptr;
+    }
+    image->segment_count = 0;
+    image->in_use = false;
+    image->stale = false;
+    image->building = false;
+}
+
+// A read-only segment can only be shared if none of its pages also hold
+// writable data (segments that are not page-aligned in the file)
+static bool overlaps_writable(const Elf64_Phdr* phdr, uint16_t phnum, uint64_t start, uint64_t end) {
+    for (uint16_t i = 0; i < phnum; i++) {
+        if (phdr[i].p_type != PT_LOAD || !(phdr[i].p_flags & PF_W)) continue;
+        uint64_t w_start = phdr[i].p_vaddr & ~0xFFFULL;
+        uint64_t w_end = (phdr[i].p_vaddr + phdr[i].p_memsz + 0xFFF) & ~0xFFFULL;
+        if (w_start < end && start < w_end) return true;
+    }
+    return false;
+}
+
+// Copy the read-only segments of an ELF into fresh frames, or map them
+// from the boot image where the file sits there page-aligned
+static bool build_image(ExecImage* image, const uint8_t* data, uint64_t size) {
+    if (!elf_validate(data, size)) return false;
+    bool in_boot_image = unifs_is_boot_data(data, size);
+
+    const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*)data;
+    if (ehdr->e_phoff > size || ehdr->e_phnum > (size - ehdr->e_phoff) / sizeof(Elf64_Phdr)) return false;
+    const Elf64_Phdr* phdr = (const Elf64_Phdr*)(data + ehdr->e_phoff);
+
+    image->segment_count = 0;
+    for (uint16_t i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type != PT_LOAD || (phdr[i].p_flags & PF_W)) continue;
+        if (image->segment_count == IMAGE_MAX_SHARED_SEGMENTS) break;
+
+        uint64_t vaddr = phdr[i].p_vaddr;
+        uint64_t filesz = phdr[i].p_filesz;
+        uint64_t offset = phdr[i].p_offset;
+        if (offset > size || filesz > size - offset || filesz > phdr[i].p_memsz) return false;
+
+        uint64_t start = vaddr & ~0xFFFULL;
+        uint64_t end = (vaddr + phdr[i].p_memsz + 0xFFF) & ~0xFFFULL;
+        if (end <= start || overlaps_writable(phdr, ehdr->e_phnum, start, end)) continue;
+
+        SharedSegment* seg = &image->segments[image->segment_count];
+        seg->phdr_index = i;
+        seg->vaddr = start;
+        seg->page_count = (end - start) / 0x1000;
+        seg->direct_pages = 0;
+        seg->frames = (uint64_t*)malloc(seg->page_count * sizeof(uint64_t));
+        if (!seg->frames) return false;
+        kstring::zero_memory(seg->frames, seg->page_count * sizeof(uint64_t));
+        image->segment_count++;
+
+        // File bytes behind the first page. Pages they fill completely need
+        // no copy; the first one also shows the bytes before vaddr, as a
+        // file mapping would.
+        uint64_t page_offset = vaddr & 0xFFF;
+        uint64_t file_page = (uint64_t)data + offset - page_offset;
+        bool direct = in_boot_image && offset >= page_offset && (file_page & 0xFFF) == 0;
+
+        // Same page walk as elf_load_user()
+        uint64_t bytes_copied = 0;
+        for (uint64_t p = 0; p < seg->page_count; p++) {
+            if (direct && (p + 1) * 0x1000 <= page_offset + filesz) {
+                seg->frames[p] = vmm_virt_to_phys(file_page + p * 0x1000);
+                seg->direct_pages++;
+                bytes_copied += 0x1000 - ((p == 0) ? page_offset : 0);
+                continue;
+            }
+
+            void* frame = pmm_alloc_frame();
+            if (!frame) return false;
+            seg->frames[p] = (uint64_t)frame;
+
+            uint8_t* dest = (uint8_t*)vmm_phys_to_virt((uint64_t)frame);
+            kstring::zero_memory(dest, 0x1000);
+
+            if (bytes_copied < filesz) {
+                uint64_t copy_start = (p == 0) ? (vaddr & 0xFFF) : 0;
+                uint64_t copy_amount = 0x1000 - copy_start;
+                if (bytes_copied + copy_amount > filesz) {
+                    copy_amount = filesz - bytes_copied;
+                }
+                kstring::memcpy(dest + copy_start, data + offset + bytes_copied, copy_amount);
+                bytes_copied += copy_amount;
+            }
+        }
+    }
+
+    return image->segment_count > 0;
+}
+
+// Pick a slot for a new image: a free one, else the least recently used
+// unreferenced one
+static ExecImage* find_victim_slot() {
+    ExecImage* victim = nullptr;
+    for (int i = 0; i < IMAGE_CACHE_SIZE; i++) {
+        ExecImage* image = &image_cache[i];
+        if (!image->in_use) return image;
+        if (image->refcount == 0 && (!victim || image->last_used < victim->last_used)) {
+            victim = image;
+        }
+    }
+    if (victim) free_image(victim);
+    return victim;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+ExecImage* image_cache_acquire(const char* name, const uint8_t* data, uint64_t size) {
+    if (!name || kstring::strlen(name) > UNIFS_MAX_FILENAME) return nullptr;
+
+    uint64_t generation = vfs_get_generation(name);
+
+    uint64_t flags = interrupts_save_disable();
+    spinlock_acquire(&image_cache_lock);
+
+    for (int i = 0; i < IMAGE_CACHE_SIZE; i++) {
+        ExecImage* image = &image_cache[i];
+        if (!image->in_use || image->stale) continue;
+        if (kstring::strcmp(image->name, name) != 0) continue;
+
+        if (image->size == size && image->generation == generation) {
+            // Still being built by someone else: do not wait for it
+            if (image->building) {
+                spinlock_release(&image_cache_lock);
+                interrupts_restore(flags);
+                return nullptr;
+            }
+            image->refcount++;
+            image->last_used = timer_get_ticks();
+            cache_hits++;
+            spinlock_release(&image_cache_lock);
+            interrupts_restore(flags);
+            return image;
+        }
+
+        // File was replaced or rewritten: retire the old image
+        if (image->refcount == 0) {
+            free_image(image);
+        } else {
+            image->stale = true;
+        }
+    }
+
+    cache_misses++;
+    ExecImage* image = find_victim_slot();
+    if (!image) {
+        // Every slot is referenced - load privately
+        spinlock_release(&image_cache_lock);
+        interrupts_restore(flags);
+        return nullptr;
+    }
+
+    image->in_use = true;
+    image->stale = false;
+    image->building = true;
+    kstring::strncpy(image->name, name, sizeof(image->name) - 1);
+    image->name[sizeof(image->name) - 1] = '\0';
+    image->size = size;
+    image->generation = generation;
+    image->refcount = 1;
+    image->last_used = timer_get_ticks();
+    spinlock_release(&image_cache_lock);
+    interrupts_restore(flags);
+
+    // Copying whole segments takes a while: do it with interrupts on. The
+    // reference keeps the slot from being evicted meanwhile.
+    bool built = build_image(image, data, size);
+
+    flags = interrupts_save_disable();
+    spinlock_acquire(&image_cache_lock);
+    if (!built) {
+        free_image(image);
+        spinlock_release(&image_cache_lock);
+        interrupts_restore(flags);
+        return nullptr;
+    }
+    image->building = false;
+    spinlock_release(&image_cache_lock);
+    interrupts_restore(flags);
+
+    DEBUG_INFO("Cached image '%s' (%d shared segments)\n", name, image->segment_count);
+    return image;
+}
+
+void image_cache_retain(ExecImage* image) {
+    if (!image) return;
+
+    uint64_t flags = interrupts_save_disable();
+    spinlock_acquire(&image_cache_lock);
+    image->refcount++;
+    spinlock_release(&image_cache_lock);
+    interrupts_restore(flags);
+}
+
+void image_cache_release(ExecImage* image) {
+    if (!image) return;
+
+    uint64_t flags = interrupts_save_disable();
+    spinlock_acquire(&image_cache_lock);
+    if (image->refcount > 0) image->refcount--;
+    if (image->refcount == 0 && image->stale) {
+        free_image(image);
+    }
+    spinlock_release(&image_cache_lock);
+    interrupts_restore(flags);
+}
+
+const SharedSegment* image_cache_find_segment(const ExecImage* image, uint16_t phdr_index) {
+    if (!image) return nullptr;
+    for (uint32_t s = 0; s < image->segment_count; s++) {
+        if (image->segments[s].phdr_index == phdr_index) return &image->segments[s];
+    }
+    return nullptr;
+}
+
+void image_cache_get_stats(ImageCacheStats* stats) {
+    if (!stats) return;
+
+    stats->hits = cache_hits;
+    stats->misses = cache_misses;
+    stats->images = 0;
+    stats->shared_pages = 0;
+    stats->direct_pages = 0;
+    for (int i = 0; i < IMAGE_CACHE_SIZE; i++) {
+        if (!image_cache[i].in_use || image_cache[i].building) continue;
+        stats->images++;
+        for (uint32_t s = 0; s < image_cache[i].segment_count; s++) {
+            const SharedSegment* seg = &image_cache[i].segments[s];
+            stats->shared_pages += seg->page_count - seg->direct_pages;
+            stats->direct_pages += seg->direct_pages;
+        }
+    }
+}
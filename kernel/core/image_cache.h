@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+
+// ============================================================================
+// Executable Image Cache
+// ============================================================================
+// Read-only PT_LOAD segments (no PF_W) of programs started with exec are
+// loaded once per uniFS file and mapped into every instance of the program.
+// Those PTEs carry PTE_SHARED so fork shares them and address-space teardown
+// leaves the frames to the cache.
+//
+// Pages that a boot file holds in place at the right page offset (images
+// built with mkunifs.py --aligned) are mapped straight from the boot image
+// instead of being copied.
+//
+// Images are keyed by path, size and file generation, not by where the
+// caller's copy of the file sits, so a program read into a fresh buffer
+// for every exec still finds its image.
+//
+// Each process holds one reference on its image. Unreferenced images stay
+// cached for fast relaunch until their slot is needed or the file changes.
+// A slot is reserved under the cache lock and its segments are built after
+// dropping it; others loading the same file meanwhile load privately.
+// ============================================================================
+
+#define IMAGE_CACHE_SIZE            16
+#define IMAGE_MAX_SHARED_SEGMENTS   4
+
+struct SharedSegment {
+    uint16_t phdr_index;      // Program header this segment was built from
+    uint64_t vaddr;           // Page-aligned start address
+    uint64_t page_count;
+    uint64_t* frames;         // Physical frame per page (heap array)
+    uint64_t direct_pages;    // Leading frames that belong to the boot image
+};
+
+struct ExecImage {
+    bool in_use;
+    bool stale;               // File changed; freed once refcount drops to 0
+    bool building;            // Segments being filled in by the first acquirer
+    char name[64];            // Path, with size and generation the cache key
+    uint64_t size;
+    uint64_t generation;      // vfs_get_generation() at load time
+    uint32_t refcount;
+    uint64_t last_used;       // Timer tick of last acquire (for eviction)
+    uint32_t segment_count;
+    SharedSegment segments[IMAGE_MAX_SHARED_SEGMENTS];
+};
+
+struct ImageCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t images;          // Cached images (referenced or not)
+    uint64_t shared_pages;    // Frames owned by the cache
+    uint64_t direct_pages;    // Pages mapped from the boot image (not copied)
+};
+
+// Look up (or build) the image for a uniFS file and take a reference.
+// Returns nullptr if the file has no shareable segments or memory is short;
+// the caller then loads everything privately.
+ExecImage* image_cache_acquire(const char* name, const uint8_t* data, uint64_t size);
+
+// Take another reference (fork)
+void image_cache_retain(ExecImage* image);
+
+// Drop a reference (process reaped / exec failed)
+void image_cache_release(ExecImage* image);
+
+// Shared segment built from a program header, or nullptr
+const SharedSegment* image_cache_find_segment(const ExecImage* image, uint16_t phdr_index);
+
+void image_cache_get_stats(ImageCacheStats* stats);
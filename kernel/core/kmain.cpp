@@ -33,6 +33,8 @@ static volatile LIMINE_REQUESTS_END_MARKER;
 #include "gdt.h"
 #include "idt.h"
 #include "pic.h"
+#include "irq.h"
+#include "lapic.h"
 #include "ps2_keyboard.h"
 #include "timer.h"
 #include "pmm.h"
@@ -41,6 +43,9 @@ static volatile LIMINE_REQUESTS_END_MARKER;
 #include "heap.h"
 #include "scheduler.h"
 #include "unifs.h"
+#include "vfs.h"
+#include "tmpfs.h"
+#include "bcache.h"
 #include "shell.h"
 #include "ps2_mouse.h"
 #include "debug.h"
@@ -58,6 +63,9 @@ static volatile LIMINE_REQUESTS_END_MARKER;
 
 // New
 #include "ac97.h"
+#include "virtio_blk.h"
+#include "nvme.h"
+#include "ahci.h"
 
 // Global framebuffer pointer
 struct limine_framebuffer* g_framebuffer = nullptr;
@@ -102,6 +110,13 @@ extern "C" void irq_handler(void* stack_frame) {
     uint64_t int_no = regs[15];
     uint8_t irq = int_no - 32;
     
+    // MSI vectors come through the local APIC, not the PIC
+    if (irq >= IRQ_MSI_BASE) {
+        lapic_eoi();
+        irq_dispatch(irq);
+        return;
+    }
+
     pic_send_eoi(irq);
 
     if (irq == 0) {
@@ -111,6 +126,8 @@ extern "C" void irq_handler(void* stack_frame) {
         ps2_keyboard_handler();
     } else if (irq == 12) {
         ps2_mouse_handler();
+    } else {
+        irq_dispatch(irq);
     }
 }
 
@@ -630,6 +647,8 @@ extern "C" void _start(void) {
     pci_init();
     DEBUG_INFO("PCI Subsystem Initialized");
     
+    lapic_init();  // Needed for MSI/MSI-X; legacy IRQs stay on the PIC
+    
     acpi_init();  // Initialize ACPI for poweroff support
     
     rtc_init();  // Initialize RTC for date/time
@@ -650,18 +669,33 @@ extern "C" void _start(void) {
     // Initialize sound driver
     ac97_init();
     // ac97_init logs its own status
+
+    // Initialize storage drivers (register with the block layer)
+    virtio_blk_init();
+    nvme_init();
+    ahci_init();
+    bcache_init();  // Buffer cache + flusher task for the devices above
     
     // Enable interrupts
     asm("sti");
     DEBUG_INFO("Interrupts Enabled");
     
-    // Initialize filesystem
-    if (module_request.response && module_request.response->module_count > 0) {
-        unifs_init(module_request.response->modules[0]->address);
+    // Initialize filesystem: a snapshot on disk wins over the boot module
+    if (unifs_load_snapshot()) {
+        DEBUG_INFO("Filesystem Ready (snapshot)");
+    } else if (module_request.response && module_request.response->module_count > 0) {
+        unifs_init(module_request.response->modules[0]->address,
+                   module_request.response->modules[0]->size);
         DEBUG_INFO("Filesystem Ready");
     } else {
         DEBUG_WARN("Filesystem: No modules");
     }
+    unifs_mount_disks();  // Persistent volume on a block device, if any
+    vfs_init();
+    vfs_mount("/", &unifs_vfs_ops, nullptr);
+    tmpfs_init();
+    vfs_mount("/tmp", &tmpfs_vfs_ops, nullptr);
+    unifs_start_verify();   // Checks boot files in the background
     
 #ifdef DEBUG
     // Debug build: show boot log and wait for keypress
@@ -703,6 +737,7 @@ extern "C" void _start(void) {
         // 1. Always poll hardware (USB needs frequent polling)
         input_poll();
         net_poll();
+        unifs_reap_verify();
 
         // Poll sound
         ac97_poll();
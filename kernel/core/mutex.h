@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include "scheduler.h"
+
+/**
+ * @file mutex.h
+ * @brief Sleeping lock for code paths that wait on I/O
+ *
+ * Unlike a Spinlock, a Mutex does not disable interrupts, so the holder may
+ * block (e.g. waiting for a disk read). Contenders yield the CPU instead of
+ * spinning. Never take a Mutex from an interrupt handler.
+ *
+ * Usage:
+ *   Mutex m = MUTEX_INIT;
+ *   mutex_lock(&m);
+ *   // critical section, may block
+ *   mutex_unlock(&m);
+ */
+
+struct Mutex {
+    volatile uint32_t locked;   // 0 = unlocked, 1 = locked
+};
+
+#define MUTEX_INIT {0}
+
+static inline void mutex_init(Mutex* m) {
+    m->locked = 0;
+}
+
+static inline void mutex_lock(Mutex* m) {
+    while (__sync_lock_test_and_set(&m->locked, 1)) {
+        scheduler_yield();
+    }
+    asm volatile("" ::: "memory");
+}
+
+static inline bool mutex_try_lock(Mutex* m) {
+    return __sync_lock_test_and_set(&m->locked, 1) == 0;
+}
+
+static inline void mutex_unlock(Mutex* m) {
+    asm volatile("" ::: "memory");
+    __sync_lock_release(&m->locked);
+}
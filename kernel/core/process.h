@@ -43,14 +43,37 @@ struct Process {
     uint64_t wait_for_pid;    // PID to wait for (0 = any child)
     uint64_t wake_time;       // Timer tick when process should wake (for SLEEPING)
     bool fpu_initialized;     // Whether FPU state has been initialized
+    uint64_t mmap_next;       // Next free address for anonymous user mappings
+    struct ExecImage* image;  // Shared program text (image cache reference)
+    struct WaitQueue* waiting_on; // Queue this process is blocked on, if any
+    Process* wait_next;       // Next waiter in that queue
+    void (*task_entry)(void*); // scheduler_spawn() entry point and its argument
+    void* task_arg;
+    struct TerminalSink* output; // Terminal output goes here instead of the screen, if set
     Process* next;
 };
 
+// Anonymous mappings (SYS_MMAP) are handed out upwards from here
+#define USER_MMAP_BASE 0x0000000100000000ULL
+
+// Selectors used when entering ring 3
+#define USER_CODE_SELECTOR 0x1B
+#define USER_DATA_SELECTOR 0x23
+
 extern "C" void switch_to_task(Process* current, Process* next);
 
+// Return-to-user trampoline (arch/process.asm). Pops the callee-saved
+// registers saved by isr128 and irets with RAX = 0.
+extern "C" void enter_user_mode();
+
 // New process management functions
 Process* process_get_current();
 Process* process_find_by_pid(uint64_t pid);
 uint64_t process_fork();
 void process_exit(int32_t status);
 int64_t process_waitpid(int64_t pid, int32_t* status);
+
+// Load an ELF image into a fresh address space and start it in ring 3.
+// `name` keys the shared-text image cache (nullptr = load privately).
+// Returns the new PID, or -1 on failure.
+int64_t process_exec(const char* name, const uint8_t* data, uint64_t size);
@@ -8,6 +8,9 @@
 #include "timer.h"
 #include "gdt.h"  // For tss_set_rsp0
 #include "kstring.h"
+#include "elf.h"
+#include "image_cache.h"
+#include "waitqueue.h"
 #include <stddef.h>
 
 // External assembly function to initialize FPU state
@@ -22,6 +25,49 @@ static Process* current_process = nullptr;
 static Process* process_list = nullptr;
 static uint64_t next_pid = 1;
 
+// Kernel stack frames used to enter ring 3 (see enter_user_mode in process.asm)
+// isr128 frame: SS, RSP, RFLAGS, CS, RIP pushed by the CPU + 6 callee-saved regs
+#define USER_ENTRY_FRAME_QWORDS 11
+// switch_to_task frame: RIP, RFLAGS + 6 callee-saved regs
+#define SWITCH_FRAME_QWORDS 8
+
+// Append a process to the circular run list
+static void add_to_process_list(Process* proc) {
+    spinlock_acquire(&scheduler_lock);
+    Process* last = process_list;
+    while (last->next != process_list) {
+        last = last->next;
+    }
+    last->next = proc;
+    proc->next = process_list;
+    spinlock_release(&scheduler_lock);
+}
+
+// Place a switch_to_task frame below the isr128 frame at the top of a kernel
+// stack (stack_top = HHDM address of the stack's end) so the first switch into
+// the process "returns" through enter_user_mode. Returns the saved SP value.
+static uint64_t prepare_user_return(uint64_t* stack_top) {
+    uint64_t* frame = stack_top - USER_ENTRY_FRAME_QWORDS - SWITCH_FRAME_QWORDS;
+    for (int i = 0; i < 6; i++) frame[i] = 0;   // r15..rbx
+    frame[6] = 0x2;                             // RFLAGS (IF=0 until iretq)
+    frame[7] = (uint64_t)enter_user_mode;       // RIP
+    return KERNEL_STACK_TOP - (USER_ENTRY_FRAME_QWORDS + SWITCH_FRAME_QWORDS) * sizeof(uint64_t);
+}
+
+// Allocate and map a kernel stack at KERNEL_STACK_TOP in the given address space
+static uint64_t alloc_kernel_stack(uint64_t* pml4) {
+    size_t stack_pages = KERNEL_STACK_SIZE / 4096;
+    void* stack_phys = pmm_alloc_frames(stack_pages);
+    if (!stack_phys) return 0;
+    
+    uint64_t stack_virt_base = KERNEL_STACK_TOP - KERNEL_STACK_SIZE;
+    for (size_t i = 0; i < stack_pages; i++) {
+        vmm_map_page_in(pml4, stack_virt_base + i * 4096, (uint64_t)stack_phys + i * 4096,
+                        PTE_PRESENT | PTE_WRITABLE);
+    }
+    return (uint64_t)stack_phys;
+}
+
 Process* process_get_current() {
     return current_process;
 }
@@ -79,7 +125,9 @@ void scheduler_init() {
     DEBUG_INFO("Scheduler Initialized. Initial PID: 0\n");
 }
 
-void scheduler_create_task(void (*entry)()) {
+// Build a kernel task that starts at entry and add it to the process list.
+// task_entry/task_arg are for spawn_trampoline. Returns nullptr on failure.
+static Process* create_kernel_task(void (*entry)(), void (*task_entry)(void*), void* task_arg) {
     // CRITICAL: Disable interrupts to prevent timer IRQ from running scheduler_schedule
     // while we're modifying the process list. This prevents deadlock/corruption.
     uint64_t flags = interrupts_save_disable();
@@ -89,7 +137,7 @@ void scheduler_create_task(void (*entry)()) {
     if (!new_process) {
         DEBUG_ERROR("Failed to allocate process struct\n");
         interrupts_restore(flags);
-        return;
+        return nullptr;
     }
     
     // Zero the entire struct first
@@ -103,6 +151,8 @@ void scheduler_create_task(void (*entry)()) {
     new_process->wait_for_pid = 0;
     new_process->page_table = nullptr;  // Kernel task - no VMM isolation
     new_process->stack_phys = 0;        // Kernel task - stack is heap-allocated
+    new_process->task_entry = task_entry;
+    new_process->task_arg = task_arg;
     
     // Initialize FPU state for the new task
     init_fpu_state(new_process->fpu_state);
@@ -114,7 +164,7 @@ void scheduler_create_task(void (*entry)()) {
         DEBUG_ERROR("Failed to allocate stack for PID %d\n", new_process->pid);
         aligned_free(new_process);  // Must use aligned_free, not free!
         interrupts_restore(flags);
-        return; 
+        return nullptr;
     }
     
     // Align stack top to 16 bytes
@@ -135,17 +185,27 @@ void scheduler_create_task(void (*entry)()) {
     new_process->sp = (uint64_t)stack_top;
     
     // Add to list (protected by scheduler lock)
-    spinlock_acquire(&scheduler_lock);
-    Process* last = process_list;
-    while (last->next != process_list) {
-        last = last->next;
-    }
-    last->next = new_process;
-    new_process->next = process_list;
-    spinlock_release(&scheduler_lock);
+    add_to_process_list(new_process);
     
     interrupts_restore(flags);
     DEBUG_INFO("Created Task PID: %d\n", new_process->pid);
+    return new_process;
+}
+
+void scheduler_create_task(void (*entry)()) {
+    create_kernel_task(entry, nullptr, nullptr);
+}
+
+// Where spawned tasks start: run the entry function, then exit so the
+// parent can reap the task with process_waitpid()
+static void spawn_trampoline() {
+    current_process->task_entry(current_process->task_arg);
+    process_exit(0);
+}
+
+uint64_t scheduler_spawn(void (*entry)(void*), void* arg) {
+    Process* proc = create_kernel_task(spawn_trampoline, entry, arg);
+    return proc ? proc->pid : 0;
 }
 
 // Helper: Wake up any sleeping processes whose time has come
@@ -255,6 +315,8 @@ uint64_t process_fork() {
     child->state = PROCESS_READY;
     child->exit_status = 0;
     child->wait_for_pid = 0;
+    child->mmap_next = parent->mmap_next;
+    child->image = parent->image;
     
     // Copy parent's FPU state
     for (size_t i = 0; i < FPU_STATE_SIZE; i++) {
@@ -275,23 +337,15 @@ uint64_t process_fork() {
         return (uint64_t)-1;
     }
     
-    // Allocate physical pages for child's kernel stack
-    size_t stack_pages = KERNEL_STACK_SIZE / 4096;
-    void* stack_phys = pmm_alloc_frames(stack_pages);
-    if (!stack_phys) {
+    // Allocate physical pages for child's kernel stack and map them at
+    // KERNEL_STACK_TOP - KERNEL_STACK_SIZE in child's address space
+    child->stack_phys = alloc_kernel_stack(child->page_table);
+    if (!child->stack_phys) {
         vmm_free_address_space(child->page_table);
         aligned_free(child);
         return (uint64_t)-1;
     }
-    child->stack_phys = (uint64_t)stack_phys;
-    
-    // Map stack at KERNEL_STACK_TOP - KERNEL_STACK_SIZE in child's address space
     uint64_t stack_virt_base = KERNEL_STACK_TOP - KERNEL_STACK_SIZE;
-    for (size_t i = 0; i < stack_pages; i++) {
-        uint64_t virt = stack_virt_base + i * 4096;
-        uint64_t phys = (uint64_t)stack_phys + i * 4096;
-        vmm_map_page_in(child->page_table, virt, phys, PTE_PRESENT | PTE_WRITABLE);
-    }
     child->stack_base = (uint64_t*)stack_virt_base;
     
     // Copy parent's stack content to child's physical pages
@@ -308,8 +362,10 @@ uint64_t process_fork() {
         for (size_t i = 0; i < KERNEL_STACK_SIZE / sizeof(uint64_t); i++) {
             dst[i] = src[i];
         }
-        // Child's SP is same as parent's (both use KERNEL_STACK_TOP)
-        child->sp = parent->sp;
+        // Isolated processes only fork through int 0x80, so the top of the
+        // copied stack holds the parent's user frame. Resume the child there
+        // with RAX = 0 instead of at the parent's stale switch point.
+        child->sp = prepare_user_return(dst + KERNEL_STACK_SIZE / sizeof(uint64_t));
     } else {
         // Parent is kernel task (HHDM stack) - copy and REBASE pointers
         // CRITICAL: RBP values on parent's stack point to HHDM addresses.
@@ -334,20 +390,79 @@ uint64_t process_fork() {
         child->sp = stack_virt_base + sp_offset;
     }
     
+    // Shared text pages were mapped (not copied) by the clone
+    image_cache_retain(child->image);
+    
     // Add to list (protected by scheduler lock)
-    spinlock_acquire(&scheduler_lock);
-    Process* last = process_list;
-    while (last->next != process_list) {
-        last = last->next;
-    }
-    last->next = child;
-    child->next = process_list;
-    spinlock_release(&scheduler_lock);
+    add_to_process_list(child);
     
     DEBUG_INFO("Forked PID %d -> %d (isolated)\n", parent->pid, child->pid);
     return child->pid;
 }
 
+// Exec: Start an ELF image as a new ring 3 process
+int64_t process_exec(const char* name, const uint8_t* data, uint64_t size) {
+    uint64_t* page_table = vmm_create_address_space();
+    if (!page_table) return -1;
+    
+    // Read-only segments come from the image cache when possible
+    ExecImage* image = name ? image_cache_acquire(name, data, size) : nullptr;
+    
+    uint64_t entry = elf_load_user(page_table, data, size, image);
+    if (!entry) {
+        DEBUG_ERROR("Invalid or unloadable ELF image\n");
+        vmm_free_address_space(page_table);
+        image_cache_release(image);
+        return -1;
+    }
+    
+    // Use aligned_alloc to ensure FPU state is 16-byte aligned for fxsave/fxrstor
+    Process* proc = (Process*)aligned_alloc(16, sizeof(Process));
+    if (!proc) {
+        vmm_free_address_space(page_table);
+        image_cache_release(image);
+        return -1;
+    }
+    kstring::zero_memory(proc, sizeof(Process));
+    
+    proc->stack_phys = alloc_kernel_stack(page_table);
+    if (!proc->stack_phys) {
+        vmm_free_address_space(page_table);
+        image_cache_release(image);
+        aligned_free(proc);
+        return -1;
+    }
+    proc->stack_base = (uint64_t*)(KERNEL_STACK_TOP - KERNEL_STACK_SIZE);
+    proc->page_table = page_table;
+    proc->mmap_next = USER_MMAP_BASE;
+    proc->image = image;
+    
+    // Build the initial user frame: iretq to entry with zeroed registers
+    uint64_t* top = (uint64_t*)(proc->stack_phys + vmm_get_hhdm_offset() + KERNEL_STACK_SIZE);
+    top[-1] = USER_DATA_SELECTOR;   // SS
+    top[-2] = USER_STACK_TOP;       // RSP
+    top[-3] = 0x202;                // RFLAGS (IF=1)
+    top[-4] = USER_CODE_SELECTOR;   // CS
+    top[-5] = entry;                // RIP
+    for (int i = 6; i <= USER_ENTRY_FRAME_QWORDS; i++) top[-i] = 0;
+    proc->sp = prepare_user_return(top);
+    
+    init_fpu_state(proc->fpu_state);
+    proc->fpu_initialized = true;
+    
+    uint64_t flags = interrupts_save_disable();
+    spinlock_acquire(&scheduler_lock);
+    proc->pid = next_pid++;
+    spinlock_release(&scheduler_lock);
+    proc->parent_pid = current_process ? current_process->pid : 0;
+    proc->state = PROCESS_READY;
+    add_to_process_list(proc);
+    interrupts_restore(flags);
+    
+    DEBUG_INFO("Exec PID %d (entry 0x%lx)\n", proc->pid, entry);
+    return proc->pid;
+}
+
 void process_exit(int32_t status) {
     DEBUG_INFO("Process %d exiting with status %d\n", current_process->pid, status);
     
@@ -405,6 +520,8 @@ int64_t process_waitpid(int64_t pid, int32_t* status) {
                         }
                         // Free address space (user pages + page tables)
                         vmm_free_address_space(p->page_table);
+                        // Drop the shared text reference
+                        image_cache_release(p->image);
                     } else if (p->stack_base) {
                         // Kernel task - stack was heap-allocated
                         free(p->stack_base);
@@ -449,3 +566,75 @@ void scheduler_sleep_ms(uint64_t ms) {
     if (ticks == 0 && ms > 0) ticks = 1;  // At least 1 tick for non-zero ms
     scheduler_sleep(ticks);
 }
+
+// Unlink a waiter (queue lock held)
+static void wait_queue_remove(WaitQueue* wq, Process* proc) {
+    Process* prev = nullptr;
+    Process* p = wq->head;
+    while (p && p != proc) {
+        prev = p;
+        p = p->wait_next;
+    }
+    if (!p) return;
+    
+    if (prev) prev->wait_next = proc->wait_next;
+    else wq->head = proc->wait_next;
+    if (wq->tail == proc) wq->tail = prev;
+    proc->wait_next = nullptr;
+    proc->waiting_on = nullptr;
+}
+
+void wait_queue_init(WaitQueue* wq) {
+    spinlock_init(&wq->lock);
+    wq->head = nullptr;
+    wq->tail = nullptr;
+}
+
+void wait_queue_wait(WaitQueue* wq, Mutex* lock) {
+    if (!current_process) return;
+    Process* self = current_process;
+    
+    // Queue and block with interrupts off: a timer tick in between would
+    // switch away from a BLOCKED process still holding lock
+    uint64_t flags = interrupts_save_disable();
+    spinlock_acquire(&wq->lock);
+    self->wait_next = nullptr;
+    self->waiting_on = wq;
+    if (wq->tail) wq->tail->wait_next = self;
+    else wq->head = self;
+    wq->tail = self;
+    self->state = PROCESS_BLOCKED;
+    spinlock_release(&wq->lock);
+    if (lock) mutex_unlock(lock);
+    
+    scheduler_schedule();
+    
+    // Woken, or nothing else was runnable and schedule() came straight back
+    spinlock_acquire(&wq->lock);
+    if (self->waiting_on == wq) wait_queue_remove(wq, self);
+    spinlock_release(&wq->lock);
+    self->state = PROCESS_RUNNING;
+    interrupts_restore(flags);
+    
+    if (lock) mutex_lock(lock);
+}
+
+void wait_queue_wake_one(WaitQueue* wq) {
+    spinlock_acquire(&wq->lock);
+    Process* proc = wq->head;
+    if (proc) {
+        wait_queue_remove(wq, proc);
+        if (proc->state == PROCESS_BLOCKED) proc->state = PROCESS_READY;
+    }
+    spinlock_release(&wq->lock);
+}
+
+void wait_queue_wake_all(WaitQueue* wq) {
+    spinlock_acquire(&wq->lock);
+    while (wq->head) {
+        Process* proc = wq->head;
+        wait_queue_remove(wq, proc);
+        if (proc->state == PROCESS_BLOCKED) proc->state = PROCESS_READY;
+    }
+    spinlock_release(&wq->lock);
+}
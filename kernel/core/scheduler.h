@@ -3,6 +3,11 @@
 
 void scheduler_init();
 void scheduler_create_task(void (*entry)());
+
+// Start a kernel task running entry(arg). The task exits when entry
+// returns and stays a zombie until the caller reaps it with
+// process_waitpid(). Returns the PID, or 0 on failure.
+uint64_t scheduler_spawn(void (*entry)(void*), void* arg);
 void scheduler_schedule();
 void scheduler_yield();
 
@@ -1,10 +1,15 @@
 #include "syscall.h"
 #include "limine.h"
-#include "unifs.h"
+#include "vfs.h"
 #include "pipe.h"
 #include "process.h"
 #include "debug.h"
-#include "graphics.h"
+#include "terminal.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "kstring.h"
 #include <stddef.h>
 
 // ============================================================================
@@ -59,9 +64,6 @@ static size_t validate_user_string(const char* str, size_t max_len) {
     return (size_t)-1;
 }
 
-static uint64_t sys_cursor_x = 50;
-static uint64_t sys_cursor_y = 480;
-
 // File descriptor table (simple, single-process for now)
 static FileDescriptor fd_table[MAX_OPEN_FILES];
 static bool fd_initialized = false;
@@ -91,7 +93,7 @@ bool is_file_open(const char* filename) {
     if (!filename || !fd_initialized) return false;
     
     for (int i = 3; i < MAX_OPEN_FILES; i++) {
-        if (fd_table[i].in_use && fd_table[i].filename) {
+        if (fd_table[i].in_use && fd_table[i].type == FD_FILE && fd_table[i].filename) {
             // Compare filenames
             const char* a = fd_table[i].filename;
             const char* b = filename;
@@ -114,21 +116,21 @@ static uint64_t sys_open(const char* filename) {
     
     init_fd_table();
     
-    // Use thread-safe version with local buffer to avoid race condition
-    UniFSFile file;
-    if (!unifs_open_into(filename, &file)) {
-        return (uint64_t)-1;
-    }
-    
     int fd = find_free_fd();
     if (fd < 0) return (uint64_t)-1;
     
-    // Copy data from local buffer to fd_table (safe, won't be overwritten)
+    // Reads stream from the file instead of loading it whole
+    VfsFile* file = vfs_file_open(filename);
+    if (!file) {
+        return (uint64_t)-1;
+    }
+    
     fd_table[fd].in_use = true;
-    fd_table[fd].filename = file.name;
+    fd_table[fd].type = FD_FILE;
+    fd_table[fd].pipe_id = -1;
+    fd_table[fd].filename = vfs_file_path(file);
     fd_table[fd].position = 0;
-    fd_table[fd].size = file.size;
-    fd_table[fd].data = file.data;
+    fd_table[fd].file = file;
     
     return fd;
 }
@@ -152,15 +154,18 @@ static uint64_t sys_read(int fd, char* buf, uint64_t count) {
     }
     
     FileDescriptor* f = &fd_table[fd];
-    uint64_t remaining = f->size - f->position;
-    uint64_t to_read = (count < remaining) ? count : remaining;
-    
-    for (uint64_t i = 0; i < to_read; i++) {
-        buf[i] = f->data[f->position + i];
+    if (f->type == FD_PIPE_READ) {
+        // Blocks until data arrives or the writer goes away (0 = EOF)
+        int64_t n = pipe_read(f->pipe_id, buf, count);
+        return n < 0 ? (uint64_t)-1 : (uint64_t)n;
     }
-    f->position += to_read;
+    if (f->type != FD_FILE) return (uint64_t)-1;
     
-    return to_read;
+    int64_t n = vfs_file_read(f->file, f->position, buf, count);
+    if (n < 0) return (uint64_t)-1;
+    f->position += n;
+    
+    return (uint64_t)n;
 }
 
 // SYS_WRITE: write(fd, buf, count) -> bytes_written
@@ -172,16 +177,22 @@ static uint64_t sys_write(int fd, const char* buf, uint64_t count) {
     
     if (fd == STDOUT_FD || fd == STDERR_FD) {
         for (uint64_t i = 0; i < count && buf[i]; i++) {
-            if (buf[i] == '\n') {
-                sys_cursor_x = 50;
-                sys_cursor_y += 10;
-            } else {
-                gfx_draw_char(sys_cursor_x, sys_cursor_y, buf[i], COLOR_GREEN);
-                sys_cursor_x += 9;
-            }
+            g_terminal.put_char(buf[i]);
         }
         return count;
     }
+    
+    init_fd_table();
+    
+    if (fd < 3 || fd >= MAX_OPEN_FILES || !fd_table[fd].in_use) {
+        return (uint64_t)-1;
+    }
+    
+    if (fd_table[fd].type == FD_PIPE_WRITE) {
+        // Blocks until everything is buffered or the reader goes away
+        int64_t n = pipe_write(fd_table[fd].pipe_id, buf, count);
+        return n < 0 ? (uint64_t)-1 : (uint64_t)n;
+    }
     return (uint64_t)-1; // Can't write to files (read-only FS)
 }
 
@@ -192,10 +203,124 @@ static uint64_t sys_close(int fd) {
     if (fd < 3 || fd >= MAX_OPEN_FILES) return (uint64_t)-1;
     if (!fd_table[fd].in_use) return (uint64_t)-1;
     
+    if (fd_table[fd].type == FD_PIPE_READ) {
+        pipe_close_read(fd_table[fd].pipe_id);
+    } else if (fd_table[fd].type == FD_PIPE_WRITE) {
+        pipe_close_write(fd_table[fd].pipe_id);
+    } else if (fd_table[fd].type == FD_FILE) {
+        vfs_file_close(fd_table[fd].file);
+        fd_table[fd].file = nullptr;
+    }
+    
     fd_table[fd].in_use = false;
     return 0;
 }
 
+// SYS_PIPE: pipe(fds[2]) -> 0 on success; fds[0] = read end, fds[1] = write end
+static uint64_t sys_pipe(int32_t* fds) {
+    if (!validate_user_ptr(fds, 2 * sizeof(int32_t))) {
+        return (uint64_t)-1;
+    }
+    
+    init_fd_table();
+    
+    int read_fd = find_free_fd();
+    if (read_fd < 0) return (uint64_t)-1;
+    fd_table[read_fd].in_use = true;  // Reserve before looking for the second slot
+    
+    int write_fd = find_free_fd();
+    int pipe_id = (write_fd >= 0) ? pipe_create() : -1;
+    if (pipe_id < 0) {
+        fd_table[read_fd].in_use = false;
+        return (uint64_t)-1;
+    }
+    
+    fd_table[read_fd].type = FD_PIPE_READ;
+    fd_table[read_fd].pipe_id = pipe_id;
+    fd_table[read_fd].filename = nullptr;
+    
+    fd_table[write_fd].in_use = true;
+    fd_table[write_fd].type = FD_PIPE_WRITE;
+    fd_table[write_fd].pipe_id = pipe_id;
+    fd_table[write_fd].filename = nullptr;
+    
+    fds[0] = read_fd;
+    fds[1] = write_fd;
+    return 0;
+}
+
+// ============================================================================
+// Anonymous Memory
+// ============================================================================
+// mmap(addr, length, prot): always anonymous + private, placed by the kernel
+// (addr is only a hint and currently ignored). Pages are mapped eagerly.
+
+static void unmap_user_range(Process* proc, uint64_t base, uint64_t pages) {
+    for (uint64_t i = 0; i < pages; i++) {
+        uint64_t phys = vmm_unmap_page_in(proc->page_table, base + i * 0x1000);
+        if (phys) pmm_free_frame((void*)phys);
+    }
+}
+
+static uint64_t sys_mmap(uint64_t addr, uint64_t length, uint64_t prot) {
+    (void)addr;
+    
+    Process* proc = process_get_current();
+    if (!proc || !proc->page_table || length == 0) return MAP_FAILED;
+    
+    uint64_t pages = (length + 0xFFF) / 0x1000;
+    uint64_t base = proc->mmap_next;
+    if (pages > (USER_SPACE_MAX - base) / 0x1000) return MAP_FAILED;
+    
+    uint64_t flags = PTE_PRESENT | PTE_USER;
+    if (prot & PROT_WRITE) flags |= PTE_WRITABLE;
+    
+    for (uint64_t i = 0; i < pages; i++) {
+        void* frame = pmm_alloc_frame();
+        if (!frame) {
+            unmap_user_range(proc, base, i);
+            return MAP_FAILED;
+        }
+        kstring::zero_memory((void*)vmm_phys_to_virt((uint64_t)frame), 0x1000);
+        vmm_map_page_in(proc->page_table, base + i * 0x1000, (uint64_t)frame, flags);
+    }
+    
+    proc->mmap_next = base + pages * 0x1000;
+    return base;
+}
+
+static uint64_t sys_munmap(uint64_t addr, uint64_t length) {
+    Process* proc = process_get_current();
+    if (!proc || !proc->page_table || length == 0) return (uint64_t)-1;
+    
+    // Only anonymous mappings may be released this way
+    if ((addr & 0xFFF) || addr < USER_MMAP_BASE || addr >= proc->mmap_next) {
+        return (uint64_t)-1;
+    }
+    
+    uint64_t pages = (length + 0xFFF) / 0x1000;
+    if (pages > (proc->mmap_next - addr) / 0x1000) return (uint64_t)-1;
+    
+    unmap_user_range(proc, addr, pages);
+    return 0;
+}
+
+// SYS_CLOCK_GETTIME: clock_gettime(clock_id, ts) - monotonic time since boot
+// (resolution is one timer tick; user code can use rdtsc for finer timing)
+static uint64_t sys_clock_gettime(uint64_t clock_id, KernelTimespec* ts) {
+    (void)clock_id;
+    
+    if (!validate_user_ptr(ts, sizeof(KernelTimespec))) {
+        return (uint64_t)-1;
+    }
+    
+    uint64_t ticks = timer_get_ticks();
+    uint64_t freq = timer_get_frequency();
+    ts->tv_sec = ticks / freq;
+    ts->tv_nsec = ((ticks % freq) * 1000000000ULL) / freq;
+    return 0;
+}
+
 // Process ID (simple, single PID for now)
 static uint64_t current_pid = 1;
 
@@ -211,8 +336,15 @@ extern "C" uint64_t syscall_handler(uint64_t syscall_num, uint64_t arg1, uint64_
             return sys_open((const char*)arg1);
         case SYS_CLOSE:
             return sys_close((int)arg1);
+        case SYS_MMAP:
+            return sys_mmap(arg1, arg2, arg3);
+        case SYS_MUNMAP:
+            return sys_munmap(arg1, arg2);
         case SYS_PIPE:
-            return pipe_create();
+            return sys_pipe((int32_t*)arg1);
+        case SYS_SCHED_YIELD:
+            scheduler_yield();
+            return 0;
         case SYS_GETPID: {
             extern Process* process_get_current();
             Process* p = process_get_current();
@@ -235,6 +367,8 @@ extern "C" uint64_t syscall_handler(uint64_t syscall_num, uint64_t arg1, uint64_
             extern int64_t process_waitpid(int64_t pid, int32_t* status);
             return process_waitpid((int64_t)arg1, (int32_t*)arg2);
         }
+        case SYS_CLOCK_GETTIME:
+            return sys_clock_gettime(arg1, (KernelTimespec*)arg2);
         default:
             DEBUG_WARN("Unknown syscall: %d\n", syscall_num);
             return (uint64_t)-1;
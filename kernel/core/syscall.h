@@ -6,11 +6,23 @@
 #define SYS_WRITE  1
 #define SYS_OPEN   2
 #define SYS_CLOSE  3
+#define SYS_MMAP   9
+#define SYS_MUNMAP 11
 #define SYS_PIPE   22
+#define SYS_SCHED_YIELD 24
 #define SYS_GETPID 39
 #define SYS_FORK   57
 #define SYS_EXIT   60
 #define SYS_WAIT4  61
+#define SYS_CLOCK_GETTIME 228
+
+// SYS_MMAP protection bits (anonymous private mappings only)
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC  0x4
+
+// Returned by SYS_MMAP on failure
+#define MAP_FAILED ((uint64_t)-1)
 
 // File descriptor constants
 #define STDIN_FD   0
@@ -20,13 +32,29 @@
 // Max open files per process
 #define MAX_OPEN_FILES 16
 
+// What a file descriptor refers to
+enum FdType {
+    FD_FILE,
+    FD_PIPE_READ,
+    FD_PIPE_WRITE
+};
+
+struct VfsFile;
+
 // File descriptor entry
 struct FileDescriptor {
     bool in_use;
+    FdType type;
+    int pipe_id;              // Kernel pipe (FD_PIPE_*)
     const char* filename;
     uint64_t position;
-    uint64_t size;
-    const uint8_t* data;
+    VfsFile* file;            // Open file (FD_FILE), read with read-ahead
+};
+
+// Time value for SYS_CLOCK_GETTIME
+struct KernelTimespec {
+    int64_t tv_sec;
+    int64_t tv_nsec;
 };
 
 extern "C" uint64_t syscall_handler(uint64_t syscall_num, uint64_t arg1, uint64_t arg2, uint64_t arg3);
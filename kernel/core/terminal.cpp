@@ -2,6 +2,7 @@
 #include "drivers/graphics.h"
 #include "drivers/timer.h"
 #include "mem/heap.h"
+#include "core/process.h"
 
 Terminal g_terminal;
 
@@ -16,8 +17,7 @@ Terminal::Terminal()
       cursor_col(0), cursor_row(0), 
       fg_color(COLOR_WHITE), bg_color(COLOR_BLACK),
       cursor_visible(true), cursor_state(true), last_blink_tick(0),
-      text_buffer(nullptr), buffer_size(0),
-      capturing(false), capture_buffer(nullptr), capture_len(0), capture_max(0) {
+      text_buffer(nullptr), buffer_size(0) {
 }
 
 Terminal::~Terminal() {
@@ -111,11 +111,10 @@ void Terminal::get_cursor_pos(int* col, int* row) {
 }
 
 void Terminal::put_char(char c) {
-    // If capturing, route to buffer instead of screen
-    if (capturing) {
-        if (capture_buffer && capture_len < capture_max) {
-            capture_buffer[capture_len++] = c;
-        }
+    // Pipeline stages write into their sink instead of the screen
+    Process* self = process_get_current();
+    if (self && self->output) {
+        self->output->put(self->output, c);
         return;
     }
     
@@ -351,24 +350,7 @@ void Terminal::write_char_at_color(int col, int row, char c, uint32_t fg, uint32
     gfx_draw_char(x, y, c, fg);
 }
 
-void Terminal::start_capture(char* buffer, size_t max_len) {
-    capture_buffer = buffer;
-    capture_max = max_len;
-    capture_len = 0;
-    capturing = true;
-}
-
-size_t Terminal::stop_capture() {
-    capturing = false;
-    size_t len = capture_len;
-    
-    if (capture_buffer && capture_len < capture_max) {
-        capture_buffer[capture_len] = '\0';
-    }
-    
-    capture_buffer = nullptr;
-    capture_len = 0;
-    capture_max = 0;
-    
-    return len;
+bool Terminal::is_redirected() const {
+    Process* self = process_get_current();
+    return self && self->output;
 }
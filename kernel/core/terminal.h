@@ -2,6 +2,12 @@
 #include <stdint.h>
 #include <stddef.h>
 
+// Per-task output redirection (pipelines). While the running process has
+// an output sink, put_char() hands characters to it instead of drawing.
+struct TerminalSink {
+    void (*put)(TerminalSink* sink, char c);
+};
+
 // Cell structure for text buffer (character + colors)
 struct Cell {
     char ch;
@@ -37,10 +43,8 @@ public:
     void write_char_at(int col, int row, char c);
     void write_char_at_color(int col, int row, char c, uint32_t fg, uint32_t bg);
     
-    // Output capture for piping
-    void start_capture(char* buffer, size_t max_len);
-    size_t stop_capture();  // Returns bytes captured
-    bool is_capturing() const { return capturing; }
+    // True if the running task's output goes to a sink, not the screen
+    bool is_redirected() const;
 
 private:
     void scroll_up();
@@ -65,12 +69,6 @@ private:
     // Text buffer for fast scrolling
     Cell* text_buffer;
     int buffer_size;
-    
-    // Capture mode for piping
-    bool capturing;
-    char* capture_buffer;
-    size_t capture_len;
-    size_t capture_max;
 };
 
 // Global terminal instance
@@ -51,10 +51,10 @@
 
 #define UNIOS_VERSION_MAJOR 0
 #define UNIOS_VERSION_MINOR 6
-#define UNIOS_VERSION_PATCH 2
+#define UNIOS_VERSION_PATCH 27
 
-#define UNIOS_VERSION_STRING "0.6.2"
-#define UNIOS_VERSION_FULL   "uniOS v0.6.2"
+#define UNIOS_VERSION_STRING "0.6.27"
+#define UNIOS_VERSION_FULL   "uniOS v0.6.27"
 
 // Build date (set at compile time)
 #define UNIOS_BUILD_DATE __DATE__
@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include "spinlock.h"
+#include "mutex.h"
+
+/**
+ * @file waitqueue.h
+ * @brief Blocking waits for a condition another task or an IRQ makes true
+ *
+ * A waiting process is taken off the run queue (PROCESS_BLOCKED) until it
+ * is woken, so unlike a yield loop it costs no CPU time. Wakeups may be
+ * spurious, so the condition is re-checked in a loop:
+ *
+ *   mutex_lock(&m);
+ *   while (!condition) wait_queue_wait(&wq, &m);
+ *   // ...
+ *   mutex_unlock(&m);
+ *
+ * The side that makes the condition true calls wait_queue_wake_all() (or
+ * _one) after changing it under the same lock. A waiter is queued before
+ * the lock is dropped, so a wakeup in between is never lost. State shared
+ * with an interrupt handler is checked with interrupts disabled and waited
+ * on with a null lock.
+ */
+
+struct Process;
+
+struct WaitQueue {
+    Spinlock lock;
+    Process* head;          // FIFO through Process::wait_next
+    Process* tail;
+};
+
+#define WAIT_QUEUE_INIT {SPINLOCK_INIT, nullptr, nullptr}
+
+void wait_queue_init(WaitQueue* wq);
+
+// Block the current process until woken. lock (held by the caller, may be
+// null) is released while blocked and held again on return.
+void wait_queue_wait(WaitQueue* wq, Mutex* lock);
+
+// Make the oldest / every waiter runnable. Safe from interrupt handlers.
+void wait_queue_wake_one(WaitQueue* wq);
+void wait_queue_wake_all(WaitQueue* wq);
@@ -0,0 +1,554 @@
+#include "ahci.h"
+#include "blockdev.h"
+#include "pci.h"
+#include "vmm.h"
+#include "io.h"
+#include "irq.h"
+#include "heap.h"
+#include "scheduler.h"
+#include "spinlock.h"
+#include "kstring.h"
+#include "debug.h"
+
+// Per-port DMA layout: command list, received FIS area, command tables
+#define AHCI_CMD_LIST_SIZE      (AHCI_MAX_SLOTS * sizeof(AhciCommandHeader))   // 1KB aligned
+#define AHCI_FIS_OFFSET         AHCI_CMD_LIST_SIZE                              // 256B aligned
+#define AHCI_TABLE_OFFSET       (AHCI_FIS_OFFSET + 256)                         // 128B aligned
+#define AHCI_PORT_MEM_SIZE      (AHCI_TABLE_OFFSET + AHCI_MAX_SLOTS * sizeof(AhciCommandTable))
+
+#define AHCI_PORT_IRQS          (AHCI_PxIS_DHRS | AHCI_PxIS_PSS | AHCI_PxIS_SDBS | AHCI_PxIS_ERRORS)
+#define AHCI_TIMEOUT_US         500000
+
+struct AhciController;
+
+struct AhciPort {
+    AhciController* hba;
+    uint32_t index;
+    volatile uint8_t* regs;
+
+    DMAAllocation mem;
+    volatile AhciCommandHeader* cmd_list;
+    volatile AhciCommandTable* tables;
+    uint64_t tables_phys;
+
+    uint32_t slot_count;        // Tags in use: min(HBA slots, NCQ depth), 1 without NCQ
+    bool ncq;
+    bool write_cache;
+
+    // Slot bitmaps (bit n = command slot / NCQ tag n)
+    uint32_t free_mask;
+    uint32_t pending;           // Built but not yet issued (issued by kick)
+    uint32_t active;            // Issued to the HBA
+    BlockRequest* slots[AHCI_MAX_SLOTS];
+    bool is_flush[AHCI_MAX_SLOTS];
+
+    Spinlock lock;
+    BlockDevice blk;
+};
+
+struct AhciController {
+    PciDevice pci;
+    volatile uint8_t* regs;
+    uint32_t cap;
+    AhciPort* ports[AHCI_MAX_PORTS];
+    uint32_t disk_count;
+    int irq;                    // MSI IRQ number or PIC line, -1 if polled
+    bool initialized;
+};
+
+static AhciController g_ahci;
+
+// ============================================================================
+// Register Helpers
+// ============================================================================
+
+static inline uint32_t hba_read(AhciController* c, uint32_t reg) {
+    return mmio_read32(c->regs + reg);
+}
+
+static inline void hba_write(AhciController* c, uint32_t reg, uint32_t value) {
+    mmio_write32(c->regs + reg, value);
+}
+
+static inline uint32_t port_read(AhciPort* p, uint32_t reg) {
+    return mmio_read32(p->regs + reg);
+}
+
+static inline void port_write(AhciPort* p, uint32_t reg, uint32_t value) {
+    mmio_write32(p->regs + reg, value);
+}
+
+// Wait until (reg & mask) == value, ~1us per iteration
+static bool port_wait(AhciPort* p, uint32_t reg, uint32_t mask, uint32_t value) {
+    for (uint32_t us = 0; us < AHCI_TIMEOUT_US; us++) {
+        if ((port_read(p, reg) & mask) == value) return true;
+        io_wait();
+    }
+    return false;
+}
+
+// ============================================================================
+// Port Control
+// ============================================================================
+
+static bool port_stop(AhciPort* p) {
+    uint32_t cmd = port_read(p, AHCI_PxCMD);
+    port_write(p, AHCI_PxCMD, cmd & ~AHCI_PxCMD_ST);
+    if (!port_wait(p, AHCI_PxCMD, AHCI_PxCMD_CR, 0)) return false;
+
+    cmd = port_read(p, AHCI_PxCMD);
+    port_write(p, AHCI_PxCMD, cmd & ~AHCI_PxCMD_FRE);
+    return port_wait(p, AHCI_PxCMD, AHCI_PxCMD_FR, 0);
+}
+
+static bool port_start(AhciPort* p) {
+    if (!port_wait(p, AHCI_PxTFD, AHCI_PxTFD_BSY | AHCI_PxTFD_DRQ, 0)) return false;
+
+    uint32_t cmd = port_read(p, AHCI_PxCMD);
+    port_write(p, AHCI_PxCMD, cmd | AHCI_PxCMD_FRE);
+    port_write(p, AHCI_PxCMD, cmd | AHCI_PxCMD_FRE | AHCI_PxCMD_ST);
+    return true;
+}
+
+// Fill slot's command FIS and PRDT. segs may be null for non-data commands
+static void build_command(AhciPort* p, uint32_t slot, uint8_t command, uint64_t lba,
+                          uint32_t count, bool write, const BlockSegment* segs, uint32_t seg_count) {
+    volatile AhciCommandTable* table = &p->tables[slot];
+    kstring::zero_memory((void*)table->cfis, sizeof(table->cfis));
+
+    FisRegH2D* fis = (FisRegH2D*)table->cfis;
+    fis->type = FIS_TYPE_REG_H2D;
+    fis->flags = 0x80;
+    fis->command = command;
+    fis->device = 0x40;  // LBA mode
+    fis->lba0 = (uint8_t)lba;
+    fis->lba1 = (uint8_t)(lba >> 8);
+    fis->lba2 = (uint8_t)(lba >> 16);
+    fis->lba3 = (uint8_t)(lba >> 24);
+    fis->lba4 = (uint8_t)(lba >> 32);
+    fis->lba5 = (uint8_t)(lba >> 40);
+
+    if (command == ATA_CMD_READ_FPDMA_QUEUED || command == ATA_CMD_WRITE_FPDMA_QUEUED) {
+        // NCQ: sector count moves to the features field, the tag goes in count
+        fis->feature_low = (uint8_t)count;
+        fis->feature_high = (uint8_t)(count >> 8);
+        fis->count_low = (uint8_t)(slot << 3);
+    } else {
+        fis->count_low = (uint8_t)count;
+        fis->count_high = (uint8_t)(count >> 8);
+    }
+
+    for (uint32_t i = 0; i < seg_count; i++) {
+        table->prdt[i].dba = segs[i].phys;
+        table->prdt[i].reserved = 0;
+        table->prdt[i].dbc = segs[i].length - 1;
+    }
+
+    volatile AhciCommandHeader* hdr = &p->cmd_list[slot];
+    hdr->flags = (uint16_t)((sizeof(FisRegH2D) / 4) | (write ? AHCI_CMD_WRITE : 0));
+    hdr->prdtl = (uint16_t)seg_count;
+    hdr->prdbc = 0;
+}
+
+// Synchronous non-queued command on slot 0 (init only, interrupts off)
+static bool issue_sync(AhciPort* p, uint8_t command, uint64_t phys, uint32_t bytes) {
+    BlockSegment seg = {phys, bytes};
+    build_command(p, 0, command, 0, 0, false, bytes ? &seg : nullptr, bytes ? 1 : 0);
+
+    port_write(p, AHCI_PxIS, 0xFFFFFFFF);
+    port_write(p, AHCI_PxCI, 1);
+    for (uint32_t us = 0; us < AHCI_TIMEOUT_US; us++) {
+        if (port_read(p, AHCI_PxIS) & AHCI_PxIS_TFES) return false;
+        if ((port_read(p, AHCI_PxCI) & 1) == 0) return true;
+        io_wait();
+    }
+    return false;
+}
+
+// ============================================================================
+// I/O Path
+// ============================================================================
+
+static bool ahci_submit(BlockDevice* dev, BlockRequest* req) {
+    AhciPort* p = (AhciPort*)dev->driver_data;
+
+    BlockSegment segs[AHCI_MAX_PRDT];
+    uint32_t seg_count = block_build_segments(req, segs, AHCI_MAX_PRDT, 0x400000);
+    if (seg_count == 0) return false;
+
+    spinlock_acquire(&p->lock);
+    if (p->free_mask == 0) {
+        spinlock_release(&p->lock);
+        return false;
+    }
+    uint32_t slot = __builtin_ctz(p->free_mask);
+
+    uint8_t command;
+    if (p->ncq) {
+        command = req->write ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED;
+    } else {
+        command = req->write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+    }
+    build_command(p, slot, command, req->lba, block_command_sectors(req), req->write, segs, seg_count);
+
+    p->free_mask &= ~(1u << slot);
+    p->pending |= 1u << slot;
+    p->slots[slot] = req;
+    p->is_flush[slot] = false;
+    spinlock_release(&p->lock);
+    return true;
+}
+
+// Issue everything built since the last kick with one SACT/CI write
+static void issue_pending_locked(AhciPort* p) {
+    uint32_t bits = p->pending;
+    if (!bits) return;
+    p->pending = 0;
+    p->active |= bits;
+    if (p->ncq) port_write(p, AHCI_PxSACT, bits);
+    port_write(p, AHCI_PxCI, bits);
+}
+
+static void ahci_kick(BlockDevice* dev) {
+    AhciPort* p = (AhciPort*)dev->driver_data;
+    spinlock_acquire(&p->lock);
+    issue_pending_locked(p);
+    spinlock_release(&p->lock);
+}
+
+// Collect finished slots and complete them outside the port lock.
+// A queued command finishes when its SACT bit clears; a non-queued one when
+// its CI bit clears, so a slot is done once it is in neither register.
+static void reap(AhciPort* p) {
+    BlockRequest* done[AHCI_MAX_SLOTS];
+    bool is_flush[AHCI_MAX_SLOTS];
+    int n = 0;
+    int32_t status = BLOCK_OK;
+
+    spinlock_acquire(&p->lock);
+    uint32_t is = port_read(p, AHCI_PxIS);
+    port_write(p, AHCI_PxIS, is);
+
+    uint32_t finished;
+    if (is & AHCI_PxIS_ERRORS) {
+        // NCQ error recovery would read log page 10h to find the failing
+        // tag; instead fail everything outstanding and restart the port.
+        DEBUG_WARN("ahci: Port %u error (IS 0x%x, TFD 0x%x, SERR 0x%x)", p->index, is,
+            port_read(p, AHCI_PxTFD), port_read(p, AHCI_PxSERR));
+        finished = p->active;
+        status = BLOCK_ERR_IO;
+
+        port_stop(p);
+        port_write(p, AHCI_PxSERR, 0xFFFFFFFF);
+        port_write(p, AHCI_PxIS, 0xFFFFFFFF);
+        if (!port_start(p)) DEBUG_ERROR("ahci: Port %u did not restart", p->index);
+        p->active = 0;
+    } else {
+        uint32_t busy = port_read(p, AHCI_PxSACT) | port_read(p, AHCI_PxCI);
+        finished = p->active & ~busy;
+        p->active &= busy;
+    }
+
+    while (finished) {
+        uint32_t slot = __builtin_ctz(finished);
+        finished &= finished - 1;
+        if (!p->slots[slot]) continue;
+
+        done[n] = p->slots[slot];
+        is_flush[n] = p->is_flush[slot];
+        n++;
+        p->slots[slot] = nullptr;
+        p->free_mask |= 1u << slot;
+    }
+    spinlock_release(&p->lock);
+
+    for (int i = 0; i < n; i++) {
+        if (is_flush[i]) {
+            done[i]->status = status;
+        } else {
+            block_complete(done[i], status);
+        }
+    }
+}
+
+static void ahci_poll(BlockDevice* dev) {
+    reap((AhciPort*)dev->driver_data);
+}
+
+// FLUSH CACHE EXT is not a queued command, so the port must be idle: hold
+// back new requests, drain the queued ones, then flush.
+static int ahci_flush(BlockDevice* dev) {
+    AhciPort* p = (AhciPort*)dev->driver_data;
+    if (!p->write_cache) return BLOCK_OK;
+
+    BlockRequest* req = (BlockRequest*)malloc(sizeof(BlockRequest));
+    if (!req) return BLOCK_ERR_NO_MEMORY;
+    kstring::zero_memory(req, sizeof(*req));
+    req->dev = dev;
+    req->status = BLOCK_PENDING;
+
+    block_plug(dev);
+    for (;;) {
+        spinlock_acquire(&p->lock);
+        bool queued = false;
+        if (p->active == 0 && p->pending == 0) {
+            uint32_t slot = __builtin_ctz(p->free_mask);
+            build_command(p, slot, ATA_CMD_FLUSH_CACHE_EXT, 0, 0, false, nullptr, 0);
+            p->free_mask &= ~(1u << slot);
+            p->slots[slot] = req;
+            p->is_flush[slot] = true;
+            p->active |= 1u << slot;
+            port_write(p, AHCI_PxCI, 1u << slot);
+            queued = true;
+        }
+        spinlock_release(&p->lock);
+        if (queued) break;
+
+        if (!dev->irq_driven || !interrupts_enabled()) reap(p);
+        scheduler_yield();
+    }
+
+    int status = block_wait(req);
+    block_unplug(dev);
+    free(req);
+    return status;
+}
+
+static const BlockDeviceOps ahci_ops = {
+    ahci_submit,
+    ahci_kick,
+    ahci_poll,
+    ahci_flush,
+};
+
+// One interrupt for the whole HBA; IS tells which ports need attention
+static void ahci_irq(void* ctx) {
+    AhciController* c = (AhciController*)ctx;
+    uint32_t is = hba_read(c, AHCI_REG_IS);
+    if (!is) return;
+
+    for (uint32_t bits = is; bits; bits &= bits - 1) {
+        AhciPort* p = c->ports[__builtin_ctz(bits)];
+        if (!p) continue;
+        p->blk.stats.interrupts++;
+        reap(p);
+    }
+    hba_write(c, AHCI_REG_IS, is);  // After the port IS bits are cleared
+}
+
+// ============================================================================
+// Initialization
+// ============================================================================
+
+static bool port_has_disk(AhciController* c, uint32_t index) {
+    volatile uint8_t* regs = c->regs + AHCI_PORT_BASE(index);
+    uint32_t ssts = mmio_read32(regs + AHCI_PxSSTS);
+    if ((ssts & 0xF) != AHCI_SSTS_DET_PRESENT) return false;
+    return mmio_read32(regs + AHCI_PxSIG) == AHCI_SIG_ATA;
+}
+
+// Point the port at its command list / FIS area and start it
+static bool port_setup(AhciPort* p) {
+    if (!port_stop(p)) {
+        DEBUG_ERROR("ahci: Port %u did not stop", p->index);
+        return false;
+    }
+
+    p->mem = vmm_alloc_dma((AHCI_PORT_MEM_SIZE + 0xFFF) / 0x1000);
+    if (!p->mem.virt) return false;
+    kstring::zero_memory((void*)p->mem.virt, p->mem.size);
+
+    p->cmd_list = (volatile AhciCommandHeader*)p->mem.virt;
+    p->tables = (volatile AhciCommandTable*)(p->mem.virt + AHCI_TABLE_OFFSET);
+    p->tables_phys = p->mem.phys + AHCI_TABLE_OFFSET;
+    for (uint32_t i = 0; i < AHCI_MAX_SLOTS; i++) {
+        p->cmd_list[i].ctba = p->tables_phys + i * sizeof(AhciCommandTable);
+    }
+
+    uint64_t fis_phys = p->mem.phys + AHCI_FIS_OFFSET;
+    port_write(p, AHCI_PxCLB, (uint32_t)p->mem.phys);
+    port_write(p, AHCI_PxCLBU, (uint32_t)(p->mem.phys >> 32));
+    port_write(p, AHCI_PxFB, (uint32_t)fis_phys);
+    port_write(p, AHCI_PxFBU, (uint32_t)(fis_phys >> 32));
+
+    port_write(p, AHCI_PxSERR, 0xFFFFFFFF);
+    port_write(p, AHCI_PxIS, 0xFFFFFFFF);
+    port_write(p, AHCI_PxIE, 0);
+
+    if (!port_start(p)) {
+        DEBUG_ERROR("ahci: Port %u busy, not starting", p->index);
+        return false;
+    }
+    return true;
+}
+
+// IDENTIFY DEVICE: capacity, NCQ depth and write cache. Returns the sector
+// count, 0 if the disk is unusable.
+static uint64_t identify(AhciPort* p, const DMAAllocation& buf) {
+    if (!issue_sync(p, ATA_CMD_IDENTIFY, buf.phys, 512)) {
+        DEBUG_ERROR("ahci: IDENTIFY failed on port %u", p->index);
+        return 0;
+    }
+    const uint16_t* id = (const uint16_t*)buf.virt;
+
+    if (!(id[83] & (1u << 10))) {
+        DEBUG_WARN("ahci: Port %u has no LBA48, skipping", p->index);
+        return 0;
+    }
+    // Logical sectors larger than 512 bytes (word 106 bit 12) are not handled
+    if ((id[106] & 0xC000) == 0x4000 && (id[106] & (1u << 12))) {
+        DEBUG_WARN("ahci: Port %u uses large logical sectors, skipping", p->index);
+        return 0;
+    }
+
+    uint32_t hba_slots = AHCI_CAP_NCS(p->hba->cap);
+    p->ncq = (p->hba->cap & AHCI_CAP_SNCQ) && (id[76] & (1u << 8));
+    if (p->ncq) {
+        uint32_t depth = (id[75] & 0x1F) + 1;
+        p->slot_count = depth < hba_slots ? depth : hba_slots;
+    } else {
+        p->slot_count = 1;
+    }
+    p->write_cache = (id[85] & (1u << 5)) && (id[83] & (1u << 13));
+
+    return (uint64_t)id[100] | ((uint64_t)id[101] << 16) |
+           ((uint64_t)id[102] << 32) | ((uint64_t)id[103] << 48);
+}
+
+// BIOS may still own the HBA; ask for it back
+static void bios_handoff(AhciController* c) {
+    if (!(hba_read(c, AHCI_REG_CAP2) & AHCI_CAP2_BOH)) return;
+
+    hba_write(c, AHCI_REG_BOHC, hba_read(c, AHCI_REG_BOHC) | AHCI_BOHC_OOS);
+    for (uint32_t us = 0; us < AHCI_TIMEOUT_US; us++) {
+        if (!(hba_read(c, AHCI_REG_BOHC) & AHCI_BOHC_BOS)) return;
+        io_wait();
+    }
+    DEBUG_WARN("ahci: BIOS did not release the controller");
+}
+
+static void setup_interrupts(AhciController* c) {
+    int msi_irq = irq_alloc_msi(ahci_irq, c);
+    if (msi_irq >= 0) {
+        if (pci_enable_msi(&c->pci, IRQ_VECTOR(msi_irq))) {
+            c->irq = msi_irq;
+            DEBUG_INFO("ahci: Using MSI (vector %u)", IRQ_VECTOR(msi_irq));
+            return;
+        }
+        irq_free_msi(msi_irq);
+    }
+
+    if (c->pci.irq_line < 16 && irq_register_handler(c->pci.irq_line, ahci_irq, c)) {
+        c->irq = c->pci.irq_line;
+        pci_enable_interrupts(&c->pci);
+        DEBUG_INFO("ahci: Using INTx (IRQ %u)", c->pci.irq_line);
+        return;
+    }
+
+    c->irq = -1;
+    DEBUG_WARN("ahci: No interrupt available, polling");
+}
+
+bool ahci_init() {
+    AhciController* c = &g_ahci;
+    if (c->initialized) return true;
+
+    if (!pci_find_device_by_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_SATA, PCI_PROGIF_AHCI, &c->pci)) {
+        DEBUG_INFO("ahci: No controller found");
+        return false;
+    }
+    if (!pci_bar_is_mmio(&c->pci, AHCI_ABAR)) {
+        DEBUG_ERROR("ahci: ABAR is not MMIO");
+        return false;
+    }
+
+    pci_enable_memory_space(&c->pci);
+    pci_enable_bus_mastering(&c->pci);
+
+    uint64_t bar_size;
+    uint64_t abar = pci_get_bar(&c->pci, AHCI_ABAR, &bar_size);
+    c->regs = (volatile uint8_t*)vmm_map_mmio(abar, bar_size);
+    if (!c->regs) {
+        DEBUG_ERROR("ahci: Failed to map registers");
+        return false;
+    }
+
+    bios_handoff(c);
+    hba_write(c, AHCI_REG_GHC, hba_read(c, AHCI_REG_GHC) | AHCI_GHC_AE);
+    c->cap = hba_read(c, AHCI_REG_CAP);
+    if (!(c->cap & AHCI_CAP_S64A)) {
+        DEBUG_WARN("ahci: HBA is limited to 32-bit DMA addresses");
+    }
+
+    DMAAllocation identify_buf = vmm_alloc_dma(1);
+    if (!identify_buf.virt) return false;
+
+    uint32_t implemented = hba_read(c, AHCI_REG_PI);
+    for (uint32_t i = 0; i < AHCI_MAX_PORTS; i++) {
+        if (!(implemented & (1u << i)) || !port_has_disk(c, i)) continue;
+
+        AhciPort* p = (AhciPort*)malloc(sizeof(AhciPort));
+        if (!p) break;
+        kstring::zero_memory(p, sizeof(*p));
+        p->hba = c;
+        p->index = i;
+        p->regs = c->regs + AHCI_PORT_BASE(i);
+        spinlock_init(&p->lock);
+
+        uint64_t sectors = 0;
+        if (port_setup(p)) sectors = identify(p, identify_buf);
+        if (sectors == 0) {
+            port_stop(p);
+            if (p->mem.virt) vmm_free_dma(p->mem);
+            free(p);
+            continue;
+        }
+
+        p->free_mask = (p->slot_count == 32) ? 0xFFFFFFFF : ((1u << p->slot_count) - 1);
+
+        BlockDevice* blk = &p->blk;
+        blk->name[0] = 's';
+        blk->name[1] = 'd';
+        blk->name[2] = (char)('a' + c->disk_count);
+        blk->sector_size = BLOCK_SECTOR_SIZE;
+        blk->sector_count = sectors;
+        blk->max_segments = AHCI_MAX_PRDT;
+        blk->max_sectors = AHCI_MAX_PRDT * (0x1000 / BLOCK_SECTOR_SIZE);
+        blk->queue_depth = p->slot_count;
+        blk->ops = &ahci_ops;
+        blk->driver_data = p;
+
+        c->ports[i] = p;
+        if (!block_register(blk)) {
+            DEBUG_ERROR("ahci: Block device table full");
+            c->ports[i] = nullptr;
+            port_stop(p);
+            break;
+        }
+        c->disk_count++;
+
+        DEBUG_INFO("ahci: Port %u: %s, %lu MB, %s depth %u%s", i, blk->name,
+            (sectors * BLOCK_SECTOR_SIZE) / (1024 * 1024), p->ncq ? "NCQ" : "no NCQ,",
+            p->slot_count, p->write_cache ? ", write cache" : "");
+    }
+    vmm_free_dma(identify_buf);
+
+    if (c->disk_count == 0) {
+        DEBUG_INFO("ahci: No disks attached");
+        return false;
+    }
+
+    setup_interrupts(c);
+    for (uint32_t i = 0; i < AHCI_MAX_PORTS; i++) {
+        AhciPort* p = c->ports[i];
+        if (!p) continue;
+        p->blk.irq_driven = (c->irq >= 0);
+        port_write(p, AHCI_PxIS, 0xFFFFFFFF);
+        if (c->irq >= 0) port_write(p, AHCI_PxIE, AHCI_PORT_IRQS);
+    }
+    hba_write(c, AHCI_REG_IS, 0xFFFFFFFF);
+    if (c->irq >= 0) hba_write(c, AHCI_REG_GHC, hba_read(c, AHCI_REG_GHC) | AHCI_GHC_IE);
+
+    c->initialized = true;
+    return true;
+}
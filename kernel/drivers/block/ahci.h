@@ -0,0 +1,141 @@
+#pragma once
+#include <stdint.h>
+
+// ============================================================================
+// AHCI (SATA) Driver
+// ============================================================================
+// QEMU: -drive file=disk.img,if=none,id=sata -device ahci,id=ahci
+//       -device ide-hd,drive=sata,bus=ahci.0
+//
+// Each ATA port gets a command list, FIS receive area and one command table
+// per slot. Disks that support Native Command Queuing use READ/WRITE FPDMA
+// QUEUED with up to 32 tags outstanding; others fall back to one DMA EXT
+// command at a time. Completions arrive by MSI or INTx, with polling if
+// neither is available. Disks register with the block layer as "sda",
+// "sdb", ...
+// ============================================================================
+
+// PCI prog-if for PCI_CLASS_STORAGE / PCI_SUBCLASS_SATA
+#define PCI_PROGIF_AHCI             0x01
+
+#define AHCI_ABAR                   5       // Registers live in BAR5
+
+// HBA registers
+#define AHCI_REG_CAP                0x00
+#define AHCI_REG_GHC                0x04
+#define AHCI_REG_IS                 0x08
+#define AHCI_REG_PI                 0x0C    // Ports implemented
+#define AHCI_REG_VS                 0x10
+#define AHCI_REG_CAP2               0x24
+#define AHCI_REG_BOHC               0x28    // BIOS/OS handoff
+
+#define AHCI_CAP_NCS(cap)           ((((cap) >> 8) & 0x1F) + 1)    // Command slots
+#define AHCI_CAP_SNCQ               (1u << 30)
+#define AHCI_CAP_S64A               (1u << 31)
+#define AHCI_CAP2_BOH               (1u << 0)
+#define AHCI_BOHC_BOS               (1u << 0)
+#define AHCI_BOHC_OOS               (1u << 1)
+#define AHCI_GHC_IE                 (1u << 1)
+#define AHCI_GHC_AE                 (1u << 31)
+
+// Port registers (0x100 + port * 0x80)
+#define AHCI_PORT_BASE(p)           (0x100 + (p) * 0x80)
+#define AHCI_PxCLB                  0x00
+#define AHCI_PxCLBU                 0x04
+#define AHCI_PxFB                   0x08
+#define AHCI_PxFBU                  0x0C
+#define AHCI_PxIS                   0x10
+#define AHCI_PxIE                   0x14
+#define AHCI_PxCMD                  0x18
+#define AHCI_PxTFD                  0x20
+#define AHCI_PxSIG                  0x24
+#define AHCI_PxSSTS                 0x28
+#define AHCI_PxSERR                 0x30
+#define AHCI_PxSACT                 0x34
+#define AHCI_PxCI                   0x38
+
+#define AHCI_PxCMD_ST               (1u << 0)
+#define AHCI_PxCMD_FRE              (1u << 4)
+#define AHCI_PxCMD_FR               (1u << 14)
+#define AHCI_PxCMD_CR               (1u << 15)
+
+#define AHCI_PxIS_DHRS              (1u << 0)   // D2H register FIS
+#define AHCI_PxIS_PSS               (1u << 1)   // PIO setup FIS
+#define AHCI_PxIS_SDBS              (1u << 3)   // Set device bits FIS (NCQ)
+#define AHCI_PxIS_IFS               (1u << 27)
+#define AHCI_PxIS_HBDS              (1u << 28)
+#define AHCI_PxIS_HBFS              (1u << 29)
+#define AHCI_PxIS_TFES              (1u << 30)
+#define AHCI_PxIS_ERRORS            (AHCI_PxIS_IFS | AHCI_PxIS_HBDS | AHCI_PxIS_HBFS | AHCI_PxIS_TFES)
+
+#define AHCI_PxTFD_ERR              (1u << 0)
+#define AHCI_PxTFD_DRQ              (1u << 3)
+#define AHCI_PxTFD_BSY              (1u << 7)
+
+#define AHCI_SSTS_DET_PRESENT       3
+#define AHCI_SIG_ATA                0x00000101
+
+// ATA commands
+#define ATA_CMD_READ_DMA_EXT        0x25
+#define ATA_CMD_WRITE_DMA_EXT       0x35
+#define ATA_CMD_READ_FPDMA_QUEUED   0x60
+#define ATA_CMD_WRITE_FPDMA_QUEUED  0x61
+#define ATA_CMD_IDENTIFY            0xEC
+#define ATA_CMD_FLUSH_CACHE_EXT     0xEA
+
+#define FIS_TYPE_REG_H2D            0x27
+
+#define AHCI_MAX_PORTS              32
+#define AHCI_MAX_SLOTS              32
+#define AHCI_MAX_PRDT               32      // PRD entries per command table
+
+// Command list entry (32 bytes)
+struct AhciCommandHeader {
+    uint16_t flags;         // CFL [4:0], A, W (write), P, R, B, C, PMP [15:12]
+    uint16_t prdtl;         // PRD entries
+    volatile uint32_t prdbc;
+    uint64_t ctba;          // Command table base (128-byte aligned)
+    uint32_t reserved[4];
+};
+
+#define AHCI_CMD_WRITE              (1u << 6)
+#define AHCI_CMD_CLEAR_BUSY         (1u << 10)
+
+// Physical region descriptor (16 bytes)
+struct AhciPrd {
+    uint64_t dba;
+    uint32_t reserved;
+    uint32_t dbc;           // Byte count - 1 [21:0], interrupt on completion [31]
+};
+
+// Command table: FIS area followed by the PRDT
+struct AhciCommandTable {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    AhciPrd prdt[AHCI_MAX_PRDT];
+};
+
+// Host to device register FIS (20 bytes)
+struct FisRegH2D {
+    uint8_t type;
+    uint8_t flags;          // Bit 7: command (vs control)
+    uint8_t command;
+    uint8_t feature_low;
+    uint8_t lba0;
+    uint8_t lba1;
+    uint8_t lba2;
+    uint8_t device;
+    uint8_t lba3;
+    uint8_t lba4;
+    uint8_t lba5;
+    uint8_t feature_high;
+    uint8_t count_low;
+    uint8_t count_high;
+    uint8_t icc;
+    uint8_t control;
+    uint32_t reserved;
+};
+
+// Probe PCI for an AHCI controller and register every ATA disk found
+bool ahci_init();
@@ -0,0 +1,169 @@
+#include "blockbench.h"
+#include "timer.h"
+#include "heap.h"
+#include "kstring.h"
+
+struct BenchSlot {
+    BlockRequest req;
+    uint64_t start_tsc;
+    volatile uint64_t end_tsc;
+    volatile bool done;
+    bool active;
+};
+
+static void bench_complete(BlockRequest* req) {
+    BenchSlot* slot = (BenchSlot*)req->ctx;
+    slot->end_tsc = rdtsc();
+    slot->done = true;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// In-place heapsort (no recursion, no extra memory)
+static void sift_down(uint64_t* a, uint64_t start, uint64_t end) {
+    uint64_t root = start;
+    while (2 * root + 1 < end) {
+        uint64_t child = 2 * root + 1;
+        if (child + 1 < end && a[child] < a[child + 1]) child++;
+        if (a[root] >= a[child]) return;
+        uint64_t tmp = a[root]; a[root] = a[child]; a[child] = tmp;
+        root = child;
+    }
+}
+
+static void sort_u64(uint64_t* a, uint64_t n) {
+    if (n < 2) return;
+    for (uint64_t i = n / 2; i-- > 0;) sift_down(a, i, n);
+    for (uint64_t end = n - 1; end > 0; end--) {
+        uint64_t tmp = a[0]; a[0] = a[end]; a[end] = tmp;
+        sift_down(a, 0, end);
+    }
+}
+
+static uint64_t percentile(const uint64_t* sorted, uint64_t n, uint64_t per_mille) {
+    uint64_t idx = (n * per_mille) / 1000;
+    if (idx >= n) idx = n - 1;
+    return sorted[idx];
+}
+
+bool block_bench_run(BlockDevice* dev, uint32_t queue_depth, uint32_t ops,
+                     uint32_t io_bytes, BlockBenchResult* out) {
+    if (!dev || !out || queue_depth == 0 || ops == 0) return false;
+    if (io_bytes < dev->sector_size || io_bytes % dev->sector_size) return false;
+
+    uint64_t tsc_khz = timer_get_tsc_khz();
+    if (tsc_khz == 0) return false;
+
+    uint32_t sectors_per_io = io_bytes / dev->sector_size;
+    uint64_t positions = dev->sector_count / sectors_per_io;
+    if (positions == 0) return false;
+
+    BenchSlot* slots = (BenchSlot*)malloc(queue_depth * sizeof(BenchSlot));
+    uint64_t* latencies = (uint64_t*)malloc((uint64_t)ops * sizeof(uint64_t));
+    void** buffers = (void**)malloc(queue_depth * sizeof(void*));
+    if (!slots || !latencies || !buffers) {
+        free(slots);
+        free(latencies);
+        free(buffers);
+        return false;
+    }
+    kstring::zero_memory(slots, queue_depth * sizeof(BenchSlot));
+    kstring::zero_memory(buffers, queue_depth * sizeof(void*));
+
+    bool ok = true;
+    for (uint32_t i = 0; i < queue_depth && ok; i++) {
+        buffers[i] = aligned_alloc(0x1000, io_bytes);
+        ok = buffers[i] != nullptr;
+    }
+
+    uint64_t rng = 0x9E3779B97F4A7C15ULL ^ timer_get_ticks();
+    uint64_t issued = 0, completed = 0, errors = 0;
+    bool poll = !dev->irq_driven || !interrupts_enabled();
+
+    auto start = [&](uint32_t i) {
+        BenchSlot* slot = &slots[i];
+        kstring::zero_memory(&slot->req, sizeof(slot->req));
+        slot->req.dev = dev;
+        slot->req.lba = (xorshift64(&rng) % positions) * sectors_per_io;
+        slot->req.count = sectors_per_io;
+        slot->req.buffer = buffers[i];
+        slot->req.complete = bench_complete;
+        slot->req.ctx = slot;
+        slot->done = false;
+        slot->active = true;
+        slot->start_tsc = rdtsc();
+        issued++;
+        if (!block_submit(&slot->req)) {
+            // Rejected outright: count it as a failed I/O
+            slot->end_tsc = rdtsc();
+            slot->done = true;
+        }
+    };
+
+    uint64_t t0 = rdtsc();
+    if (ok) {
+        block_plug(dev);
+        for (uint32_t i = 0; i < queue_depth && issued < ops; i++) start(i);
+        block_unplug(dev);
+
+        while (completed < ops) {
+            if (poll && dev->ops->poll) dev->ops->poll(dev);
+
+            bool plugged = false;
+            for (uint32_t i = 0; i < queue_depth; i++) {
+                BenchSlot* slot = &slots[i];
+                if (!slot->active || !slot->done) continue;
+
+                latencies[completed++] = slot->end_tsc - slot->start_tsc;
+                if (slot->req.status != BLOCK_OK) errors++;
+                slot->active = false;
+
+                if (issued < ops) {
+                    if (!plugged) {
+                        block_plug(dev);
+                        plugged = true;
+                    }
+                    start(i);
+                }
+            }
+            if (plugged) block_unplug(dev);
+            asm volatile("pause");
+        }
+    }
+    uint64_t elapsed_cycles = rdtsc() - t0;
+
+    if (ok) {
+        sort_u64(latencies, completed);
+
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < completed; i++) sum += latencies[i];
+        auto to_ns = [&](uint64_t cycles) { return cycles * 1000000ULL / tsc_khz; };
+
+        out->queue_depth = queue_depth;
+        out->ops = completed;
+        out->errors = errors;
+        out->elapsed_us = to_ns(elapsed_cycles) / 1000;
+        out->iops = out->elapsed_us ? completed * 1000000ULL / out->elapsed_us : 0;
+        out->avg_ns = to_ns(sum / completed);
+        out->p50_ns = to_ns(percentile(latencies, completed, 500));
+        out->p90_ns = to_ns(percentile(latencies, completed, 900));
+        out->p99_ns = to_ns(percentile(latencies, completed, 990));
+        out->p999_ns = to_ns(percentile(latencies, completed, 999));
+        out->max_ns = to_ns(latencies[completed - 1]);
+    }
+
+    for (uint32_t i = 0; i < queue_depth; i++) {
+        if (buffers[i]) aligned_free(buffers[i]);
+    }
+    free(buffers);
+    free(latencies);
+    free(slots);
+    return ok;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+
+// ============================================================================
+// Block Benchmark
+// ============================================================================
+// Random reads at a fixed queue depth through the asynchronous block API.
+// Latency is measured per request with the TSC, from block_submit() to the
+// completion callback. Read-only, so it is safe on a disk with data.
+// ============================================================================
+
+struct BlockBenchResult {
+    uint32_t queue_depth;
+    uint64_t ops;
+    uint64_t errors;
+    uint64_t elapsed_us;
+    uint64_t iops;
+    uint64_t avg_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+};
+
+// Issue `ops` random reads of io_bytes (multiple of the sector size) keeping
+// queue_depth in flight. Returns false if memory or the TSC clock is
+// unavailable, or the device is smaller than one I/O.
+bool block_bench_run(BlockDevice* dev, uint32_t queue_depth, uint32_t ops,
+                     uint32_t io_bytes, BlockBenchResult* out);
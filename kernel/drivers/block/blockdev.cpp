@@ -0,0 +1,358 @@
+#include "blockdev.h"
+#include "vmm.h"
+#include "scheduler.h"
+#include "kstring.h"
+#include "heap.h"
+#include "debug.h"
+
+static BlockDevice* devices[BLOCK_MAX_DEVICES];
+static int device_count = 0;
+
+// ============================================================================
+// Internal Helpers
+// ============================================================================
+
+static uint32_t pages_spanned(const BlockRequest* req, uint32_t sector_size) {
+    uint64_t start = (uint64_t)req->buffer;
+    uint64_t end = start + (uint64_t)req->count * sector_size - 1;
+    return (uint32_t)((end >> 12) - (start >> 12) + 1);
+}
+
+static void queue_push_front(BlockDevice* dev, BlockRequest* req) {
+    req->next = dev->queue_head;
+    dev->queue_head = req;
+    if (!dev->queue_tail) dev->queue_tail = req;
+}
+
+// Undo a merge after the driver refused the command: the chain goes back to
+// the front of the queue in its original order
+static void requeue_chain(BlockDevice* dev, BlockRequest* head) {
+    BlockRequest* chain[BLOCK_MAX_SEGMENTS];
+    int n = 0;
+    for (BlockRequest* r = head; r && n < BLOCK_MAX_SEGMENTS; r = r->merged) {
+        chain[n++] = r;
+    }
+    while (n-- > 0) {
+        chain[n]->merged = nullptr;
+        queue_push_front(dev, chain[n]);
+    }
+}
+
+// Hand queued requests to the driver while it has free slots.
+// Called with dev->lock held.
+static void dispatch_locked(BlockDevice* dev) {
+    if (dev->plug_count > 0) return;
+
+    uint32_t submitted = 0;
+    while (dev->queue_head && dev->stats.in_flight < dev->queue_depth) {
+        BlockRequest* head = dev->queue_head;
+        dev->queue_head = head->next;
+        head->next = nullptr;
+        head->merged = nullptr;
+
+        // Fold following requests that continue this one on disk
+        BlockRequest* tail = head;
+        uint32_t sectors = head->count;
+        uint32_t pages = pages_spanned(head, dev->sector_size);
+        while (dev->queue_head) {
+            BlockRequest* next = dev->queue_head;
+            if (next->write != head->write) break;
+            if (next->lba != tail->lba + tail->count) break;
+            if (dev->merge_page_aligned) {
+                uint64_t tail_end = (uint64_t)tail->buffer + (uint64_t)tail->count * dev->sector_size;
+                if ((tail_end & 0xFFF) || ((uint64_t)next->buffer & 0xFFF)) break;
+            }
+
+            uint32_t next_pages = pages_spanned(next, dev->sector_size);
+            if (sectors + next->count > dev->max_sectors) break;
+            if (pages + next_pages > dev->max_segments) break;
+
+            dev->queue_head = next->next;
+            next->next = nullptr;
+            next->merged = nullptr;
+            tail->merged = next;
+            tail = next;
+            sectors += next->count;
+            pages += next_pages;
+            dev->stats.merges++;
+        }
+        if (!dev->queue_head) dev->queue_tail = nullptr;
+
+        dev->stats.in_flight++;
+        if (!dev->ops->submit(dev, head)) {
+            dev->stats.in_flight--;
+            requeue_chain(dev, head);
+            break;
+        }
+        submitted++;
+        dev->stats.commands++;
+        if (dev->stats.in_flight > dev->stats.max_in_flight) {
+            dev->stats.max_in_flight = dev->stats.in_flight;
+        }
+    }
+
+    if (submitted > 0 && dev->ops->kick) dev->ops->kick(dev);
+}
+
+// ============================================================================
+// Registration
+// ============================================================================
+
+bool block_register(BlockDevice* dev) {
+    if (!dev || !dev->ops || !dev->ops->submit || device_count >= BLOCK_MAX_DEVICES) {
+        return false;
+    }
+    if (dev->sector_size == 0) dev->sector_size = BLOCK_SECTOR_SIZE;
+    if (dev->queue_depth == 0) dev->queue_depth = 1;
+    if (dev->max_segments == 0 || dev->max_segments > BLOCK_MAX_SEGMENTS) {
+        dev->max_segments = BLOCK_MAX_SEGMENTS;
+    }
+    if (dev->max_sectors == 0) dev->max_sectors = 0x1000 / dev->sector_size;
+
+    spinlock_init(&dev->lock);
+    dev->queue_head = nullptr;
+    dev->queue_tail = nullptr;
+    dev->plug_count = 0;
+    kstring::zero_memory(&dev->stats, sizeof(dev->stats));
+
+    devices[device_count++] = dev;
+    DEBUG_INFO("block: %s registered (%lu sectors of %u bytes, %lu MB)",
+        dev->name, dev->sector_count, dev->sector_size,
+        (dev->sector_count * dev->sector_size) / (1024 * 1024));
+    return true;
+}
+
+int block_count() {
+    return device_count;
+}
+
+BlockDevice* block_get(int index) {
+    if (index < 0 || index >= device_count) return nullptr;
+    return devices[index];
+}
+
+BlockDevice* block_find(const char* name) {
+    if (!name) return nullptr;
+    for (int i = 0; i < device_count; i++) {
+        if (kstring::strcmp(devices[i]->name, name) == 0) return devices[i];
+    }
+    return nullptr;
+}
+
+// ============================================================================
+// Asynchronous I/O
+// ============================================================================
+
+bool block_submit(BlockRequest* req) {
+    if (!req) return false;
+    BlockDevice* dev = req->dev;
+
+    if (!dev || !req->buffer || req->count == 0 ||
+        req->lba >= dev->sector_count || req->count > dev->sector_count - req->lba) {
+        req->status = BLOCK_ERR_INVALID;
+        return false;
+    }
+    if (req->write && dev->read_only) {
+        req->status = BLOCK_ERR_READ_ONLY;
+        return false;
+    }
+    if (vmm_virt_to_phys((uint64_t)req->buffer) == 0) {
+        req->status = BLOCK_ERR_INVALID;
+        return false;
+    }
+    // A single request must fit one device command on its own
+    if (req->count > dev->max_sectors || pages_spanned(req, dev->sector_size) > dev->max_segments) {
+        req->status = BLOCK_ERR_INVALID;
+        return false;
+    }
+
+    req->status = BLOCK_PENDING;
+    req->next = nullptr;
+    req->merged = nullptr;
+
+    spinlock_acquire(&dev->lock);
+    if (req->write) {
+        dev->stats.writes++;
+        dev->stats.sectors_written += req->count;
+    } else {
+        dev->stats.reads++;
+        dev->stats.sectors_read += req->count;
+    }
+
+    if (dev->queue_tail) {
+        dev->queue_tail->next = req;
+    } else {
+        dev->queue_head = req;
+    }
+    dev->queue_tail = req;
+
+    dispatch_locked(dev);
+    spinlock_release(&dev->lock);
+    return true;
+}
+
+void block_plug(BlockDevice* dev) {
+    if (!dev) return;
+    spinlock_acquire(&dev->lock);
+    dev->plug_count++;
+    spinlock_release(&dev->lock);
+}
+
+void block_unplug(BlockDevice* dev) {
+    if (!dev) return;
+    spinlock_acquire(&dev->lock);
+    if (dev->plug_count > 0) dev->plug_count--;
+    dispatch_locked(dev);
+    spinlock_release(&dev->lock);
+}
+
+int block_wait(BlockRequest* req) {
+    BlockDevice* dev = req->dev;
+
+    while (req->status == BLOCK_PENDING) {
+        // Interrupts cannot arrive with IF=0 (e.g. inside a syscall), and
+        // polled devices never raise them
+        if (!dev->irq_driven || !interrupts_enabled()) {
+            if (dev->ops->poll) dev->ops->poll(dev);
+            if (req->status != BLOCK_PENDING) break;
+        }
+        scheduler_yield();
+    }
+    return req->status;
+}
+
+// ============================================================================
+// Synchronous Helpers
+// ============================================================================
+
+// Largest chunk (in sectors) that fits one command starting at buf
+static uint32_t chunk_sectors(BlockDevice* dev, uint64_t buf, uint32_t remaining) {
+    uint32_t count = remaining < dev->max_sectors ? remaining : dev->max_sectors;
+
+    // Keep within the segment limit assuming no physical contiguity
+    uint64_t max_bytes = (uint64_t)dev->max_segments * 0x1000 - (buf & 0xFFF);
+    uint32_t max_count = (uint32_t)(max_bytes / dev->sector_size);
+    if (max_count == 0) max_count = 1;
+    return count < max_count ? count : max_count;
+}
+
+static int block_transfer(BlockDevice* dev, uint64_t lba, uint32_t count, void* buffer, bool write) {
+    if (!dev || !buffer) return BLOCK_ERR_INVALID;
+
+    // Issue every chunk before waiting so the device sees them together.
+    // Requests are completed from IRQ context, possibly while another address
+    // space is active, so they cannot live on a process kernel stack.
+    const int batch_size = 16;
+    BlockRequest* reqs = (BlockRequest*)malloc(batch_size * sizeof(BlockRequest));
+    if (!reqs) return BLOCK_ERR_NO_MEMORY;
+    uint8_t* buf = (uint8_t*)buffer;
+    int result = BLOCK_OK;
+
+    while (count > 0) {
+        int issued = 0;
+        block_plug(dev);
+        while (count > 0 && issued < batch_size) {
+            uint32_t n = chunk_sectors(dev, (uint64_t)buf, count);
+            BlockRequest* req = &reqs[issued];
+            kstring::zero_memory(req, sizeof(*req));
+            req->dev = dev;
+            req->lba = lba;
+            req->count = n;
+            req->write = write;
+            req->buffer = buf;
+            if (!block_submit(req)) {
+                result = req->status;
+                count = 0;
+                break;
+            }
+            issued++;
+            lba += n;
+            count -= n;
+            buf += (uint64_t)n * dev->sector_size;
+        }
+        block_unplug(dev);
+
+        for (int i = 0; i < issued; i++) {
+            int status = block_wait(&reqs[i]);
+            if (status != BLOCK_OK) result = status;
+        }
+        if (result != BLOCK_OK) break;
+    }
+
+    free(reqs);
+    return result;
+}
+
+int block_read(BlockDevice* dev, uint64_t lba, uint32_t count, void* buffer) {
+    return block_transfer(dev, lba, count, buffer, false);
+}
+
+int block_write(BlockDevice* dev, uint64_t lba, uint32_t count, const void* buffer) {
+    return block_transfer(dev, lba, count, (void*)buffer, true);
+}
+
+int block_flush(BlockDevice* dev) {
+    if (!dev) return BLOCK_ERR_INVALID;
+    if (!dev->ops->flush) return BLOCK_OK;
+    return dev->ops->flush(dev);
+}
+
+// ============================================================================
+// Driver Side
+// ============================================================================
+
+void block_complete(BlockRequest* req, int32_t status) {
+    BlockDevice* dev = req->dev;
+
+    spinlock_acquire(&dev->lock);
+    if (dev->stats.in_flight > 0) dev->stats.in_flight--;
+    if (status != BLOCK_OK) dev->stats.errors++;
+    dispatch_locked(dev);  // Refill the slot this command freed
+    spinlock_release(&dev->lock);
+
+    // The callback may recycle the request, so read the link first
+    while (req) {
+        BlockRequest* next = req->merged;
+        req->merged = nullptr;
+        req->status = status;
+        if (req->complete) req->complete(req);
+        req = next;
+    }
+}
+
+uint32_t block_build_segments(const BlockRequest* req, BlockSegment* segments,
+                              uint32_t max_segments, uint32_t max_length) {
+    uint32_t n = 0;
+    uint32_t sector_size = req->dev->sector_size;
+
+    for (const BlockRequest* r = req; r; r = r->merged) {
+        uint64_t virt = (uint64_t)r->buffer;
+        uint64_t remaining = (uint64_t)r->count * sector_size;
+
+        while (remaining > 0) {
+            uint64_t chunk = 0x1000 - (virt & 0xFFF);
+            if (chunk > remaining) chunk = remaining;
+            uint64_t phys = vmm_virt_to_phys(virt);
+            if (phys == 0) return 0;
+
+            BlockSegment* last = n ? &segments[n - 1] : nullptr;
+            if (last && last->phys + last->length == phys && last->length + chunk <= max_length) {
+                last->length += (uint32_t)chunk;
+            } else {
+                if (n == max_segments) return 0;
+                segments[n].phys = phys;
+                segments[n].length = (uint32_t)chunk;
+                n++;
+            }
+            virt += chunk;
+            remaining -= chunk;
+        }
+    }
+    return n;
+}
+
+uint32_t block_command_sectors(const BlockRequest* req) {
+    uint32_t total = 0;
+    for (const BlockRequest* r = req; r; r = r->merged) total += r->count;
+    return total;
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <stdint.h>
+#include "spinlock.h"
+
+// ============================================================================
+// Block Device Layer
+// ============================================================================
+// Storage drivers (virtio-blk, ...) register a BlockDevice and implement
+// BlockDeviceOps. Filesystems and tools talk to this interface only.
+//
+// Requests are asynchronous: block_submit() queues a BlockRequest and returns
+// immediately; the driver completes it from its interrupt handler (or poll)
+// and the optional callback runs. Requests queued back-to-back for adjacent
+// sectors in the same direction are merged into one device command, so
+// callers that know they are about to issue a run of I/O should bracket it
+// with block_plug()/block_unplug().
+// ============================================================================
+
+#define BLOCK_MAX_DEVICES     8
+#define BLOCK_SECTOR_SIZE     512
+#define BLOCK_MAX_SEGMENTS    64     // Upper bound for BlockDevice::max_segments
+
+// Request status values
+#define BLOCK_OK              0
+#define BLOCK_PENDING         1
+#define BLOCK_ERR_IO          -1
+#define BLOCK_ERR_INVALID     -2
+#define BLOCK_ERR_READ_ONLY   -3
+#define BLOCK_ERR_NO_MEMORY   -4
+
+struct BlockDevice;
+struct BlockRequest;
+
+typedef void (*BlockCompletion)(BlockRequest* req);
+
+// Completed from IRQ context in whatever address space is current, so both
+// the request and its buffer must live in the kernel heap (not on a stack).
+struct BlockRequest {
+    BlockDevice* dev;
+    uint64_t lba;               // In device sectors
+    uint32_t count;             // Sectors
+    bool write;
+    void* buffer;               // Kernel virtual address, count * sector_size bytes
+    volatile int32_t status;    // BLOCK_PENDING until completed
+    BlockCompletion complete;   // Runs after completion (IRQ context), may be null
+    void* ctx;                  // For the completion callback
+
+    // Owned by the block layer
+    BlockRequest* next;         // Software queue link
+    BlockRequest* merged;       // Requests served by the same device command
+};
+
+// Physically contiguous piece of a request's buffers
+struct BlockSegment {
+    uint64_t phys;
+    uint32_t length;
+};
+
+struct BlockDeviceOps {
+    // Start one device command covering req and every request chained on
+    // req->merged. Called with the block layer lock held; must not complete
+    // the request itself. Return false if the device has no free slot; the request
+    // then stays queued and is retried after the next completion.
+    bool (*submit)(BlockDevice* dev, BlockRequest* req);
+
+    // Notify the device once after a batch of submits (doorbell/notify
+    // register). May be null if submit already notifies.
+    void (*kick)(BlockDevice* dev);
+
+    // Reap finished commands without waiting for an interrupt
+    void (*poll)(BlockDevice* dev);
+
+    // Flush the volatile write cache (synchronous). May be null
+    int (*flush)(BlockDevice* dev);
+};
+
+struct BlockStats {
+    uint64_t reads;             // Requests (before merging)
+    uint64_t writes;
+    uint64_t sectors_read;
+    uint64_t sectors_written;
+    uint64_t commands;          // Device commands issued
+    uint64_t merges;            // Requests folded into another's command
+    uint64_t interrupts;
+    uint64_t errors;
+    uint32_t in_flight;         // Device commands outstanding
+    uint32_t max_in_flight;
+};
+
+struct BlockDevice {
+    // Filled in by the driver before block_register()
+    char name[16];
+    uint32_t sector_size;
+    uint64_t sector_count;
+    uint32_t max_sectors;       // Per device command
+    uint32_t max_segments;      // BlockSegments per device command
+    uint32_t queue_depth;       // Device commands the driver can track at once
+    bool read_only;
+    bool irq_driven;            // Completions arrive by interrupt (else poll)
+    bool merge_page_aligned;    // Only merge where buffers meet on page boundaries (PRP)
+    const BlockDeviceOps* ops;
+    void* driver_data;
+
+    // Block layer state
+    Spinlock lock;
+    BlockRequest* queue_head;   // Waiting for a device slot
+    BlockRequest* queue_tail;
+    uint32_t plug_count;
+    BlockStats stats;
+};
+
+// Registration / lookup
+bool block_register(BlockDevice* dev);
+int block_count();
+BlockDevice* block_get(int index);
+BlockDevice* block_find(const char* name);
+
+// Asynchronous I/O
+bool block_submit(BlockRequest* req);
+void block_plug(BlockDevice* dev);
+void block_unplug(BlockDevice* dev);
+int block_wait(BlockRequest* req);
+
+// Synchronous helpers (split large transfers, wait for completion)
+int block_read(BlockDevice* dev, uint64_t lba, uint32_t count, void* buffer);
+int block_write(BlockDevice* dev, uint64_t lba, uint32_t count, const void* buffer);
+int block_flush(BlockDevice* dev);
+
+// Driver side
+// Complete a device command: finishes req and everything merged behind it
+void block_complete(BlockRequest* req, int32_t status);
+
+// Describe the buffers of req (and its merged chain) as physical segments,
+// splitting at max_length. Returns the segment count, or 0 if more than
+// max_segments would be needed.
+uint32_t block_build_segments(const BlockRequest* req, BlockSegment* segments,
+                              uint32_t max_segments, uint32_t max_length);
+
+// Total sectors covered by req and its merged chain
+uint32_t block_command_sectors(const BlockRequest* req);
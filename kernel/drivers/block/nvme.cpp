@@ -0,0 +1,565 @@
+#include "nvme.h"
+#include "blockdev.h"
+#include "pci.h"
+#include "vmm.h"
+#include "io.h"
+#include "irq.h"
+#include "heap.h"
+#include "scheduler.h"
+#include "spinlock.h"
+#include "kstring.h"
+#include "debug.h"
+
+#define NVME_REAP_BATCH     32
+
+struct NvmeQueue {
+    uint16_t id;
+    uint16_t size;
+    DMAAllocation sq_mem;
+    DMAAllocation cq_mem;
+    volatile NvmeCommand* sq;
+    volatile NvmeCompletion* cq;
+    volatile uint32_t* sq_doorbell;
+    volatile uint32_t* cq_doorbell;
+    uint16_t sq_tail;
+    uint16_t sq_head;           // Last head reported by the controller
+    uint16_t cq_head;
+    uint8_t phase;
+    bool tail_dirty;            // Commands written since the last doorbell
+
+    // Command IDs index the tracking arrays
+    BlockRequest** slots;
+    bool* is_flush;
+    uint16_t* free_cids;
+    uint16_t free_count;
+    DMAAllocation prp_mem;      // NVME_PRP_LIST_BYTES per command ID
+
+    Spinlock lock;
+};
+
+struct NvmeController {
+    PciDevice pci;
+    volatile uint8_t* regs;
+    uint64_t cap;
+    uint32_t doorbell_stride;
+    uint32_t timeout_ms;
+
+    NvmeQueue admin;
+    NvmeQueue io_queues[NVME_MAX_IO_QUEUES];
+    uint32_t io_queue_count;
+
+    DMAAllocation identify_buf;
+    uint32_t max_transfer_pages;
+    bool volatile_cache;
+    int irq;                    // MSI IRQ number or PIC line, -1 if polled
+
+    BlockDevice blk;
+    bool initialized;
+};
+
+static NvmeController g_nvme;
+
+// ============================================================================
+// Register Helpers
+// ============================================================================
+
+static inline uint32_t nvme_read32(NvmeController* c, uint32_t reg) {
+    return mmio_read32(c->regs + reg);
+}
+
+static inline void nvme_write32(NvmeController* c, uint32_t reg, uint32_t value) {
+    mmio_write32(c->regs + reg, value);
+}
+
+static inline uint64_t nvme_read64(NvmeController* c, uint32_t reg) {
+    return mmio_read64(c->regs + reg);
+}
+
+static inline void nvme_write64(NvmeController* c, uint32_t reg, uint64_t value) {
+    mmio_write64(c->regs + reg, value);
+}
+
+// Interrupts are still off during init, so time with port-I/O delays (~1us)
+static bool wait_ready(NvmeController* c, bool ready) {
+    for (uint64_t us = 0; us < (uint64_t)c->timeout_ms * 1000; us++) {
+        uint32_t csts = nvme_read32(c, NVME_REG_CSTS);
+        if (csts & NVME_CSTS_CFS) return false;
+        if (((csts & NVME_CSTS_RDY) != 0) == ready) return true;
+        io_wait();
+    }
+    return false;
+}
+
+// ============================================================================
+// Queues
+// ============================================================================
+
+// I/O queues need per-command tracking; the admin queue is used synchronously
+static bool queue_alloc(NvmeController* c, NvmeQueue* q, uint16_t id, uint16_t size, bool tracking) {
+    q->id = id;
+    q->size = size;
+    q->sq_tail = 0;
+    q->sq_head = 0;
+    q->cq_head = 0;
+    q->phase = 1;
+    q->tail_dirty = false;
+    spinlock_init(&q->lock);
+
+    q->sq_mem = vmm_alloc_dma((size * sizeof(NvmeCommand) + 0xFFF) / 0x1000);
+    q->cq_mem = vmm_alloc_dma((size * sizeof(NvmeCompletion) + 0xFFF) / 0x1000);
+    if (!q->sq_mem.virt || !q->cq_mem.virt) return false;
+    kstring::zero_memory((void*)q->sq_mem.virt, q->sq_mem.size);
+    kstring::zero_memory((void*)q->cq_mem.virt, q->cq_mem.size);
+    q->sq = (volatile NvmeCommand*)q->sq_mem.virt;
+    q->cq = (volatile NvmeCompletion*)q->cq_mem.virt;
+
+    q->sq_doorbell = (volatile uint32_t*)(c->regs + NVME_REG_DOORBELL_BASE + (2 * id) * c->doorbell_stride);
+    q->cq_doorbell = (volatile uint32_t*)(c->regs + NVME_REG_DOORBELL_BASE + (2 * id + 1) * c->doorbell_stride);
+
+    if (!tracking) return true;
+
+    // One slot stays empty to tell a full SQ from an empty one
+    uint16_t cids = size - 1;
+    q->slots = (BlockRequest**)malloc(cids * sizeof(BlockRequest*));
+    q->is_flush = (bool*)malloc(cids * sizeof(bool));
+    q->free_cids = (uint16_t*)malloc(cids * sizeof(uint16_t));
+    q->prp_mem = vmm_alloc_dma((cids * NVME_PRP_LIST_BYTES + 0xFFF) / 0x1000);
+    if (!q->slots || !q->is_flush || !q->free_cids || !q->prp_mem.virt) return false;
+
+    kstring::zero_memory(q->slots, cids * sizeof(BlockRequest*));
+    kstring::zero_memory(q->is_flush, cids * sizeof(bool));
+    for (uint16_t i = 0; i < cids; i++) q->free_cids[i] = cids - 1 - i;
+    q->free_count = cids;
+    return true;
+}
+
+// Copy a command into the SQ. Called with q->lock held (or during init)
+static bool queue_push(NvmeQueue* q, const NvmeCommand* cmd) {
+    uint16_t next = (q->sq_tail + 1) % q->size;
+    if (next == q->sq_head) return false;
+
+    volatile NvmeCommand* slot = &q->sq[q->sq_tail];
+    const uint32_t* src = (const uint32_t*)cmd;
+    volatile uint32_t* dst = (volatile uint32_t*)slot;
+    for (uint32_t i = 0; i < sizeof(NvmeCommand) / 4; i++) dst[i] = src[i];
+
+    q->sq_tail = next;
+    q->tail_dirty = true;
+    return true;
+}
+
+static void ring_sq_doorbell(NvmeQueue* q) {
+    if (!q->tail_dirty) return;
+    q->tail_dirty = false;
+    mmio_write32(q->sq_doorbell, q->sq_tail);
+}
+
+// Synchronous admin command (init only)
+static bool admin_command(NvmeController* c, NvmeCommand* cmd, uint32_t* result) {
+    NvmeQueue* q = &c->admin;
+    static uint16_t next_cid = 0;
+    uint16_t cid = next_cid++;
+    cmd->cdw0 = (cmd->cdw0 & 0xFFFF) | ((uint32_t)cid << 16);
+
+    if (!queue_push(q, cmd)) return false;
+    ring_sq_doorbell(q);
+
+    for (uint64_t us = 0; us < (uint64_t)c->timeout_ms * 1000; us++) {
+        volatile NvmeCompletion* cqe = &q->cq[q->cq_head];
+        if ((cqe->status & 1) == q->phase) {
+            uint16_t status = cqe->status >> 1;
+            if (result) *result = cqe->result;
+            q->sq_head = cqe->sq_head;
+
+            if (++q->cq_head == q->size) {
+                q->cq_head = 0;
+                q->phase ^= 1;
+            }
+            mmio_write32(q->cq_doorbell, q->cq_head);
+
+            if (status != 0) {
+                DEBUG_WARN("nvme: Admin opcode 0x%x failed, status 0x%x", cmd->cdw0 & 0xFF, status);
+                return false;
+            }
+            return true;
+        }
+        io_wait();
+    }
+    DEBUG_ERROR("nvme: Admin opcode 0x%x timed out", cmd->cdw0 & 0xFF);
+    return false;
+}
+
+// ============================================================================
+// I/O Path
+// ============================================================================
+
+static NvmeQueue* current_queue(NvmeController* c) {
+    // Per-CPU queue selection; only CPU 0 exists
+    return &c->io_queues[0];
+}
+
+// Fill PRP1/PRP2 for a request chain. Segments meet on page boundaries
+// (merge_page_aligned), so every page after the first starts page-aligned.
+static bool build_prps(NvmeController* c, NvmeQueue* q, uint16_t cid,
+                       const BlockRequest* req, NvmeCommand* cmd) {
+    BlockSegment segs[NVME_MAX_TRANSFER_PAGES];
+    uint32_t seg_count = block_build_segments(req, segs, c->blk.max_segments, 0x400000);
+    if (seg_count == 0) return false;
+
+    uint64_t pages[NVME_MAX_TRANSFER_PAGES];
+    uint32_t page_count = 0;
+    for (uint32_t s = 0; s < seg_count; s++) {
+        uint64_t addr = segs[s].phys;
+        uint64_t end = segs[s].phys + segs[s].length;
+        while (addr < end) {
+            if (page_count == NVME_MAX_TRANSFER_PAGES) return false;
+            pages[page_count++] = addr;
+            addr = (addr & ~0xFFFULL) + 0x1000;
+        }
+    }
+
+    cmd->prp1 = pages[0];
+    if (page_count == 1) {
+        cmd->prp2 = 0;
+    } else if (page_count == 2) {
+        cmd->prp2 = pages[1];
+    } else {
+        uint64_t* list = (uint64_t*)(q->prp_mem.virt + (uint64_t)cid * NVME_PRP_LIST_BYTES);
+        for (uint32_t i = 1; i < page_count; i++) list[i - 1] = pages[i];
+        cmd->prp2 = q->prp_mem.phys + (uint64_t)cid * NVME_PRP_LIST_BYTES;
+    }
+    return true;
+}
+
+static bool nvme_submit(BlockDevice* dev, BlockRequest* req) {
+    NvmeController* c = (NvmeController*)dev->driver_data;
+    NvmeQueue* q = current_queue(c);
+
+    spinlock_acquire(&q->lock);
+    if (q->free_count == 0) {
+        spinlock_release(&q->lock);
+        return false;
+    }
+    uint16_t cid = q->free_cids[q->free_count - 1];
+
+    NvmeCommand cmd;
+    kstring::zero_memory(&cmd, sizeof(cmd));
+    cmd.cdw0 = (req->write ? NVME_CMD_WRITE : NVME_CMD_READ) | ((uint32_t)cid << 16);
+    cmd.nsid = 1;
+    cmd.cdw10 = (uint32_t)req->lba;
+    cmd.cdw11 = (uint32_t)(req->lba >> 32);
+    cmd.cdw12 = block_command_sectors(req) - 1;  // 0-based block count
+
+    if (!build_prps(c, q, cid, req, &cmd) || !queue_push(q, &cmd)) {
+        spinlock_release(&q->lock);
+        return false;
+    }
+
+    q->free_count--;
+    q->slots[cid] = req;
+    q->is_flush[cid] = false;
+    spinlock_release(&q->lock);
+    return true;
+}
+
+// One doorbell write per dispatch batch
+static void nvme_kick(BlockDevice* dev) {
+    NvmeQueue* q = current_queue((NvmeController*)dev->driver_data);
+    spinlock_acquire(&q->lock);
+    ring_sq_doorbell(q);
+    spinlock_release(&q->lock);
+}
+
+// Collect completions and finish them outside the queue lock
+static void reap(NvmeQueue* q) {
+    BlockRequest* done[NVME_REAP_BATCH];
+    int32_t status[NVME_REAP_BATCH];
+    bool is_flush[NVME_REAP_BATCH];
+
+    for (;;) {
+        int n = 0;
+
+        spinlock_acquire(&q->lock);
+        while (n < NVME_REAP_BATCH) {
+            volatile NvmeCompletion* cqe = &q->cq[q->cq_head];
+            if ((cqe->status & 1) != q->phase) break;
+            asm volatile("lfence" ::: "memory");
+
+            uint16_t cid = cqe->cid;
+            uint16_t sc = cqe->status >> 1;
+            q->sq_head = cqe->sq_head;
+            if (++q->cq_head == q->size) {
+                q->cq_head = 0;
+                q->phase ^= 1;
+            }
+
+            if (cid >= q->size - 1 || !q->slots[cid]) continue;
+            done[n] = q->slots[cid];
+            status[n] = (sc == 0) ? BLOCK_OK : BLOCK_ERR_IO;
+            is_flush[n] = q->is_flush[cid];
+            n++;
+
+            q->slots[cid] = nullptr;
+            q->free_cids[q->free_count++] = cid;
+        }
+        if (n > 0) mmio_write32(q->cq_doorbell, q->cq_head);
+        spinlock_release(&q->lock);
+
+        if (n == 0) return;
+        for (int i = 0; i < n; i++) {
+            if (is_flush[i]) {
+                done[i]->status = status[i];
+            } else {
+                block_complete(done[i], status[i]);
+            }
+        }
+    }
+}
+
+static void nvme_poll(BlockDevice* dev) {
+    NvmeController* c = (NvmeController*)dev->driver_data;
+    for (uint32_t i = 0; i < c->io_queue_count; i++) reap(&c->io_queues[i]);
+}
+
+static int nvme_flush(BlockDevice* dev) {
+    NvmeController* c = (NvmeController*)dev->driver_data;
+    if (!c->volatile_cache) return BLOCK_OK;
+
+    BlockRequest* req = (BlockRequest*)malloc(sizeof(BlockRequest));
+    if (!req) return BLOCK_ERR_NO_MEMORY;
+    kstring::zero_memory(req, sizeof(*req));
+    req->dev = dev;
+    req->status = BLOCK_PENDING;
+
+    NvmeQueue* q = current_queue(c);
+    for (;;) {
+        spinlock_acquire(&q->lock);
+        bool queued = false;
+        if (q->free_count > 0) {
+            uint16_t cid = q->free_cids[q->free_count - 1];
+            NvmeCommand cmd;
+            kstring::zero_memory(&cmd, sizeof(cmd));
+            cmd.cdw0 = NVME_CMD_FLUSH | ((uint32_t)cid << 16);
+            cmd.nsid = 1;
+            if (queue_push(q, &cmd)) {
+                q->free_count--;
+                q->slots[cid] = req;
+                q->is_flush[cid] = true;
+                ring_sq_doorbell(q);
+                queued = true;
+            }
+        }
+        spinlock_release(&q->lock);
+        if (queued) break;
+
+        reap(q);
+        scheduler_yield();
+    }
+
+    int status = block_wait(req);
+    free(req);
+    return status;
+}
+
+static const BlockDeviceOps nvme_ops = {
+    nvme_submit,
+    nvme_kick,
+    nvme_poll,
+    nvme_flush,
+};
+
+static void nvme_irq(void* ctx) {
+    NvmeController* c = (NvmeController*)ctx;
+    c->blk.stats.interrupts++;
+    for (uint32_t i = 0; i < c->io_queue_count; i++) reap(&c->io_queues[i]);
+}
+
+// ============================================================================
+// Initialization
+// ============================================================================
+
+static bool identify(NvmeController* c, uint32_t cns, uint32_t nsid) {
+    NvmeCommand cmd;
+    kstring::zero_memory(&cmd, sizeof(cmd));
+    cmd.cdw0 = NVME_ADMIN_IDENTIFY;
+    cmd.nsid = nsid;
+    cmd.prp1 = c->identify_buf.phys;
+    cmd.cdw10 = cns;
+    return admin_command(c, &cmd, nullptr);
+}
+
+// Interrupt source for the I/O completion queues, best first.
+// Returns the CQ interrupt vector index (MSI-X entry) or -1 for polling.
+static int setup_interrupts(NvmeController* c) {
+    int msi_irq = irq_alloc_msi(nvme_irq, c);
+    if (msi_irq >= 0) {
+        if (pci_enable_msix(&c->pci, 0, IRQ_VECTOR(msi_irq))) {
+            c->irq = msi_irq;
+            DEBUG_INFO("nvme: Using MSI-X (vector %u)", IRQ_VECTOR(msi_irq));
+            return 0;
+        }
+        if (pci_enable_msi(&c->pci, IRQ_VECTOR(msi_irq))) {
+            c->irq = msi_irq;
+            nvme_write32(c, NVME_REG_INTMC, 1);
+            DEBUG_INFO("nvme: Using MSI (vector %u)", IRQ_VECTOR(msi_irq));
+            return 0;
+        }
+        irq_free_msi(msi_irq);
+    }
+
+    if (c->pci.irq_line < 16 && irq_register_handler(c->pci.irq_line, nvme_irq, c)) {
+        c->irq = c->pci.irq_line;
+        pci_enable_interrupts(&c->pci);
+        nvme_write32(c, NVME_REG_INTMC, 1);
+        DEBUG_INFO("nvme: Using INTx (IRQ %u)", c->pci.irq_line);
+        return 0;
+    }
+
+    c->irq = -1;
+    DEBUG_WARN("nvme: No interrupt available, polling");
+    return -1;
+}
+
+static bool create_io_queue(NvmeController* c, NvmeQueue* q, uint16_t id, uint16_t size, int vector) {
+    if (!queue_alloc(c, q, id, size, true)) return false;
+
+    NvmeCommand cmd;
+    kstring::zero_memory(&cmd, sizeof(cmd));
+    cmd.cdw0 = NVME_ADMIN_CREATE_CQ;
+    cmd.prp1 = q->cq_mem.phys;
+    cmd.cdw10 = ((uint32_t)(size - 1) << 16) | id;
+    cmd.cdw11 = NVME_QUEUE_PHYS_CONTIG;
+    if (vector >= 0) cmd.cdw11 |= NVME_CQ_IRQ_ENABLED | ((uint32_t)vector << 16);
+    if (!admin_command(c, &cmd, nullptr)) return false;
+
+    kstring::zero_memory(&cmd, sizeof(cmd));
+    cmd.cdw0 = NVME_ADMIN_CREATE_SQ;
+    cmd.prp1 = q->sq_mem.phys;
+    cmd.cdw10 = ((uint32_t)(size - 1) << 16) | id;
+    cmd.cdw11 = ((uint32_t)id << 16) | NVME_QUEUE_PHYS_CONTIG;  // CQ id = SQ id
+    return admin_command(c, &cmd, nullptr);
+}
+
+bool nvme_init() {
+    NvmeController* c = &g_nvme;
+    if (c->initialized) return true;
+
+    if (!pci_find_device_by_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_NVM, PCI_PROGIF_NVME, &c->pci)) {
+        DEBUG_INFO("nvme: No controller found");
+        return false;
+    }
+    if (!pci_bar_is_mmio(&c->pci, 0)) {
+        DEBUG_ERROR("nvme: BAR0 is not MMIO");
+        return false;
+    }
+
+    pci_enable_memory_space(&c->pci);
+    pci_enable_bus_mastering(&c->pci);
+
+    uint64_t bar_size;
+    uint64_t bar0 = pci_get_bar(&c->pci, 0, &bar_size);
+    c->regs = (volatile uint8_t*)vmm_map_mmio(bar0, bar_size);
+    if (!c->regs) {
+        DEBUG_ERROR("nvme: Failed to map registers");
+        return false;
+    }
+
+    c->cap = nvme_read64(c, NVME_REG_CAP);
+    c->doorbell_stride = 4u << NVME_CAP_DSTRD(c->cap);
+    c->timeout_ms = NVME_CAP_TO(c->cap) * 500;
+    if (c->timeout_ms == 0) c->timeout_ms = 500;
+    if (NVME_CAP_MPSMIN(c->cap) != 0) {
+        DEBUG_ERROR("nvme: Controller does not support 4KB pages");
+        return false;
+    }
+
+    // Disable, set up the admin queue, re-enable
+    nvme_write32(c, NVME_REG_CC, nvme_read32(c, NVME_REG_CC) & ~NVME_CC_EN);
+    if (!wait_ready(c, false)) {
+        DEBUG_ERROR("nvme: Controller did not stop");
+        return false;
+    }
+
+    if (!queue_alloc(c, &c->admin, 0, NVME_ADMIN_QUEUE_SIZE, false)) {
+        DEBUG_ERROR("nvme: Out of memory for admin queue");
+        return false;
+    }
+    nvme_write32(c, NVME_REG_AQA, ((NVME_ADMIN_QUEUE_SIZE - 1) << 16) | (NVME_ADMIN_QUEUE_SIZE - 1));
+    nvme_write64(c, NVME_REG_ASQ, c->admin.sq_mem.phys);
+    nvme_write64(c, NVME_REG_ACQ, c->admin.cq_mem.phys);
+    nvme_write32(c, NVME_REG_INTMS, 0xFFFFFFFF);  // Until an interrupt mode is chosen
+
+    nvme_write32(c, NVME_REG_CC, NVME_CC_EN | NVME_CC_CSS_NVM | NVME_CC_MPS_4K |
+                                 NVME_CC_AMS_RR | NVME_CC_IOSQES | NVME_CC_IOCQES);
+    if (!wait_ready(c, true)) {
+        DEBUG_ERROR("nvme: Controller did not become ready");
+        return false;
+    }
+
+    c->identify_buf = vmm_alloc_dma(1);
+    if (!c->identify_buf.virt) return false;
+    const uint8_t* id = (const uint8_t*)c->identify_buf.virt;
+
+    // Controller: max transfer size (MDTS, power of two in min pages) and
+    // volatile write cache
+    if (!identify(c, NVME_IDENTIFY_CONTROLLER, 0)) return false;
+    uint8_t mdts = id[77];
+    c->volatile_cache = (id[525] & 1) != 0;
+    c->max_transfer_pages = NVME_MAX_TRANSFER_PAGES;
+    if (mdts != 0 && (1u << mdts) < c->max_transfer_pages) c->max_transfer_pages = 1u << mdts;
+
+    // Namespace 1: size and LBA format
+    if (!identify(c, NVME_IDENTIFY_NAMESPACE, 1)) return false;
+    uint64_t nsze = *(const uint64_t*)(id + 0);
+    uint8_t flbas = id[26] & 0xF;
+    uint32_t lbaf = *(const uint32_t*)(id + 128 + flbas * 4);
+    uint32_t lba_shift = (lbaf >> 16) & 0xFF;
+    if (nsze == 0 || lba_shift < 9 || lba_shift > 12) {
+        DEBUG_ERROR("nvme: Unusable namespace 1 (size %lu, LBA shift %u)", nsze, lba_shift);
+        return false;
+    }
+
+    // Ask for one I/O queue pair per CPU (0-based counts)
+    NvmeCommand cmd;
+    kstring::zero_memory(&cmd, sizeof(cmd));
+    cmd.cdw0 = NVME_ADMIN_SET_FEATURES;
+    cmd.cdw10 = NVME_FEATURE_NUM_QUEUES;
+    cmd.cdw11 = ((NVME_MAX_IO_QUEUES - 1) << 16) | (NVME_MAX_IO_QUEUES - 1);
+    admin_command(c, &cmd, nullptr);
+
+    int vector = setup_interrupts(c);
+
+    uint16_t io_size = NVME_IO_QUEUE_SIZE;
+    if (NVME_CAP_MQES(c->cap) + 1 < io_size) io_size = NVME_CAP_MQES(c->cap) + 1;
+    for (uint32_t i = 0; i < NVME_MAX_IO_QUEUES; i++) {
+        if (!create_io_queue(c, &c->io_queues[i], i + 1, io_size, vector)) {
+            DEBUG_ERROR("nvme: Failed to create I/O queue %u", i + 1);
+            return false;
+        }
+        c->io_queue_count++;
+    }
+
+    uint32_t sector_size = 1u << lba_shift;
+    BlockDevice* blk = &c->blk;
+    kstring::strncpy(blk->name, "nvme0n1", sizeof(blk->name) - 1);
+    blk->sector_size = sector_size;
+    blk->sector_count = nsze;
+    blk->max_segments = c->max_transfer_pages;
+    blk->max_sectors = c->max_transfer_pages * (0x1000 / sector_size);
+    blk->queue_depth = io_size - 1;
+    blk->irq_driven = (c->irq >= 0);
+    blk->merge_page_aligned = true;
+    blk->ops = &nvme_ops;
+    blk->driver_data = c;
+
+    if (!block_register(blk)) {
+        DEBUG_ERROR("nvme: Block device table full");
+        return false;
+    }
+
+    c->initialized = true;
+    DEBUG_INFO("nvme: %lu MB, %u-byte LBAs, %u I/O queue(s) of %u, max %u KB/command",
+        (nsze << lba_shift) / (1024 * 1024), sector_size, c->io_queue_count, io_size,
+        c->max_transfer_pages * 4);
+    return true;
+}
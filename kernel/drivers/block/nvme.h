@@ -0,0 +1,97 @@
+#pragma once
+#include <stdint.h>
+
+// ============================================================================
+// NVMe Driver
+// ============================================================================
+// QEMU: -drive file=disk.img,if=none,id=nvm -device nvme,serial=uni,drive=nvm
+//
+// Admin queue plus one I/O queue pair per CPU (uniOS is uniprocessor, so one
+// pair today). Transfers are described with PRP entries/lists; completions
+// arrive by MSI-X, MSI or INTx, with polling if none can be set up.
+// Namespace 1 is registered with the block layer as "nvme0n1".
+// ============================================================================
+
+// PCI prog-if for PCI_CLASS_STORAGE / PCI_SUBCLASS_NVM
+#define PCI_PROGIF_NVME             0x02
+
+// Controller registers (BAR0)
+#define NVME_REG_CAP                0x00    // Capabilities (64-bit)
+#define NVME_REG_VS                 0x08    // Version
+#define NVME_REG_INTMS              0x0C    // Interrupt mask set
+#define NVME_REG_INTMC              0x10    // Interrupt mask clear
+#define NVME_REG_CC                 0x14    // Controller configuration
+#define NVME_REG_CSTS               0x1C    // Controller status
+#define NVME_REG_AQA                0x24    // Admin queue attributes
+#define NVME_REG_ASQ                0x28    // Admin SQ base (64-bit)
+#define NVME_REG_ACQ                0x30    // Admin CQ base (64-bit)
+#define NVME_REG_DOORBELL_BASE      0x1000
+
+// CAP fields
+#define NVME_CAP_MQES(cap)          ((uint32_t)((cap) & 0xFFFF))        // Max queue entries - 1
+#define NVME_CAP_TO(cap)            ((uint32_t)(((cap) >> 24) & 0xFF))  // Timeout, 500ms units
+#define NVME_CAP_DSTRD(cap)         ((uint32_t)(((cap) >> 32) & 0xF))   // Doorbell stride
+#define NVME_CAP_MPSMIN(cap)        ((uint32_t)(((cap) >> 48) & 0xF))
+
+// CC / CSTS bits
+#define NVME_CC_EN                  (1u << 0)
+#define NVME_CC_CSS_NVM             (0u << 4)
+#define NVME_CC_MPS_4K              (0u << 7)
+#define NVME_CC_AMS_RR              (0u << 11)
+#define NVME_CC_IOSQES              (6u << 16)  // 64-byte SQ entries
+#define NVME_CC_IOCQES              (4u << 20)  // 16-byte CQ entries
+#define NVME_CSTS_RDY               (1u << 0)
+#define NVME_CSTS_CFS               (1u << 1)
+
+// Admin opcodes
+#define NVME_ADMIN_CREATE_SQ        0x01
+#define NVME_ADMIN_CREATE_CQ        0x05
+#define NVME_ADMIN_IDENTIFY         0x06
+#define NVME_ADMIN_SET_FEATURES     0x09
+
+#define NVME_FEATURE_NUM_QUEUES     0x07
+
+#define NVME_IDENTIFY_NAMESPACE     0x00
+#define NVME_IDENTIFY_CONTROLLER    0x01
+
+// I/O opcodes
+#define NVME_CMD_FLUSH              0x00
+#define NVME_CMD_WRITE              0x01
+#define NVME_CMD_READ               0x02
+
+// Queue creation flags (CDW11)
+#define NVME_QUEUE_PHYS_CONTIG      (1u << 0)
+#define NVME_CQ_IRQ_ENABLED         (1u << 1)
+
+#define NVME_ADMIN_QUEUE_SIZE       32
+#define NVME_IO_QUEUE_SIZE          128     // Capped by CAP.MQES
+#define NVME_MAX_IO_QUEUES          1       // One per CPU
+#define NVME_MAX_TRANSFER_PAGES     64      // PRP entries per command (256KB)
+#define NVME_PRP_LIST_BYTES         (NVME_MAX_TRANSFER_PAGES * 8)
+
+struct NvmeCommand {
+    uint32_t cdw0;          // Opcode [7:0], command ID [31:16]
+    uint32_t nsid;
+    uint64_t reserved;
+    uint64_t mptr;
+    uint64_t prp1;
+    uint64_t prp2;
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+};  // Naturally aligned: 64 bytes, no packing needed
+
+struct NvmeCompletion {
+    uint32_t result;
+    uint32_t reserved;
+    uint16_t sq_head;
+    uint16_t sq_id;
+    uint16_t cid;
+    uint16_t status;        // Phase tag in bit 0, status field above
+};  // 16 bytes
+
+// Probe PCI for an NVMe controller and register namespace 1
+bool nvme_init();
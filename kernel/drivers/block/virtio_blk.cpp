@@ -0,0 +1,366 @@
+#include "virtio_blk.h"
+#include "blockdev.h"
+#include "pci.h"
+#include "vmm.h"
+#include "io.h"
+#include "irq.h"
+#include "heap.h"
+#include "scheduler.h"
+#include "spinlock.h"
+#include "kstring.h"
+#include "debug.h"
+
+#define VIRTQ_USED_F_NO_NOTIFY  1
+#define VIRTIO_BLK_REAP_BATCH   32
+
+struct VirtioBlk {
+    PciDevice pci;
+    uint16_t io_base;
+    uint16_t queue_size;
+    uint32_t features;
+    uint32_t seg_max;
+    uint32_t size_max;
+
+    DMAAllocation ring_mem;
+    volatile VirtqDesc* desc;
+    volatile VirtqAvail* avail;
+    volatile VirtqUsed* used;
+    uint16_t free_head;         // Free descriptors are chained through next
+    uint16_t num_free;
+    uint16_t last_used;
+
+    // Per-slot request header and status byte, indexed by head descriptor
+    DMAAllocation req_mem;
+    volatile VirtioBlkReqHeader* headers;
+    volatile uint8_t* statuses;
+    BlockRequest** slots;
+
+    Spinlock lock;
+    BlockDevice blk;
+    bool initialized;
+};
+
+static VirtioBlk g_vblk;
+
+// ============================================================================
+// Virtqueue Helpers
+// ============================================================================
+
+static inline uint64_t header_phys(VirtioBlk* vb, uint16_t head) {
+    return vb->req_mem.phys + head * sizeof(VirtioBlkReqHeader);
+}
+
+static inline uint64_t status_phys(VirtioBlk* vb, uint16_t head) {
+    return vb->req_mem.phys + vb->queue_size * sizeof(VirtioBlkReqHeader) + head;
+}
+
+// Build a descriptor chain: header, data segments, status byte.
+// Called with vb->lock held; returns the head index or -1 if the ring is full
+static int build_chain(VirtioBlk* vb, uint32_t type, uint64_t sector,
+                       const BlockSegment* segs, uint32_t seg_count, bool device_writes) {
+    uint32_t needed = seg_count + 2;
+    if (vb->num_free < needed) return -1;
+
+    uint16_t head = vb->free_head;
+    uint16_t idx = head;
+
+    vb->headers[head].type = type;
+    vb->headers[head].reserved = 0;
+    vb->headers[head].sector = sector;
+    vb->statuses[head] = 0xFF;
+
+    vb->desc[idx].addr = header_phys(vb, head);
+    vb->desc[idx].len = sizeof(VirtioBlkReqHeader);
+    vb->desc[idx].flags = VIRTQ_DESC_F_NEXT;
+    idx = vb->desc[idx].next;
+
+    for (uint32_t i = 0; i < seg_count; i++) {
+        vb->desc[idx].addr = segs[i].phys;
+        vb->desc[idx].len = segs[i].length;
+        vb->desc[idx].flags = VIRTQ_DESC_F_NEXT | (device_writes ? VIRTQ_DESC_F_WRITE : 0);
+        idx = vb->desc[idx].next;
+    }
+
+    vb->desc[idx].addr = status_phys(vb, head);
+    vb->desc[idx].len = 1;
+    vb->desc[idx].flags = VIRTQ_DESC_F_WRITE;
+
+    // The unused tail of the free list starts after the last descriptor
+    vb->free_head = vb->desc[idx].next;
+    vb->num_free -= needed;
+
+    // Publish: ring entry first, then the index the device polls
+    uint16_t avail_idx = vb->avail->idx;
+    vb->avail->ring[avail_idx % vb->queue_size] = head;
+    asm volatile("mfence" ::: "memory");
+    vb->avail->idx = avail_idx + 1;
+    return head;
+}
+
+// Return a finished chain to the free list. Called with vb->lock held
+static void free_chain(VirtioBlk* vb, uint16_t head) {
+    uint16_t idx = head;
+    uint16_t count = 1;
+    while (vb->desc[idx].flags & VIRTQ_DESC_F_NEXT) {
+        idx = vb->desc[idx].next;
+        count++;
+    }
+    vb->desc[idx].next = vb->free_head;
+    vb->free_head = head;
+    vb->num_free += count;
+}
+
+static void notify(VirtioBlk* vb) {
+    asm volatile("mfence" ::: "memory");
+    if (!(vb->used->flags & VIRTQ_USED_F_NO_NOTIFY)) {
+        outw(vb->io_base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+    }
+}
+
+// Collect finished chains and complete them outside the driver lock
+static void reap(VirtioBlk* vb) {
+    BlockRequest* done[VIRTIO_BLK_REAP_BATCH];
+    int32_t status[VIRTIO_BLK_REAP_BATCH];
+    bool is_flush[VIRTIO_BLK_REAP_BATCH];
+
+    for (;;) {
+        int n = 0;
+
+        spinlock_acquire(&vb->lock);
+        while (n < VIRTIO_BLK_REAP_BATCH && vb->last_used != vb->used->idx) {
+            asm volatile("lfence" ::: "memory");
+            uint16_t head = (uint16_t)vb->used->ring[vb->last_used % vb->queue_size].id;
+            vb->last_used++;
+            if (head >= vb->queue_size || !vb->slots[head]) continue;
+
+            done[n] = vb->slots[head];
+            status[n] = (vb->statuses[head] == VIRTIO_BLK_S_OK) ? BLOCK_OK : BLOCK_ERR_IO;
+            is_flush[n] = (vb->headers[head].type == VIRTIO_BLK_T_FLUSH);
+            n++;
+
+            vb->slots[head] = nullptr;
+            free_chain(vb, head);
+        }
+        spinlock_release(&vb->lock);
+
+        if (n == 0) return;
+        for (int i = 0; i < n; i++) {
+            if (is_flush[i]) {
+                // Flushes bypass the block queue
+                done[i]->status = status[i];
+            } else {
+                block_complete(done[i], status[i]);
+            }
+        }
+    }
+}
+
+// ============================================================================
+// Block Device Operations
+// ============================================================================
+
+static bool vblk_submit(BlockDevice* dev, BlockRequest* req) {
+    VirtioBlk* vb = (VirtioBlk*)dev->driver_data;
+
+    BlockSegment segs[VIRTIO_BLK_MAX_SEGMENTS];
+    uint32_t seg_count = block_build_segments(req, segs, vb->seg_max, vb->size_max);
+    if (seg_count == 0) return false;
+
+    // Device sectors are always 512 bytes
+    uint64_t sector = req->lba * (dev->sector_size / 512);
+
+    spinlock_acquire(&vb->lock);
+    int head = build_chain(vb, req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, sector,
+                           segs, seg_count, !req->write);
+    if (head >= 0) vb->slots[head] = req;
+    spinlock_release(&vb->lock);
+
+    return head >= 0;
+}
+
+static void vblk_kick(BlockDevice* dev) {
+    notify((VirtioBlk*)dev->driver_data);
+}
+
+static void vblk_poll(BlockDevice* dev) {
+    reap((VirtioBlk*)dev->driver_data);
+}
+
+static int vblk_flush(BlockDevice* dev) {
+    VirtioBlk* vb = (VirtioBlk*)dev->driver_data;
+    if (!(vb->features & VIRTIO_BLK_F_FLUSH)) return BLOCK_OK;
+
+    BlockRequest* req = (BlockRequest*)malloc(sizeof(BlockRequest));
+    if (!req) return BLOCK_ERR_NO_MEMORY;
+    kstring::zero_memory(req, sizeof(*req));
+    req->dev = dev;
+    req->status = BLOCK_PENDING;
+
+    for (;;) {
+        spinlock_acquire(&vb->lock);
+        int head = build_chain(vb, VIRTIO_BLK_T_FLUSH, 0, nullptr, 0, false);
+        if (head >= 0) vb->slots[head] = req;
+        spinlock_release(&vb->lock);
+        if (head >= 0) break;
+
+        // Ring full: let in-flight I/O drain
+        reap(vb);
+        scheduler_yield();
+    }
+    notify(vb);
+
+    int status = block_wait(req);
+    free(req);
+    return status;
+}
+
+static const BlockDeviceOps vblk_ops = {
+    vblk_submit,
+    vblk_kick,
+    vblk_poll,
+    vblk_flush,
+};
+
+static void vblk_irq(void* ctx) {
+    VirtioBlk* vb = (VirtioBlk*)ctx;
+
+    // Reading the ISR acknowledges it; 0 means the shared line was not ours
+    uint8_t isr = inb(vb->io_base + VIRTIO_REG_ISR_STATUS);
+    if (!(isr & 1)) return;
+
+    vb->blk.stats.interrupts++;
+    reap(vb);
+}
+
+// ============================================================================
+// Initialization
+// ============================================================================
+
+static bool setup_queue(VirtioBlk* vb) {
+    outw(vb->io_base + VIRTIO_REG_QUEUE_SELECT, 0);
+    uint16_t qsize = inw(vb->io_base + VIRTIO_REG_QUEUE_SIZE);
+    if (qsize == 0 || qsize > VIRTIO_BLK_MAX_QUEUE) {
+        DEBUG_ERROR("virtio-blk: Unsupported queue size %u", qsize);
+        return false;
+    }
+    vb->queue_size = qsize;
+
+    // Legacy layout: descriptors, avail ring, then the used ring on its own page
+    uint64_t avail_offset = 16ULL * qsize;
+    uint64_t used_offset = (avail_offset + 6 + 2ULL * qsize + 0xFFF) & ~0xFFFULL;
+    uint64_t ring_bytes = used_offset + 6 + 8ULL * qsize;
+
+    vb->ring_mem = vmm_alloc_dma((ring_bytes + 0xFFF) / 0x1000);
+    if (!vb->ring_mem.virt) return false;
+    kstring::zero_memory((void*)vb->ring_mem.virt, vb->ring_mem.size);
+
+    vb->desc = (volatile VirtqDesc*)vb->ring_mem.virt;
+    vb->avail = (volatile VirtqAvail*)(vb->ring_mem.virt + avail_offset);
+    vb->used = (volatile VirtqUsed*)(vb->ring_mem.virt + used_offset);
+
+    for (uint16_t i = 0; i < qsize; i++) {
+        vb->desc[i].next = (uint16_t)((i + 1) % qsize);
+    }
+    vb->free_head = 0;
+    vb->num_free = qsize;
+    vb->last_used = 0;
+
+    uint64_t req_bytes = qsize * (sizeof(VirtioBlkReqHeader) + 1);
+    vb->req_mem = vmm_alloc_dma((req_bytes + 0xFFF) / 0x1000);
+    if (!vb->req_mem.virt) return false;
+    vb->headers = (volatile VirtioBlkReqHeader*)vb->req_mem.virt;
+    vb->statuses = (volatile uint8_t*)(vb->req_mem.virt + qsize * sizeof(VirtioBlkReqHeader));
+
+    vb->slots = (BlockRequest**)malloc(qsize * sizeof(BlockRequest*));
+    if (!vb->slots) return false;
+    kstring::zero_memory(vb->slots, qsize * sizeof(BlockRequest*));
+
+    outl(vb->io_base + VIRTIO_REG_QUEUE_ADDRESS, (uint32_t)(vb->ring_mem.phys >> 12));
+    return true;
+}
+
+bool virtio_blk_init() {
+    VirtioBlk* vb = &g_vblk;
+    if (vb->initialized) return true;
+
+    if (!pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_DEV_ID_BLK_LEGACY, &vb->pci)) {
+        DEBUG_INFO("virtio-blk: No device found");
+        return false;
+    }
+    if (pci_bar_is_mmio(&vb->pci, 0)) {
+        DEBUG_WARN("virtio-blk: Legacy I/O BAR not available (modern-only device)");
+        return false;
+    }
+
+    pci_enable_io_space(&vb->pci);
+    pci_enable_bus_mastering(&vb->pci);
+    vb->io_base = (uint16_t)pci_get_bar(&vb->pci, 0, nullptr);
+    spinlock_init(&vb->lock);
+
+    // Reset, then announce ourselves
+    outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS, 0);
+    outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+    uint32_t offered = inl(vb->io_base + VIRTIO_REG_DEVICE_FEATURES);
+    vb->features = offered & (VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX |
+                              VIRTIO_BLK_F_RO | VIRTIO_BLK_F_FLUSH);
+    outl(vb->io_base + VIRTIO_REG_GUEST_FEATURES, vb->features);
+
+    if (!setup_queue(vb)) {
+        DEBUG_ERROR("virtio-blk: Failed to set up virtqueue");
+        outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        return false;
+    }
+
+    uint16_t cfg = vb->io_base + VIRTIO_REG_DEVICE_CONFIG;
+    uint64_t capacity = inl(cfg + VIRTIO_BLK_CFG_CAPACITY) |
+                        ((uint64_t)inl(cfg + VIRTIO_BLK_CFG_CAPACITY + 4) << 32);
+
+    vb->seg_max = VIRTIO_BLK_MAX_SEGMENTS;
+    if (vb->features & VIRTIO_BLK_F_SEG_MAX) {
+        uint32_t seg_max = inl(cfg + VIRTIO_BLK_CFG_SEG_MAX);
+        if (seg_max > 0 && seg_max < vb->seg_max) vb->seg_max = seg_max;
+    }
+    if (vb->seg_max > (uint32_t)vb->queue_size - 2) vb->seg_max = vb->queue_size - 2;
+
+    vb->size_max = 0x400000;
+    if (vb->features & VIRTIO_BLK_F_SIZE_MAX) {
+        uint32_t size_max = inl(cfg + VIRTIO_BLK_CFG_SIZE_MAX);
+        if (size_max >= 0x1000 && size_max < vb->size_max) vb->size_max = size_max;
+    }
+
+    BlockDevice* blk = &vb->blk;
+    kstring::strncpy(blk->name, "vda", sizeof(blk->name) - 1);
+    blk->sector_size = 512;
+    blk->sector_count = capacity;
+    blk->max_segments = vb->seg_max;
+    blk->max_sectors = vb->seg_max * (0x1000 / 512);
+    blk->queue_depth = vb->queue_size / 3;  // Smallest chain is 3 descriptors
+    blk->read_only = (vb->features & VIRTIO_BLK_F_RO) != 0;
+    blk->ops = &vblk_ops;
+    blk->driver_data = vb;
+
+    // INTx if the firmware routed one, otherwise poll and ask for no interrupts
+    if (vb->pci.irq_line < 16 && irq_register_handler(vb->pci.irq_line, vblk_irq, vb)) {
+        pci_enable_interrupts(&vb->pci);
+        blk->irq_driven = true;
+    } else {
+        vb->avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+        blk->irq_driven = false;
+    }
+
+    outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS,
+         VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+    if (!block_register(blk)) {
+        DEBUG_ERROR("virtio-blk: Block device table full");
+        return false;
+    }
+
+    vb->initialized = true;
+    DEBUG_INFO("virtio-blk: %lu MB, queue %u, %u segments/request, %s",
+        (capacity * 512) / (1024 * 1024), vb->queue_size, vb->seg_max,
+        blk->irq_driven ? "IRQ" : "polled");
+    return true;
+}
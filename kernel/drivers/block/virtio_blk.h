@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+
+// ============================================================================
+// virtio-blk (legacy PCI transport)
+// ============================================================================
+// QEMU: -drive file=disk.img,if=virtio,format=raw
+//
+// One split virtqueue, multiple requests in flight, completions by INTx
+// interrupt with polling as fallback. Registered with the block layer as
+// "vda".
+// ============================================================================
+
+#define VIRTIO_VENDOR_ID            0x1AF4
+#define VIRTIO_DEV_ID_BLK_LEGACY    0x1001
+
+// Legacy PCI register layout (I/O BAR0)
+#define VIRTIO_REG_DEVICE_FEATURES  0x00
+#define VIRTIO_REG_GUEST_FEATURES   0x04
+#define VIRTIO_REG_QUEUE_ADDRESS    0x08  // Page frame number of the ring
+#define VIRTIO_REG_QUEUE_SIZE       0x0C
+#define VIRTIO_REG_QUEUE_SELECT     0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY     0x10
+#define VIRTIO_REG_DEVICE_STATUS    0x12
+#define VIRTIO_REG_ISR_STATUS       0x13
+#define VIRTIO_REG_DEVICE_CONFIG    0x14  // Without MSI-X
+
+// virtio-blk device config (offsets from VIRTIO_REG_DEVICE_CONFIG)
+#define VIRTIO_BLK_CFG_CAPACITY     0x00  // uint64_t, 512-byte sectors
+#define VIRTIO_BLK_CFG_SIZE_MAX     0x08
+#define VIRTIO_BLK_CFG_SEG_MAX      0x0C
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE   0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FAILED        0x80
+
+// Feature bits
+#define VIRTIO_BLK_F_SIZE_MAX       (1u << 1)
+#define VIRTIO_BLK_F_SEG_MAX        (1u << 2)
+#define VIRTIO_BLK_F_RO             (1u << 5)
+#define VIRTIO_BLK_F_FLUSH          (1u << 9)
+
+// Request types
+#define VIRTIO_BLK_T_IN             0
+#define VIRTIO_BLK_T_OUT            1
+#define VIRTIO_BLK_T_FLUSH          4
+
+// Request status byte
+#define VIRTIO_BLK_S_OK             0
+#define VIRTIO_BLK_S_IOERR          1
+#define VIRTIO_BLK_S_UNSUPP         2
+
+// Descriptor flags
+#define VIRTQ_DESC_F_NEXT           1
+#define VIRTQ_DESC_F_WRITE          2  // Device writes (read request data, status)
+
+#define VIRTQ_AVAIL_F_NO_INTERRUPT  1
+
+#define VIRTIO_BLK_MAX_QUEUE        1024
+#define VIRTIO_BLK_MAX_SEGMENTS     32  // Data descriptors per request
+
+struct VirtqDesc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed));
+
+struct VirtqAvail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed));
+
+struct VirtqUsedElem {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed));
+
+struct VirtqUsed {
+    uint16_t flags;
+    uint16_t idx;
+    VirtqUsedElem ring[];
+} __attribute__((packed));
+
+struct VirtioBlkReqHeader {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed));
+
+// Probe PCI for a virtio-blk device and register it with the block layer
+bool virtio_blk_init();
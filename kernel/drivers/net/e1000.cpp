@@ -5,10 +5,17 @@
 #include "io.h"
 #include "debug.h"
 #include "heap.h"
+#include "netbuf.h"
+#include "kstring.h"
+#include "spinlock.h"
+#include "irq.h"
 
 // Global e1000 device
 static E1000Device g_e1000;
 
+// Pages holding a descriptor ring (contiguous, up to 64 KB at 4096 entries)
+#define E1000_RING_PAGES(count, desc) (((count) * sizeof(desc) + 4095) / 4096)
+
 // Helper to read/write MMIO registers
 static inline uint32_t e1000_read_reg(uint32_t reg) {
     return *(volatile uint32_t*)(g_e1000.mmio_base + reg);
@@ -85,7 +92,7 @@ static void e1000_read_mac() {
 // Initialize RX descriptors
 static bool e1000_init_rx() {
     // Allocate descriptor ring (aligned to 16 bytes, we use page alignment)
-    void* rx_ring_phys = pmm_alloc_frame();
+    void* rx_ring_phys = pmm_alloc_frames(E1000_RING_PAGES(E1000_NUM_RX_DESC, e1000_rx_desc));
     if (!rx_ring_phys) {
         DEBUG_ERROR("e1000: Failed to allocate RX descriptor ring");
         return false;
@@ -104,16 +111,15 @@ static bool e1000_init_rx() {
         g_e1000.rx_descs[i].special = 0;
     }
     
-    // Allocate RX buffers
+    // Post a netbuf to each descriptor; frames are DMAed straight into them
     for (int i = 0; i < E1000_NUM_RX_DESC; i++) {
-        void* buf_phys = pmm_alloc_frame();
-        if (!buf_phys) {
+        NetBuf* nb = netbuf_alloc(0);
+        if (!nb) {
             DEBUG_ERROR("e1000: Failed to allocate RX buffer %d", i);
             return false;
         }
-        g_e1000.rx_buffers_phys[i] = (uint64_t)buf_phys;
-        g_e1000.rx_buffers[i] = (uint8_t*)vmm_phys_to_virt((uint64_t)buf_phys);
-        g_e1000.rx_descs[i].addr = (uint64_t)buf_phys;
+        g_e1000.rx_bufs[i] = nb;
+        g_e1000.rx_descs[i].addr = netbuf_phys(nb);
     }
     
     // Set up RX descriptor ring
@@ -125,6 +131,9 @@ static bool e1000_init_rx() {
     
     g_e1000.rx_cur = 0;
     
+    // Have the NIC check IPv4 and TCP/UDP checksums of received frames
+    e1000_write_reg(E1000_REG_RXCSUM, E1000_RXCSUM_IPOFLD | E1000_RXCSUM_TUOFLD);
+    
     // Enable receiver
     uint32_t rctl = E1000_RCTL_EN | E1000_RCTL_BAM | E1000_RCTL_BSIZE_2048 | 
                     E1000_RCTL_SECRC | E1000_RCTL_LBM_NONE;
@@ -137,7 +146,7 @@ static bool e1000_init_rx() {
 // Initialize TX descriptors
 static bool e1000_init_tx() {
     // Allocate descriptor ring
-    void* tx_ring_phys = pmm_alloc_frame();
+    void* tx_ring_phys = pmm_alloc_frames(E1000_RING_PAGES(E1000_NUM_TX_DESC, e1000_tx_desc));
     if (!tx_ring_phys) {
         DEBUG_ERROR("e1000: Failed to allocate TX descriptor ring");
         return false;
@@ -164,7 +173,14 @@ static bool e1000_init_tx() {
     e1000_write_reg(E1000_REG_TDH, 0);
     e1000_write_reg(E1000_REG_TDT, 0);
     
+    for (int i = 0; i < E1000_NUM_TX_DESC; i++) {
+        g_e1000.tx_bufs[i] = nullptr;
+    }
     g_e1000.tx_cur = 0;
+    g_e1000.tx_clean = 0;
+    g_e1000.tx_unkicked = 0;
+    g_e1000.tx_plugged = 0;
+    g_e1000.tx_context = 0;
     
     // Set Inter Packet Gap
     // Recommended values: IPGT=10, IPGR1=10, IPGR2=10 (for full duplex)
@@ -180,6 +196,53 @@ static bool e1000_init_tx() {
     return true;
 }
 
+static void e1000_tx_reclaim();
+
+// Interrupt handler. Reading ICR acknowledges every cause; on a shared
+// INTx line a read with none of ours set means another device fired.
+static void e1000_irq(void*) {
+    uint32_t icr = e1000_read_reg(E1000_REG_ICR);
+    if (!(icr & (E1000_ICR_RX | E1000_ICR_TXDW | E1000_ICR_LSC))) return;
+    g_e1000.interrupts++;
+    
+    if (icr & E1000_ICR_TXDW) e1000_tx_reclaim();
+    if (icr & E1000_ICR_LSC) {
+        g_e1000.link_up = (e1000_read_reg(E1000_REG_STATUS) & E1000_STATUS_LU) != 0;
+    }
+    // Frames are handled in task context: mask RX until the poller re-arms
+    if ((icr & E1000_ICR_RX) && g_e1000.rx_notify) {
+        e1000_write_reg(E1000_REG_IMC, E1000_ICR_RX);
+        g_e1000.rx_notify();
+    }
+}
+
+// Interrupt source, best first; causes stay masked until someone listens
+static void e1000_setup_interrupts(PciDevice* nic) {
+    // Moderate with ITR alone rather than the per-packet RX delay timer
+    e1000_write_reg(E1000_REG_ITR, E1000_ITR_VALUE);
+    e1000_write_reg(E1000_REG_RDTR, 0);
+    
+    int msi_irq = irq_alloc_msi(e1000_irq, nullptr);
+    if (msi_irq >= 0) {
+        if (pci_enable_msi(nic, IRQ_VECTOR(msi_irq))) {
+            g_e1000.irq = msi_irq;
+            DEBUG_INFO("e1000: Using MSI (vector %u)", IRQ_VECTOR(msi_irq));
+            return;
+        }
+        irq_free_msi(msi_irq);
+    }
+    
+    if (nic->irq_line < 16 && irq_register_handler(nic->irq_line, e1000_irq, nullptr)) {
+        g_e1000.irq = nic->irq_line;
+        pci_enable_interrupts(nic);
+        DEBUG_INFO("e1000: Using INTx (IRQ %u)", nic->irq_line);
+        return;
+    }
+    
+    g_e1000.irq = -1;
+    DEBUG_WARN("e1000: No interrupt available, polling");
+}
+
 // Find and initialize e1000 device
 bool e1000_init() {
     if (g_e1000.initialized) {
@@ -268,7 +331,7 @@ bool e1000_init() {
         if (!(ctrl & E1000_CTRL_RST)) break;
     }
     
-    // Disable interrupts (we'll use polling)
+    // Disable interrupts until the stack is ready for them
     e1000_write_reg(E1000_REG_IMC, 0xFFFFFFFF);
     e1000_read_reg(E1000_REG_ICR); // Clear pending interrupts
     
@@ -292,6 +355,8 @@ bool e1000_init() {
         return false;
     }
     
+    e1000_setup_interrupts(&nic);
+    
     // Set link up
     ctrl = e1000_read_reg(E1000_REG_CTRL);
     ctrl |= E1000_CTRL_SLU | E1000_CTRL_ASDE;
@@ -319,114 +384,252 @@ bool e1000_init() {
     return true;
 }
 
-// Send a packet
+// Send a packet by copying it into a netbuf
 bool e1000_send(const void* data, uint16_t length) {
-    if (!g_e1000.initialized || !data || length == 0 || length > 1500) {
+    if (!g_e1000.initialized || !data || length == 0 || length > 1514) {
         return false;
     }
     
-    uint32_t cur = g_e1000.tx_cur;
-    e1000_tx_desc* desc = &g_e1000.tx_descs[cur];
-    
-    // Wait for previous transmission to complete (if any)
-    int timeout = 10000;
-    while (!(desc->status & E1000_TXD_STAT_DD) && timeout-- > 0) {
-        for (volatile int i = 0; i < 100; i++);
-    }
-    
-    if (timeout <= 0) {
-        DEBUG_WARN("e1000: TX timeout waiting for descriptor");
+    NetBuf* nb = netbuf_alloc(0);
+    if (!nb) {
+        DEBUG_ERROR("e1000: Failed to allocate TX buffer");
         return false;
     }
+    kstring::memcpy(netbuf_append(nb, length), data, length);
+    return e1000_send_buf(nb);
+}
+
+// Transmit ring: descriptors [tx_clean, tx_cur) belong to the NIC, each
+// holding the netbuf it sends from. Nothing waits for a frame to leave;
+// completed descriptors are reclaimed lazily, at the next send or poll.
+// One descriptor is always left empty, since TDH == TDT means an empty
+// ring to the NIC. Ring state is changed with interrupts off.
+//
+// Frames with checksums to fill in go out on an extended data descriptor,
+// preceded by a context descriptor when the checksum layout differs from
+// the one the NIC last loaded. Context descriptors hold no netbuf; they
+// ask for status too, so reclaim can step over them.
+
+// Release the netbufs of descriptors the NIC has written back
+static void e1000_tx_reclaim() {
+    while (g_e1000.tx_clean != g_e1000.tx_cur) {
+        e1000_tx_desc* desc = &g_e1000.tx_descs[g_e1000.tx_clean];
+        if (!(desc->status & E1000_TXD_STAT_DD)) break;
+        netbuf_release(g_e1000.tx_bufs[g_e1000.tx_clean]);
+        g_e1000.tx_bufs[g_e1000.tx_clean] = nullptr;
+        g_e1000.tx_clean = (g_e1000.tx_clean + 1) % E1000_NUM_TX_DESC;
+    }
+}
+
+// Announce filled descriptors to the NIC
+static void e1000_tx_kick() {
+    if (g_e1000.tx_unkicked == 0) return;
+    e1000_write_reg(E1000_REG_TDT, g_e1000.tx_cur);
+    g_e1000.tx_unkicked = 0;
+}
+
+// Fewer than needed descriptors free
+static bool e1000_tx_full(uint32_t needed) {
+    uint32_t used = (g_e1000.tx_cur + E1000_NUM_TX_DESC - g_e1000.tx_clean) % E1000_NUM_TX_DESC;
+    return E1000_NUM_TX_DESC - 1 - used < needed;
+}
+
+// Checksum layout of an Ethernet + IPv4 frame, packed as the key the
+// loaded context is cached under: IP header end, L4 checksum offset, TCP
+static uint32_t e1000_tx_csum_layout(NetBuf* nb) {
+    if (!(nb->csum & (NETBUF_TX_CSUM_IP | NETBUF_TX_CSUM_TCP | NETBUF_TX_CSUM_UDP))) return 0;
+    if (nb->len < 14 + 20) return 0;
+    const uint8_t* frame = netbuf_data(nb);
+    if (frame[12] != 0x08 || frame[13] != 0x00) return 0;   // Not IPv4
+    
+    uint32_t ipcse = 14 + (frame[14] & 0x0F) * 4 - 1;
+    uint32_t tucso = ipcse + 1;
+    uint32_t tcp = 0;
+    if (nb->csum & NETBUF_TX_CSUM_TCP) {
+        tucso += 16;
+        tcp = 1;
+    } else {
+        tucso += 6;     // UDP, or none (TXSM stays clear then)
+    }
+    return ipcse | (tucso << 8) | (tcp << 16) | (1u << 24);
+}
+
+// Load the checksum layout into the NIC with a context descriptor at tx_cur
+static void e1000_tx_load_context(uint32_t layout) {
+    uint32_t cur = g_e1000.tx_cur;
+    e1000_context_desc* ctx = (e1000_context_desc*)&g_e1000.tx_descs[cur];
+    uint8_t ipcse = layout & 0xFF;
+    uint8_t tucmd = E1000_TUCMD_IP | E1000_TXD_CMD_RS | E1000_TXD_CMD_DEXT;
+    if (layout & (1u << 16)) tucmd |= E1000_TUCMD_TCP;
+    
+    ctx->ipcss = 14;
+    ctx->ipcso = 14 + 10;       // IPv4 header checksum field
+    ctx->ipcse = ipcse;
+    ctx->tucss = ipcse + 1;
+    ctx->tucso = (layout >> 8) & 0xFF;
+    ctx->tucse = 0;
+    ctx->cmd_and_length = ((uint32_t)E1000_TXD_DTYP_CTX << E1000_TXD_DTYP_SHIFT) |
+                          ((uint32_t)tucmd << E1000_TXD_CMD_SHIFT);
+    ctx->status = 0;
+    ctx->hdrlen = 0;
+    ctx->mss = 0;
+    g_e1000.tx_bufs[cur] = nullptr;
     
-    // Allocate buffer for this packet
-    void* tx_buf_phys = pmm_alloc_frame();
-    if (!tx_buf_phys) {
-        DEBUG_ERROR("e1000: Failed to allocate TX buffer");
+    g_e1000.tx_cur = (cur + 1) % E1000_NUM_TX_DESC;
+    g_e1000.tx_unkicked++;
+    g_e1000.tx_context = layout;
+}
+
+bool e1000_send_buf(NetBuf* nb) {
+    if (!nb) return false;
+    if (!g_e1000.initialized || nb->len == 0 || nb->len > 1514) {
+        netbuf_release(nb);
         return false;
     }
     
-    uint8_t* tx_buf = (uint8_t*)vmm_phys_to_virt((uint64_t)tx_buf_phys);
+    uint32_t layout = e1000_tx_csum_layout(nb);
     
-    // Copy data to TX buffer
-    const uint8_t* src = (const uint8_t*)data;
-    for (uint16_t i = 0; i < length; i++) {
-        tx_buf[i] = src[i];
+    uint64_t flags = interrupts_save_disable();
+    e1000_tx_reclaim();
+    // A frame with only the IP checksum to fill in fits any context for
+    // the same IP header length
+    if (layout && !(nb->csum & (NETBUF_TX_CSUM_TCP | NETBUF_TX_CSUM_UDP)) &&
+        (g_e1000.tx_context & 0xFF) == (layout & 0xFF)) {
+        layout = g_e1000.tx_context;
+    }
+    uint32_t needed = (layout && layout != g_e1000.tx_context) ? 2 : 1;
+    
+    // Every descriptor in flight: make sure the NIC knows about them, then
+    // wait for the oldest to complete
+    if (e1000_tx_full(needed)) {
+        e1000_tx_kick();
+        for (uint32_t spin = 0; spin < E1000_TX_WAIT_SPINS && e1000_tx_full(needed); spin++) {
+            asm volatile("pause" ::: "memory");  // The NIC writes status behind our back
+            e1000_tx_reclaim();
+        }
+        if (e1000_tx_full(needed)) {
+            interrupts_restore(flags);
+            DEBUG_WARN("e1000: TX timeout waiting for descriptor");
+            netbuf_release(nb);
+            return false;
+        }
     }
     
-    // Set up descriptor
-    desc->addr = (uint64_t)tx_buf_phys;
-    desc->length = length;
-    desc->cmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS;
-    desc->status = 0;
-    desc->cso = 0;
-    desc->css = 0;
-    desc->special = 0;
+    if (needed == 2) e1000_tx_load_context(layout);
     
-    // Advance tail
-    g_e1000.tx_cur = (cur + 1) % E1000_NUM_TX_DESC;
-    e1000_write_reg(E1000_REG_TDT, g_e1000.tx_cur);
-    
-    // Wait for transmission (with short timeout for debug)
-    timeout = 10000;
-    while (!(desc->status & E1000_TXD_STAT_DD) && timeout-- > 0) {
-        for (volatile int i = 0; i < 100; i++);
+    uint32_t cur = g_e1000.tx_cur;
+    if (layout) {
+        // Extended data descriptor: checksums per the loaded context
+        e1000_data_desc* desc = (e1000_data_desc*)&g_e1000.tx_descs[cur];
+        uint8_t dcmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS | E1000_TXD_CMD_DEXT;
+        desc->addr = netbuf_phys(nb);
+        desc->lower = nb->len | ((uint32_t)E1000_TXD_DTYP_DATA << E1000_TXD_DTYP_SHIFT) |
+                      ((uint32_t)dcmd << E1000_TXD_CMD_SHIFT);
+        desc->status = 0;
+        desc->popts = 0;
+        if (nb->csum & NETBUF_TX_CSUM_IP) desc->popts |= E1000_TXD_POPTS_IXSM;
+        if (nb->csum & (NETBUF_TX_CSUM_TCP | NETBUF_TX_CSUM_UDP)) desc->popts |= E1000_TXD_POPTS_TXSM;
+        desc->special = 0;
+    } else {
+        e1000_tx_desc* desc = &g_e1000.tx_descs[cur];
+        desc->addr = netbuf_phys(nb);
+        desc->length = nb->len;
+        desc->cmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS;
+        desc->status = 0;
+        desc->cso = 0;
+        desc->css = 0;
+        desc->special = 0;
     }
+    g_e1000.tx_bufs[cur] = nb;
     
-    // Free the TX buffer
-    pmm_free_frame(tx_buf_phys);
+    // Advance tail; while plugged, the register write waits for unplug
+    g_e1000.tx_cur = (cur + 1) % E1000_NUM_TX_DESC;
+    g_e1000.tx_unkicked++;
+    if (g_e1000.tx_plugged == 0) e1000_tx_kick();
     
-    return (desc->status & E1000_TXD_STAT_DD) != 0;
+    interrupts_restore(flags);
+    return true;
+}
+
+void e1000_tx_plug() {
+    uint64_t flags = interrupts_save_disable();
+    g_e1000.tx_plugged++;
+    interrupts_restore(flags);
+}
+
+void e1000_tx_unplug() {
+    uint64_t flags = interrupts_save_disable();
+    if (g_e1000.tx_plugged > 0 && --g_e1000.tx_plugged == 0) {
+        e1000_tx_kick();
+    }
+    interrupts_restore(flags);
 }
 
-// Receive a packet (returns length, or 0 if no packet)
-int e1000_receive(void* buffer, uint16_t max_length) {
-    if (!g_e1000.initialized || !buffer) {
+// Receive a batch. The next descriptors are prefetched while the current
+// one is handled, and the frame data is prefetched for the caller, who
+// reads the headers next.
+int e1000_receive_batch(NetBuf** out, int max) {
+    if (!g_e1000.initialized || max <= 0) {
         return 0;
     }
     
+    int count = 0;
     uint32_t cur = g_e1000.rx_cur;
-    e1000_rx_desc* desc = &g_e1000.rx_descs[cur];
-    
-    // Check if descriptor is done
-    if (!(desc->status & E1000_RXD_STAT_DD)) {
-        return 0; // No packet available
-    }
-    
-    // Check for errors
-    if (desc->errors) {
-        DEBUG_WARN("e1000: RX error 0x%02x", desc->errors);
-        // Reset descriptor and continue
+    uint32_t last = E1000_NUM_RX_DESC;   // Last descriptor given back, if any
+    
+    while (count < max) {
+        e1000_rx_desc* desc = &g_e1000.rx_descs[cur];
+        
+        // Check if descriptor is done
+        if (!(desc->status & E1000_RXD_STAT_DD)) {
+            break; // No more packets
+        }
+        asm volatile("" ::: "memory");  // Read the rest only after DD
+        __builtin_prefetch(&g_e1000.rx_descs[(cur + 4) % E1000_NUM_RX_DESC]);
+        
+        // Checksum errors are not fatal: the stack checks those frames itself
+        if (desc->errors & E1000_RXD_ERR_FRAME) {
+            DEBUG_WARN("e1000: RX error 0x%02x", desc->errors);
+            g_e1000.rx_dropped++;
+        } else {
+            // Hand the filled netbuf up and post a fresh one in its place. If
+            // the pool is dry, drop the frame and keep the old buffer posted.
+            NetBuf* fresh = netbuf_alloc(0);
+            if (fresh) {
+                NetBuf* nb = g_e1000.rx_bufs[cur];
+                nb->len = desc->length;
+                if (nb->len > E1000_RX_BUFFER_SIZE) nb->len = E1000_RX_BUFFER_SIZE;
+                nb->csum = 0;
+                if (!(desc->status & E1000_RXD_STAT_IXSM)) {
+                    if ((desc->status & E1000_RXD_STAT_IPCS) && !(desc->errors & E1000_RXD_ERR_IPE)) {
+                        nb->csum |= NETBUF_RX_CSUM_IP;
+                    }
+                    if ((desc->status & E1000_RXD_STAT_TCPCS) && !(desc->errors & E1000_RXD_ERR_TCPE)) {
+                        nb->csum |= NETBUF_RX_CSUM_L4;
+                    }
+                }
+                __builtin_prefetch(nb->page);
+                out[count++] = nb;
+                g_e1000.rx_bufs[cur] = fresh;
+                desc->addr = netbuf_phys(fresh);
+            } else {
+                g_e1000.rx_dropped++;
+            }
+        }
+        
+        // Reset descriptor for reuse
         desc->status = 0;
-        g_e1000.rx_cur = (cur + 1) % E1000_NUM_RX_DESC;
-        e1000_write_reg(E1000_REG_RDT, cur);
-        return 0;
-    }
-    
-    // Get packet length
-    uint16_t length = desc->length;
-    if (length > max_length) {
-        length = max_length;
+        last = cur;
+        cur = (cur + 1) % E1000_NUM_RX_DESC;
     }
     
-    // Copy data
-    uint8_t* src = g_e1000.rx_buffers[cur];
-    uint8_t* dst = (uint8_t*)buffer;
-    for (uint16_t i = 0; i < length; i++) {
-        dst[i] = src[i];
+    // Give the whole batch back to the hardware with one tail write
+    if (last != E1000_NUM_RX_DESC) {
+        g_e1000.rx_cur = cur;
+        e1000_write_reg(E1000_REG_RDT, last);
     }
     
-    // Reset descriptor for reuse
-    desc->status = 0;
-    
-    // Advance to next descriptor
-    uint32_t old_cur = cur;
-    g_e1000.rx_cur = (cur + 1) % E1000_NUM_RX_DESC;
-    
-    // Update tail (give this descriptor back to hardware)
-    e1000_write_reg(E1000_REG_RDT, old_cur);
-    
-    return length;
+    return count;
 }
 
 // Get MAC address
@@ -446,12 +649,45 @@ bool e1000_link_up() {
     return g_e1000.link_up;
 }
 
+bool e1000_has_irq() {
+    return g_e1000.initialized && g_e1000.irq >= 0;
+}
+
+void e1000_set_rx_notify(void (*fn)()) {
+    g_e1000.rx_notify = fn;
+    if (!e1000_has_irq()) return;
+    e1000_write_reg(E1000_REG_IMS, fn ? (E1000_ICR_RX | E1000_ICR_TXDW | E1000_ICR_LSC)
+                                      : (E1000_ICR_TXDW | E1000_ICR_LSC));
+}
+
+// Back to interrupts after polling. Causes raised while masked are still
+// latched in ICR, so a frame that slipped in fires right away.
+void e1000_rx_irq_enable() {
+    if (e1000_has_irq() && g_e1000.rx_notify) {
+        e1000_write_reg(E1000_REG_IMS, E1000_ICR_RX);
+    }
+}
+
+bool e1000_csum_offload() {
+    return g_e1000.initialized;
+}
+
+uint64_t e1000_get_interrupts() {
+    return g_e1000.interrupts;
+}
+
 // Poll for events (for interrupt-less operation)
 void e1000_poll() {
     if (!g_e1000.initialized) return;
     
-    // Read and clear interrupt cause
-    e1000_read_reg(E1000_REG_ICR);
+    // Without an IRQ nobody else reads ICR: clear it here. With one, the
+    // handler owns it. Either way hand back buffers of sent frames and
+    // announce any held back by a plug (someone is waiting on the network).
+    if (g_e1000.irq < 0) e1000_read_reg(E1000_REG_ICR);
+    uint64_t flags = interrupts_save_disable();
+    e1000_tx_reclaim();
+    e1000_tx_kick();
+    interrupts_restore(flags);
 }
 
 // Get device (internal)
@@ -2,6 +2,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+struct NetBuf;
+
 // Intel e1000/e1000e Vendor ID
 #define E1000_VENDOR_ID         0x8086
 
@@ -67,6 +69,7 @@
 #define E1000_REG_EECD      0x0010  // EEPROM Control
 #define E1000_REG_EERD      0x0014  // EEPROM Read
 #define E1000_REG_ICR       0x00C0  // Interrupt Cause Read
+#define E1000_REG_ITR       0x00C4  // Interrupt Throttling
 #define E1000_REG_IMS       0x00D0  // Interrupt Mask Set
 #define E1000_REG_IMC       0x00D8  // Interrupt Mask Clear
 #define E1000_REG_RCTL      0x0100  // Receive Control
@@ -77,11 +80,13 @@
 #define E1000_REG_RDLEN     0x2808  // RX Descriptor Length
 #define E1000_REG_RDH       0x2810  // RX Descriptor Head
 #define E1000_REG_RDT       0x2818  // RX Descriptor Tail
+#define E1000_REG_RDTR      0x2820  // RX Delay Timer
 #define E1000_REG_TDBAL     0x3800  // TX Descriptor Base Low
 #define E1000_REG_TDBAH     0x3804  // TX Descriptor Base High
 #define E1000_REG_TDLEN     0x3808  // TX Descriptor Length
 #define E1000_REG_TDH       0x3810  // TX Descriptor Head
 #define E1000_REG_TDT       0x3818  // TX Descriptor Tail
+#define E1000_REG_RXCSUM    0x5000  // RX Checksum Control
 #define E1000_REG_RAL0      0x5400  // Receive Address Low
 #define E1000_REG_RAH0      0x5404  // Receive Address High
 #define E1000_REG_MTA       0x5200  // Multicast Table Array
@@ -117,17 +122,61 @@
 #define E1000_TCTL_CT_SHIFT 4          // Collision Threshold
 #define E1000_TCTL_COLD_SHIFT 12       // Collision Distance
 
-// TX Descriptor Command bits
+// TX Descriptor Command bits (DCMD of the extended data descriptor too)
 #define E1000_TXD_CMD_EOP   (1 << 0)   // End of Packet
 #define E1000_TXD_CMD_IFCS  (1 << 1)   // Insert FCS
 #define E1000_TXD_CMD_RS    (1 << 3)   // Report Status
+#define E1000_TXD_CMD_DEXT  (1 << 5)   // Extended descriptor
+
+// Extended TX descriptor types (DTYP) and context TUCMD bits
+#define E1000_TXD_DTYP_CTX  0          // Context descriptor
+#define E1000_TXD_DTYP_DATA 1          // Data descriptor
+#define E1000_TXD_DTYP_SHIFT 20
+#define E1000_TXD_CMD_SHIFT 24
+#define E1000_TUCMD_TCP     (1 << 0)   // L4 is TCP (else UDP)
+#define E1000_TUCMD_IP      (1 << 1)   // L3 is IPv4
+
+// Data descriptor POPTS bits
+#define E1000_TXD_POPTS_IXSM (1 << 0)  // Insert IP checksum
+#define E1000_TXD_POPTS_TXSM (1 << 1)  // Insert TCP/UDP checksum
 
 // TX Descriptor Status bits
 #define E1000_TXD_STAT_DD   (1 << 0)   // Descriptor Done
 
+// Interrupt Cause bits (same layout in IMS/IMC)
+#define E1000_ICR_TXDW      (1 << 0)   // Transmit Descriptor Written Back
+#define E1000_ICR_LSC       (1 << 2)   // Link Status Change
+#define E1000_ICR_RXDMT0    (1 << 4)   // RX Descriptors Minimum Threshold
+#define E1000_ICR_RXO       (1 << 6)   // Receiver Overrun
+#define E1000_ICR_RXT0      (1 << 7)   // Receiver Timer Interrupt
+#define E1000_ICR_RX        (E1000_ICR_RXT0 | E1000_ICR_RXDMT0 | E1000_ICR_RXO)
+
+// Interrupt moderation: ITR is the minimum gap between interrupts in
+// 256 ns units. 20000 interrupts/s at most.
+#define E1000_ITR_RATE      20000
+#define E1000_ITR_VALUE     (1000000000 / (E1000_ITR_RATE * 256))
+
 // RX Descriptor Status bits
 #define E1000_RXD_STAT_DD   (1 << 0)   // Descriptor Done
 #define E1000_RXD_STAT_EOP  (1 << 1)   // End of Packet
+#define E1000_RXD_STAT_IXSM (1 << 2)   // Ignore Checksum Indication
+#define E1000_RXD_STAT_TCPCS (1 << 5)  // TCP/UDP Checksum Calculated
+#define E1000_RXD_STAT_IPCS (1 << 6)   // IP Checksum Calculated
+
+// RX Descriptor Error bits
+#define E1000_RXD_ERR_CE    (1 << 0)   // CRC Error
+#define E1000_RXD_ERR_SE    (1 << 1)   // Symbol Error
+#define E1000_RXD_ERR_SEQ   (1 << 2)   // Sequence Error
+#define E1000_RXD_ERR_CXE   (1 << 4)   // Carrier Extension Error
+#define E1000_RXD_ERR_TCPE  (1 << 5)   // TCP/UDP Checksum Error
+#define E1000_RXD_ERR_IPE   (1 << 6)   // IP Checksum Error
+#define E1000_RXD_ERR_RXE   (1 << 7)   // RX Data Error
+#define E1000_RXD_ERR_FRAME (E1000_RXD_ERR_CE | E1000_RXD_ERR_SE | E1000_RXD_ERR_SEQ | \
+                             E1000_RXD_ERR_CXE | E1000_RXD_ERR_RXE)
+
+// RXCSUM bits
+#define E1000_RXCSUM_IPOFLD (1 << 8)   // IP checksum offload
+#define E1000_RXCSUM_TUOFLD (1 << 9)   // TCP/UDP checksum offload
 
 // EEPROM
 #define E1000_EERD_START    (1 << 0)
@@ -135,10 +184,25 @@
 #define E1000_EERD_ADDR_SHIFT 8
 #define E1000_EERD_DATA_SHIFT 16
 
-// Descriptor counts (must be multiple of 8, max 65536)
-#define E1000_NUM_RX_DESC   32
-#define E1000_NUM_TX_DESC   32
+// Descriptor counts: multiples of 8 (the ring length must be a multiple of
+// 128 bytes), at most E1000_MAX_DESC. Override at build time with
+// make E1000_RX_DESC=n E1000_TX_DESC=n. Each RX descriptor keeps a netbuf
+// page posted, so 256 of them pin 1 MB.
+#define E1000_MAX_DESC      4096
+#ifndef E1000_NUM_RX_DESC
+#define E1000_NUM_RX_DESC   256
+#endif
+#ifndef E1000_NUM_TX_DESC
+#define E1000_NUM_TX_DESC   256
+#endif
+#if E1000_NUM_RX_DESC % 8 || E1000_NUM_RX_DESC < 8 || E1000_NUM_RX_DESC > E1000_MAX_DESC
+#error "E1000_NUM_RX_DESC must be a multiple of 8 between 8 and 4096"
+#endif
+#if E1000_NUM_TX_DESC % 8 || E1000_NUM_TX_DESC < 8 || E1000_NUM_TX_DESC > E1000_MAX_DESC
+#error "E1000_NUM_TX_DESC must be a multiple of 8 between 8 and 4096"
+#endif
 #define E1000_RX_BUFFER_SIZE 2048
+#define E1000_TX_WAIT_SPINS 1000000     // Polls of a busy ring before giving up
 
 // TX Descriptor (Legacy)
 struct e1000_tx_desc {
@@ -151,6 +215,30 @@ struct e1000_tx_desc {
     uint16_t special;   // Special field
 } __attribute__((packed));
 
+// TX Context Descriptor: where the checksums of the data descriptors
+// that follow start, end and go. The NIC keeps it until the next one.
+struct e1000_context_desc {
+    uint8_t ipcss;      // IP checksum start
+    uint8_t ipcso;      // IP checksum offset
+    uint16_t ipcse;     // IP checksum end (inclusive)
+    uint8_t tucss;      // TCP/UDP checksum start
+    uint8_t tucso;      // TCP/UDP checksum offset
+    uint16_t tucse;     // TCP/UDP checksum end (0: end of packet)
+    uint32_t cmd_and_length;    // PAYLEN, DTYP, TUCMD
+    uint8_t status;     // Status (same place as in the legacy descriptor)
+    uint8_t hdrlen;     // Header length (segmentation only)
+    uint16_t mss;       // Maximum segment size (segmentation only)
+} __attribute__((packed));
+
+// TX Data Descriptor (Extended)
+struct e1000_data_desc {
+    uint64_t addr;      // Buffer address
+    uint32_t lower;     // Length, DTYP, DCMD
+    uint8_t status;     // Status
+    uint8_t popts;      // Packet options
+    uint16_t special;   // Special field
+} __attribute__((packed));
+
 // RX Descriptor (Legacy)
 struct e1000_rx_desc {
     uint64_t addr;      // Buffer address
@@ -171,11 +259,22 @@ struct E1000Device {
     uint64_t rx_descs_phys;         // Physical address of RX ring
     uint64_t tx_descs_phys;         // Physical address of TX ring
     
-    uint8_t* rx_buffers[E1000_NUM_RX_DESC];  // RX packet buffers
-    uint64_t rx_buffers_phys[E1000_NUM_RX_DESC];
+    NetBuf* rx_bufs[E1000_NUM_RX_DESC];     // Netbufs posted to the RX ring
+    
+    NetBuf* tx_bufs[E1000_NUM_TX_DESC];     // Held until the NIC is done with them
+    
+    uint64_t rx_dropped;            // Frames dropped: RX errors or no netbuf to replace them
     
     uint32_t rx_cur;                // Current RX descriptor
-    uint32_t tx_cur;                // Current TX descriptor
+    uint32_t tx_cur;                // Next free TX descriptor
+    uint32_t tx_clean;              // Oldest TX descriptor not yet reclaimed
+    uint32_t tx_unkicked;           // Descriptors filled since TDT was last written
+    uint32_t tx_plugged;            // Nesting depth of e1000_tx_plug()
+    uint32_t tx_context;            // Checksum context last loaded, 0 if none
+    
+    int irq;                        // MSI IRQ number or PIC line, -1 if polled
+    uint64_t interrupts;
+    void (*rx_notify)();            // Called from the IRQ handler when frames arrive
     
     bool link_up;                   // Link status
     bool initialized;               // Device initialized
@@ -184,7 +283,38 @@ struct E1000Device {
 // Public API
 bool e1000_init();
 bool e1000_send(const void* data, uint16_t length);
-int e1000_receive(void* buffer, uint16_t max_length);
+
+// Queue the frame in nb for DMA from its page and return without waiting
+// for it to go out; consumes the reference. The netbuf is released once
+// the NIC has written the descriptor back, found on a later send or poll.
+// Only waits if all descriptors are in flight.
+bool e1000_send_buf(NetBuf* nb);
+
+// Interrupts. The driver takes MSI if the device has it, else its INTx
+// line; e1000_set_rx_notify() unmasks them. On RX causes the handler masks
+// RX interrupts and calls fn, which should poll the ring until it is empty
+// and then re-arm with e1000_rx_irq_enable(). TX completions and link
+// changes are handled in the IRQ handler itself.
+bool e1000_has_irq();
+void e1000_set_rx_notify(void (*fn)());
+void e1000_rx_irq_enable();
+uint64_t e1000_get_interrupts();
+
+// The NIC computes IPv4 header and TCP/UDP checksums: frames flagged with
+// NETBUF_TX_CSUM_* go out with them filled in, and received frames carry
+// NETBUF_RX_CSUM_* for the checksums it found good
+bool e1000_csum_offload();
+
+// While plugged, queued frames are not announced to the NIC; unplug
+// writes the tail register once for all of them
+void e1000_tx_plug();
+void e1000_tx_unplug();
+
+// Take up to max received frames off the RX ring into out[] and return
+// how many. Each netbuf now belongs to the caller; fresh ones are posted
+// in their place and the NIC is told once, with a single RDT write.
+int e1000_receive_batch(NetBuf** out, int max);
+
 void e1000_get_mac(uint8_t* out_mac);
 bool e1000_link_up();
 void e1000_poll();
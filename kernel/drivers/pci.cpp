@@ -1,5 +1,7 @@
 #include "pci.h"
 #include "io.h"
+#include "lapic.h"
+#include "vmm.h"
 
 // Build PCI config address for Mechanism 1
 static uint32_t pci_make_address(uint8_t bus, uint8_t device, uint8_t func, uint8_t offset) {
@@ -119,6 +121,27 @@ bool pci_find_device_by_class(uint8_t class_code, uint8_t subclass, uint8_t prog
     return false;
 }
 
+// Find a device by vendor/device ID
+bool pci_find_device(uint16_t vendor_id, uint16_t device_id, PciDevice* out) {
+    for (uint16_t bus = 0; bus < PCI_MAX_BUS; bus++) {
+        for (uint8_t dev = 0; dev < PCI_MAX_DEVICE; dev++) {
+            if (!pci_device_exists(bus, dev, 0)) continue;
+
+            uint8_t header_type = pci_config_read8(bus, dev, 0, PCI_HEADER_TYPE);
+            uint8_t max_func = (header_type & 0x80) ? PCI_MAX_FUNC : 1;
+
+            for (uint8_t func = 0; func < max_func; func++) {
+                if (pci_config_read16(bus, dev, func, PCI_VENDOR_ID) != vendor_id) continue;
+                if (pci_config_read16(bus, dev, func, PCI_DEVICE_ID) != device_id) continue;
+
+                pci_enum_function(bus, dev, func, out);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 // Find xHCI controller
 bool pci_find_xhci(PciDevice* out) {
     return pci_find_device_by_class(PCI_CLASS_SERIAL_BUS, PCI_SUBCLASS_USB, PCI_PROGIF_XHCI, out);
@@ -247,6 +270,82 @@ void pci_disable_interrupts(const PciDevice* dev) {
     pci_config_write16(dev->bus, dev->device, dev->function, PCI_COMMAND, cmd);
 }
 
+// Walk the capability list
+uint8_t pci_find_capability(const PciDevice* dev, uint8_t cap_id) {
+    uint16_t status = pci_config_read16(dev->bus, dev->device, dev->function, PCI_STATUS);
+    if (!(status & PCI_STATUS_CAP_LIST)) return 0;
+
+    uint8_t offset = pci_config_read8(dev->bus, dev->device, dev->function, PCI_CAPABILITY_PTR) & 0xFC;
+    for (int guard = 0; offset && guard < 48; guard++) {
+        uint8_t id = pci_config_read8(dev->bus, dev->device, dev->function, offset);
+        if (id == cap_id) return offset;
+        offset = pci_config_read8(dev->bus, dev->device, dev->function, offset + 1) & 0xFC;
+    }
+    return 0;
+}
+
+// Enable MSI with a single message (fixed delivery to the boot CPU)
+bool pci_enable_msi(const PciDevice* dev, uint8_t vector) {
+    if (!lapic_available()) return false;
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_ID_MSI);
+    if (!cap) return false;
+
+    uint16_t ctrl = pci_config_read16(dev->bus, dev->device, dev->function, cap + 2);
+    uint32_t address = MSI_ADDRESS_BASE | (lapic_id() << 12);
+
+    pci_config_write32(dev->bus, dev->device, dev->function, cap + 4, address);
+    if (ctrl & PCI_MSI_CTRL_64BIT) {
+        pci_config_write32(dev->bus, dev->device, dev->function, cap + 8, 0);
+        pci_config_write16(dev->bus, dev->device, dev->function, cap + 12, vector);
+    } else {
+        pci_config_write16(dev->bus, dev->device, dev->function, cap + 8, vector);
+    }
+
+    // One message (MME = 0), then enable
+    ctrl &= ~(0x7 << 4);
+    ctrl |= PCI_MSI_CTRL_ENABLE;
+    pci_config_write16(dev->bus, dev->device, dev->function, cap + 2, ctrl);
+    pci_disable_interrupts(dev);
+    return true;
+}
+
+// Program one MSI-X table entry and enable MSI-X
+bool pci_enable_msix(const PciDevice* dev, uint16_t entry, uint8_t vector) {
+    if (!lapic_available()) return false;
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_ID_MSIX);
+    if (!cap) return false;
+
+    uint16_t ctrl = pci_config_read16(dev->bus, dev->device, dev->function, cap + 2);
+    uint16_t table_size = (ctrl & 0x7FF) + 1;
+    if (entry >= table_size) return false;
+
+    uint32_t table = pci_config_read32(dev->bus, dev->device, dev->function, cap + 4);
+    int bir = table & 0x7;
+    uint64_t bar = pci_get_bar(dev, bir, nullptr);
+    if (!bar || !pci_bar_is_mmio(dev, bir)) return false;
+
+    uint64_t table_phys = bar + (table & ~0x7u);
+    uint64_t entry_phys = table_phys + entry * PCI_MSIX_ENTRY_SIZE;
+    uint64_t page = entry_phys & ~0xFFFULL;
+    uint64_t virt = vmm_map_mmio(page, 0x1000);
+    if (!virt) return false;
+    volatile uint8_t* slot = (volatile uint8_t*)(virt + (entry_phys - page));
+
+    // Function-mask while programming, as the spec requires
+    pci_config_write16(dev->bus, dev->device, dev->function, cap + 2,
+                       ctrl | PCI_MSIX_CTRL_ENABLE | PCI_MSIX_CTRL_MASK_ALL);
+
+    mmio_write32(slot + 0, MSI_ADDRESS_BASE | (lapic_id() << 12));
+    mmio_write32(slot + 4, 0);
+    mmio_write32(slot + 8, vector);
+    mmio_write32(slot + 12, 0);  // Unmask this vector
+
+    ctrl = (ctrl | PCI_MSIX_CTRL_ENABLE) & ~PCI_MSIX_CTRL_MASK_ALL;
+    pci_config_write16(dev->bus, dev->device, dev->function, cap + 2, ctrl);
+    pci_disable_interrupts(dev);
+    return true;
+}
+
 // Initialize PCI subsystem (currently just a placeholder for future enumeration caching)
 void pci_init() {
     // No initialization needed for now - enumeration is done on-demand
@@ -27,6 +27,22 @@
 #define PCI_INTERRUPT_LINE  0x3C
 #define PCI_INTERRUPT_PIN   0x3D
 
+#define PCI_CAPABILITY_PTR  0x34
+
+// PCI Status register bits
+#define PCI_STATUS_CAP_LIST     (1 << 4)
+
+// Capability IDs
+#define PCI_CAP_ID_MSI          0x05
+#define PCI_CAP_ID_MSIX         0x11
+
+// MSI / MSI-X capability layout
+#define PCI_MSI_CTRL_ENABLE     (1 << 0)
+#define PCI_MSI_CTRL_64BIT      (1 << 7)
+#define PCI_MSIX_CTRL_MASK_ALL  (1 << 14)
+#define PCI_MSIX_CTRL_ENABLE    (1 << 15)
+#define PCI_MSIX_ENTRY_SIZE     16
+
 // PCI Command register bits
 #define PCI_COMMAND_IO          (1 << 0)
 #define PCI_COMMAND_MEMORY      (1 << 1)
@@ -41,6 +57,10 @@
 #define PCI_SUBCLASS_AC97       0x01
 #define PCI_SUBCLASS_HDA        0x03
 
+#define PCI_CLASS_STORAGE       0x01
+#define PCI_SUBCLASS_SATA       0x06
+#define PCI_SUBCLASS_NVM        0x08
+
 #define PCI_PROGIF_UHCI         0x00
 #define PCI_PROGIF_OHCI         0x10
 #define PCI_PROGIF_EHCI         0x20
@@ -86,6 +106,7 @@ void pci_config_write8(uint8_t bus, uint8_t device, uint8_t func, uint8_t offset
 // Device discovery
 bool pci_find_device_by_class(uint8_t class_code, uint8_t subclass, PciDevice* out);
 bool pci_find_device_by_class(uint8_t class_code, uint8_t subclass, uint8_t prog_if, PciDevice* out);
+bool pci_find_device(uint16_t vendor_id, uint16_t device_id, PciDevice* out);
 bool pci_find_xhci(PciDevice* out);
 bool pci_find_ac97(PciDevice* out);
 bool pci_find_hda(PciDevice* out);
@@ -101,3 +122,11 @@ void pci_enable_memory_space(const PciDevice* dev);
 void pci_enable_io_space(const PciDevice* dev);
 void pci_enable_interrupts(const PciDevice* dev);
 void pci_disable_interrupts(const PciDevice* dev);
+
+// Capabilities / message-signalled interrupts
+// Offset of a capability in config space, or 0 if the device lacks it
+uint8_t pci_find_capability(const PciDevice* dev, uint8_t cap_id);
+// Route MSI (or MSI-X table entry) to a local APIC vector and enable it.
+// INTx is disabled on success.
+bool pci_enable_msi(const PciDevice* dev, uint8_t vector);
+bool pci_enable_msix(const PciDevice* dev, uint16_t entry, uint8_t vector);
@@ -9,7 +9,7 @@
 #include "ac97.h"
 #include "wav.h"
 #include "debug.h"
-#include "unifs.h"
+#include "vfs.h"
 #include "pmm.h"
 #include "vmm.h"
 #include "io.h"
@@ -19,6 +19,8 @@ using kstring::memcpy;
 
 static Ac97Device ac97_info;
 
+static bool ac97_start(uint8_t* data, VfsFile* file, uint64_t file_offset, uint32_t size);
+
 bool ac97_is_initialized() {
     return ac97_info.is_initialized;
 }
@@ -131,6 +133,19 @@ void ac97_reset() {
 
     ac97_info.played_bytes = 0;
 
+    // Let refills in flight finish: they write into the sound buffer and read the file.
+    for (uint32_t i = 0; i < AC97_BUFFER_ENTRY_COUNT; i++) {
+        if (ac97_info.refills[i].file && !ac97_info.refills[i].done) {
+            vfs_io_wait(&ac97_info.refills[i]);
+        }
+        ac97_info.refills[i].file = nullptr;
+    }
+
+    if (ac97_info.sound_file) {
+        vfs_file_close(ac97_info.sound_file);
+        ac97_info.sound_file = nullptr;
+    }
+
     // Clean buffer entries and sound buffer.
     memset((void*)ac97_info.buffer_entries_dma.virt, 0, ac97_info.buffer_entries_dma.size);
     memset((void*)ac97_info.sound_buffers_dma.virt, 0, ac97_info.sound_buffers_dma.size);
@@ -189,21 +204,24 @@ void ac97_play_wav_file(const char* filename) {
 
     DEBUG_INFO("trying to play %s", filename);
 
-    uint8_t* data_ptr;
+    WavHeader wav;
+    uint64_t data_offset;
     uint32_t data_size;
 
     // Try to open WAV file.
-    WavHeader* wav = wav_open(filename, &data_ptr, &data_size);
-    if (!wav) {
+    VfsFile* file = wav_open(filename, &wav, &data_offset, &data_size);
+    if (!file) {
         DEBUG_ERROR("wav_open failed");
         return;
     }
 
     // Set sample rate to one retrieved from WAV header.
-    ac97_set_sample_rate(wav->samples);
+    ac97_set_sample_rate(wav.samples);
 
-    // Play it!
-    ac97_play(data_ptr, data_size);
+    // Play it! Samples are streamed from the file.
+    if (!ac97_start(nullptr, file, data_offset, data_size)) {
+        vfs_file_close(file);
+    }
 }
 
 // Play raw .pcm audio file.
@@ -215,33 +233,89 @@ void ac97_play_pcm_file(const char* filename) {
 
     DEBUG_INFO("trying to play %s", filename);
 
-    UniFSFile file;
-    if (!unifs_open_into(filename, &file)) {
-        DEBUG_ERROR("unifs_open_into failed");
+    VfsFile* file = vfs_file_open(filename);
+    if (!file) {
+        DEBUG_ERROR("vfs_file_open failed");
         return;
     }
 
-    uint8_t* data_ptr = (uint8_t*)(uint64_t)file.data;
-    uint32_t data_size = file.size;
+    uint64_t file_size = vfs_file_size(file);
+    uint32_t data_size = file_size > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)file_size;
 
     // FIXME: hard-coded sample rate value for ffmpeg .pcm files.
     ac97_set_sample_rate(22050);
 
-    // Play it!
-    ac97_play(data_ptr, data_size);
+    // Play it! Samples are streamed from the file.
+    if (!ac97_start(nullptr, file, 0, data_size)) {
+        vfs_file_close(file);
+    }
 }
 
 // Play PCM byte array.
 void ac97_play(uint8_t* data, uint32_t size) {
+    ac97_start(data, nullptr, 0, size);
+}
+
+// Zero what a short read (end of file, I/O error) left unfilled.
+static void ac97_refill_done(VfsIoRequest* req) {
+    uint64_t got = req->result > 0 ? (uint64_t)req->result : 0;
+    if (got < req->length) {
+        memset((uint8_t*)req->buffer + got, 0, req->length - got);
+    }
+}
+
+// Refill one buffer entry with sound data starting at src_offset. From a file,
+// the read is queued and completes in the background while earlier entries play.
+static void ac97_fill_entry(uint32_t entry, uint32_t src_offset) {
+    uint8_t* dst = (uint8_t*)(ac97_info.sound_buffers_dma.virt + (AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE * entry));
+
+    // Bounds-check before copying
+    uint32_t copy_len = 0;
+    if (src_offset < ac97_info.sound_data_size) {
+        uint32_t avail = ac97_info.sound_data_size - src_offset;
+        copy_len = (avail < AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE) ? avail : AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE;
+    }
+
+    if (ac97_info.sound_file && copy_len > 0) {
+        VfsIoRequest* req = &ac97_info.refills[entry];
+        if (req->file && !req->done) {
+            DEBUG_WARN("refill of buffer entry %d is still in flight", entry);
+            return;
+        }
+        if (copy_len < AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE) {
+            memset(dst + copy_len, 0, AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE - copy_len);
+        }
+        req->file = ac97_info.sound_file;
+        req->offset = ac97_info.sound_file_offset + src_offset;
+        req->buffer = dst;
+        req->length = copy_len;
+        req->complete = ac97_refill_done;
+        req->ctx = nullptr;
+        vfs_submit_read(req);
+        return;
+    }
+
+    if (copy_len > 0) {
+        memcpy(dst, ac97_info.sound_data + src_offset, copy_len);
+    }
+    // Zero remainder if partial (or the whole buffer past the end of data)
+    if (copy_len < AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE) {
+        memset(dst + copy_len, 0, AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE - copy_len);
+    }
+}
+
+// Start playback of size bytes from data, or from file at file_offset. The
+// file is owned by the driver from here until playback stops.
+static bool ac97_start(uint8_t* data, VfsFile* file, uint64_t file_offset, uint32_t size) {
     if (!ac97_info.is_initialized) {
         DEBUG_ERROR("ac97 device is not initialized");
-        return;
+        return false;
     }
 
     // Do not play if sound card is already busy. In future we may add sound mixing.
     if (ac97_info.is_playing) {
         DEBUG_WARN("already playing! stop current playback before playing next sound");
-        return;
+        return false;
     }
 
     // Reset stream.
@@ -262,10 +336,18 @@ void ac97_play(uint8_t* data, uint32_t size) {
     // Set sound data source.
     ac97_info.sound_data = data;
     ac97_info.sound_data_size = size;
+    ac97_info.sound_file = file;
+    ac97_info.sound_file_offset = file_offset;
 
     // Copy new buffer data (bounded to avoid reading past source)
     size_t copy_size = (size < ac97_info.sound_buffers_dma.size) ? size : ac97_info.sound_buffers_dma.size;
-    memcpy((void*)ac97_info.sound_buffers_dma.virt, data, copy_size);
+    if (file) {
+        // The first pass is read up front; later refills are asynchronous.
+        int64_t got = vfs_file_read(file, file_offset, (void*)ac97_info.sound_buffers_dma.virt, copy_size);
+        copy_size = got > 0 ? (size_t)got : 0;
+    } else {
+        memcpy((void*)ac97_info.sound_buffers_dma.virt, data, copy_size);
+    }
     // Zero remaining buffer if source was smaller
     if (copy_size < ac97_info.sound_buffers_dma.size) {
         memset((void*)(ac97_info.sound_buffers_dma.virt + copy_size), 0, ac97_info.sound_buffers_dma.size - copy_size);
@@ -297,6 +379,8 @@ void ac97_play(uint8_t* data, uint32_t size) {
     // Let everyone know audio is playing.
     ac97_info.is_paused = false;
     ac97_info.is_playing = true;
+
+    return true;
 }
 
 // Resume playback if we played something before.
@@ -398,40 +482,12 @@ void ac97_poll() {
         ac97_info.current_buffer_entry = 0;
         ac97_info.buffer_entry_offset++;
 
-        // Calculate source offset and bounds-check before copying
-        uint32_t src_offset = AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE * (AC97_BUFFER_ENTRY_COUNT * ac97_info.buffer_entry_offset + (AC97_BUFFER_ENTRY_COUNT - 1));
-        void* dst = (void*)(ac97_info.sound_buffers_dma.virt + (AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE * (AC97_BUFFER_ENTRY_COUNT - 1)));
-        if (src_offset < ac97_info.sound_data_size) {
-            uint32_t avail = ac97_info.sound_data_size - src_offset;
-            uint32_t copy_len = (avail < AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE) ? avail : AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE;
-            memcpy(dst, ac97_info.sound_data + src_offset, copy_len);
-            // Zero remainder if partial
-            if (copy_len < AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE) {
-                memset((void*)((uint8_t*)dst + copy_len), 0, AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE - copy_len);
-            }
-        } else {
-            // Past end of data, zero the buffer
-            memset(dst, 0, AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE);
-        }
+        ac97_fill_entry(AC97_BUFFER_ENTRY_COUNT - 1, AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE * (AC97_BUFFER_ENTRY_COUNT * ac97_info.buffer_entry_offset + (AC97_BUFFER_ENTRY_COUNT - 1)));
     }
 
     // Refill previous buffer with fresh data.
     if (stream_pos > (AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE * (ac97_info.current_buffer_entry + 1))) {
-        // Calculate source offset and bounds-check before copying
-        uint32_t src_offset = AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE * (AC97_BUFFER_ENTRY_COUNT * (ac97_info.buffer_entry_offset + 1) + ac97_info.current_buffer_entry);
-        void* dst = (void*)(ac97_info.sound_buffers_dma.virt + (AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE * ac97_info.current_buffer_entry));
-        if (src_offset < ac97_info.sound_data_size) {
-            uint32_t avail = ac97_info.sound_data_size - src_offset;
-            uint32_t copy_len = (avail < AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE) ? avail : AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE;
-            memcpy(dst, ac97_info.sound_data + src_offset, copy_len);
-            // Zero remainder if partial
-            if (copy_len < AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE) {
-                memset((void*)((uint8_t*)dst + copy_len), 0, AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE - copy_len);
-            }
-        } else {
-            // Past end of data, zero the buffer
-            memset(dst, 0, AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE);
-        }
+        ac97_fill_entry(ac97_info.current_buffer_entry, AC97_BUFFER_ENTRY_SOUND_BUFFER_SIZE * (AC97_BUFFER_ENTRY_COUNT * (ac97_info.buffer_entry_offset + 1) + ac97_info.current_buffer_entry));
 
         // Now we can move to next entry.
         ac97_info.current_buffer_entry++;
@@ -4,6 +4,7 @@
 
 #include "pci.h"
 #include "vmm.h"
+#include "vfs.h"
 
 // NAM registers.
 #define AC97_NAM_RESET 0x00
@@ -74,9 +75,14 @@ struct Ac97Device {
 
     Ac97BufferEntry* buffer_entries; // Buffer entries array (should be virtual address of DMA allocation for buffer entries)
 
-    uint8_t* sound_data; // Byte array of entire PCM sound data (virtual address from filesystem!).
+    uint8_t* sound_data; // Byte array of entire PCM sound data, or nullptr when streaming from sound_file.
     uint32_t sound_data_size; // Size of entire PCM sound data.
 
+    // Streaming from a file.
+    VfsFile* sound_file; // Open file the sound data is read from (owned while playing).
+    uint64_t sound_file_offset; // File offset of the first sample.
+    VfsIoRequest refills[AC97_BUFFER_ENTRY_COUNT]; // Asynchronous buffer refills, one per buffer entry.
+
     // Buffer refilling.
     uint32_t current_buffer_entry; // Current buffer entry for refilling.
     uint32_t buffer_entry_offset; // Buffers offset (how many times sound card went back to first buffer since playback start).
@@ -2,6 +2,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+struct VfsFile;
+
 struct __attribute__((packed)) WavHeader {
     /* RIFF Chunk Descriptor */
     uint8_t         riff[4];        // RIFF Header Magic header
@@ -23,4 +25,6 @@ struct __attribute__((packed)) WavHeader {
     uint8_t         data_;          // First byte of audio data (for pointer math)
 };
 
-WavHeader* wav_open(const char* filename, uint8_t** data, uint32_t* data_size);
+// Open a WAV file and check its header. Returns the open file (close it
+// with vfs_file_close) with the samples at *data_offset, or nullptr.
+VfsFile* wav_open(const char* filename, WavHeader* header, uint64_t* data_offset, uint32_t* data_size);
@@ -4,6 +4,7 @@
 
 static volatile uint64_t ticks = 0;
 static uint32_t tick_frequency = 0;
+static uint64_t tsc_khz = 0;
 
 void timer_init(uint32_t frequency) {
     tick_frequency = frequency;
@@ -43,3 +44,23 @@ void sleep(uint32_t ms) {
         asm("hlt");
     }
 }
+
+uint64_t timer_get_tsc_khz() {
+    if (tsc_khz || tick_frequency == 0) return tsc_khz;
+
+    uint64_t flags;
+    asm volatile("pushfq; pop %0" : "=r"(flags));
+    if (!(flags & 0x200)) return 0;
+
+    // Count TSC cycles across 50 timer ticks, starting on a tick edge
+    const uint64_t sample_ticks = 50;
+    uint64_t start_tick = ticks;
+    while (ticks == start_tick) asm volatile("pause");
+    start_tick = ticks;
+    uint64_t start_tsc = rdtsc();
+    while (ticks - start_tick < sample_ticks) asm volatile("pause");
+    uint64_t cycles = rdtsc() - start_tsc;
+
+    tsc_khz = cycles * tick_frequency / (sample_ticks * 1000);
+    return tsc_khz;
+}
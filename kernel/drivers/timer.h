@@ -9,3 +9,14 @@ uint64_t timer_get_ticks();
 uint32_t timer_get_frequency();
 void timer_handler();
 void sleep(uint32_t ms);
+
+// Time-stamp counter, for sub-millisecond measurements
+static inline uint64_t rdtsc() {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+// TSC frequency in kHz, calibrated against the PIT on first use
+// (needs interrupts enabled; returns 0 if they are not)
+uint64_t timer_get_tsc_khz();
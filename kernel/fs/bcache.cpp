@@ -0,0 +1,575 @@
+#include "bcache.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "heap.h"
+#include "timer.h"
+#include "scheduler.h"
+#include "spinlock.h"
+#include "kstring.h"
+#include "debug.h"
+
+static Buffer* hash_table[BCACHE_HASH_BUCKETS];
+static Buffer* lru_head = nullptr;
+static Buffer* lru_tail = nullptr;
+static Buffer* dirty_head = nullptr;
+static Buffer* dirty_tail = nullptr;
+static Buffer* spare_heads = nullptr;   // Buffer structs without a frame
+static Spinlock bcache_lock = SPINLOCK_INIT;
+
+static uint64_t max_buffers = 0;
+static uint64_t buffer_count = 0;
+static uint64_t dirty_count = 0;
+static uint64_t stat_hits = 0;
+static uint64_t stat_misses = 0;
+static uint64_t stat_coalesced = 0;
+static uint64_t stat_writebacks = 0;
+static uint64_t stat_evictions = 0;
+static uint64_t stat_reclaimed = 0;
+static uint64_t stat_errors = 0;
+
+// ============================================================================
+// Lists (called with bcache_lock held)
+// ============================================================================
+
+static inline uint32_t hash_index(const BlockDevice* dev, uint64_t block) {
+    uint64_t key = block ^ ((uint64_t)dev >> 4);
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) % BCACHE_HASH_BUCKETS;
+}
+
+static Buffer* hash_find(const BlockDevice* dev, uint64_t block) {
+    for (Buffer* b = hash_table[hash_index(dev, block)]; b; b = b->hash_next) {
+        if (b->dev == dev && b->block == block) return b;
+    }
+    return nullptr;
+}
+
+static void hash_insert(Buffer* b) {
+    uint32_t idx = hash_index(b->dev, b->block);
+    b->hash_next = hash_table[idx];
+    hash_table[idx] = b;
+}
+
+static void hash_remove(Buffer* b) {
+    Buffer** link = &hash_table[hash_index(b->dev, b->block)];
+    while (*link && *link != b) link = &(*link)->hash_next;
+    if (*link) *link = b->hash_next;
+    b->hash_next = nullptr;
+}
+
+static void lru_remove(Buffer* b) {
+    if (b->lru_prev) b->lru_prev->lru_next = b->lru_next; else lru_head = b->lru_next;
+    if (b->lru_next) b->lru_next->lru_prev = b->lru_prev; else lru_tail = b->lru_prev;
+    b->lru_prev = b->lru_next = nullptr;
+}
+
+static void lru_append(Buffer* b) {
+    b->lru_prev = lru_tail;
+    b->lru_next = nullptr;
+    if (lru_tail) lru_tail->lru_next = b; else lru_head = b;
+    lru_tail = b;
+}
+
+static void dirty_remove(Buffer* b) {
+    if (b->dirty_prev) b->dirty_prev->dirty_next = b->dirty_next; else dirty_head = b->dirty_next;
+    if (b->dirty_next) b->dirty_next->dirty_prev = b->dirty_prev; else dirty_tail = b->dirty_prev;
+    b->dirty_prev = b->dirty_next = nullptr;
+    b->flags &= ~BUF_DIRTY;
+    dirty_count--;
+}
+
+static void dirty_append(Buffer* b) {
+    b->flags |= BUF_DIRTY;
+    b->dirty_since = timer_get_ticks();
+    b->dirty_prev = dirty_tail;
+    b->dirty_next = nullptr;
+    if (dirty_tail) dirty_tail->dirty_next = b; else dirty_head = b;
+    dirty_tail = b;
+    dirty_count++;
+}
+
+// ============================================================================
+// Allocation / Eviction (called with bcache_lock held)
+// ============================================================================
+
+static inline bool is_idle(const Buffer* b) {
+    return b->refcount == 0 && !(b->flags & (BUF_DIRTY | BUF_IO));
+}
+
+// Unhook the least recently used idle buffer; it keeps its frame
+static Buffer* evict_one() {
+    for (Buffer* b = lru_head; b; b = b->lru_next) {
+        if (!is_idle(b)) continue;
+        hash_remove(b);
+        lru_remove(b);
+        buffer_count--;
+        stat_evictions++;
+        return b;
+    }
+    return nullptr;
+}
+
+static void free_buffer(Buffer* b) {
+    pmm_free_frame((void*)((uint64_t)b->data - vmm_get_hhdm_offset()));
+    b->data = nullptr;
+    b->hash_next = spare_heads;
+    spare_heads = b;
+}
+
+// New frame while below the limit, otherwise recycle the LRU buffer
+static Buffer* alloc_buffer() {
+    if (buffer_count < max_buffers) {
+        Buffer* b = spare_heads;
+        if (b) {
+            spare_heads = b->hash_next;
+        } else {
+            b = (Buffer*)malloc(sizeof(Buffer));
+        }
+        if (b) {
+            void* frame = pmm_alloc_frame();
+            if (frame) {
+                b->data = (uint8_t*)vmm_phys_to_virt((uint64_t)frame);
+                return b;
+            }
+            b->hash_next = spare_heads;
+            spare_heads = b;
+        }
+    }
+    return evict_one();
+}
+
+// Referenced buffer for (dev, block), created empty if not cached
+static Buffer* lookup(BlockDevice* dev, uint64_t block, bool* hit) {
+    Buffer* b = hash_find(dev, block);
+    if (b) {
+        stat_hits++;
+        lru_remove(b);
+        lru_append(b);
+        b->refcount++;
+        *hit = true;
+        return b;
+    }
+
+    stat_misses++;
+    *hit = false;
+    b = alloc_buffer();
+    if (!b) return nullptr;
+
+    uint8_t* data = b->data;
+    kstring::zero_memory(b, sizeof(*b));
+    b->data = data;
+    b->dev = dev;
+    b->block = block;
+    b->refcount = 1;
+    hash_insert(b);
+    lru_append(b);
+    buffer_count++;
+    return b;
+}
+
+// ============================================================================
+// I/O
+// ============================================================================
+
+// Completion callback (IRQ context). Every I/O holds a buffer reference.
+static void io_done(BlockRequest* req) {
+    Buffer* b = (Buffer*)req->ctx;
+
+    spinlock_acquire(&bcache_lock);
+    if (req->status == BLOCK_OK) {
+        if (req->write) {
+            stat_writebacks++;
+        } else {
+            b->flags |= BUF_VALID;
+        }
+    } else {
+        b->flags |= BUF_ERROR;
+        stat_errors++;
+        // Keep failed writes dirty so the data is not silently dropped
+        if (req->write && !(b->flags & (BUF_DIRTY | BUF_PINNED))) dirty_append(b);
+    }
+    b->flags &= ~BUF_IO;
+    b->refcount--;
+    spinlock_release(&bcache_lock);
+}
+
+// Mark a buffer busy for I/O. Called with bcache_lock held
+static void begin_io(Buffer* b) {
+    b->flags = (b->flags | BUF_IO) & ~BUF_ERROR;
+    b->refcount++;
+}
+
+static void submit_io(Buffer* b, bool write) {
+    BlockDevice* dev = b->dev;
+    uint32_t per_block = BCACHE_BLOCK_SIZE / dev->sector_size;
+
+    BlockRequest* req = &b->req;
+    kstring::zero_memory(req, sizeof(*req));
+    req->dev = dev;
+    req->lba = b->block * per_block;
+    req->count = per_block;
+    req->write = write;
+    req->buffer = b->data;
+    req->complete = io_done;
+    req->ctx = b;
+
+    if (!block_submit(req)) io_done(req);  // Status already holds the error
+}
+
+static void wait_io(Buffer* b) {
+    BlockDevice* dev = b->dev;
+    while (b->flags & BUF_IO) {
+        // Same rule as block_wait(): no interrupts means nobody else reaps
+        if ((!dev->irq_driven || !interrupts_enabled()) && dev->ops->poll) {
+            dev->ops->poll(dev);
+            if (!(b->flags & BUF_IO)) break;
+        }
+        scheduler_yield();
+    }
+}
+
+static bool block_less(const Buffer* a, const Buffer* b) {
+    if (a->dev != b->dev) return (uint64_t)a->dev < (uint64_t)b->dev;
+    return a->block < b->block;
+}
+
+static void sort_buffers(Buffer** bufs, int n) {
+    for (int i = 1; i < n; i++) {
+        Buffer* b = bufs[i];
+        int j = i - 1;
+        while (j >= 0 && block_less(b, bufs[j])) {
+            bufs[j + 1] = bufs[j];
+            j--;
+        }
+        bufs[j + 1] = b;
+    }
+}
+
+// Take dirty buffers off the dirty list for writing. Without `all`, only
+// expired ones (unless over the dirty limit). Sorted by (device, block) so
+// the block layer can merge neighbours. Called with bcache_lock held.
+static int collect_dirty(BlockDevice* dev, bool all, Buffer** out, int max) {
+    uint64_t expire = (uint64_t)BCACHE_DIRTY_EXPIRE_MS * timer_get_frequency() / 1000;
+    uint64_t now = timer_get_ticks();
+    if (dirty_count > max_buffers * BCACHE_DIRTY_LIMIT_PERCENT / 100) all = true;
+
+    int n = 0;
+    Buffer* next;
+    for (Buffer* b = dirty_head; b && n < max; b = next) {
+        next = b->dirty_next;
+        if (dev && b->dev != dev) continue;
+        if (b->flags & BUF_IO) continue;
+        if (!all && now - b->dirty_since < expire) break;  // Oldest first
+
+        dirty_remove(b);
+        begin_io(b);
+        out[n++] = b;
+    }
+
+    sort_buffers(out, n);
+    return n;
+}
+
+// One plug per device so sorted neighbours go out as merged commands
+static void submit_writes(Buffer** bufs, int n) {
+    BlockDevice* plugged = nullptr;
+    for (int i = 0; i < n; i++) {
+        if (bufs[i]->dev != plugged) {
+            if (plugged) block_unplug(plugged);
+            plugged = bufs[i]->dev;
+            block_plug(plugged);
+        }
+        submit_io(bufs[i], true);
+    }
+    if (plugged) block_unplug(plugged);
+}
+
+static void flusher_entry() {
+    Buffer* batch[BCACHE_WRITEBACK_BATCH];
+    for (;;) {
+        scheduler_sleep_ms(BCACHE_FLUSH_INTERVAL_MS);
+
+        int n;
+        do {
+            spinlock_acquire(&bcache_lock);
+            n = collect_dirty(nullptr, false, batch, BCACHE_WRITEBACK_BATCH);
+            spinlock_release(&bcache_lock);
+            submit_writes(batch, n);
+        } while (n == BCACHE_WRITEBACK_BATCH);
+    }
+}
+
+// Memory pressure: give back frames of idle clean buffers. May run from
+// inside an allocation made with bcache_lock held, hence the trylock.
+static uint64_t bcache_reclaim(uint64_t pages) {
+    if (!spinlock_try_acquire(&bcache_lock)) return 0;
+    uint64_t freed = 0;
+    while (freed < pages) {
+        Buffer* b = evict_one();
+        if (!b) break;
+        free_buffer(b);
+        freed++;
+    }
+    stat_reclaimed += freed;
+    spinlock_release(&bcache_lock);
+    return freed;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void bcache_init() {
+    max_buffers = pmm_get_total_memory() / 100 * BCACHE_MAX_MEMORY_PERCENT / BCACHE_BLOCK_SIZE;
+    pmm_register_reclaim(bcache_reclaim);
+    scheduler_create_task(flusher_entry);
+    DEBUG_INFO("bcache: Up to %lu buffers (%lu MB)", max_buffers,
+        max_buffers * BCACHE_BLOCK_SIZE / (1024 * 1024));
+}
+
+Buffer* bcache_read(BlockDevice* dev, uint64_t block) {
+    if (!dev || block >= bcache_block_count(dev)) return nullptr;
+
+    spinlock_acquire(&bcache_lock);
+    bool hit;
+    Buffer* b = lookup(dev, block, &hit);
+    if (!b) {
+        spinlock_release(&bcache_lock);
+        return nullptr;
+    }
+
+    bool start_read = false;
+    if (!(b->flags & BUF_VALID)) {
+        if (b->flags & BUF_IO) {
+            stat_coalesced++;  // Someone is already reading it
+        } else {
+            begin_io(b);
+            start_read = true;
+        }
+    }
+    spinlock_release(&bcache_lock);
+
+    if (start_read) submit_io(b, false);
+    if (!(b->flags & BUF_VALID)) wait_io(b);
+
+    if (!(b->flags & BUF_VALID)) {
+        bcache_release(b);
+        return nullptr;
+    }
+    return b;
+}
+
+Buffer* bcache_get(BlockDevice* dev, uint64_t block) {
+    if (!dev || block >= bcache_block_count(dev)) return nullptr;
+
+    spinlock_acquire(&bcache_lock);
+    bool hit;
+    Buffer* b = lookup(dev, block, &hit);
+    spinlock_release(&bcache_lock);
+
+    // Do not let the caller's overwrite race an in-flight transfer
+    if (b) wait_io(b);
+    return b;
+}
+
+void bcache_prefetch(BlockDevice* dev, uint64_t block, uint32_t count) {
+    if (!dev) return;
+    uint64_t blocks = bcache_block_count(dev);
+    if (block >= blocks) return;
+    if (count > blocks - block) count = (uint32_t)(blocks - block);
+
+    block_plug(dev);
+    for (uint32_t i = 0; i < count; i++) {
+        spinlock_acquire(&bcache_lock);
+        bool hit;
+        Buffer* b = lookup(dev, block + i, &hit);
+        if (!b) {
+            spinlock_release(&bcache_lock);
+            break;
+        }
+        bool start_read = !(b->flags & (BUF_VALID | BUF_IO));
+        if (start_read) begin_io(b);
+        b->refcount--;  // The I/O holds its own reference
+        spinlock_release(&bcache_lock);
+
+        if (start_read) submit_io(b, false);
+    }
+    block_unplug(dev);
+}
+
+void bcache_release(Buffer* buf) {
+    if (!buf) return;
+    spinlock_acquire(&bcache_lock);
+    if (buf->refcount > 0) buf->refcount--;
+    spinlock_release(&bcache_lock);
+}
+
+void bcache_mark_dirty(Buffer* buf) {
+    if (!buf) return;
+    Buffer* batch[BCACHE_WRITEBACK_BATCH];
+    int n = 0;
+
+    spinlock_acquire(&bcache_lock);
+    buf->flags |= BUF_VALID;
+    if (!(buf->flags & (BUF_DIRTY | BUF_PINNED))) dirty_append(buf);
+
+    // Throttle writers that outrun the flusher
+    if (dirty_count > max_buffers * BCACHE_DIRTY_LIMIT_PERCENT / 100) {
+        n = collect_dirty(nullptr, true, batch, BCACHE_WRITEBACK_BATCH);
+    }
+    spinlock_release(&bcache_lock);
+
+    submit_writes(batch, n);
+}
+
+int bcache_write_sync(Buffer* buf) {
+    if (!buf) return BLOCK_ERR_INVALID;
+
+    for (;;) {
+        wait_io(buf);
+        spinlock_acquire(&bcache_lock);
+        if (!(buf->flags & BUF_IO)) break;
+        spinlock_release(&bcache_lock);
+    }
+    if (buf->flags & BUF_DIRTY) dirty_remove(buf);
+    buf->flags |= BUF_VALID;
+    begin_io(buf);
+    spinlock_release(&bcache_lock);
+
+    submit_io(buf, true);
+    wait_io(buf);
+    return (buf->flags & BUF_ERROR) ? BLOCK_ERR_IO : BLOCK_OK;
+}
+
+int bcache_write_list(Buffer** bufs, uint32_t count) {
+    if (count == 0) return BLOCK_OK;
+
+    // Let earlier transfers finish so the writes below carry current data
+    for (uint32_t i = 0; i < count; i++) wait_io(bufs[i]);
+
+    // Dirty buffers go to the front, ready for submission
+    uint32_t n = 0;
+    spinlock_acquire(&bcache_lock);
+    for (uint32_t i = 0; i < count; i++) {
+        Buffer* b = bufs[i];
+        if (!(b->flags & BUF_DIRTY) || (b->flags & BUF_IO)) continue;
+        dirty_remove(b);
+        begin_io(b);
+        bufs[i] = bufs[n];
+        bufs[n++] = b;
+    }
+    spinlock_release(&bcache_lock);
+
+    sort_buffers(bufs, (int)n);
+    submit_writes(bufs, (int)n);
+
+    int result = BLOCK_OK;
+    for (uint32_t i = 0; i < count; i++) {
+        wait_io(bufs[i]);
+        if (bufs[i]->flags & BUF_ERROR) result = BLOCK_ERR_IO;
+    }
+    return result;
+}
+
+bool bcache_pin(Buffer* buf) {
+    if (!buf) return false;
+    for (;;) {
+        wait_io(buf);
+        spinlock_acquire(&bcache_lock);
+        if (!(buf->flags & BUF_IO)) break;
+        spinlock_release(&bcache_lock);
+    }
+    // Changes already queued ride along with the transaction now
+    bool was_dirty = buf->flags & BUF_DIRTY;
+    if (was_dirty) dirty_remove(buf);
+    buf->flags |= BUF_PINNED;
+    buf->refcount++;
+    spinlock_release(&bcache_lock);
+    return was_dirty;
+}
+
+void bcache_unpin(Buffer* buf, bool dirty) {
+    if (!buf) return;
+    spinlock_acquire(&bcache_lock);
+    buf->flags &= ~BUF_PINNED;
+    if (dirty) {
+        buf->flags |= BUF_VALID;
+        if (!(buf->flags & BUF_DIRTY)) dirty_append(buf);
+    }
+    if (buf->refcount > 0) buf->refcount--;
+    spinlock_release(&bcache_lock);
+}
+
+int bcache_sync(BlockDevice* dev) {
+    Buffer* batch[BCACHE_WRITEBACK_BATCH];
+    int result = BLOCK_OK;
+
+    for (;;) {
+        spinlock_acquire(&bcache_lock);
+        int n = collect_dirty(dev, true, batch, BCACHE_WRITEBACK_BATCH);
+        bool writing = n > 0;
+        if (!writing) {
+            // Nothing left to start; wait for write-backs already running
+            for (Buffer* b = lru_head; b && n < BCACHE_WRITEBACK_BATCH; b = b->lru_next) {
+                if ((b->flags & BUF_IO) && (!dev || b->dev == dev)) batch[n++] = b;
+            }
+        }
+        for (int i = 0; i < n; i++) batch[i]->refcount++;
+        spinlock_release(&bcache_lock);
+
+        if (n == 0) break;
+        if (writing) submit_writes(batch, n);
+        for (int i = 0; i < n; i++) {
+            wait_io(batch[i]);
+            if (writing && (batch[i]->flags & BUF_ERROR)) result = BLOCK_ERR_IO;
+            bcache_release(batch[i]);
+        }
+        if (result != BLOCK_OK) break;  // Failed blocks went back on the dirty list
+    }
+
+    if (dev) {
+        int status = block_flush(dev);
+        if (result == BLOCK_OK) result = status;
+    } else {
+        for (int i = 0; i < block_count(); i++) {
+            int status = block_flush(block_get(i));
+            if (result == BLOCK_OK) result = status;
+        }
+    }
+    return result;
+}
+
+void bcache_invalidate(BlockDevice* dev) {
+    if (!dev) return;
+    bcache_sync(dev);
+
+    spinlock_acquire(&bcache_lock);
+    Buffer* next;
+    for (Buffer* b = lru_head; b; b = next) {
+        next = b->lru_next;
+        if (b->dev != dev || !is_idle(b)) continue;
+        hash_remove(b);
+        lru_remove(b);
+        buffer_count--;
+        free_buffer(b);
+    }
+    spinlock_release(&bcache_lock);
+}
+
+uint64_t bcache_block_count(const BlockDevice* dev) {
+    return dev->sector_count * dev->sector_size / BCACHE_BLOCK_SIZE;
+}
+
+void bcache_get_stats(BcacheStats* stats) {
+    spinlock_acquire(&bcache_lock);
+    stats->hits = stat_hits;
+    stats->misses = stat_misses;
+    stats->coalesced = stat_coalesced;
+    stats->buffers = buffer_count;
+    stats->max_buffers = max_buffers;
+    stats->dirty = dirty_count;
+    stats->writebacks = stat_writebacks;
+    stats->evictions = stat_evictions;
+    stats->reclaimed = stat_reclaimed;
+    stats->errors = stat_errors;
+    spinlock_release(&bcache_lock);
+}
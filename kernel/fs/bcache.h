@@ -0,0 +1,112 @@
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+
+// ============================================================================
+// Block Buffer Cache
+// ============================================================================
+// 4KB blocks of any block device, keyed by (device, block number). Lookups
+// go through a hash table; unreferenced clean buffers are evicted in LRU
+// order when the cache is full or the PMM asks for memory back.
+//
+// Writes are write-back: bcache_mark_dirty() queues the buffer and a flusher
+// task writes dirty buffers out once they are BCACHE_DIRTY_EXPIRE_MS old (or
+// sooner when too many are dirty), sorted so adjacent blocks merge into one
+// device command. bcache_sync() forces everything out.
+//
+// Readers of a block that is already being read wait for that I/O instead
+// of issuing another; bcache_prefetch() queues a run of reads at once.
+//
+// Buffers carry no content lock: filesystems serialize access to the
+// blocks they own. A journal pins the metadata buffers of its running
+// transaction so write-back cannot put uncommitted changes on disk.
+// ============================================================================
+
+#define BCACHE_BLOCK_SIZE           4096
+#define BCACHE_HASH_BUCKETS         1024
+#define BCACHE_MAX_MEMORY_PERCENT   25      // Of physical memory
+#define BCACHE_FLUSH_INTERVAL_MS    1000
+#define BCACHE_DIRTY_EXPIRE_MS      3000
+#define BCACHE_DIRTY_LIMIT_PERCENT  50      // Of cached buffers; flush early above this
+#define BCACHE_WRITEBACK_BATCH      64
+
+// Buffer flags
+#define BUF_VALID       (1u << 0)   // Data matches (or supersedes) the disk
+#define BUF_DIRTY       (1u << 1)   // Needs writing back
+#define BUF_IO          (1u << 2)   // Read or write in flight
+#define BUF_ERROR       (1u << 3)   // Last I/O failed
+#define BUF_PINNED      (1u << 4)   // Held by a journal transaction: no write-back
+
+struct Buffer {
+    BlockDevice* dev;
+    uint64_t block;
+    uint8_t* data;              // BCACHE_BLOCK_SIZE bytes (HHDM view of one frame)
+    volatile uint32_t flags;
+
+    // Owned by the cache
+    uint32_t refcount;
+    uint64_t dirty_since;       // Timer tick the buffer became dirty
+    BlockRequest req;           // For reads and write-back
+    Buffer* hash_next;
+    Buffer* lru_prev;           // All cached buffers, least recently used first
+    Buffer* lru_next;
+    Buffer* dirty_prev;         // Dirty buffers, oldest first
+    Buffer* dirty_next;
+};
+
+struct BcacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t coalesced;         // Lookups that joined an in-flight read
+    uint64_t buffers;           // Cached blocks
+    uint64_t max_buffers;
+    uint64_t dirty;
+    uint64_t writebacks;        // Blocks written back
+    uint64_t evictions;
+    uint64_t reclaimed;         // Blocks given back under memory pressure
+    uint64_t errors;
+};
+
+// Start the flusher and register with memory-pressure reclaim
+void bcache_init();
+
+// Block with valid contents (read from disk if needed), referenced.
+// Returns nullptr on I/O error or when no buffer can be had.
+Buffer* bcache_read(BlockDevice* dev, uint64_t block);
+
+// Block without reading it, for callers about to overwrite all of it.
+// Contents are undefined unless BUF_VALID is set.
+Buffer* bcache_get(BlockDevice* dev, uint64_t block);
+
+// Start reads for blocks not yet cached, without waiting
+void bcache_prefetch(BlockDevice* dev, uint64_t block, uint32_t count);
+
+// Drop a reference from bcache_read/bcache_get
+void bcache_release(Buffer* buf);
+
+// Contents changed: mark valid and queue for write-back
+void bcache_mark_dirty(Buffer* buf);
+
+// Write one buffer now and wait for it
+int bcache_write_sync(Buffer* buf);
+
+// Write the dirty buffers among bufs now (sorted, under one plug) and wait
+// for all of them, including write-backs already in flight. Reorders bufs.
+int bcache_write_list(Buffer** bufs, uint32_t count);
+
+// Keep buf out of write-back until bcache_unpin(). Waits for I/O in flight
+// and takes a reference; unpin gives it back and, if dirty, queues the
+// buffer for write-back. Returns true if buf held changes not yet written.
+bool bcache_pin(Buffer* buf);
+void bcache_unpin(Buffer* buf, bool dirty);
+
+// Write every dirty buffer of dev (all devices if null), wait, flush caches
+int bcache_sync(BlockDevice* dev);
+
+// Forget all buffers of dev after writing them back (unmount)
+void bcache_invalidate(BlockDevice* dev);
+
+// Blocks (of BCACHE_BLOCK_SIZE) on a device
+uint64_t bcache_block_count(const BlockDevice* dev);
+
+void bcache_get_stats(BcacheStats* stats);
@@ -0,0 +1,512 @@
+#include "journal.h"
+#include "heap.h"
+#include "timer.h"
+#include "kstring.h"
+#include "debug.h"
+
+struct RevokeEntry {
+    uint64_t block;
+    uint64_t sequence;          // Transaction that freed it
+};
+
+struct Journal {
+    BlockDevice* dev;
+    uint64_t start;             // Region on the device
+    uint64_t blocks;
+    uint64_t sequence;          // Of the running transaction
+    uint64_t head;              // Next free log block (region-relative)
+    uint64_t txn_limit;         // Log blocks per transaction before committing
+    uint64_t txn_began;         // Tick of the running transaction's first change
+
+    Buffer** meta;              // Pinned metadata buffers
+    uint32_t meta_count;
+    uint32_t meta_capacity;
+    uint32_t meta_unwritten;    // Pinned with committed changes not yet in place
+    Buffer** data;              // Ordered data, referenced
+    uint32_t data_count;
+    uint32_t data_capacity;
+    uint64_t* revoked;
+    uint32_t revoke_count;
+    uint32_t revoke_capacity;
+
+    JournalStats stats;
+};
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+// FNV-1a over one log block
+static uint32_t checksum_block(uint32_t h, const uint8_t* data) {
+    for (uint32_t i = 0; i < JOURNAL_BLOCK_SIZE; i++) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+#define CHECKSUM_SEED   2166136261u
+
+static bool grow(void** array, uint32_t* capacity, uint32_t count, uint32_t elem_size) {
+    if (count < *capacity) return true;
+    uint32_t cap = *capacity ? *capacity * 2 : 64;
+    void* bigger = malloc((uint64_t)cap * elem_size);
+    if (!bigger) return false;
+    if (*array) {
+        kstring::memcpy(bigger, *array, (uint64_t)count * elem_size);
+        free(*array);
+    }
+    *array = bigger;
+    *capacity = cap;
+    return true;
+}
+
+static void begin_change(Journal* j) {
+    if (j->meta_count == 0 && j->data_count == 0 && j->revoke_count == 0) {
+        j->txn_began = timer_get_ticks();
+    }
+}
+
+static uint64_t log_blocks_needed(const Journal* j) {
+    uint64_t descriptors = (j->meta_count + JOURNAL_TAGS_PER_BLOCK - 1) / JOURNAL_TAGS_PER_BLOCK;
+    uint64_t revokes = (j->revoke_count + JOURNAL_TAGS_PER_BLOCK - 1) / JOURNAL_TAGS_PER_BLOCK;
+    return j->meta_count + descriptors + revokes + 1;  // + commit block
+}
+
+static int write_block_now(Buffer* b) {
+    bcache_mark_dirty(b);
+    return bcache_write_list(&b, 1);
+}
+
+// Ordered mode: file data reaches the disk before the metadata naming it
+static int write_data(Journal* j) {
+    if (j->data_count == 0) return BLOCK_OK;
+    int result = bcache_write_list(j->data, j->data_count);
+    for (uint32_t i = 0; i < j->data_count; i++) bcache_release(j->data[i]);
+    j->stats.data_blocks += j->data_count;
+    j->data_count = 0;
+    return result;
+}
+
+static void unpin_all(Journal* j) {
+    for (uint32_t i = 0; i < j->meta_count; i++) bcache_unpin(j->meta[i], true);
+    j->meta_count = 0;
+    j->meta_unwritten = 0;
+    j->revoke_count = 0;
+}
+
+// Put every committed block in place and restart the log at block 1. The
+// running transaction's buffers are pinned and stay out of this.
+static int checkpoint_log(Journal* j) {
+    int result = bcache_sync(j->dev);
+    if (result != BLOCK_OK) return result;
+
+    Buffer* b = bcache_get(j->dev, j->start);
+    if (!b) return BLOCK_ERR_NO_MEMORY;
+    kstring::zero_memory(b->data, JOURNAL_BLOCK_SIZE);
+    JournalHeader* hdr = (JournalHeader*)b->data;
+    hdr->h.magic = JOURNAL_MAGIC;
+    hdr->h.type = JOURNAL_HEADER;
+    hdr->h.sequence = j->sequence;
+    hdr->blocks = j->blocks;
+    result = write_block_now(b);
+    bcache_release(b);
+    if (result == BLOCK_OK) result = block_flush(j->dev);
+
+    j->head = 1;
+    j->stats.checkpoints++;
+    return result;
+}
+
+// Transaction too big for the log (or the log failed): write everything
+// in place and restart the log after it
+static int commit_in_place(Journal* j) {
+    unpin_all(j);
+    j->sequence++;
+    return checkpoint_log(j);
+}
+
+// ============================================================================
+// Format / Open (replay)
+// ============================================================================
+
+int journal_format(BlockDevice* dev, uint64_t start, uint64_t blocks) {
+    if (blocks < JOURNAL_MIN_BLOCKS) return BLOCK_ERR_INVALID;
+
+    // Stale transactions of an earlier filesystem must not match the new
+    // sequence, so start from an unpredictable one
+    for (uint64_t i = 0; i < 2; i++) {
+        Buffer* b = bcache_get(dev, start + i);
+        if (!b) return BLOCK_ERR_NO_MEMORY;
+        kstring::zero_memory(b->data, JOURNAL_BLOCK_SIZE);
+        if (i == 0) {
+            JournalHeader* hdr = (JournalHeader*)b->data;
+            hdr->h.magic = JOURNAL_MAGIC;
+            hdr->h.type = JOURNAL_HEADER;
+            hdr->h.sequence = (rdtsc() & 0xFFFFFFFFFFFFULL) + 1;
+            hdr->blocks = blocks;
+        }
+        bcache_mark_dirty(b);
+        bcache_release(b);
+    }
+    return BLOCK_OK;
+}
+
+// Check that a complete, intact transaction with this sequence starts at
+// pos; collect its revoke records. *next = block after its commit.
+static bool scan_transaction(Journal* j, uint64_t pos, uint64_t sequence, uint64_t* next,
+                             RevokeEntry** revokes, uint32_t* revoke_count, uint32_t* revoke_capacity) {
+    uint32_t checksum = CHECKSUM_SEED;
+    uint32_t revokes_before = *revoke_count;
+    uint64_t p = pos;
+
+    while (p < j->blocks) {
+        Buffer* b = bcache_read(j->dev, j->start + p);
+        if (!b) break;
+        const JournalTags* tags = (const JournalTags*)b->data;
+        if (tags->h.magic != JOURNAL_MAGIC || tags->h.sequence != sequence) {
+            bcache_release(b);
+            break;
+        }
+
+        if (tags->h.type == JOURNAL_COMMIT) {
+            const JournalCommit* commit = (const JournalCommit*)b->data;
+            bool ok = commit->length == p - pos && commit->checksum == checksum;
+            bcache_release(b);
+            if (!ok) break;
+            *next = p + 1;
+            return true;
+        }
+
+        if (tags->h.type == JOURNAL_DESCRIPTOR && tags->count <= JOURNAL_TAGS_PER_BLOCK) {
+            uint32_t count = tags->count;
+            checksum = checksum_block(checksum, b->data);
+            bcache_release(b);
+            if (p + 1 + count >= j->blocks) break;
+            bool ok = true;
+            for (uint32_t i = 0; i < count && ok; i++) {
+                Buffer* copy = bcache_read(j->dev, j->start + p + 1 + i);
+                if (!copy) {
+                    ok = false;
+                    break;
+                }
+                checksum = checksum_block(checksum, copy->data);
+                bcache_release(copy);
+            }
+            if (!ok) break;
+            p += 1 + count;
+        } else if (tags->h.type == JOURNAL_REVOKE && tags->count <= JOURNAL_TAGS_PER_BLOCK) {
+            bool ok = true;
+            for (uint32_t i = 0; i < tags->count && ok; i++) {
+                ok = grow((void**)revokes, revoke_capacity, *revoke_count, sizeof(RevokeEntry));
+                if (ok) (*revokes)[(*revoke_count)++] = {tags->blocks[i], sequence};
+            }
+            checksum = checksum_block(checksum, b->data);
+            bcache_release(b);
+            if (!ok) break;
+            p++;
+        } else {
+            bcache_release(b);
+            break;
+        }
+    }
+
+    *revoke_count = revokes_before;  // Torn transaction: its revokes never happened
+    return false;
+}
+
+static bool is_revoked(const RevokeEntry* revokes, uint32_t count, uint64_t block, uint64_t sequence) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (revokes[i].block == block && revokes[i].sequence >= sequence) return true;
+    }
+    return false;
+}
+
+// Copy one scanned transaction's blocks to their home locations.
+// Returns the block after its commit.
+static uint64_t replay_transaction(Journal* j, uint64_t pos, uint64_t sequence,
+                                   const RevokeEntry* revokes, uint32_t revoke_count) {
+    uint64_t p = pos;
+    for (;;) {
+        Buffer* b = bcache_read(j->dev, j->start + p);
+        if (!b) return p + 1;
+        const JournalTags* tags = (const JournalTags*)b->data;
+        uint32_t type = tags->h.type;
+        if (type == JOURNAL_COMMIT) {
+            bcache_release(b);
+            return p + 1;
+        }
+        if (type == JOURNAL_REVOKE) {
+            bcache_release(b);
+            p++;
+            continue;
+        }
+
+        uint32_t count = tags->count;
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t target = tags->blocks[i];
+            if (is_revoked(revokes, revoke_count, target, sequence)) continue;
+            Buffer* copy = bcache_read(j->dev, j->start + p + 1 + i);
+            Buffer* home = bcache_get(j->dev, target);
+            if (copy && home) {
+                kstring::memcpy(home->data, copy->data, JOURNAL_BLOCK_SIZE);
+                bcache_mark_dirty(home);
+            }
+            bcache_release(copy);
+            bcache_release(home);
+        }
+        bcache_release(b);
+        p += 1 + count;
+    }
+}
+
+Journal* journal_open(BlockDevice* dev, uint64_t start, uint64_t blocks) {
+    if (blocks < JOURNAL_MIN_BLOCKS) return nullptr;
+
+    Buffer* b = bcache_read(dev, start);
+    if (!b) return nullptr;
+    JournalHeader hdr;
+    kstring::memcpy(&hdr, b->data, sizeof(hdr));
+    bcache_release(b);
+    if (hdr.h.magic != JOURNAL_MAGIC || hdr.h.type != JOURNAL_HEADER || hdr.blocks != blocks) {
+        return nullptr;
+    }
+
+    Journal* j = (Journal*)malloc(sizeof(Journal));
+    if (!j) return nullptr;
+    kstring::zero_memory(j, sizeof(*j));
+    j->dev = dev;
+    j->start = start;
+    j->blocks = blocks;
+    j->sequence = hdr.h.sequence;
+    j->head = 1;
+    j->txn_limit = (blocks - 1) / 4;
+
+    // Pass 1: find the committed transactions and what they revoked
+    RevokeEntry* revokes = nullptr;
+    uint32_t revoke_count = 0, revoke_capacity = 0;
+    uint64_t pos = 1, committed = 0;
+    uint64_t next;
+    while (scan_transaction(j, pos, j->sequence + committed, &next, &revokes, &revoke_count, &revoke_capacity)) {
+        pos = next;
+        committed++;
+    }
+
+    if (committed > 0) {
+        if (dev->read_only) {
+            DEBUG_ERROR("journal: %s needs recovery but is read-only", dev->name);
+            free(revokes);
+            free(j);
+            return nullptr;
+        }
+
+        // Pass 2: replay in order, then start a fresh log
+        pos = 1;
+        for (uint64_t t = 0; t < committed; t++) {
+            pos = replay_transaction(j, pos, j->sequence + t, revokes, revoke_count);
+        }
+        j->sequence += committed;
+        j->stats.replayed = committed;
+        if (checkpoint_log(j) != BLOCK_OK) {
+            DEBUG_ERROR("journal: Writing recovered blocks on %s failed", dev->name);
+        }
+        DEBUG_INFO("journal: Replayed %lu transactions on %s", committed, dev->name);
+    }
+    free(revokes);
+    return j;
+}
+
+// ============================================================================
+// Running Transaction
+// ============================================================================
+
+void journal_access(Journal* j, Buffer* buf) {
+    if (buf->flags & BUF_PINNED) return;  // Already part of this transaction
+
+    if (!grow((void**)&j->meta, &j->meta_capacity, j->meta_count, sizeof(Buffer*))) {
+        // No memory to track it: fall back to a plain in-place update
+        DEBUG_WARN("journal: Out of memory, block %lu not journaled", buf->block);
+        bcache_mark_dirty(buf);
+        return;
+    }
+    begin_change(j);
+    if (bcache_pin(buf)) j->meta_unwritten++;
+    j->meta[j->meta_count++] = buf;
+
+    // Reused after being freed in this transaction: the new copy counts
+    for (uint32_t i = 0; i < j->revoke_count; i++) {
+        if (j->revoked[i] == buf->block) {
+            j->revoked[i] = j->revoked[--j->revoke_count];
+            break;
+        }
+    }
+}
+
+void journal_add_data(Journal* j, Buffer* buf) {
+    if (j->data_count >= JOURNAL_MAX_DATA) write_data(j);
+    if (!grow((void**)&j->data, &j->data_capacity, j->data_count, sizeof(Buffer*))) {
+        bcache_write_list(&buf, 1);
+        bcache_release(buf);
+        return;
+    }
+    begin_change(j);
+    j->data[j->data_count++] = buf;
+}
+
+void journal_revoke(Journal* j, uint64_t block) {
+    for (uint32_t i = 0; i < j->revoke_count; i++) {
+        if (j->revoked[i] == block) return;
+    }
+    if (!grow((void**)&j->revoked, &j->revoke_capacity, j->revoke_count, sizeof(uint64_t))) {
+        // Cannot record it: make sure no log copy of the block survives
+        journal_checkpoint(j);
+        return;
+    }
+    begin_change(j);
+    j->revoked[j->revoke_count++] = block;
+}
+
+bool journal_should_commit(const Journal* j, uint32_t interval_ms) {
+    if (j->meta_count == 0 && j->data_count == 0 && j->revoke_count == 0) return false;
+    if (log_blocks_needed(j) >= j->txn_limit) return true;
+    if (j->data_count >= JOURNAL_MAX_DATA) return true;
+    uint64_t interval = (uint64_t)interval_ms * timer_get_frequency() / 1000;
+    return timer_get_ticks() - j->txn_began >= interval;
+}
+
+int journal_commit(Journal* j) {
+    int result = write_data(j);
+    if (j->meta_count == 0 && j->revoke_count == 0) return result;
+
+    uint64_t needed = log_blocks_needed(j);
+    if (needed > j->blocks - 1) {
+        DEBUG_WARN("journal: Transaction of %lu blocks exceeds the log, writing in place", needed);
+        return commit_in_place(j);
+    }
+    if (j->head + needed > j->blocks) {
+        // Emptying the log now would drop the only durable copy of blocks
+        // this transaction re-pinned before they reached their place
+        if (j->meta_unwritten > 0) return commit_in_place(j);
+        int status = checkpoint_log(j);
+        if (status != BLOCK_OK) return commit_in_place(j);
+    }
+
+    Buffer** log = (Buffer**)malloc(needed * sizeof(Buffer*));
+    if (!log) return commit_in_place(j);
+
+    // Descriptors with the block copies behind them, then revoke records
+    uint32_t n = 0;
+    uint32_t checksum = CHECKSUM_SEED;
+    bool ok = true;
+    for (uint32_t i = 0; i < j->meta_count && ok; i += JOURNAL_TAGS_PER_BLOCK) {
+        uint32_t count = j->meta_count - i;
+        if (count > JOURNAL_TAGS_PER_BLOCK) count = JOURNAL_TAGS_PER_BLOCK;
+
+        Buffer* d = bcache_get(j->dev, j->start + j->head + n);
+        if (!d) {
+            ok = false;
+            break;
+        }
+        kstring::zero_memory(d->data, JOURNAL_BLOCK_SIZE);
+        JournalTags* tags = (JournalTags*)d->data;
+        tags->h.magic = JOURNAL_MAGIC;
+        tags->h.type = JOURNAL_DESCRIPTOR;
+        tags->h.sequence = j->sequence;
+        tags->count = count;
+        for (uint32_t k = 0; k < count; k++) tags->blocks[k] = j->meta[i + k]->block;
+        log[n++] = d;
+
+        for (uint32_t k = 0; k < count; k++) {
+            Buffer* copy = bcache_get(j->dev, j->start + j->head + n);
+            if (!copy) {
+                ok = false;
+                break;
+            }
+            kstring::memcpy(copy->data, j->meta[i + k]->data, JOURNAL_BLOCK_SIZE);
+            log[n++] = copy;
+        }
+    }
+    for (uint32_t i = 0; i < j->revoke_count && ok; i += JOURNAL_TAGS_PER_BLOCK) {
+        uint32_t count = j->revoke_count - i;
+        if (count > JOURNAL_TAGS_PER_BLOCK) count = JOURNAL_TAGS_PER_BLOCK;
+
+        Buffer* r = bcache_get(j->dev, j->start + j->head + n);
+        if (!r) {
+            ok = false;
+            break;
+        }
+        kstring::zero_memory(r->data, JOURNAL_BLOCK_SIZE);
+        JournalTags* tags = (JournalTags*)r->data;
+        tags->h.magic = JOURNAL_MAGIC;
+        tags->h.type = JOURNAL_REVOKE;
+        tags->h.sequence = j->sequence;
+        tags->count = count;
+        for (uint32_t k = 0; k < count; k++) tags->blocks[k] = j->revoked[i + k];
+        log[n++] = r;
+    }
+
+    // One sequential write for the body, then the commit block
+    int status = BLOCK_ERR_NO_MEMORY;
+    uint32_t body = n;
+    if (ok) {
+        for (uint32_t i = 0; i < body; i++) {
+            checksum = checksum_block(checksum, log[i]->data);
+            bcache_mark_dirty(log[i]);
+        }
+        status = bcache_write_list(log, body);
+        if (status == BLOCK_OK) status = block_flush(j->dev);
+    }
+    if (status == BLOCK_OK) {
+        Buffer* c = bcache_get(j->dev, j->start + j->head + body);
+        status = BLOCK_ERR_NO_MEMORY;
+        if (c) {
+            kstring::zero_memory(c->data, JOURNAL_BLOCK_SIZE);
+            JournalCommit* commit = (JournalCommit*)c->data;
+            commit->h.magic = JOURNAL_MAGIC;
+            commit->h.type = JOURNAL_COMMIT;
+            commit->h.sequence = j->sequence;
+            commit->checksum = checksum;
+            commit->length = body;
+            status = write_block_now(c);
+            bcache_release(c);
+            if (status == BLOCK_OK) status = block_flush(j->dev);
+        }
+    }
+    for (uint32_t i = 0; i < n; i++) bcache_release(log[i]);
+    free(log);
+
+    if (status != BLOCK_OK) {
+        DEBUG_ERROR("journal: Commit %lu on %s failed (%d), writing in place",
+            j->sequence, j->dev->name, status);
+        return commit_in_place(j);
+    }
+
+    j->stats.commits++;
+    j->stats.logged_blocks += j->meta_count;
+    j->head += body + 1;
+    j->sequence++;
+    unpin_all(j);
+
+    // Make room for the next transaction while nothing is pinned
+    if (j->head + j->txn_limit > j->blocks) checkpoint_log(j);
+    return BLOCK_OK;
+}
+
+int journal_checkpoint(Journal* j) {
+    int result = journal_commit(j);
+    int status = checkpoint_log(j);
+    return result != BLOCK_OK ? result : status;
+}
+
+void journal_get_stats(const Journal* j, JournalStats* stats) {
+    *stats = j->stats;
+}
+
+void journal_close(Journal* j) {
+    if (!j) return;
+    if (!j->dev->read_only) journal_checkpoint(j);
+    free(j->meta);
+    free(j->data);
+    free(j->revoked);
+    free(j);
+}
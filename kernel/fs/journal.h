@@ -0,0 +1,107 @@
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+#include "bcache.h"
+
+// ============================================================================
+// Block Journal (write-ahead log for filesystem metadata)
+// ============================================================================
+// A fixed region of a block device holding whole-block copies of metadata.
+// Changes collect in one running transaction: the first change to a block
+// pins its buffer, later changes to the same block cost nothing. Commit
+// (group commit) then
+//
+//   1. writes the transaction's file data in place (ordered mode),
+//   2. appends descriptor + block copies (+ revoke records) sequentially,
+//   3. flushes, writes the commit block, flushes again,
+//   4. unpins the buffers so write-back puts them in place later.
+//
+// Once the log is full everything is written in place and it starts over
+// (checkpoint). Mount replays committed transactions in order; a revoke
+// record stops an older copy from overwriting a block freed and reused
+// since.
+//
+// Region layout:
+//   Block 0     JournalHeader (sequence expected in block 1)
+//   Block 1..   Transactions: { Descriptor, copies... | Revoke }* Commit
+//
+// The caller serializes all calls for one journal.
+// ============================================================================
+
+#define JOURNAL_MAGIC               0x4C4E524A  // "JRNL"
+#define JOURNAL_BLOCK_SIZE          BCACHE_BLOCK_SIZE
+#define JOURNAL_MIN_BLOCKS          64
+#define JOURNAL_TAGS_PER_BLOCK      ((JOURNAL_BLOCK_SIZE - 24) / 8)
+#define JOURNAL_MAX_DATA            1024    // Ordered data buffers held per transaction
+
+// Block types
+#define JOURNAL_HEADER              1
+#define JOURNAL_DESCRIPTOR          2
+#define JOURNAL_REVOKE              3
+#define JOURNAL_COMMIT              4
+
+struct JournalBlockHeader {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t sequence;
+} __attribute__((packed));
+
+struct JournalHeader {
+    JournalBlockHeader h;       // sequence: first transaction in the log
+    uint64_t blocks;            // Region size
+} __attribute__((packed));
+
+// Descriptor and revoke blocks: a list of device block numbers
+struct JournalTags {
+    JournalBlockHeader h;
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t blocks[JOURNAL_TAGS_PER_BLOCK];
+} __attribute__((packed));
+
+struct JournalCommit {
+    JournalBlockHeader h;
+    uint32_t checksum;          // Over every block of the transaction before this one
+    uint32_t length;            // Those blocks
+} __attribute__((packed));
+
+struct JournalStats {
+    uint64_t commits;
+    uint64_t logged_blocks;     // Metadata copies written to the log
+    uint64_t data_blocks;       // Ordered data written at commit
+    uint64_t checkpoints;
+    uint64_t replayed;          // Transactions replayed at mount
+};
+
+struct Journal;
+
+// Write an empty log header (mkfs)
+int journal_format(BlockDevice* dev, uint64_t start, uint64_t blocks);
+
+// Replay committed transactions and open the log. nullptr if the region is
+// not a journal, or it needs replay on a read-only device.
+Journal* journal_open(BlockDevice* dev, uint64_t start, uint64_t blocks);
+
+// About to modify a metadata block (call before changing buf->data)
+void journal_access(Journal* j, Buffer* buf);
+
+// File data dirtied in this transaction; the journal takes over the reference
+void journal_add_data(Journal* j, Buffer* buf);
+
+// Block freed: older log copies must not be replayed over it
+void journal_revoke(Journal* j, uint64_t block);
+
+// Running transaction is large or old enough to commit before the next
+// operation
+bool journal_should_commit(const Journal* j, uint32_t interval_ms);
+
+// Commit the running transaction (no-op when empty)
+int journal_commit(Journal* j);
+
+// Commit, write everything in place and empty the log
+int journal_checkpoint(Journal* j);
+
+void journal_get_stats(const Journal* j, JournalStats* stats);
+
+// Checkpoint and free (unmount, failed mount)
+void journal_close(Journal* j);
@@ -0,0 +1,56 @@
+#include "lz4.h"
+#include "kstring.h"
+
+#define LZ4_MIN_MATCH   4
+
+// Length extension: bytes of 255 continue it, the first smaller byte ends it
+static bool read_length(const uint8_t** ip, const uint8_t* end, uint64_t* length) {
+    uint8_t b;
+    do {
+        if (*ip >= end) return false;
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+    return true;
+}
+
+int64_t lz4_decompress(const uint8_t* src, uint64_t src_len, uint8_t* dst, uint64_t dst_capacity) {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dst_capacity;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        // Literals
+        uint64_t literals = token >> 4;
+        if (literals == 15 && !read_length(&ip, iend, &literals)) return -1;
+        if (literals > (uint64_t)(iend - ip) || literals > (uint64_t)(oend - op)) return -1;
+        kstring::memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == iend) break;  // Last sequence: literals only
+
+        // Match
+        if (iend - ip < 2) return -1;
+        uint64_t offset = (uint64_t)ip[0] | ((uint64_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint64_t)(op - dst)) return -1;
+
+        uint64_t length = token & 15;
+        if (length == 15 && !read_length(&ip, iend, &length)) return -1;
+        length += LZ4_MIN_MATCH;
+        if (length > (uint64_t)(oend - op)) return -1;
+
+        const uint8_t* match = op - offset;
+        if (offset >= length) {
+            kstring::memcpy(op, match, length);
+            op += length;
+        } else {
+            // Overlapping copy repeats the last offset bytes
+            while (length--) *op++ = *match++;
+        }
+    }
+    return op - dst;
+}
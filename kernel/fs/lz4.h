@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+
+// ============================================================================
+// LZ4 Block Decompression
+// ============================================================================
+// Decoder for the raw LZ4 block format (no frame, no checksums), as written
+// by tools/mkunifs.py --compress. A block is a run of sequences: a token
+// (literal length << 4 | match length - 4), literals, then a 16-bit
+// little-endian back-reference offset and match length extension. The last
+// sequence has literals only.
+//
+// Input comes from boot images, so every length and offset is bounds-checked
+// against both buffers; malformed input fails rather than overrunning.
+// ============================================================================
+
+// Decode src into dst. Returns the decoded length, or -1 if src is malformed
+// or would decode to more than dst_capacity bytes.
+int64_t lz4_decompress(const uint8_t* src, uint64_t src_len, uint8_t* dst, uint64_t dst_capacity);
@@ -1,99 +1,330 @@
 #include "pipe.h"
+#include "mutex.h"
+#include "spinlock.h"
+#include "waitqueue.h"
+#include "heap.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "kstring.h"
 #include <stddef.h>
 
-static Pipe pipes[MAX_PIPES];
-static bool pipes_initialized = false;
+struct Pipe {
+    Mutex lock;                 // Everything below except users
+    uint8_t** pages;            // Ring storage, PIPE_PAGE_SIZE each (HHDM addresses)
+    uint64_t capacity;          // Bytes in the ring (whole pages)
+    uint64_t read_pos;
+    uint64_t count;             // Bytes buffered
+    bool write_closed;
+    bool read_closed;
+    uint32_t users;             // Calls in progress (table lock)
+    WaitQueue readers;          // Waiting for data or EOF
+    WaitQueue writers;          // Waiting for space or the reader to leave
+};
 
-void pipe_init() {
-    if (pipes_initialized) return;
-    for (int i = 0; i < MAX_PIPES; i++) {
-        pipes[i].in_use = false;
+// Pipe table, grown on demand; freed slots are nullptr and reused
+static Pipe** pipes = nullptr;
+static uint32_t pipe_slots = 0;
+static Spinlock pipe_table_lock = SPINLOCK_INIT;
+static PipeStats stats;
+
+// ============================================================================
+// Ring Buffer
+// ============================================================================
+
+static void free_ring(uint8_t** pages, uint64_t count) {
+    for (uint64_t i = 0; i < count; i++) {
+        pmm_free_frame((void*)((uint64_t)pages[i] - vmm_get_hhdm_offset()));
     }
-    pipes_initialized = true;
+    free(pages);
 }
 
-int pipe_create() {
-    pipe_init();
-    
-    for (int i = 0; i < MAX_PIPES; i++) {
-        if (!pipes[i].in_use) {
-            pipes[i].in_use = true;
-            pipes[i].read_pos = 0;
-            pipes[i].write_pos = 0;
-            pipes[i].count = 0;
-            pipes[i].write_closed = false;
-            pipes[i].read_closed = false;
-            return i;
+static uint8_t** alloc_ring(uint64_t count) {
+    uint8_t** pages = (uint8_t**)malloc(count * sizeof(uint8_t*));
+    if (!pages) return nullptr;
+    for (uint64_t i = 0; i < count; i++) {
+        void* frame = pmm_alloc_frame();
+        if (!frame) {
+            free_ring(pages, i);
+            return nullptr;
         }
+        pages[i] = (uint8_t*)frame + vmm_get_hhdm_offset();
     }
-    return -1;
+    return pages;
 }
 
-int64_t pipe_read(int pipe_id, char* buf, uint64_t count) {
-    if (pipe_id < 0 || pipe_id >= MAX_PIPES || !pipes[pipe_id].in_use) {
+// Copy out of / into the ring at a ring offset, one memcpy per page run.
+// The capacity is whole pages, so wrapping happens on a page boundary.
+static void ring_copy_out(const Pipe* p, uint64_t pos, uint8_t* dst, uint64_t len) {
+    while (len > 0) {
+        uint64_t off = pos % PIPE_PAGE_SIZE;
+        uint64_t n = PIPE_PAGE_SIZE - off;
+        if (n > len) n = len;
+        kstring::memcpy(dst, p->pages[pos / PIPE_PAGE_SIZE] + off, n);
+        pos = (pos + n) % p->capacity;
+        dst += n;
+        len -= n;
+    }
+}
+
+static void ring_copy_in(Pipe* p, uint64_t pos, const uint8_t* src, uint64_t len) {
+    while (len > 0) {
+        uint64_t off = pos % PIPE_PAGE_SIZE;
+        uint64_t n = PIPE_PAGE_SIZE - off;
+        if (n > len) n = len;
+        kstring::memcpy(p->pages[pos / PIPE_PAGE_SIZE] + off, src, n);
+        pos = (pos + n) % p->capacity;
+        src += n;
+        len -= n;
+    }
+}
+
+// ============================================================================
+// Pipe Table
+// ============================================================================
+
+// Pin a pipe for the duration of a call; nullptr if the id is not open
+static Pipe* pipe_get(int pipe_id) {
+    Pipe* p = nullptr;
+    spinlock_acquire(&pipe_table_lock);
+    if (pipe_id >= 0 && (uint32_t)pipe_id < pipe_slots && pipes[pipe_id]) {
+        p = pipes[pipe_id];
+        p->users++;
+    }
+    spinlock_release(&pipe_table_lock);
+    return p;
+}
+
+// Unpin; the last call out of a pipe with both ends closed frees it
+static void pipe_put(int pipe_id, Pipe* p) {
+    spinlock_acquire(&pipe_table_lock);
+    bool dead = --p->users == 0 && p->read_closed && p->write_closed;
+    if (dead) {
+        pipes[pipe_id] = nullptr;
+        stats.pipes--;
+        stats.buffer_bytes -= p->capacity;
+    }
+    spinlock_release(&pipe_table_lock);
+    
+    if (dead) {
+        free_ring(p->pages, p->capacity / PIPE_PAGE_SIZE);
+        free(p);
+    }
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+int pipe_create() {
+    Pipe* p = (Pipe*)malloc(sizeof(Pipe));
+    if (!p) return -1;
+    kstring::zero_memory(p, sizeof(Pipe));
+    p->pages = alloc_ring(PIPE_DEFAULT_SIZE / PIPE_PAGE_SIZE);
+    if (!p->pages) {
+        free(p);
         return -1;
     }
+    p->capacity = PIPE_DEFAULT_SIZE;
+    mutex_init(&p->lock);
+    wait_queue_init(&p->readers);
+    wait_queue_init(&p->writers);
     
-    Pipe* p = &pipes[pipe_id];
+    spinlock_acquire(&pipe_table_lock);
+    uint32_t slot = 0;
+    while (slot < pipe_slots && pipes[slot]) slot++;
+    if (slot == pipe_slots) {
+        uint32_t grown = pipe_slots ? pipe_slots * 2 : 8;
+        Pipe** bigger = (Pipe**)malloc(grown * sizeof(Pipe*));
+        if (!bigger) {
+            spinlock_release(&pipe_table_lock);
+            free_ring(p->pages, p->capacity / PIPE_PAGE_SIZE);
+            free(p);
+            return -1;
+        }
+        kstring::zero_memory(bigger, grown * sizeof(Pipe*));
+        if (pipes) {
+            kstring::memcpy(bigger, pipes, pipe_slots * sizeof(Pipe*));
+            free(pipes);
+        }
+        pipes = bigger;
+        pipe_slots = grown;
+    }
+    pipes[slot] = p;
+    stats.pipes++;
+    stats.buffer_bytes += p->capacity;
+    spinlock_release(&pipe_table_lock);
+    return (int)slot;
+}
+
+int64_t pipe_read(int pipe_id, char* buf, uint64_t count) {
+    Pipe* p = pipe_get(pipe_id);
+    if (!p) return -1;
     
-    // If no data and write end closed, return 0 (EOF)
-    if (p->count == 0 && p->write_closed) {
-        return 0;
+    mutex_lock(&p->lock);
+    while (count > 0 && p->count == 0 && !p->write_closed) {
+        stats.read_waits++;
+        wait_queue_wait(&p->readers, &p->lock);
     }
+    uint64_t n = (count < p->count) ? count : p->count;
+    ring_copy_out(p, p->read_pos, (uint8_t*)buf, n);
+    p->read_pos = (p->read_pos + n) % p->capacity;
+    p->count -= n;
+    stats.bytes_moved += n;
+    mutex_unlock(&p->lock);
     
-    // Read available data
-    uint64_t to_read = (count < p->count) ? count : p->count;
+    if (n > 0) wait_queue_wake_all(&p->writers);
+    pipe_put(pipe_id, p);
+    return (int64_t)n;
+}
+
+int64_t pipe_read_page(int pipe_id, uint8_t** page) {
+    *page = nullptr;
+    void* frame = pmm_alloc_frame();    // The ring's replacement page, or the copy
+    if (!frame) return -1;
+    uint8_t* spare = (uint8_t*)frame + vmm_get_hhdm_offset();
+    Pipe* p = pipe_get(pipe_id);
+    if (!p) {
+        pmm_free_frame(frame);
+        return -1;
+    }
     
-    for (uint64_t i = 0; i < to_read; i++) {
-        buf[i] = p->buffer[p->read_pos];
-        p->read_pos = (p->read_pos + 1) % PIPE_BUFFER_SIZE;
+    mutex_lock(&p->lock);
+    while (p->count == 0 && !p->write_closed) {
+        stats.read_waits++;
+        wait_queue_wait(&p->readers, &p->lock);
+    }
+    uint64_t off = p->read_pos % PIPE_PAGE_SIZE;
+    uint64_t n;
+    if (off == 0 && p->count >= PIPE_PAGE_SIZE) {
+        uint64_t slot = p->read_pos / PIPE_PAGE_SIZE;
+        *page = p->pages[slot];
+        p->pages[slot] = spare;
+        n = PIPE_PAGE_SIZE;
+        stats.pages_spliced++;
+    } else {
+        n = PIPE_PAGE_SIZE - off;
+        if (n > p->count) n = p->count;
+        ring_copy_out(p, p->read_pos, spare, n);
+        if (n > 0) *page = spare;
     }
-    p->count -= to_read;
+    p->read_pos = (p->read_pos + n) % p->capacity;
+    p->count -= n;
+    stats.bytes_moved += n;
+    mutex_unlock(&p->lock);
     
-    return to_read;
+    if (n > 0) wait_queue_wake_all(&p->writers);
+    else pmm_free_frame(frame);
+    pipe_put(pipe_id, p);
+    return (int64_t)n;
 }
 
 int64_t pipe_write(int pipe_id, const char* buf, uint64_t count) {
-    if (pipe_id < 0 || pipe_id >= MAX_PIPES || !pipes[pipe_id].in_use) {
-        return -1;
+    Pipe* p = pipe_get(pipe_id);
+    if (!p) return -1;
+    
+    uint64_t written = 0;
+    mutex_lock(&p->lock);
+    while (written < count && !p->read_closed) {
+        uint64_t space = p->capacity - p->count;
+        if (space == 0) {
+            stats.write_waits++;
+            wait_queue_wait(&p->writers, &p->lock);
+            continue;
+        }
+        uint64_t n = (count - written < space) ? count - written : space;
+        ring_copy_in(p, (p->read_pos + p->count) % p->capacity, (const uint8_t*)buf + written, n);
+        p->count += n;
+        written += n;
+        wait_queue_wake_all(&p->readers);
     }
+    mutex_unlock(&p->lock);
     
-    Pipe* p = &pipes[pipe_id];
+    pipe_put(pipe_id, p);
+    if (written == 0 && count > 0) return -1;  // Reader already gone
+    return (int64_t)written;
+}
+
+uint64_t pipe_get_size(int pipe_id) {
+    Pipe* p = pipe_get(pipe_id);
+    if (!p) return 0;
+    uint64_t size = p->capacity;
+    pipe_put(pipe_id, p);
+    return size;
+}
+
+int pipe_set_size(int pipe_id, uint64_t bytes) {
+    if (bytes < PIPE_MIN_SIZE || bytes > PIPE_MAX_SIZE) return -1;
+    uint64_t page_count = (bytes + PIPE_PAGE_SIZE - 1) / PIPE_PAGE_SIZE;
     
-    // If read end closed, return error
-    if (p->read_closed) {
+    Pipe* p = pipe_get(pipe_id);
+    if (!p) return -1;
+    uint8_t** fresh = alloc_ring(page_count);
+    if (!fresh) {
+        pipe_put(pipe_id, p);
         return -1;
     }
     
-    // Write as much as possible
-    uint64_t space = PIPE_BUFFER_SIZE - p->count;
-    uint64_t to_write = (count < space) ? count : space;
+    mutex_lock(&p->lock);
+    uint64_t capacity = page_count * PIPE_PAGE_SIZE;
+    if (p->count > capacity) {
+        mutex_unlock(&p->lock);
+        free_ring(fresh, page_count);
+        pipe_put(pipe_id, p);
+        return -1;
+    }
     
-    for (uint64_t i = 0; i < to_write; i++) {
-        p->buffer[p->write_pos] = buf[i];
-        p->write_pos = (p->write_pos + 1) % PIPE_BUFFER_SIZE;
+    // Move what is buffered to the start of the new ring
+    for (uint64_t done = 0, i = 0; done < p->count; done += PIPE_PAGE_SIZE, i++) {
+        uint64_t n = p->count - done < PIPE_PAGE_SIZE ? p->count - done : PIPE_PAGE_SIZE;
+        ring_copy_out(p, (p->read_pos + done) % p->capacity, fresh[i], n);
     }
-    p->count += to_write;
+    uint8_t** old = p->pages;
+    uint64_t old_capacity = p->capacity;
+    p->pages = fresh;
+    p->capacity = capacity;
+    p->read_pos = 0;
+    mutex_unlock(&p->lock);
     
-    return to_write;
+    spinlock_acquire(&pipe_table_lock);
+    stats.buffer_bytes = stats.buffer_bytes - old_capacity + capacity;
+    spinlock_release(&pipe_table_lock);
+    
+    free_ring(old, old_capacity / PIPE_PAGE_SIZE);
+    wait_queue_wake_all(&p->writers);  // There may be more room now
+    pipe_put(pipe_id, p);
+    return 0;
 }
 
 void pipe_close_read(int pipe_id) {
-    if (pipe_id < 0 || pipe_id >= MAX_PIPES) return;
-    pipes[pipe_id].read_closed = true;
-    
-    // If both ends closed, free the pipe
-    if (pipes[pipe_id].write_closed) {
-        pipes[pipe_id].in_use = false;
-    }
+    Pipe* p = pipe_get(pipe_id);
+    if (!p) return;
+    mutex_lock(&p->lock);
+    p->read_closed = true;
+    mutex_unlock(&p->lock);
+    wait_queue_wake_all(&p->writers);  // Writers fail instead of waiting forever
+    pipe_put(pipe_id, p);
 }
 
 void pipe_close_write(int pipe_id) {
-    if (pipe_id < 0 || pipe_id >= MAX_PIPES) return;
-    pipes[pipe_id].write_closed = true;
-    
-    // If both ends closed, free the pipe
-    if (pipes[pipe_id].read_closed) {
-        pipes[pipe_id].in_use = false;
-    }
+    Pipe* p = pipe_get(pipe_id);
+    if (!p) return;
+    mutex_lock(&p->lock);
+    p->write_closed = true;
+    mutex_unlock(&p->lock);
+    wait_queue_wake_all(&p->readers);  // Readers see EOF once drained
+    pipe_put(pipe_id, p);
+}
+
+bool pipe_is_write_closed(int pipe_id) {
+    Pipe* p = pipe_get(pipe_id);
+    if (!p) return true;
+    bool closed = p->write_closed;
+    pipe_put(pipe_id, p);
+    return closed;
+}
+
+void pipe_get_stats(PipeStats* out) {
+    spinlock_acquire(&pipe_table_lock);
+    *out = stats;
+    spinlock_release(&pipe_table_lock);
 }
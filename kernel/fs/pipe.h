@@ -1,22 +1,59 @@
 #pragma once
 #include <stdint.h>
 
-#define PIPE_BUFFER_SIZE 512
-#define MAX_PIPES 8
-
-struct Pipe {
-    bool in_use;
-    uint8_t buffer[PIPE_BUFFER_SIZE];
-    uint64_t read_pos;
-    uint64_t write_pos;
-    uint64_t count;      // Bytes in buffer
-    bool write_closed;
-    bool read_closed;
+// ============================================================================
+// Kernel Pipes
+// ============================================================================
+// Each pipe is a ring buffer of PMM pages, PIPE_DEFAULT_SIZE bytes unless it
+// is resized (PIPE_MIN_SIZE..PIPE_MAX_SIZE). Data moves with one memcpy per
+// contiguous run, never byte by byte.
+//
+// Reads block until data arrives or the write end closes (0 = EOF). Writes
+// block until everything is buffered or the read end closes. Blocked ends
+// sleep on wait queues instead of polling. Pipes are allocated on demand
+// and their ids reused once both ends are closed.
+// ============================================================================
+
+#define PIPE_PAGE_SIZE      4096
+#define PIPE_DEFAULT_SIZE   (64 * 1024)
+#define PIPE_MIN_SIZE       PIPE_PAGE_SIZE
+#define PIPE_MAX_SIZE       (1024 * 1024)
+
+struct PipeStats {
+    uint32_t pipes;             // Open pipes
+    uint64_t buffer_bytes;      // Ring memory held by them
+    uint64_t bytes_moved;       // Total bytes read
+    uint64_t read_waits;        // Times a reader blocked on an empty pipe
+    uint64_t write_waits;       // Times a writer blocked on a full pipe
+    uint64_t pages_spliced;     // Ring pages handed out by pipe_read_page()
 };
 
-void pipe_init();
 int pipe_create();  // Returns pipe ID, or -1 on error
+
+// Blocks until at least one byte can be read. Bytes read, 0 at EOF, -1 for
+// a bad pipe.
 int64_t pipe_read(int pipe_id, char* buf, uint64_t count);
+
+// Like pipe_read, but the bytes arrive in a PIPE_PAGE_SIZE page that the
+// caller owns afterwards (*page, HHDM address; return it with
+// pmm_free_frame). A full, page-aligned ring page is given away whole and
+// replaced by a fresh one, so nothing is copied; otherwise the bytes up to
+// the next page boundary are copied out, which realigns the stream for the
+// next call. Bytes in the page, 0 at EOF (*page = nullptr), -1 for a bad
+// pipe or no memory.
+int64_t pipe_read_page(int pipe_id, uint8_t** page);
+
+// Blocks until all of buf is buffered. Bytes written (fewer if the read end
+// closed part way), -1 if nothing could be written.
 int64_t pipe_write(int pipe_id, const char* buf, uint64_t count);
+
+// Ring size in bytes. Resizing rounds up to whole pages and fails (-1) if
+// out of range, out of memory, or more is buffered than would fit.
+uint64_t pipe_get_size(int pipe_id);
+int pipe_set_size(int pipe_id, uint64_t bytes);
+
 void pipe_close_read(int pipe_id);
 void pipe_close_write(int pipe_id);
+bool pipe_is_write_closed(int pipe_id);  // True once no more data can arrive
+
+void pipe_get_stats(PipeStats* out);
@@ -0,0 +1,685 @@
+#include "tmpfs.h"
+#include "vfs.h"
+#include "unifs.h"
+#include "unifs_disk.h"
+#include "kstring.h"
+#include "heap.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "mutex.h"
+#include "debug.h"
+
+// ============================================================================
+// State
+// ============================================================================
+// Calls from the VFS are serialized by it; tmpfs_lock additionally keeps the
+// reclaim callback, which can run from any allocation, off the trees while
+// an operation changes them.
+
+#define TMPFS_FANOUT        512     // Pointers per radix node (one page)
+#define TMPFS_FANOUT_SHIFT  9
+#define TMPFS_MAX_FILE_SIZE (1ULL << 40)    // 1 TB, sparse
+#define TMPFS_DIR_INITIAL   8
+
+struct TmpNode {
+    char name[UNIFS_MAX_FILENAME + 1];
+    uint32_t hash;              // unifs2_name_hash(name)
+    uint8_t kind;               // VFS_NODE_*
+    TmpNode* parent;
+
+    // Directories: entries in creation order
+    TmpNode** entries;
+    uint32_t entry_count;
+    uint32_t entry_capacity;
+
+    // Files
+    uint64_t size;
+    uint64_t generation;
+    void** root;                // Radix tree (HHDM addresses), nullptr = all hole
+    uint32_t levels;            // The tree covers 512^levels pages
+    uint64_t pages;             // Data pages held
+    TmpNode* file_next;         // All files, for reclaim
+};
+
+static TmpNode root_dir;
+static TmpNode* file_list = nullptr;
+static uint64_t next_generation = 1;
+static Mutex tmpfs_lock = MUTEX_INIT;
+static TmpfsStats stats;
+
+// Reclaim resumes where it stopped
+static TmpNode* scan_file = nullptr;
+static uint64_t scan_page = 0;
+
+// ============================================================================
+// Pages
+// ============================================================================
+
+static uint8_t* frame_alloc() {
+    void* frame = pmm_alloc_frame();
+    if (!frame) return nullptr;
+    uint8_t* page = (uint8_t*)frame + vmm_get_hhdm_offset();
+    kstring::zero_memory(page, TMPFS_PAGE_SIZE);
+    return page;
+}
+
+static void frame_free(void* page) {
+    pmm_free_frame((void*)((uint64_t)page - vmm_get_hhdm_offset()));
+}
+
+static bool is_zero(const void* data, uint64_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    while (len >= 8) {
+        uint64_t word;
+        __builtin_memcpy(&word, p, 8);
+        if (word) return false;
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        if (*p++) return false;
+    }
+    return true;
+}
+
+// Pages covered by a tree of this depth
+static uint64_t level_span(uint32_t levels) {
+    return 1ULL << (TMPFS_FANOUT_SHIFT * levels);
+}
+
+static uint32_t level_index(uint64_t page, uint32_t level) {
+    return (page >> (TMPFS_FANOUT_SHIFT * (level - 1))) & (TMPFS_FANOUT - 1);
+}
+
+static uint8_t* page_find(TmpNode* f, uint64_t page) {
+    if (!f->root || page >= level_span(f->levels)) return nullptr;
+    void** node = f->root;
+    for (uint32_t level = f->levels; level > 1; level--) {
+        node = (void**)node[level_index(page, level)];
+        if (!node) return nullptr;
+    }
+    return (uint8_t*)node[level_index(page, 1)];
+}
+
+static void** index_alloc() {
+    void** node = (void**)frame_alloc();
+    if (node) stats.index_pages++;
+    return node;
+}
+
+static void index_free(void** node) {
+    frame_free(node);
+    stats.index_pages--;
+}
+
+// Leaf slot for a page, adding levels and nodes as needed; nullptr if out
+// of memory. Nodes never move, so slots stay valid as the tree grows.
+static void** page_slot(TmpNode* f, uint64_t page) {
+    if (!f->root) {
+        f->root = index_alloc();
+        if (!f->root) return nullptr;
+        f->levels = 1;
+    }
+    while (page >= level_span(f->levels)) {
+        void** top = index_alloc();
+        if (!top) return nullptr;
+        top[0] = f->root;
+        f->root = top;
+        f->levels++;
+    }
+    void** node = f->root;
+    for (uint32_t level = f->levels; level > 1; level--) {
+        void** child = (void**)node[level_index(page, level)];
+        if (!child) {
+            child = index_alloc();
+            if (!child) return nullptr;
+            node[level_index(page, level)] = child;
+        }
+        node = child;
+    }
+    return &node[level_index(page, 1)];
+}
+
+// Free the data pages in [first, last] below node, whose first page is base,
+// and the nodes this empties. True if node itself is now empty.
+static bool punch_node(TmpNode* f, void** node, uint32_t level, uint64_t base,
+                       uint64_t first, uint64_t last) {
+    uint64_t child_span = level_span(level - 1);
+    bool empty = true;
+    for (uint32_t i = 0; i < TMPFS_FANOUT; i++) {
+        if (!node[i]) continue;
+        uint64_t lo = base + i * child_span;
+        uint64_t hi = lo + child_span - 1;
+        if (hi < first || lo > last) {
+            empty = false;
+        } else if (level == 1) {
+            frame_free(node[i]);
+            node[i] = nullptr;
+            f->pages--;
+            stats.data_pages--;
+        } else if (punch_node(f, (void**)node[i], level - 1, lo, first, last)) {
+            index_free((void**)node[i]);
+            node[i] = nullptr;
+        } else {
+            empty = false;
+        }
+    }
+    return empty;
+}
+
+static void free_pages(TmpNode* f, uint64_t first, uint64_t last) {
+    if (!f->root || first > last) return;
+    if (punch_node(f, f->root, f->levels, 0, first, last)) {
+        index_free(f->root);
+        f->root = nullptr;
+        f->levels = 0;
+    }
+}
+
+// Zero [offset, offset + len) within one page. A page this leaves all
+// zeros is kept; the reclaimer finds it when memory runs short.
+static void zero_in_page(TmpNode* f, uint64_t offset, uint64_t len) {
+    uint8_t* data = page_find(f, offset / TMPFS_PAGE_SIZE);
+    if (data) kstring::zero_memory(data + offset % TMPFS_PAGE_SIZE, len);
+}
+
+// Make [offset, end) read as zeros, freeing every page it covers whole
+static void zero_range(TmpNode* f, uint64_t offset, uint64_t end) {
+    if (offset >= end) return;
+    uint64_t first = (offset + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE;
+    uint64_t last = end / TMPFS_PAGE_SIZE;   // First page not covered whole
+    if (first >= last) {
+        // Inside one page, or across one boundary with neither page whole
+        uint64_t boundary = (offset / TMPFS_PAGE_SIZE + 1) * TMPFS_PAGE_SIZE;
+        if (end <= boundary) {
+            zero_in_page(f, offset, end - offset);
+        } else {
+            zero_in_page(f, offset, boundary - offset);
+            zero_in_page(f, boundary, end - boundary);
+        }
+        return;
+    }
+    if (offset % TMPFS_PAGE_SIZE) zero_in_page(f, offset, first * TMPFS_PAGE_SIZE - offset);
+    free_pages(f, first, last - 1);
+    if (end % TMPFS_PAGE_SIZE) zero_in_page(f, last * TMPFS_PAGE_SIZE, end % TMPFS_PAGE_SIZE);
+}
+
+// Drop everything from size on: the rest of its page reads as zeros again
+// and later pages go
+static void cut_at(TmpNode* f, uint64_t size) {
+    uint64_t in_page = size % TMPFS_PAGE_SIZE;
+    if (in_page) zero_in_page(f, size, TMPFS_PAGE_SIZE - in_page);
+    free_pages(f, (size + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE, ~0ULL);
+}
+
+// Pages a write of data at offset would add: holes it puts non-zero bytes in
+static uint64_t pages_needed(TmpNode* f, uint64_t offset, const uint8_t* data, uint64_t len) {
+    uint64_t needed = 0;
+    while (len > 0) {
+        uint64_t in_page = offset % TMPFS_PAGE_SIZE;
+        uint64_t n = TMPFS_PAGE_SIZE - in_page;
+        if (n > len) n = len;
+        if (!page_find(f, offset / TMPFS_PAGE_SIZE) && !is_zero(data, n)) needed++;
+        offset += n;
+        data += n;
+        len -= n;
+    }
+    return needed;
+}
+
+// Give the holes a write needs zeroed pages, so the copy cannot fail half
+// way. Contents do not change. False if out of memory; unpopulate() then
+// takes the pages back.
+static bool populate(TmpNode* f, uint64_t offset, const uint8_t* data, uint64_t len) {
+    while (len > 0) {
+        uint64_t in_page = offset % TMPFS_PAGE_SIZE;
+        uint64_t n = TMPFS_PAGE_SIZE - in_page;
+        if (n > len) n = len;
+        uint64_t page = offset / TMPFS_PAGE_SIZE;
+        if (!page_find(f, page) && !is_zero(data, n)) {
+            if (pmm_get_free_memory() / TMPFS_PAGE_SIZE < TMPFS_RESERVE_PAGES) return false;
+            void** slot = page_slot(f, page);
+            uint8_t* frame = slot ? frame_alloc() : nullptr;
+            if (!frame) return false;
+            *slot = frame;
+            f->pages++;
+            stats.data_pages++;
+        }
+        offset += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Free the all-zero pages in [offset, offset + len): those populate() added
+static void unpopulate(TmpNode* f, uint64_t offset, uint64_t len) {
+    uint64_t last = (offset + len - 1) / TMPFS_PAGE_SIZE;
+    for (uint64_t page = offset / TMPFS_PAGE_SIZE; page <= last; page++) {
+        uint8_t* data = page_find(f, page);
+        if (data && is_zero(data, TMPFS_PAGE_SIZE)) free_pages(f, page, page);
+    }
+}
+
+// After populate(): holes left in the range only receive zeros
+static void copy_in(TmpNode* f, uint64_t offset, const uint8_t* data, uint64_t len) {
+    while (len > 0) {
+        uint64_t in_page = offset % TMPFS_PAGE_SIZE;
+        uint64_t n = TMPFS_PAGE_SIZE - in_page;
+        if (n > len) n = len;
+        uint64_t page = offset / TMPFS_PAGE_SIZE;
+        uint8_t* dst = page_find(f, page);
+        if (dst) {
+            if (n == TMPFS_PAGE_SIZE && is_zero(data, n)) {
+                free_pages(f, page, page);
+            } else {
+                kstring::memcpy(dst + in_page, data, n);
+            }
+        }
+        offset += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static void copy_out(TmpNode* f, uint64_t offset, uint8_t* buf, uint64_t len) {
+    while (len > 0) {
+        uint64_t in_page = offset % TMPFS_PAGE_SIZE;
+        uint64_t n = TMPFS_PAGE_SIZE - in_page;
+        if (n > len) n = len;
+        const uint8_t* src = page_find(f, offset / TMPFS_PAGE_SIZE);
+        if (src) {
+            kstring::memcpy(buf, src + in_page, n);
+        } else {
+            kstring::zero_memory(buf, n);
+        }
+        offset += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+// ============================================================================
+// Nodes and Paths
+// ============================================================================
+
+static TmpNode* dir_find(TmpNode* dir, const char* name, uint32_t len) {
+    uint32_t hash = unifs2_name_hash(name, len);
+    for (uint32_t i = 0; i < dir->entry_count; i++) {
+        TmpNode* n = dir->entries[i];
+        if (n->hash == hash && kstring::strncmp(n->name, name, len) == 0 && n->name[len] == '\0') {
+            return n;
+        }
+    }
+    return nullptr;
+}
+
+// Node for a path relative to the mount ("" = root), or nullptr
+static TmpNode* resolve(const char* path) {
+    TmpNode* node = &root_dir;
+    while (*path && node) {
+        if (node->kind != VFS_NODE_DIR) return nullptr;
+        const char* end = path;
+        while (*end && *end != '/') end++;
+        node = dir_find(node, path, end - path);
+        path = *end ? end + 1 : end;
+    }
+    return node;
+}
+
+// Directory that holds path; *leaf receives the last component
+static TmpNode* resolve_parent(const char* path, const char** leaf, int* error) {
+    const char* slash = nullptr;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/') slash = p;
+    }
+    *leaf = slash ? slash + 1 : path;
+    if (kstring::strlen(*leaf) > UNIFS_MAX_FILENAME) {
+        *error = UNIFS_ERR_NAME_TOO_LONG;
+        return nullptr;
+    }
+
+    TmpNode* dir = &root_dir;
+    if (slash) {
+        char parent[VFS_MAX_PATH];
+        uint64_t len = slash - path;
+        kstring::memcpy(parent, path, len);
+        parent[len] = '\0';
+        dir = resolve(parent);
+    }
+    if (!dir) {
+        *error = UNIFS_ERR_NOT_FOUND;
+    } else if (dir->kind != VFS_NODE_DIR) {
+        *error = UNIFS_ERR_NOT_DIR;
+        dir = nullptr;
+    }
+    return dir;
+}
+
+static int node_create(const char* path, uint8_t kind, TmpNode** out) {
+    const char* leaf;
+    int error;
+    TmpNode* dir = resolve_parent(path, &leaf, &error);
+    if (!dir) return error;
+    uint32_t len = kstring::strlen(leaf);
+    if (len == 0) return UNIFS_ERR_INVALID;
+    if (dir_find(dir, leaf, len)) return UNIFS_ERR_EXISTS;
+
+    if (dir->entry_count == dir->entry_capacity) {
+        uint32_t capacity = dir->entry_capacity ? dir->entry_capacity * 2 : TMPFS_DIR_INITIAL;
+        TmpNode** bigger = (TmpNode**)malloc(capacity * sizeof(TmpNode*));
+        if (!bigger) return UNIFS_ERR_NO_MEMORY;
+        if (dir->entries) {
+            kstring::memcpy(bigger, dir->entries, dir->entry_count * sizeof(TmpNode*));
+            free(dir->entries);
+        }
+        dir->entries = bigger;
+        dir->entry_capacity = capacity;
+    }
+
+    TmpNode* node = (TmpNode*)malloc(sizeof(TmpNode));
+    if (!node) return UNIFS_ERR_NO_MEMORY;
+    kstring::zero_memory(node, sizeof(TmpNode));
+    kstring::memcpy(node->name, leaf, len + 1);
+    node->hash = unifs2_name_hash(leaf, len);
+    node->kind = kind;
+    node->parent = dir;
+    node->generation = next_generation++;
+    dir->entries[dir->entry_count++] = node;
+
+    if (kind == VFS_NODE_FILE) {
+        node->file_next = file_list;
+        file_list = node;
+        stats.files++;
+    } else {
+        stats.dirs++;
+    }
+    if (out) *out = node;
+    return UNIFS_OK;
+}
+
+static void node_destroy(TmpNode* node) {
+    TmpNode* dir = node->parent;
+    for (uint32_t i = 0; i < dir->entry_count; i++) {
+        if (dir->entries[i] != node) continue;
+        kstring::memmove(&dir->entries[i], &dir->entries[i + 1],
+                         (dir->entry_count - i - 1) * sizeof(TmpNode*));
+        dir->entry_count--;
+        break;
+    }
+
+    if (node->kind == VFS_NODE_FILE) {
+        free_pages(node, 0, ~0ULL);
+        stats.bytes -= node->size;
+        stats.files--;
+        for (TmpNode** p = &file_list; *p; p = &(*p)->file_next) {
+            if (*p == node) {
+                *p = node->file_next;
+                break;
+            }
+        }
+        if (scan_file == node) {
+            scan_file = node->file_next;
+            scan_page = 0;
+        }
+    } else {
+        stats.dirs--;
+        if (node->entries) free(node->entries);
+    }
+    free(node);
+}
+
+static void set_size(TmpNode* f, uint64_t size) {
+    stats.bytes = stats.bytes - f->size + size;
+    f->size = size;
+    f->generation = next_generation++;
+}
+
+// ============================================================================
+// Memory Pressure
+// ============================================================================
+// File pages cannot be dropped like clean cache, but a page holding only
+// zeros (partly punched or truncated into zeros) is a hole in disguise.
+// Checking for that on every partial zeroing would cost a page scan each
+// time, so it waits until memory is actually short.
+// Each call checks up to TMPFS_RECLAIM_SCAN pages, continuing from where
+// the last call stopped, and frees the zero ones. Trylock, as the callback
+// may run inside one of our own allocations.
+
+static uint64_t tmpfs_reclaim(uint64_t pages) {
+    if (!mutex_try_lock(&tmpfs_lock)) return 0;
+    uint64_t freed = 0;
+    uint64_t scanned = 0;
+    uint64_t files_seen = 0;
+    while (freed < pages && scanned < TMPFS_RECLAIM_SCAN && files_seen <= stats.files) {
+        if (!scan_file) {
+            scan_file = file_list;
+            scan_page = 0;
+            files_seen++;
+            if (!scan_file) break;
+        }
+        TmpNode* f = scan_file;
+        uint64_t end = (f->size + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE;
+        while (scan_page < end && scanned < TMPFS_RECLAIM_SCAN && freed < pages) {
+            uint8_t* data = page_find(f, scan_page);
+            if (data) {
+                scanned++;
+                if (is_zero(data, TMPFS_PAGE_SIZE)) {
+                    free_pages(f, scan_page, scan_page);
+                    freed++;
+                }
+            }
+            scan_page++;
+        }
+        if (scan_page >= end) {
+            scan_file = f->file_next;
+            scan_page = 0;
+            files_seen++;
+        }
+    }
+    stats.reclaimed += freed;
+    mutex_unlock(&tmpfs_lock);
+    return freed;
+}
+
+// ============================================================================
+// VFS Driver
+// ============================================================================
+// Node ids are TmpNode addresses: the VFS keeps a file from being removed
+// while it is open, so an id is never used after its node is freed.
+
+static bool tmpfs_vfs_lookup(void*, const char* path, VfsNodeInfo* out) {
+    mutex_lock(&tmpfs_lock);
+    TmpNode* node = resolve(path);
+    if (node) {
+        out->id = (uint64_t)node;
+        out->kind = node->kind;
+        out->size = node->size;
+        out->generation = node->generation;
+    }
+    mutex_unlock(&tmpfs_lock);
+    return node != nullptr;
+}
+
+static int64_t tmpfs_vfs_read(void*, uint64_t id, uint64_t offset, void* buf, uint64_t len) {
+    TmpNode* f = (TmpNode*)id;
+    if (f->kind != VFS_NODE_FILE) return UNIFS_ERR_IS_DIR;
+    mutex_lock(&tmpfs_lock);
+    if (offset >= f->size) {
+        len = 0;
+    } else if (len > f->size - offset) {
+        len = f->size - offset;
+    }
+    copy_out(f, offset, (uint8_t*)buf, len);
+    mutex_unlock(&tmpfs_lock);
+    return (int64_t)len;
+}
+
+static int tmpfs_vfs_content_type(void*, const char* path) {
+    uint8_t head[256];
+    mutex_lock(&tmpfs_lock);
+    TmpNode* f = resolve(path);
+    int type = UNIFS_TYPE_UNKNOWN;
+    if (f && f->kind == VFS_NODE_DIR) {
+        type = UNIFS_TYPE_DIR;
+    } else if (f) {
+        uint64_t len = f->size < sizeof(head) ? f->size : sizeof(head);
+        copy_out(f, 0, head, len);
+        type = unifs_detect_type(head, len);
+    }
+    mutex_unlock(&tmpfs_lock);
+    return type;
+}
+
+static int tmpfs_vfs_create(void*, const char* path, bool dir) {
+    mutex_lock(&tmpfs_lock);
+    int result = node_create(path, dir ? VFS_NODE_DIR : VFS_NODE_FILE, nullptr);
+    mutex_unlock(&tmpfs_lock);
+    return result;
+}
+
+// Writes either fully happen or change nothing the reader can see: the
+// pages are checked against the quota and allocated before any byte moves
+static int tmpfs_vfs_write(void*, const char* path, const void* data, uint64_t size, bool append) {
+    mutex_lock(&tmpfs_lock);
+    int result = UNIFS_OK;
+    TmpNode* f = resolve(path);
+    if (!f) {
+        result = node_create(path, VFS_NODE_FILE, &f);
+    } else if (f->kind != VFS_NODE_FILE) {
+        result = UNIFS_ERR_IS_DIR;
+    }
+
+    uint64_t offset = append && f ? f->size : 0;
+    const uint8_t* bytes = (const uint8_t*)data;
+    if (result == UNIFS_OK && size > TMPFS_MAX_FILE_SIZE - offset) result = UNIFS_ERR_FULL;
+    if (result == UNIFS_OK && bytes) {
+        if (stats.data_pages + pages_needed(f, offset, bytes, size) > stats.quota_pages) {
+            result = UNIFS_ERR_FULL;
+        } else if (!populate(f, offset, bytes, size)) {
+            unpopulate(f, offset, size);
+            result = UNIFS_ERR_NO_MEMORY;
+        } else {
+            copy_in(f, offset, bytes, size);
+        }
+    }
+    if (result == UNIFS_OK) {
+        // Overwrite: zeros where no data was given, nothing past the end
+        if (!bytes) zero_range(f, offset, offset + size);
+        if (!append) cut_at(f, size);
+        set_size(f, offset + size);
+    }
+    mutex_unlock(&tmpfs_lock);
+    return result;
+}
+
+static int tmpfs_vfs_remove(void*, const char* path) {
+    mutex_lock(&tmpfs_lock);
+    int result = UNIFS_OK;
+    TmpNode* node = resolve(path);
+    if (!node || node == &root_dir) {
+        result = UNIFS_ERR_NOT_FOUND;
+    } else if (node->kind == VFS_NODE_DIR && node->entry_count) {
+        result = UNIFS_ERR_NOT_EMPTY;
+    } else {
+        node_destroy(node);
+    }
+    mutex_unlock(&tmpfs_lock);
+    return result;
+}
+
+static uint64_t tmpfs_vfs_dir_count(void*, const char* path) {
+    mutex_lock(&tmpfs_lock);
+    TmpNode* dir = resolve(path);
+    uint64_t count = dir && dir->kind == VFS_NODE_DIR ? dir->entry_count : 0;
+    mutex_unlock(&tmpfs_lock);
+    return count;
+}
+
+static const char* tmpfs_vfs_dir_name(void*, const char* path, uint64_t index) {
+    mutex_lock(&tmpfs_lock);
+    TmpNode* dir = resolve(path);
+    const char* name = nullptr;
+    if (dir && dir->kind == VFS_NODE_DIR && index < dir->entry_count) name = dir->entries[index]->name;
+    mutex_unlock(&tmpfs_lock);
+    return name;
+}
+
+// Shrinking frees the pages past the end; growing adds a hole
+static int tmpfs_vfs_truncate(void*, const char* path, uint64_t size) {
+    if (size > TMPFS_MAX_FILE_SIZE) return UNIFS_ERR_FULL;
+    mutex_lock(&tmpfs_lock);
+    TmpNode* f = resolve(path);
+    int result = UNIFS_OK;
+    if (!f) {
+        result = UNIFS_ERR_NOT_FOUND;
+    } else if (f->kind != VFS_NODE_FILE) {
+        result = UNIFS_ERR_IS_DIR;
+    } else {
+        cut_at(f, size);
+        set_size(f, size);
+    }
+    mutex_unlock(&tmpfs_lock);
+    return result;
+}
+
+static int tmpfs_vfs_punch_hole(void*, const char* path, uint64_t offset, uint64_t len) {
+    mutex_lock(&tmpfs_lock);
+    TmpNode* f = resolve(path);
+    int result = UNIFS_OK;
+    if (!f) {
+        result = UNIFS_ERR_NOT_FOUND;
+    } else if (f->kind != VFS_NODE_FILE) {
+        result = UNIFS_ERR_IS_DIR;
+    } else if (offset < f->size) {
+        uint64_t end = len > f->size - offset ? f->size : offset + len;
+        zero_range(f, offset, end);
+        f->generation = next_generation++;
+    }
+    mutex_unlock(&tmpfs_lock);
+    return result;
+}
+
+const VfsOps tmpfs_vfs_ops = {
+    "tmpfs",
+    tmpfs_vfs_lookup,
+    nullptr,
+    tmpfs_vfs_read,
+    nullptr,
+    tmpfs_vfs_content_type,
+    tmpfs_vfs_create,
+    tmpfs_vfs_write,
+    tmpfs_vfs_remove,
+    tmpfs_vfs_dir_count,
+    tmpfs_vfs_dir_name,
+    nullptr,
+    nullptr,
+    tmpfs_vfs_truncate,
+    tmpfs_vfs_punch_hole,
+};
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void tmpfs_init() {
+    kstring::zero_memory(&root_dir, sizeof(root_dir));
+    root_dir.kind = VFS_NODE_DIR;
+    kstring::zero_memory(&stats, sizeof(stats));
+    mutex_init(&tmpfs_lock);
+    tmpfs_set_quota(pmm_get_total_memory() / 100 * TMPFS_DEFAULT_QUOTA_PERCENT);
+    pmm_register_reclaim(tmpfs_reclaim);
+    DEBUG_INFO("tmpfs: Quota %lu MB", stats.quota_pages * TMPFS_PAGE_SIZE / (1024 * 1024));
+}
+
+void tmpfs_set_quota(uint64_t bytes) {
+    mutex_lock(&tmpfs_lock);
+    stats.quota_pages = (bytes + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE;
+    mutex_unlock(&tmpfs_lock);
+}
+
+void tmpfs_get_stats(TmpfsStats* out) {
+    mutex_lock(&tmpfs_lock);
+    *out = stats;
+    mutex_unlock(&tmpfs_lock);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+
+// ============================================================================
+// tmpfs - Page-Backed Memory Filesystem
+// ============================================================================
+// Files and directories that live only in memory, mounted at /tmp. File data
+// sits in PMM pages indexed by a radix tree of page-sized nodes (512 entries
+// each, one more level per 512x growth), never in the kernel heap, so a big
+// file cannot starve the heap that networking and drivers allocate from.
+//
+// Accounting is per page. Data pages count against a quota (TMPFS_DEFAULT_
+// QUOTA_PERCENT of RAM unless tmpfs_set_quota() says otherwise); a write that
+// would need more fails with UNIFS_ERR_FULL before anything changes. Writes
+// also fail with UNIFS_ERR_NO_MEMORY rather than take the last
+// TMPFS_RESERVE_PAGES free frames.
+//
+// Files are sparse: pages that were never written, punched out whole or
+// written with nothing but zeros are holes, read back as zeros and cost
+// nothing. Pages that partial punches or truncates leave all zeros are kept
+// until memory runs short; then the PMM reclaim callback scans file pages
+// and turns those back into holes.
+// ============================================================================
+
+#define TMPFS_PAGE_SIZE                 4096
+#define TMPFS_DEFAULT_QUOTA_PERCENT     25
+#define TMPFS_RESERVE_PAGES             1024    // 4 MB left for everyone else
+#define TMPFS_RECLAIM_SCAN              256     // Pages checked per reclaim call
+
+struct TmpfsStats {
+    uint64_t quota_pages;       // Data pages allowed
+    uint64_t data_pages;        // Data pages held
+    uint64_t index_pages;       // Radix tree nodes
+    uint64_t files;
+    uint64_t dirs;
+    uint64_t bytes;             // Sum of file sizes (holes included)
+    uint64_t reclaimed;         // Zero pages given back under memory pressure
+};
+
+struct VfsOps;
+extern const VfsOps tmpfs_vfs_ops;
+
+// Set up an empty filesystem and register with memory-pressure reclaim.
+// Mount it with vfs_mount("/tmp", &tmpfs_vfs_ops, nullptr).
+void tmpfs_init();
+
+// Quota in bytes, rounded up to whole pages. Lowering it below the current
+// usage only stops further growth.
+void tmpfs_set_quota(uint64_t bytes);
+
+void tmpfs_get_stats(TmpfsStats* out);
@@ -1,36 +1,227 @@
 #include "unifs.h"
+#include "unifs_disk.h"
+#include "lz4.h"
+#include "vfs.h"
 #include "kstring.h"
 #include "heap.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "crc32c.h"
+#include "spinlock.h"
+#include "scheduler.h"
+#include "process.h"
+#include "timer.h"
+#include "debug.h"
 
 // ============================================================================
 // uniFS Implementation
 // ============================================================================
-// The filesystem has two parts:
-// 1. Boot files: Read from Limine module at boot (read-only)
-// 2. RAM files: Created at runtime (read-write, lost on reboot)
+// The filesystem has three parts:
+// 1. Boot files: Read from Limine module (or a snapshot) at boot (read-only)
+// 2. RAM files: Created at runtime (read-write, lost on reboot unless saved
+//    by unifs_snapshot()), stored as lists of page-sized chunks so appends
+//    never copy the file
+// 3. Disk volume: uniFS v2 on a block device (read-write, persistent).
+//    When mounted, it takes all runtime changes instead of RAM.
+// Lookups try the disk, then RAM, then the boot image. Boot and RAM names are
+// found through hash tables; the merged listing is built once per change.
 // ============================================================================
 
 // Boot filesystem (read-only, from boot module)
 static uint8_t* fs_start = nullptr;
 static UniFSHeader* boot_header = nullptr;
 static UniFSEntry* boot_entries = nullptr;
+static uint64_t boot_size = 0;        // Bytes from fs_start past the last in-place file
+static uint64_t boot_image_size = 0;  // Whole boot module, trailers included
+static bool boot_sorted = false;      // Entries sorted by name (aligned image)
+static bool boot_indexed = false;     // boot_names points at the image's own table
 static bool mounted = false;
 
 // RAM filesystem (read-write)
+#define RAM_CHUNK_SIZE      4096    // One PMM frame
+#define RAM_TABLE_INITIAL   64
+
 struct RAMFile {
-    char name[64];        // Filename
-    uint8_t* data;        // File data (heap allocated)
-    uint64_t size;        // File size
-    uint64_t capacity;    // Allocated capacity
-    bool used;            // Slot in use
+    char name[64];            // Filename
+    uint8_t** chunks;         // File data, RAM_CHUNK_SIZE each (HHDM addresses)
+    uint64_t chunk_count;     // Chunks allocated (may run past size)
+    uint64_t chunk_capacity;  // Entries in chunks[]
+    uint64_t size;            // File size
+    uint64_t generation;      // Bumped on every modification
+    uint8_t* flat;            // Contiguous copy for unifs_open_into() ...
+    uint64_t flat_generation; // ...made at this generation
 };
 
-static RAMFile ram_files[UNIFS_MAX_FILES];
+// File table, grown on demand; freed slots are nullptr and reused
+static RAMFile** ram_files = nullptr;
+static uint32_t ram_file_slots = 0;
+static uint32_t ram_free_hint = 0;   // No free slot below this
 static uint64_t ram_file_count = 0;
+static uint64_t next_generation = 1;  // 0 is reserved for boot files
+
+// Disk volume (read-write, persistent)
+static UniFSVolume* disk_volume = nullptr;
+
+// Flat copies of disk files handed out by unifs_open_into(). A copy is
+// reused until the file's version changes, then replaced like RAM file data.
+struct DiskCopy {
+    char name[64];
+    uint32_t inode;
+    uint64_t version;
+    uint8_t* data;
+    uint64_t size;
+    DiskCopy* next;
+};
+
+static DiskCopy* disk_copies = nullptr;
+
+// Open-addressing hash table of entry indices, keyed by the entry's name.
+// Slots hold index + 1 (0 = empty, NAME_DELETED = removed). Kept at most half
+// full, tombstones included, so probes stay short.
+#define NAME_EMPTY      0u
+#define NAME_DELETED    0xFFFFFFFFu
+#define NAME_NONE       0xFFFFFFFFu
+
+struct NameTable {
+    uint32_t* slots;
+    uint32_t capacity;          // Power of two
+    uint32_t used;              // Live entries plus tombstones
+    const char* (*name_of)(uint32_t index);
+};
+
+static NameTable boot_names;
+static NameTable ram_names;
+
+// Merged boot + RAM + disk root listing for unifs_get_file_name()
+static const char** listing = nullptr;
+static uint64_t listing_count = 0;
+static uint64_t listing_capacity = 0;
+static bool listing_valid = false;
 
 // ELF magic bytes
 static const uint8_t ELF_MAGIC[] = {0x7F, 'E', 'L', 'F'};
 
+// ============================================================================
+// Name Index
+// ============================================================================
+
+static uint32_t name_hash(const char* name) {
+    return unifs2_name_hash(name, kstring::strlen(name));
+}
+
+static bool table_init(NameTable* t, uint32_t entries, const char* (*name_of)(uint32_t)) {
+    uint32_t capacity = 16;
+    while (capacity < entries * 2) capacity *= 2;
+    t->slots = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    t->capacity = t->slots ? capacity : 0;
+    t->used = 0;
+    t->name_of = name_of;
+    if (t->slots) kstring::zero_memory(t->slots, capacity * sizeof(uint32_t));
+    return t->slots != nullptr;
+}
+
+// Slot holding name, or the first free one on its probe path
+static uint32_t table_probe(const NameTable* t, const char* name, uint32_t hash, bool* found) {
+    uint32_t mask = t->capacity - 1;
+    uint32_t reuse = NAME_NONE;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t slot = t->slots[i];
+        if (slot == NAME_EMPTY) {
+            *found = false;
+            return reuse != NAME_NONE ? reuse : i;
+        }
+        if (slot == NAME_DELETED) {
+            if (reuse == NAME_NONE) reuse = i;
+        } else if (kstring::strcmp(t->name_of(slot - 1), name) == 0) {
+            *found = true;
+            return i;
+        }
+    }
+}
+
+static uint32_t table_find(const NameTable* t, const char* name) {
+    if (!t->slots) return NAME_NONE;
+    bool found;
+    uint32_t i = table_probe(t, name, name_hash(name), &found);
+    return found ? t->slots[i] - 1 : NAME_NONE;
+}
+
+static bool table_insert(NameTable* t, uint32_t index);
+
+// Rebuild at twice the size (or the same size, dropping tombstones)
+static bool table_grow(NameTable* t) {
+    NameTable bigger;
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < t->capacity; i++) {
+        if (t->slots[i] != NAME_EMPTY && t->slots[i] != NAME_DELETED) live++;
+    }
+    if (!table_init(&bigger, live * 2 + 1, t->name_of)) return false;
+    for (uint32_t i = 0; i < t->capacity; i++) {
+        uint32_t slot = t->slots[i];
+        if (slot != NAME_EMPTY && slot != NAME_DELETED) table_insert(&bigger, slot - 1);
+    }
+    free(t->slots);
+    *t = bigger;
+    return true;
+}
+
+static bool table_insert(NameTable* t, uint32_t index) {
+    if (!t->slots || (t->used + 1) * 2 > t->capacity) {
+        if (!t->slots || !table_grow(t)) return false;
+    }
+    bool found;
+    const char* name = t->name_of(index);
+    uint32_t i = table_probe(t, name, name_hash(name), &found);
+    if (!found && t->slots[i] == NAME_EMPTY) t->used++;
+    t->slots[i] = index + 1;
+    return true;
+}
+
+static void table_remove(NameTable* t, const char* name) {
+    if (!t->slots) return;
+    bool found;
+    uint32_t i = table_probe(t, name, name_hash(name), &found);
+    if (found) t->slots[i] = NAME_DELETED;
+}
+
+static const char* boot_name_of(uint32_t index) {
+    return boot_entries[index].name;
+}
+
+static const char* ram_name_of(uint32_t index) {
+    return ram_files[index]->name;
+}
+
+static void invalidate_listing() {
+    listing_valid = false;
+}
+
+// Use an aligned image's hash table in place. The table must lie inside
+// the image, every slot must name a valid entry and at least one must be
+// empty, or probes could run forever.
+static bool use_image_index(const UniFSIndex* index, uint64_t count) {
+    uint32_t slots = index->table_slots;
+    if (index->data_align != UNIFS_DATA_ALIGN || slots <= count || (slots & (slots - 1)) != 0) {
+        return false;
+    }
+    if (index->table_offset > boot_image_size || (boot_image_size - index->table_offset) / 4 < slots) {
+        return false;
+    }
+    uint32_t* table = (uint32_t*)(fs_start + index->table_offset);
+    uint32_t empty = 0;
+    for (uint32_t i = 0; i < slots; i++) {
+        if (table[i] == NAME_EMPTY) empty++;
+        else if (table[i] > count) return false;
+    }
+    if (empty == 0) return false;
+    
+    boot_names.slots = table;
+    boot_names.capacity = slots;
+    boot_names.used = (uint32_t)(slots - empty);
+    boot_names.name_of = boot_name_of;
+    return true;
+}
+
 // ============================================================================
 // Internal Helpers
 // ============================================================================
@@ -39,6 +230,25 @@ static const uint8_t ELF_MAGIC[] = {0x7F, 'E', 'L', 'F'};
 static UniFSEntry* find_boot_entry(const char* name) {
     if (!mounted || !name) return nullptr;
     
+    uint32_t index = table_find(&boot_names, name);
+    if (index != NAME_NONE) return &boot_entries[index];
+    if (boot_names.slots) return nullptr;
+    
+    // No usable index: binary search a sorted image, else scan
+    if (boot_sorted) {
+        uint64_t lo = 0, hi = boot_header->file_count;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            int cmp = kstring::strcmp(boot_entries[mid].name, name);
+            if (cmp == 0) {
+                while (mid > 0 && kstring::strcmp(boot_entries[mid - 1].name, name) == 0) mid--;
+                return &boot_entries[mid];
+            }
+            if (cmp < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return nullptr;
+    }
     for (uint64_t i = 0; i < boot_header->file_count; i++) {
         if (kstring::strcmp(boot_entries[i].name, name) == 0) {
             return &boot_entries[i];
@@ -51,22 +261,194 @@ static UniFSEntry* find_boot_entry(const char* name) {
 static RAMFile* find_ram_file(const char* name) {
     if (!name) return nullptr;
     
-    for (int i = 0; i < UNIFS_MAX_FILES; i++) {
-        if (ram_files[i].used && kstring::strcmp(ram_files[i].name, name) == 0) {
-            return &ram_files[i];
-        }
+    uint32_t index = table_find(&ram_names, name);
+    return index != NAME_NONE ? ram_files[index] : nullptr;
+}
+
+// Find a free RAM file slot, growing the table if it is full (NAME_NONE if
+// out of memory)
+static uint32_t find_free_slot() {
+    while (ram_free_hint < ram_file_slots && ram_files[ram_free_hint]) ram_free_hint++;
+    if (ram_free_hint < ram_file_slots) return ram_free_hint;
+    
+    uint32_t slots = ram_file_slots ? ram_file_slots * 2 : RAM_TABLE_INITIAL;
+    RAMFile** bigger = (RAMFile**)malloc(slots * sizeof(RAMFile*));
+    if (!bigger) return NAME_NONE;
+    kstring::zero_memory(bigger, slots * sizeof(RAMFile*));
+    if (ram_files) {
+        kstring::memcpy(bigger, ram_files, ram_file_slots * sizeof(RAMFile*));
+        free(ram_files);
     }
-    return nullptr;
+    ram_files = bigger;
+    ram_file_slots = slots;
+    return ram_free_hint;
+}
+
+// ============================================================================
+// RAM File Chunks
+// ============================================================================
+
+static uint8_t* chunk_alloc() {
+    void* frame = pmm_alloc_frame();
+    return frame ? (uint8_t*)frame + vmm_get_hhdm_offset() : nullptr;
 }
 
-// Find free RAM file slot
-static RAMFile* find_free_slot() {
-    for (int i = 0; i < UNIFS_MAX_FILES; i++) {
-        if (!ram_files[i].used) {
-            return &ram_files[i];
+static void chunk_free(uint8_t* chunk) {
+    pmm_free_frame((void*)((uint64_t)chunk - vmm_get_hhdm_offset()));
+}
+
+static void drop_flat(RAMFile* file) {
+    if (file->flat) free(file->flat);
+    file->flat = nullptr;
+}
+
+// Make room for size bytes. Only the chunk pointer array is ever copied
+// (doubling), so appends are amortized O(1). On failure the file keeps its
+// contents; chunks already added are trimmed by the next ram_trim().
+static bool ram_reserve(RAMFile* file, uint64_t size) {
+    uint64_t needed = (size + RAM_CHUNK_SIZE - 1) / RAM_CHUNK_SIZE;
+    if (needed > file->chunk_capacity) {
+        uint64_t cap = file->chunk_capacity ? file->chunk_capacity * 2 : 4;
+        while (cap < needed) cap *= 2;
+        uint8_t** bigger = (uint8_t**)malloc(cap * sizeof(uint8_t*));
+        if (!bigger) return false;
+        if (file->chunks) {
+            kstring::memcpy(bigger, file->chunks, file->chunk_count * sizeof(uint8_t*));
+            free(file->chunks);
         }
+        file->chunks = bigger;
+        file->chunk_capacity = cap;
     }
-    return nullptr;
+    while (file->chunk_count < needed) {
+        uint8_t* chunk = chunk_alloc();
+        if (!chunk) return false;
+        file->chunks[file->chunk_count++] = chunk;
+    }
+    return true;
+}
+
+// Free chunks past the end of the file
+static void ram_trim(RAMFile* file) {
+    uint64_t needed = (file->size + RAM_CHUNK_SIZE - 1) / RAM_CHUNK_SIZE;
+    while (file->chunk_count > needed) chunk_free(file->chunks[--file->chunk_count]);
+}
+
+// Copy into the file at offset (room must be reserved)
+static void ram_copy_in(RAMFile* file, uint64_t offset, const uint8_t* data, uint64_t size) {
+    while (size > 0) {
+        uint64_t off = offset % RAM_CHUNK_SIZE;
+        uint64_t n = RAM_CHUNK_SIZE - off;
+        if (n > size) n = size;
+        kstring::memcpy(file->chunks[offset / RAM_CHUNK_SIZE] + off, data, n);
+        offset += n;
+        data += n;
+        size -= n;
+    }
+}
+
+// Copy out of the file at offset (within size)
+static void ram_copy_out(const RAMFile* file, uint64_t offset, uint8_t* data, uint64_t size) {
+    while (size > 0) {
+        uint64_t off = offset % RAM_CHUNK_SIZE;
+        uint64_t n = RAM_CHUNK_SIZE - off;
+        if (n > size) n = size;
+        kstring::memcpy(data, file->chunks[offset / RAM_CHUNK_SIZE] + off, n);
+        offset += n;
+        data += n;
+        size -= n;
+    }
+}
+
+// Contiguous contents: the only chunk, or a copy reused until the file
+// changes (then replaced, like a DiskCopy). Files over UNIFS_MAX_FLAT_SIZE
+// get none, so a big file never needs a heap block of its whole size.
+static const uint8_t* ram_flat(RAMFile* file) {
+    if (file->size == 0) return nullptr;
+    if (file->size <= RAM_CHUNK_SIZE) return file->chunks[0];
+    if (file->size > UNIFS_MAX_FLAT_SIZE) return nullptr;
+    if (file->flat && file->flat_generation == file->generation) return file->flat;
+    
+    drop_flat(file);
+    file->flat = (uint8_t*)malloc(file->size);
+    if (!file->flat) return nullptr;
+    for (uint64_t off = 0; off < file->size; off += RAM_CHUNK_SIZE) {
+        uint64_t n = file->size - off < RAM_CHUNK_SIZE ? file->size - off : RAM_CHUNK_SIZE;
+        kstring::memcpy(file->flat + off, file->chunks[off / RAM_CHUNK_SIZE], n);
+    }
+    file->flat_generation = file->generation;
+    return file->flat;
+}
+
+// Inode of a disk file or directory (0 if no volume or not found)
+static uint32_t find_disk_inode(const char* name) {
+    if (!disk_volume || !name) return 0;
+    return unifs_disk_resolve(disk_volume, name);
+}
+
+// Directory inode holding a disk path; *leaf receives the last component
+static uint32_t find_disk_parent(const char* name, const char** leaf) {
+    const char* slash = nullptr;
+    for (const char* p = name; *p; p++) {
+        if (*p == '/') slash = p;
+    }
+    if (!slash) {
+        *leaf = name;
+        return UNIFS2_ROOT_INODE;
+    }
+    *leaf = slash + 1;
+
+    char dir[256];
+    uint64_t len = slash - name;
+    if (len >= sizeof(dir)) return 0;
+    kstring::memcpy(dir, name, len);
+    dir[len] = '\0';
+    return unifs_disk_resolve(disk_volume, dir);
+}
+
+// Boot file not overridden by a RAM or disk file of the same name
+static bool is_boot_only(const char* name) {
+    return find_boot_entry(name) && !find_ram_file(name) && !find_disk_inode(name);
+}
+
+static void drop_disk_copy(uint32_t inode) {
+    DiskCopy** link = &disk_copies;
+    while (*link && (*link)->inode != inode) link = &(*link)->next;
+    if (!*link) return;
+    DiskCopy* copy = *link;
+    *link = copy->next;
+    if (copy->data) free(copy->data);
+    free(copy);
+}
+
+// Current contents of a disk file, read in full on first use or after a change
+static DiskCopy* get_disk_copy(const char* name, uint32_t inode) {
+    UniFSStat st;
+    if (unifs_disk_stat(disk_volume, inode, &st) != UNIFS_OK || st.type != UNIFS2_TYPE_FILE) {
+        return nullptr;
+    }
+
+    DiskCopy* copy = disk_copies;
+    while (copy && copy->inode != inode) copy = copy->next;
+    if (copy && copy->version == st.version) return copy;
+
+    if (copy) drop_disk_copy(inode);
+    copy = (DiskCopy*)malloc(sizeof(DiskCopy));
+    if (!copy) return nullptr;
+    copy->data = st.size ? (uint8_t*)malloc(st.size) : nullptr;
+    if (st.size && (!copy->data ||
+                    unifs_disk_read(disk_volume, inode, 0, copy->data, st.size) != (int64_t)st.size)) {
+        if (copy->data) free(copy->data);
+        free(copy);
+        return nullptr;
+    }
+    kstring::strncpy(copy->name, name, sizeof(copy->name) - 1);
+    copy->name[sizeof(copy->name) - 1] = '\0';
+    copy->inode = inode;
+    copy->version = st.version;
+    copy->size = st.size;
+    copy->next = disk_copies;
+    disk_copies = copy;
+    return copy;
 }
 
 // Check if file content looks like text
@@ -85,19 +467,361 @@ static bool is_text_content(const uint8_t* data, uint64_t size) {
     return true;
 }
 
+int unifs_detect_type(const uint8_t* data, uint64_t size) {
+    if (size >= 4 && kstring::memcmp(data, ELF_MAGIC, 4) == 0) {
+        return UNIFS_TYPE_ELF;
+    }
+    
+    if (is_text_content(data, size)) {
+        return UNIFS_TYPE_TEXT;
+    }
+    
+    return UNIFS_TYPE_BINARY;
+}
+
+// ============================================================================
+// Compressed Boot Files
+// ============================================================================
+// Entries flagged UNIFS_ENTRY_LZ4 are decoded one block at a time. Positioned
+// reads go through a small LRU of decoded blocks, so they only decode the
+// blocks they touch and a sequential reader decodes each block once.
+// unifs_open_into() needs whole files: decoded copies are kept in a second
+// LRU bounded by BOOT_FLAT_BUDGET bytes, never evicting the copy just made.
+
+#define BOOT_BLOCK_SLOTS    16
+#define BOOT_FLAT_BUDGET    (8ULL * 1024 * 1024)
+
+struct BootBlock {
+    uint32_t entry;           // Boot entry index (NAME_NONE = nothing decoded)...
+    uint32_t block;           // ...and block within its frame
+    uint8_t* data;            // UNIFS_LZ4_BLOCK_SIZE bytes, allocated on first use
+    uint32_t size;            // Decoded bytes
+    uint64_t last_used;
+};
+
+struct BootFlat {
+    uint32_t entry;
+    uint8_t* data;
+    uint64_t size;
+    uint64_t last_used;
+    BootFlat* next;
+};
+
+static BootBlock boot_blocks[BOOT_BLOCK_SLOTS];
+static BootFlat* boot_flats = nullptr;
+static uint64_t boot_flat_bytes = 0;
+static uint64_t boot_clock = 0;
+static uint64_t boot_compressed = 0;    // Entries flagged UNIFS_ENTRY_LZ4
+
+static bool boot_check(uint32_t index);
+
+static bool boot_is_lz4(const UniFSEntry* entry) {
+    return (entry->offset & UNIFS_ENTRY_LZ4) != 0;
+}
+
+static const uint8_t* boot_data(const UniFSEntry* entry) {
+    return fs_start + (entry->offset & ~UNIFS_ENTRY_LZ4);
+}
+
+// Forget everything decoded from a previous image
+static void boot_cache_reset() {
+    for (uint32_t i = 0; i < BOOT_BLOCK_SLOTS; i++) {
+        boot_blocks[i].entry = NAME_NONE;
+        boot_blocks[i].last_used = 0;
+    }
+    while (boot_flats) {
+        BootFlat* flat = boot_flats;
+        boot_flats = flat->next;
+        free(flat->data);
+        free(flat);
+    }
+    boot_flat_bytes = 0;
+    boot_compressed = 0;
+}
+
+// Decode one block of a compressed entry into dst (UNIFS_LZ4_BLOCK_SIZE
+// bytes). Returns the decoded length, 0 if the frame is corrupt.
+static uint32_t boot_decode(const UniFSEntry* entry, uint32_t block, uint8_t* dst) {
+    const UniFSLz4Header* frame = (const UniFSLz4Header*)boot_data(entry);
+    uint64_t blocks = (entry->size + UNIFS_LZ4_BLOCK_SIZE - 1) / UNIFS_LZ4_BLOCK_SIZE;
+    if (kstring::memcmp(frame->magic, UNIFS_LZ4_MAGIC, 4) != 0 ||
+        frame->block_size != UNIFS_LZ4_BLOCK_SIZE || frame->block_count != blocks ||
+        block >= blocks) {
+        return 0;
+    }
+    
+    uint32_t range[2];  // Copied out, the image keeps no alignment
+    kstring::memcpy(range, (const uint32_t*)(frame + 1) + block, sizeof(range));
+    if (range[1] < range[0]) return 0;
+    const uint8_t* src = (const uint8_t*)frame + range[0];
+    uint32_t src_len = range[1] - range[0];
+    uint64_t start = (uint64_t)block * UNIFS_LZ4_BLOCK_SIZE;
+    uint32_t size = entry->size - start < UNIFS_LZ4_BLOCK_SIZE ?
+                    (uint32_t)(entry->size - start) : UNIFS_LZ4_BLOCK_SIZE;
+    
+    if (src_len == size) {
+        kstring::memcpy(dst, src, size);  // Stored raw, it did not shrink
+        return size;
+    }
+    return lz4_decompress(src, src_len, dst, size) == (int64_t)size ? size : 0;
+}
+
+// Decoded block from the block cache, nullptr if it cannot be decoded
+static const BootBlock* boot_block(uint32_t index, uint32_t block) {
+    BootBlock* victim = &boot_blocks[0];
+    for (uint32_t i = 0; i < BOOT_BLOCK_SLOTS; i++) {
+        BootBlock* slot = &boot_blocks[i];
+        if (slot->entry == index && slot->block == block) {
+            slot->last_used = ++boot_clock;
+            return slot;
+        }
+        if (slot->last_used < victim->last_used) victim = slot;
+    }
+    
+    if (!victim->data) {
+        victim->data = (uint8_t*)malloc(UNIFS_LZ4_BLOCK_SIZE);
+        if (!victim->data) return nullptr;
+    }
+    victim->entry = NAME_NONE;
+    victim->last_used = 0;
+    victim->size = boot_decode(&boot_entries[index], block, victim->data);
+    if (victim->size == 0) return nullptr;
+    victim->entry = index;
+    victim->block = block;
+    victim->last_used = ++boot_clock;
+    return victim;
+}
+
+// Read from a boot entry at offset; bytes read or UNIFS_ERR_IO
+static int64_t boot_read(const UniFSEntry* entry, uint64_t offset, uint8_t* buf, uint64_t len) {
+    uint32_t index = (uint32_t)(entry - boot_entries);
+    if (!boot_check(index)) return UNIFS_ERR_IO;
+    if (offset >= entry->size) return 0;
+    if (len > entry->size - offset) len = entry->size - offset;
+    if (!boot_is_lz4(entry)) {
+        kstring::memcpy(buf, boot_data(entry) + offset, len);
+        return (int64_t)len;
+    }
+    
+    for (uint64_t done = 0; done < len;) {
+        uint64_t pos = offset + done;
+        const BootBlock* block = boot_block(index, (uint32_t)(pos / UNIFS_LZ4_BLOCK_SIZE));
+        if (!block) return UNIFS_ERR_IO;
+        uint64_t off = pos % UNIFS_LZ4_BLOCK_SIZE;
+        uint64_t n = block->size - off;
+        if (n > len - done) n = len - done;
+        kstring::memcpy(buf + done, block->data + off, n);
+        done += n;
+    }
+    return (int64_t)len;
+}
+
+// Whole contents of a boot entry: in place, or a cached decoded copy
+static const uint8_t* boot_flat(const UniFSEntry* entry) {
+    uint32_t index = (uint32_t)(entry - boot_entries);
+    if (!boot_check(index)) return nullptr;
+    if (!boot_is_lz4(entry)) return boot_data(entry);
+    if (entry->size == 0) return nullptr;
+    
+    for (BootFlat* flat = boot_flats; flat; flat = flat->next) {
+        if (flat->entry == index) {
+            flat->last_used = ++boot_clock;
+            return flat->data;
+        }
+    }
+    
+    BootFlat* flat = (BootFlat*)malloc(sizeof(BootFlat));
+    if (!flat) return nullptr;
+    flat->data = (uint8_t*)malloc(entry->size);
+    if (!flat->data) {
+        free(flat);
+        return nullptr;
+    }
+    // Decode straight into the copy, past the block cache
+    for (uint64_t start = 0; start < entry->size; start += UNIFS_LZ4_BLOCK_SIZE) {
+        uint32_t block = (uint32_t)(start / UNIFS_LZ4_BLOCK_SIZE);
+        if (boot_decode(entry, block, flat->data + start) == 0) {
+            free(flat->data);
+            free(flat);
+            return nullptr;
+        }
+    }
+    flat->entry = index;
+    flat->size = entry->size;
+    flat->last_used = ++boot_clock;
+    flat->next = boot_flats;
+    boot_flats = flat;
+    boot_flat_bytes += flat->size;
+    
+    // Evict least recently used copies (never this one) to get under budget
+    while (boot_flat_bytes > BOOT_FLAT_BUDGET) {
+        BootFlat** oldest = nullptr;
+        for (BootFlat** link = &boot_flats; *link; link = &(*link)->next) {
+            if (*link != flat && (!oldest || (*link)->last_used < (*oldest)->last_used)) {
+                oldest = link;
+            }
+        }
+        if (!oldest) break;
+        BootFlat* victim = *oldest;
+        *oldest = victim->next;
+        boot_flat_bytes -= victim->size;
+        free(victim->data);
+        free(victim);
+    }
+    return flat->data;
+}
+
+// ============================================================================
+// Integrity Verification
+// ============================================================================
+// Only the metadata CRC is checked at mount; it covers a few KB. File data
+// is checked by boot_check(), once per entry, from whichever comes first:
+// a read, open or mapping of the file, or the background verifier walking
+// every entry. Boot does not wait for either.
+
+#define BOOT_UNCHECKED  0
+#define BOOT_GOOD       1
+#define BOOT_BAD        2
+
+static const uint8_t* boot_crcs = nullptr;  // From the trailer (unaligned)
+static uint8_t* boot_state = nullptr;       // BOOT_* per entry, nullptr = no checksums
+static Spinlock verify_lock = SPINLOCK_INIT;
+static UniFSVerifyStats verify_stats;
+static uint64_t verify_cycles = 0;
+
+// Bytes an entry occupies in the image, or UINT64_MAX if they do not fit
+static uint64_t boot_stored_size(const UniFSEntry* entry) {
+    uint64_t offset = entry->offset & ~UNIFS_ENTRY_LZ4;
+    uint64_t stored = entry->size;
+    if (boot_is_lz4(entry)) {
+        UniFSLz4Header frame;
+        if (offset > boot_image_size || boot_image_size - offset < sizeof(frame)) return UINT64_MAX;
+        kstring::memcpy(&frame, fs_start + offset, sizeof(frame));
+        uint64_t table_end = sizeof(frame) + 4ULL * ((uint64_t)frame.block_count + 1);
+        if (boot_image_size - offset < table_end) return UINT64_MAX;
+        uint32_t end;
+        kstring::memcpy(&end, fs_start + offset + table_end - 4, sizeof(end));
+        stored = end;
+    }
+    if (offset > boot_image_size || boot_image_size - offset < stored) return UINT64_MAX;
+    return stored;
+}
+
+// True if the entry's data matches its checksum (or there are none)
+static bool boot_check(uint32_t index) {
+    if (!boot_state) return true;
+    uint8_t state = boot_state[index];
+    if (state != BOOT_UNCHECKED) return state == BOOT_GOOD;
+    
+    const UniFSEntry* entry = &boot_entries[index];
+    uint32_t expected;
+    kstring::memcpy(&expected, boot_crcs + 4ULL * index, sizeof(expected));
+    uint64_t stored = boot_stored_size(entry);
+    uint64_t start = rdtsc();
+    bool good = stored != UINT64_MAX && crc32c(0, boot_data(entry), stored) == expected;
+    uint64_t cycles = rdtsc() - start;
+    
+    // The verifier and a reader may race to the same entry; count it once
+    spinlock_acquire(&verify_lock);
+    bool first = boot_state[index] == BOOT_UNCHECKED;
+    if (first) {
+        boot_state[index] = good ? BOOT_GOOD : BOOT_BAD;
+        if (good) verify_stats.verified++;
+        else verify_stats.bad++;
+        if (stored != UINT64_MAX) verify_stats.bytes += stored;
+        verify_cycles += cycles;
+    }
+    spinlock_release(&verify_lock);
+    
+    if (first && !good) DEBUG_ERROR("unifs: Boot file %s fails its checksum", entry->name);
+    return good;
+}
+
+// Find the trailer and check the metadata. False if the image carries
+// checksums and its metadata does not match them.
+static bool boot_load_checksums(uint64_t count) {
+    boot_crcs = nullptr;
+    if (boot_state) free(boot_state);
+    boot_state = nullptr;
+    kstring::zero_memory(&verify_stats, sizeof(verify_stats));
+    verify_cycles = 0;
+    verify_stats.files = count;
+    verify_stats.hardware = crc32c_is_hardware();
+    
+    UniFSCrcTrailer trailer;
+    if (boot_image_size < sizeof(UniFSHeader) + sizeof(trailer)) return true;
+    kstring::memcpy(&trailer, fs_start + boot_image_size - sizeof(trailer), sizeof(trailer));
+    if (kstring::memcmp(trailer.magic, UNIFS_CRC_MAGIC, 8) != 0) return true;
+    
+    uint64_t limit = boot_image_size - sizeof(trailer);
+    if (trailer.file_count != count || trailer.meta_size > limit ||
+        trailer.table_offset > limit || (limit - trailer.table_offset) / 4 < count ||
+        crc32c(0, fs_start, trailer.meta_size) != trailer.meta_crc) {
+        DEBUG_ERROR("unifs: Boot image metadata fails its checksum");
+        return false;
+    }
+    
+    boot_state = (uint8_t*)malloc(count ? count : 1);
+    if (!boot_state) return true;   // Cannot track it; serve unchecked
+    kstring::zero_memory(boot_state, count ? count : 1);
+    boot_crcs = fs_start + trailer.table_offset;
+    verify_stats.has_checksums = true;
+    return true;
+}
+
+static void verify_task(void*) {
+    uint64_t count = boot_header->file_count;
+    for (uint64_t i = 0; i < count; i++) {
+        boot_check((uint32_t)i);
+        scheduler_yield();  // Never hold up anything else for long
+    }
+    spinlock_acquire(&verify_lock);
+    verify_stats.done = true;
+    spinlock_release(&verify_lock);
+    DEBUG_INFO("unifs: %lu boot files verified, %lu bad", verify_stats.verified, verify_stats.bad);
+}
+
+static uint64_t verify_pid = 0;
+
+void unifs_start_verify() {
+    if (!mounted || !boot_state) return;
+    verify_pid = scheduler_spawn(verify_task, nullptr);
+    if (verify_pid == 0) {
+        DEBUG_WARN("unifs: No task for boot image verification");
+    }
+}
+
+void unifs_reap_verify() {
+    if (verify_pid == 0) return;
+    spinlock_acquire(&verify_lock);
+    bool done = verify_stats.done;
+    spinlock_release(&verify_lock);
+    if (!done) return;
+    
+    // The task exits right after setting done, so this wait is short
+    process_waitpid((int64_t)verify_pid, nullptr);
+    verify_pid = 0;
+}
+
+void unifs_get_verify_stats(UniFSVerifyStats* out) {
+    spinlock_acquire(&verify_lock);
+    *out = verify_stats;
+    uint64_t cycles = verify_cycles;
+    spinlock_release(&verify_lock);
+    uint64_t khz = timer_get_tsc_khz();
+    out->mb_per_s = cycles && khz ? out->bytes * khz / cycles / 1000 : 0;
+}
+
 // ============================================================================
 // Read API Implementation
 // ============================================================================
 
-void unifs_init(void* start_addr) {
+void unifs_init(void* start_addr, uint64_t size) {
     // Initialize RAM files
-    for (int i = 0; i < UNIFS_MAX_FILES; i++) {
-        ram_files[i].used = false;
-        ram_files[i].data = nullptr;
-        ram_files[i].size = 0;
-        ram_files[i].capacity = 0;
-    }
     ram_file_count = 0;
+    table_init(&ram_names, RAM_TABLE_INITIAL, ram_name_of);
+    invalidate_listing();
+    boot_cache_reset();
     
     if (!start_addr) {
         mounted = false;
@@ -105,15 +829,46 @@ void unifs_init(void* start_addr) {
     }
     
     fs_start = (uint8_t*)start_addr;
+    boot_image_size = size;
     boot_header = (UniFSHeader*)fs_start;
     boot_entries = (UniFSEntry*)(fs_start + sizeof(UniFSHeader));
+    boot_sorted = false;
+    boot_indexed = false;
     
     // Verify magic
-    if (kstring::memcmp(boot_header->magic, UNIFS_MAGIC, 8) != 0) {
+    bool aligned = kstring::memcmp(boot_header->magic, UNIFS_MAGIC_ALIGNED, 8) == 0;
+    if (!aligned && kstring::memcmp(boot_header->magic, UNIFS_MAGIC, 8) != 0) {
         mounted = false;
         return;
     }
     
+    // Index the boot entries; a name listed twice resolves to the first.
+    // Aligned images carry the index, so it is only checked, not built.
+    uint64_t count = boot_header->file_count;
+    if (!boot_load_checksums(count)) {
+        mounted = false;
+        return;
+    }
+    if (aligned) {
+        const UniFSIndex* index = (const UniFSIndex*)boot_entries;
+        boot_entries = (UniFSEntry*)(fs_start + sizeof(UniFSHeader) + sizeof(UniFSIndex));
+        boot_sorted = true;
+        boot_indexed = use_image_index(index, count);
+    }
+    if (!boot_indexed && table_init(&boot_names, (uint32_t)count, boot_name_of)) {
+        for (uint64_t i = count; i-- > 0;) table_insert(&boot_names, (uint32_t)i);
+    }
+    
+    boot_size = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        const UniFSEntry* entry = &boot_entries[i];
+        if (boot_is_lz4(entry)) {
+            boot_compressed++;
+        } else if (entry->offset + entry->size > boot_size) {
+            boot_size = entry->offset + entry->size;
+        }
+    }
+    
     mounted = true;
 }
 
@@ -121,25 +876,45 @@ bool unifs_is_mounted() {
     return mounted;
 }
 
+bool unifs_is_boot_data(const void* data, uint64_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    return mounted && p >= fs_start && size <= boot_size && (uint64_t)(p - fs_start) <= boot_size - size;
+}
+
 // Thread-safe version: fills caller-provided buffer
 bool unifs_open_into(const char* name, UniFSFile* out_file) {
     if (!out_file) return false;
     
-    // Check RAM files first (they can shadow boot files)
+    // Disk volume first
+    uint32_t inode = find_disk_inode(name);
+    if (inode) {
+        DiskCopy* copy = get_disk_copy(name, inode);
+        if (!copy) return false;
+        out_file->name = copy->name;
+        out_file->size = copy->size;
+        out_file->data = copy->data;
+        return true;
+    }
+    
+    // Then RAM files (they can shadow boot files)
     RAMFile* ram = find_ram_file(name);
     if (ram) {
+        const uint8_t* data = ram_flat(ram);
+        if (!data && ram->size) return false;
         out_file->name = ram->name;
         out_file->size = ram->size;
-        out_file->data = ram->data;
+        out_file->data = data;
         return true;
     }
     
     // Check boot files
     UniFSEntry* entry = find_boot_entry(name);
     if (entry) {
+        const uint8_t* data = boot_flat(entry);
+        if (!data && entry->size) return false;
         out_file->name = entry->name;
         out_file->size = entry->size;
-        out_file->data = fs_start + entry->offset;
+        out_file->data = data;
         return true;
     }
     
@@ -160,10 +935,17 @@ const UniFSFile* unifs_open(const char* name) {
 }
 
 bool unifs_file_exists(const char* name) {
-    return find_ram_file(name) != nullptr || find_boot_entry(name) != nullptr;
+    return find_disk_inode(name) != 0 || find_ram_file(name) != nullptr ||
+           find_boot_entry(name) != nullptr;
 }
 
 uint64_t unifs_get_file_size(const char* name) {
+    uint32_t inode = find_disk_inode(name);
+    if (inode) {
+        UniFSStat st;
+        return unifs_disk_stat(disk_volume, inode, &st) == UNIFS_OK ? st.size : 0;
+    }
+    
     RAMFile* ram = find_ram_file(name);
     if (ram) return ram->size;
     
@@ -174,97 +956,110 @@ uint64_t unifs_get_file_size(const char* name) {
 int unifs_get_file_type(const char* name) {
     const uint8_t* data = nullptr;
     uint64_t size = 0;
+    uint8_t head[256];  // Enough for both checks below
     
-    RAMFile* ram = find_ram_file(name);
-    if (ram) {
-        data = ram->data;
-        size = ram->size;
+    uint32_t inode = find_disk_inode(name);
+    RAMFile* ram = inode ? nullptr : find_ram_file(name);
+    if (inode) {
+        UniFSStat st;
+        if (unifs_disk_stat(disk_volume, inode, &st) != UNIFS_OK) return UNIFS_TYPE_UNKNOWN;
+        if (st.type == UNIFS2_TYPE_DIR) return UNIFS_TYPE_DIR;
+        int64_t got = unifs_disk_read(disk_volume, inode, 0, head, sizeof(head));
+        if (got < 0) return UNIFS_TYPE_UNKNOWN;
+        data = head;
+        size = (uint64_t)got;
+    } else if (ram) {
+        // Both checks fit in the first chunk
+        data = ram->size ? ram->chunks[0] : nullptr;
+        size = ram->size < RAM_CHUNK_SIZE ? ram->size : RAM_CHUNK_SIZE;
     } else {
         UniFSEntry* entry = find_boot_entry(name);
         if (!entry) return UNIFS_TYPE_UNKNOWN;
-        data = fs_start + entry->offset;
-        size = entry->size;
+        int64_t got = boot_read(entry, 0, head, sizeof(head));
+        if (got < 0) return UNIFS_TYPE_UNKNOWN;
+        data = head;
+        size = (uint64_t)got;
     }
     
-    if (size >= 4 && kstring::memcmp(data, ELF_MAGIC, 4) == 0) {
-        return UNIFS_TYPE_ELF;
-    }
-    
-    if (is_text_content(data, size)) {
-        return UNIFS_TYPE_TEXT;
-    }
-    
-    return UNIFS_TYPE_BINARY;
+    return unifs_detect_type(data, size);
 }
 
-uint64_t unifs_get_file_count() {
-    // Count boot files (excluding those shadowed by RAM files)
-    uint64_t count = 0;
-    if (mounted) {
-        for (uint64_t i = 0; i < boot_header->file_count; i++) {
-            if (!find_ram_file(boot_entries[i].name)) {
-                count++;
-            }
+// Boot file hidden by a RAM file or a disk root entry of the same name
+static bool is_boot_shadowed(const char* name) {
+    if (find_ram_file(name)) return true;
+    return disk_volume && unifs_disk_lookup(disk_volume, UNIFS2_ROOT_INODE, name) != 0;
+}
+
+static bool listing_add(const char* name) {
+    if (listing_count == listing_capacity) {
+        uint64_t cap = listing_capacity ? listing_capacity * 2 : 64;
+        const char** bigger = (const char**)malloc(cap * sizeof(const char*));
+        if (!bigger) return false;
+        if (listing) {
+            kstring::memcpy(bigger, listing, listing_count * sizeof(const char*));
+            free(listing);
         }
+        listing = bigger;
+        listing_capacity = cap;
     }
-    // Add RAM files
-    count += ram_file_count;
-    return count;
+    listing[listing_count++] = name;
+    return true;
 }
 
-const char* unifs_get_file_name(uint64_t index) {
-    // Boot files first (skip files shadowed by RAM files)
-    uint64_t visible_idx = 0;
+// Boot files not shadowed by RAM or disk files, then RAM files, then the
+// disk root directory. Rebuilt after a create or delete, not per call.
+static void build_listing() {
+    if (listing_valid) return;
+    listing_count = 0;
+    bool ok = true;
     if (mounted) {
-        for (uint64_t i = 0; i < boot_header->file_count; i++) {
-            // Skip if this boot file is shadowed by a RAM file
-            if (find_ram_file(boot_entries[i].name)) continue;
-            
-            if (visible_idx == index) {
-                return boot_entries[i].name;
-            }
-            visible_idx++;
+        for (uint64_t i = 0; i < boot_header->file_count && ok; i++) {
+            const char* name = boot_entries[i].name;
+            if (find_boot_entry(name) != &boot_entries[i]) continue;  // Duplicate
+            if (!is_boot_shadowed(name)) ok = listing_add(name);
         }
     }
-    
-    // Then RAM files (index is now relative to visible boot files)
-    uint64_t ram_index = index - visible_idx;
-    uint64_t found = 0;
-    for (int i = 0; i < UNIFS_MAX_FILES; i++) {
-        if (ram_files[i].used) {
-            if (found == ram_index) {
-                return ram_files[i].name;
-            }
-            found++;
-        }
+    for (uint32_t i = 0; i < ram_file_slots && ok; i++) {
+        if (ram_files[i]) ok = listing_add(ram_files[i]->name);
     }
-    
-    return nullptr;
+    uint32_t disk_count = disk_volume ? unifs_disk_dir_count(disk_volume, UNIFS2_ROOT_INODE) : 0;
+    for (uint32_t i = 0; i < disk_count && ok; i++) {
+        UniFSDirInfo info;
+        if (unifs_disk_readdir(disk_volume, UNIFS2_ROOT_INODE, i, &info)) ok = listing_add(info.name);
+    }
+    // Out of memory: keep what fits, retry on the next call
+    listing_valid = ok;
 }
 
-uint64_t unifs_get_file_size_by_index(uint64_t index) {
-    // Boot files first
-    if (mounted && index < boot_header->file_count) {
-        return boot_entries[index].size;
-    }
-    
-    // Then RAM files
-    uint64_t ram_index = mounted ? index - boot_header->file_count : index;
-    uint64_t found = 0;
-    for (int i = 0; i < UNIFS_MAX_FILES; i++) {
-        if (ram_files[i].used) {
-            if (found == ram_index) {
-                return ram_files[i].size;
-            }
-            found++;
-        }
+uint64_t unifs_get_file_count() {
+    build_listing();
+    return listing_count;
+}
+
+const char* unifs_get_file_name(uint64_t index) {
+    build_listing();
+    return index < listing_count ? listing[index] : nullptr;
+}
+
+uint64_t unifs_get_file_generation(const char* name) {
+    uint32_t inode = find_disk_inode(name);
+    if (inode) {
+        UniFSStat st;
+        return unifs_disk_stat(disk_volume, inode, &st) == UNIFS_OK ? st.version : 0;
     }
     
-    return 0;
+    RAMFile* ram = find_ram_file(name);
+    return ram ? ram->generation : 0;
+}
+
+uint64_t unifs_get_file_size_by_index(uint64_t index) {
+    // Same order (and shadowing) as unifs_get_file_name()
+    const char* name = unifs_get_file_name(index);
+    return name ? unifs_get_file_size(name) : 0;
 }
 
 // ============================================================================
-// Write API Implementation (RAM-only)
+// Write API Implementation
 // ============================================================================
 
 int unifs_create(const char* name) {
@@ -280,32 +1075,77 @@ int unifs_create(const char* name) {
         return UNIFS_ERR_EXISTS;
     }
     
+    if (disk_volume) {
+        const char* leaf;
+        uint32_t dir = find_disk_parent(name, &leaf);
+        if (!dir) return UNIFS_ERR_NOT_FOUND;
+        invalidate_listing();
+        return unifs_disk_create(disk_volume, dir, leaf, UNIFS2_TYPE_FILE, nullptr);
+    }
+    
     // Find free slot
-    RAMFile* slot = find_free_slot();
-    if (!slot) {
-        return UNIFS_ERR_FULL;
+    uint32_t slot = find_free_slot();
+    if (slot == NAME_NONE) {
+        return UNIFS_ERR_NO_MEMORY;
+    }
+    RAMFile* file = (RAMFile*)malloc(sizeof(RAMFile));
+    if (!file) {
+        return UNIFS_ERR_NO_MEMORY;
     }
     
     // Initialize new file
-    kstring::strcpy(slot->name, name);
-    slot->data = nullptr;
-    slot->size = 0;
-    slot->capacity = 0;
-    slot->used = true;
+    kstring::zero_memory(file, sizeof(RAMFile));
+    kstring::strcpy(file->name, name);
+    file->generation = next_generation++;
+    ram_files[slot] = file;
+    if (!table_insert(&ram_names, slot)) {
+        ram_files[slot] = nullptr;
+        free(file);
+        return UNIFS_ERR_NO_MEMORY;
+    }
     ram_file_count++;
+    invalidate_listing();
     
     return UNIFS_OK;
 }
 
+// Disk side of unifs_write/unifs_append: write at offset (or the end)
+static int disk_write(const char* name, const void* data, uint64_t size, bool append) {
+    uint32_t inode = find_disk_inode(name);
+    if (!inode) {
+        int result = unifs_create(name);
+        if (result != UNIFS_OK) return result;
+        inode = find_disk_inode(name);
+        if (!inode) return UNIFS_ERR_NOT_FOUND;
+    }
+    
+    uint64_t offset = 0;
+    if (append) {
+        UniFSStat st;
+        int result = unifs_disk_stat(disk_volume, inode, &st);
+        if (result != UNIFS_OK) return result;
+        offset = st.size;
+    }
+    
+    // Overwrite in place, then cut off whatever the old contents had beyond
+    if (size > 0) {
+        int64_t written = unifs_disk_write(disk_volume, inode, offset, data, size);
+        if (written < 0) return (int)written;
+        if ((uint64_t)written < size) return UNIFS_ERR_FULL;
+    }
+    return append ? UNIFS_OK : unifs_disk_truncate(disk_volume, inode, size);
+}
+
 int unifs_write(const char* name, const void* data, uint64_t size) {
     if (!name) return UNIFS_ERR_NOT_FOUND;
-    if (size > UNIFS_MAX_FILE_SIZE) return UNIFS_ERR_NO_MEMORY;
     
     // Check if it's a boot file (read-only)
-    if (find_boot_entry(name) && !find_ram_file(name)) {
+    if (is_boot_only(name)) {
         return UNIFS_ERR_READONLY;
     }
     
+    if (disk_volume) return disk_write(name, data, size, false);
+    
     // Find or create RAM file
     RAMFile* file = find_ram_file(name);
     if (!file) {
@@ -314,25 +1154,21 @@ int unifs_write(const char* name, const void* data, uint64_t size) {
         file = find_ram_file(name);
     }
     
-    // Allocate/reallocate buffer if needed
-    if (size > file->capacity) {
-        if (file->data) {
-            free(file->data);
-        }
-        file->data = (uint8_t*)malloc(size);
-        if (!file->data) {
-            file->size = 0;
-            file->capacity = 0;
-            return UNIFS_ERR_NO_MEMORY;
-        }
-        file->capacity = size;
+    // Overwrite the chunks in place; keep the old contents if out of memory
+    if (!ram_reserve(file, size)) {
+        ram_trim(file);
+        return UNIFS_ERR_NO_MEMORY;
     }
-    
-    // Copy data
     if (data && size > 0) {
-        kstring::memcpy(file->data, data, size);
+        ram_copy_in(file, 0, (const uint8_t*)data, size);
+    } else if (size > 0) {
+        for (uint64_t i = 0; i * RAM_CHUNK_SIZE < size; i++) {
+            kstring::zero_memory(file->chunks[i], RAM_CHUNK_SIZE);
+        }
     }
     file->size = size;
+    ram_trim(file);
+    file->generation = next_generation++;
     
     return UNIFS_OK;
 }
@@ -341,10 +1177,12 @@ int unifs_append(const char* name, const void* data, uint64_t size) {
     if (!name || !data || size == 0) return UNIFS_ERR_NOT_FOUND;
     
     // Check if it's a boot file (read-only)
-    if (find_boot_entry(name) && !find_ram_file(name)) {
+    if (is_boot_only(name)) {
         return UNIFS_ERR_READONLY;
     }
     
+    if (disk_volume) return disk_write(name, data, size, true);
+    
     // Find or create RAM file
     RAMFile* file = find_ram_file(name);
     if (!file) {
@@ -353,28 +1191,15 @@ int unifs_append(const char* name, const void* data, uint64_t size) {
         file = find_ram_file(name);
     }
     
+    // Fill the last chunk, then add new ones; existing data never moves
     uint64_t new_size = file->size + size;
-    if (new_size > UNIFS_MAX_FILE_SIZE) return UNIFS_ERR_NO_MEMORY;
-    
-    // Reallocate if needed
-    if (new_size > file->capacity) {
-        uint64_t new_capacity = new_size * 2;  // Grow by 2x
-        if (new_capacity > UNIFS_MAX_FILE_SIZE) new_capacity = UNIFS_MAX_FILE_SIZE;
-        
-        uint8_t* new_data = (uint8_t*)malloc(new_capacity);
-        if (!new_data) return UNIFS_ERR_NO_MEMORY;
-        
-        if (file->data && file->size > 0) {
-            kstring::memcpy(new_data, file->data, file->size);
-            free(file->data);
-        }
-        file->data = new_data;
-        file->capacity = new_capacity;
-    }
-    
-    // Append data
-    kstring::memcpy(file->data + file->size, data, size);
+    if (!ram_reserve(file, new_size)) {
+        ram_trim(file);
+        return UNIFS_ERR_NO_MEMORY;
+    }
+    ram_copy_in(file, file->size, (const uint8_t*)data, size);
     file->size = new_size;
+    file->generation = next_generation++;
     
     return UNIFS_OK;
 }
@@ -383,35 +1208,513 @@ int unifs_delete(const char* name) {
     if (!name) return UNIFS_ERR_NOT_FOUND;
     
     // Cannot delete boot files
-    if (find_boot_entry(name) && !find_ram_file(name)) {
+    if (is_boot_only(name)) {
         return UNIFS_ERR_READONLY;
     }
     
+    // Check if file is currently open (prevent use-after-free)
+    extern bool is_file_open(const char* filename);
+    
+    uint32_t inode = find_disk_inode(name);
+    if (inode) {
+        if (is_file_open(name)) {
+            return UNIFS_ERR_IN_USE;
+        }
+        const char* leaf;
+        uint32_t dir = find_disk_parent(name, &leaf);
+        invalidate_listing();
+        int result = unifs_disk_unlink(disk_volume, dir, leaf);
+        if (result == UNIFS_OK) drop_disk_copy(inode);
+        return result;
+    }
+    
     // Find RAM file
     RAMFile* file = find_ram_file(name);
     if (!file) {
         return UNIFS_ERR_NOT_FOUND;
     }
     
-    // Check if file is currently open (prevent use-after-free)
-    extern bool is_file_open(const char* filename);
     if (is_file_open(name)) {
         return UNIFS_ERR_IN_USE;
     }
     
-    // Free memory and mark slot as unused
-    if (file->data) {
-        free(file->data);
-    }
-    file->data = nullptr;
+    // Free memory and the slot
+    uint32_t slot = table_find(&ram_names, name);
+    table_remove(&ram_names, name);
+    invalidate_listing();
+    next_generation++;  // Snapshots see deletes as changes too
     file->size = 0;
-    file->capacity = 0;
-    file->used = false;
+    ram_trim(file);
+    drop_flat(file);
+    if (file->chunks) free(file->chunks);
+    free(file);
+    ram_files[slot] = nullptr;
+    if (slot < ram_free_hint) ram_free_hint = slot;
     ram_file_count--;
     
     return UNIFS_OK;
 }
 
+int unifs_mkdir(const char* name) {
+    if (!name) return UNIFS_ERR_NOT_FOUND;
+    if (!disk_volume) return UNIFS_ERR_READONLY;
+    if (unifs_file_exists(name)) return UNIFS_ERR_EXISTS;
+    
+    const char* leaf;
+    uint32_t dir = find_disk_parent(name, &leaf);
+    if (!dir) return UNIFS_ERR_NOT_FOUND;
+    invalidate_listing();
+    return unifs_disk_create(disk_volume, dir, leaf, UNIFS2_TYPE_DIR, nullptr);
+}
+
+// ============================================================================
+// Snapshots
+// ============================================================================
+// A snapshot device is split into two equal slots (snap_slot_sectors()).
+// Writes go to the slot not holding the device's newest snapshot, so the
+// previous one stays valid until the new header lands. RAM file chunks are
+// written and read in place, one page-sized request each, plugged so the
+// block layer merges them into large sequential commands; restored chunks
+// become the RAM files' chunks with no copy.
+
+#define SNAP_BATCH          64      // Requests in flight per batch
+#define SNAP_SLOTS          2
+
+static BlockDevice* snapshot_dev = nullptr;
+static uint64_t snapshot_sequence = 0;
+static uint64_t snapshot_generation = 0;   // next_generation when last saved
+static UniFSSnapshotStats snapshot_stats;
+
+static uint64_t snap_align(uint64_t bytes) {
+    return (bytes + UNIFS_SNAPSHOT_ALIGN - 1) & ~(uint64_t)(UNIFS_SNAPSHOT_ALIGN - 1);
+}
+
+// Sectors per slot, 0 if dev cannot hold snapshots
+static uint64_t snap_slot_sectors(const BlockDevice* dev) {
+    uint32_t ss = dev->sector_size;
+    if (ss == 0 || ss > UNIFS_SNAPSHOT_ALIGN || UNIFS_SNAPSHOT_ALIGN % ss != 0) return 0;
+    uint64_t per_page = UNIFS_SNAPSHOT_ALIGN / ss;
+    uint64_t slot = dev->sector_count / SNAP_SLOTS / per_page * per_page;
+    return slot >= 2 * per_page ? slot : 0;
+}
+
+static uint64_t snap_lba(const BlockDevice* dev, int slot, uint64_t offset) {
+    return snap_slot_sectors(dev) * slot + offset / dev->sector_size;
+}
+
+static uint64_t snap_elapsed_ms(uint64_t start) {
+    uint32_t hz = timer_get_frequency();
+    return hz ? (timer_get_ticks() - start) * 1000 / hz : 0;
+}
+
+// Move pages (HHDM addresses, UNIFS_SNAPSHOT_ALIGN bytes each) to or from
+// consecutive pages of the slot starting at offset
+static int snap_pages(BlockDevice* dev, int slot, uint64_t offset, uint8_t* const* pages,
+                      uint64_t count, bool write) {
+    BlockRequest* reqs = (BlockRequest*)malloc(SNAP_BATCH * sizeof(BlockRequest));
+    if (!reqs) return UNIFS_ERR_NO_MEMORY;
+    uint32_t sectors = UNIFS_SNAPSHOT_ALIGN / dev->sector_size;
+    uint64_t lba = snap_lba(dev, slot, offset);
+    int result = UNIFS_OK;
+    
+    for (uint64_t done = 0; done < count && result == UNIFS_OK;) {
+        int issued = 0;
+        block_plug(dev);
+        while (done < count && issued < SNAP_BATCH) {
+            BlockRequest* req = &reqs[issued];
+            kstring::zero_memory(req, sizeof(*req));
+            req->dev = dev;
+            req->lba = lba + done * sectors;
+            req->count = sectors;
+            req->write = write;
+            req->buffer = pages[done];
+            if (!block_submit(req)) {
+                result = UNIFS_ERR_IO;
+                break;
+            }
+            issued++;
+            done++;
+        }
+        block_unplug(dev);
+        for (int i = 0; i < issued; i++) {
+            if (block_wait(&reqs[i]) != BLOCK_OK) result = UNIFS_ERR_IO;
+        }
+    }
+    free(reqs);
+    return result;
+}
+
+// Write len bytes at offset in the slot; a partial last sector goes
+// through a bounce buffer so nothing past data is read
+static int snap_write_bytes(BlockDevice* dev, int slot, uint64_t offset, const uint8_t* data, uint64_t len) {
+    uint32_t ss = dev->sector_size;
+    uint64_t whole = len / ss;
+    uint64_t lba = snap_lba(dev, slot, offset);
+    while (whole > 0) {
+        uint32_t n = whole > 0x10000 ? 0x10000 : (uint32_t)whole;
+        if (block_write(dev, lba, n, data) != BLOCK_OK) return UNIFS_ERR_IO;
+        lba += n;
+        data += (uint64_t)n * ss;
+        whole -= n;
+    }
+    if (len % ss == 0) return UNIFS_OK;
+    
+    uint8_t* bounce = (uint8_t*)malloc(ss);
+    if (!bounce) return UNIFS_ERR_NO_MEMORY;
+    kstring::zero_memory(bounce, ss);
+    kstring::memcpy(bounce, data, len % ss);
+    int result = block_write(dev, lba, 1, bounce) == BLOCK_OK ? UNIFS_OK : UNIFS_ERR_IO;
+    free(bounce);
+    return result;
+}
+
+// Read whole sectors covering len bytes at offset (buf must have room)
+static int snap_read_bytes(BlockDevice* dev, int slot, uint64_t offset, uint8_t* buf, uint64_t len) {
+    uint32_t ss = dev->sector_size;
+    uint64_t sectors = (len + ss - 1) / ss;
+    uint64_t lba = snap_lba(dev, slot, offset);
+    while (sectors > 0) {
+        uint32_t n = sectors > 0x10000 ? 0x10000 : (uint32_t)sectors;
+        if (block_read(dev, lba, n, buf) != BLOCK_OK) return UNIFS_ERR_IO;
+        lba += n;
+        buf += (uint64_t)n * ss;
+        sectors -= n;
+    }
+    return UNIFS_OK;
+}
+
+// Header of a slot if it is intact and its layout fits the slot
+static bool snap_read_header(BlockDevice* dev, int slot, UniFSSnapshotHeader* out) {
+    uint8_t* page = (uint8_t*)malloc(UNIFS_SNAPSHOT_ALIGN);
+    if (!page) return false;
+    bool ok = snap_read_bytes(dev, slot, 0, page, sizeof(*out)) == UNIFS_OK;
+    if (ok) kstring::memcpy(out, page, sizeof(*out));
+    free(page);
+    if (!ok || kstring::memcmp(out->magic, UNIFS_SNAPSHOT_MAGIC, 8) != 0) return false;
+    if (crc32c(0, out, sizeof(*out) - 4) != out->header_crc) return false;
+    
+    uint64_t slot_bytes = snap_slot_sectors(dev) * dev->sector_size;
+    uint64_t table_bytes = (uint64_t)out->file_count * sizeof(UniFSSnapshotFile);
+    return out->image_size <= slot_bytes &&
+           out->files_offset >= snap_align(UNIFS_SNAPSHOT_ALIGN + out->image_size) &&
+           out->files_offset % UNIFS_SNAPSHOT_ALIGN == 0 &&
+           out->files_offset <= slot_bytes && slot_bytes - out->files_offset >= table_bytes;
+}
+
+// Overwrite both headers so dev no longer holds a snapshot
+static void snap_erase(BlockDevice* dev) {
+    if (!snap_slot_sectors(dev)) return;
+    uint8_t* zero = (uint8_t*)malloc(dev->sector_size);
+    if (!zero) return;
+    kstring::zero_memory(zero, dev->sector_size);
+    for (int slot = 0; slot < SNAP_SLOTS; slot++) block_write(dev, snap_lba(dev, slot, 0), 1, zero);
+    free(zero);
+    if (snapshot_dev == dev) snapshot_dev = nullptr;
+}
+
+static uint32_t ram_crc(const RAMFile* file) {
+    uint32_t crc = 0;
+    for (uint64_t pos = 0; pos < file->size; pos += RAM_CHUNK_SIZE) {
+        uint64_t n = file->size - pos < RAM_CHUNK_SIZE ? file->size - pos : RAM_CHUNK_SIZE;
+        crc = crc32c(crc, file->chunks[pos / RAM_CHUNK_SIZE], n);
+    }
+    return crc;
+}
+
+int unifs_snapshot(BlockDevice* dev) {
+    if (!dev) return UNIFS_ERR_NOT_FOUND;
+    if (dev->read_only) return UNIFS_ERR_READONLY;
+    if (disk_volume && unifs_disk_device(disk_volume) == dev) return UNIFS_ERR_IN_USE;
+    uint64_t slot_sectors = snap_slot_sectors(dev);
+    if (!slot_sectors) return UNIFS_ERR_INVALID;
+    uint64_t slot_bytes = slot_sectors * dev->sector_size;
+    uint64_t start = timer_get_ticks();
+    
+    // Newest snapshot on dev keeps its slot; the other one is overwritten
+    UniFSSnapshotHeader header;
+    int slot = 0;
+    uint64_t sequence = snapshot_sequence;
+    for (int i = 0; i < SNAP_SLOTS; i++) {
+        if (snap_read_header(dev, i, &header) && header.sequence >= sequence) {
+            sequence = header.sequence;
+            slot = (i + 1) % SNAP_SLOTS;
+        }
+    }
+    
+    // Layout: header page, boot image, file table, then each file's chunks
+    uint64_t image_size = mounted ? boot_image_size : 0;
+    uint64_t files_offset = snap_align(UNIFS_SNAPSHOT_ALIGN + image_size);
+    uint32_t count = (uint32_t)ram_file_count;
+    uint64_t table_bytes = snap_align((uint64_t)count * sizeof(UniFSSnapshotFile));
+    UniFSSnapshotFile* table = (UniFSSnapshotFile*)malloc(table_bytes ? table_bytes : 1);
+    if (!table) return UNIFS_ERR_NO_MEMORY;
+    kstring::zero_memory(table, table_bytes);
+    uint64_t end = files_offset + table_bytes;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < ram_file_slots && n < count; i++) {
+        const RAMFile* file = ram_files[i];
+        if (!file) continue;
+        kstring::strcpy(table[n].name, file->name);
+        table[n].offset = end;
+        table[n].size = file->size;
+        table[n].crc = ram_crc(file);
+        end += snap_align(file->size);
+        n++;
+    }
+    if (end > slot_bytes) {
+        free(table);
+        return UNIFS_ERR_FULL;
+    }
+    
+    // Invalidate the target slot first: a crash part way leaves it without
+    // a header rather than with one describing half-written data
+    uint8_t* page = (uint8_t*)malloc(UNIFS_SNAPSHOT_ALIGN);
+    if (!page) {
+        free(table);
+        return UNIFS_ERR_NO_MEMORY;
+    }
+    kstring::zero_memory(page, UNIFS_SNAPSHOT_ALIGN);
+    int result = snap_write_bytes(dev, slot, 0, page, dev->sector_size);
+    if (result == UNIFS_OK && image_size) {
+        result = snap_write_bytes(dev, slot, UNIFS_SNAPSHOT_ALIGN, fs_start, image_size);
+    }
+    if (result == UNIFS_OK && table_bytes) {
+        result = snap_write_bytes(dev, slot, files_offset, (const uint8_t*)table, table_bytes);
+    }
+    n = 0;
+    for (uint32_t i = 0; i < ram_file_slots && n < count && result == UNIFS_OK; i++) {
+        const RAMFile* file = ram_files[i];
+        if (!file) continue;
+        uint64_t pages = (file->size + RAM_CHUNK_SIZE - 1) / RAM_CHUNK_SIZE;
+        result = snap_pages(dev, slot, table[n].offset, file->chunks, pages, true);
+        n++;
+    }
+    if (result == UNIFS_OK && block_flush(dev) != BLOCK_OK) result = UNIFS_ERR_IO;
+    
+    // Then the header, and flush again so it is durable when we return
+    if (result == UNIFS_OK) {
+        kstring::zero_memory(&header, sizeof(header));
+        kstring::memcpy(header.magic, UNIFS_SNAPSHOT_MAGIC, 8);
+        header.sequence = sequence + 1;
+        header.image_size = image_size;
+        header.files_offset = files_offset;
+        header.file_count = count;
+        header.image_crc = crc32c(0, fs_start, image_size);
+        header.files_crc = crc32c(0, table, (uint64_t)count * sizeof(UniFSSnapshotFile));
+        header.header_crc = crc32c(0, &header, sizeof(header) - 4);
+        kstring::memcpy(page, &header, sizeof(header));
+        result = snap_write_bytes(dev, slot, 0, page, dev->sector_size);
+        if (result == UNIFS_OK && block_flush(dev) != BLOCK_OK) result = UNIFS_ERR_IO;
+    }
+    free(page);
+    free(table);
+    if (result != UNIFS_OK) return result;
+    
+    snapshot_dev = dev;
+    snapshot_sequence = header.sequence;
+    snapshot_generation = next_generation;
+    snapshot_stats.sequence = header.sequence;
+    snapshot_stats.files = count;
+    snapshot_stats.bytes = end;
+    snapshot_stats.ms = snap_elapsed_ms(start);
+    snapshot_stats.restored = false;
+    return UNIFS_OK;
+}
+
+// Read one slot's files into freshly allocated chunks. On success files[]
+// holds count RAMFiles ready to adopt; on failure nothing is left allocated.
+static bool snap_read_files(BlockDevice* dev, int slot, const UniFSSnapshotHeader* header,
+                            RAMFile** files) {
+    uint64_t slot_bytes = snap_slot_sectors(dev) * dev->sector_size;
+    uint64_t table_bytes = snap_align((uint64_t)header->file_count * sizeof(UniFSSnapshotFile));
+    UniFSSnapshotFile* table = (UniFSSnapshotFile*)malloc(table_bytes ? table_bytes : 1);
+    if (!table) return false;
+    bool ok = snap_read_bytes(dev, slot, header->files_offset, (uint8_t*)table, table_bytes) == UNIFS_OK &&
+              crc32c(0, table, (uint64_t)header->file_count * sizeof(UniFSSnapshotFile)) == header->files_crc;
+    
+    uint32_t n = 0;
+    for (; ok && n < header->file_count; n++) {
+        const UniFSSnapshotFile* entry = &table[n];
+        uint64_t pages = (entry->size + RAM_CHUNK_SIZE - 1) / RAM_CHUNK_SIZE;
+        if (entry->offset % UNIFS_SNAPSHOT_ALIGN || entry->offset > slot_bytes ||
+            (slot_bytes - entry->offset) / RAM_CHUNK_SIZE < pages ||
+            entry->name[sizeof(entry->name) - 1] || !entry->name[0]) {
+            ok = false;
+            break;
+        }
+        RAMFile* file = (RAMFile*)malloc(sizeof(RAMFile));
+        if (!file) {
+            ok = false;
+            break;
+        }
+        kstring::zero_memory(file, sizeof(RAMFile));
+        files[n] = file;
+        kstring::strcpy(file->name, entry->name);
+        if (!ram_reserve(file, entry->size)) {
+            n++;
+            ok = false;
+            break;
+        }
+        file->size = entry->size;
+        ok = snap_pages(dev, slot, entry->offset, file->chunks, pages, false) == UNIFS_OK &&
+             ram_crc(file) == entry->crc;
+    }
+    if (!ok) {
+        for (uint32_t i = 0; i < n; i++) {
+            RAMFile* file = files[i];
+            file->size = 0;
+            ram_trim(file);
+            if (file->chunks) free(file->chunks);
+            free(file);
+        }
+    }
+    free(table);
+    return ok;
+}
+
+static bool snap_restore(BlockDevice* dev, int slot, const UniFSSnapshotHeader* header) {
+    uint64_t start = timer_get_ticks();
+    uint8_t* image = nullptr;
+    uint64_t image_pages = snap_align(header->image_size) / UNIFS_SNAPSHOT_ALIGN;
+    if (image_pages) {
+        // Stays allocated for the life of the system, like the Limine module
+        void* frames = pmm_alloc_frames(image_pages);
+        if (!frames) return false;
+        image = (uint8_t*)frames + vmm_get_hhdm_offset();
+        if (snap_read_bytes(dev, slot, UNIFS_SNAPSHOT_ALIGN, image, header->image_size) != UNIFS_OK ||
+            crc32c(0, image, header->image_size) != header->image_crc) {
+            for (uint64_t i = 0; i < image_pages; i++) pmm_free_frame((uint8_t*)frames + i * UNIFS_SNAPSHOT_ALIGN);
+            return false;
+        }
+    }
+    
+    RAMFile** files = (RAMFile**)malloc((header->file_count ? header->file_count : 1) * sizeof(RAMFile*));
+    if (!files || !snap_read_files(dev, slot, header, files)) {
+        if (files) free(files);
+        for (uint64_t i = 0; i < image_pages; i++) {
+            pmm_free_frame((void*)((uint64_t)image - vmm_get_hhdm_offset() + i * UNIFS_SNAPSHOT_ALIGN));
+        }
+        return false;
+    }
+    
+    unifs_init(image, header->image_size);
+    uint64_t bytes = header->files_offset + snap_align((uint64_t)header->file_count * sizeof(UniFSSnapshotFile));
+    for (uint32_t i = 0; i < header->file_count; i++) {
+        RAMFile* file = files[i];
+        bytes += snap_align(file->size);
+        uint32_t index = find_free_slot();
+        bool added = index != NAME_NONE && !find_ram_file(file->name);
+        if (added) {
+            file->generation = next_generation++;
+            ram_files[index] = file;
+            added = table_insert(&ram_names, index);
+            if (!added) ram_files[index] = nullptr;
+        }
+        if (!added) {
+            DEBUG_WARN("unifs: Snapshot file %s dropped", file->name);
+            file->size = 0;
+            ram_trim(file);
+            if (file->chunks) free(file->chunks);
+            free(file);
+            continue;
+        }
+        ram_file_count++;
+    }
+    free(files);
+    invalidate_listing();
+    
+    snapshot_dev = dev;
+    snapshot_sequence = header->sequence;
+    snapshot_generation = next_generation;
+    snapshot_stats.sequence = header->sequence;
+    snapshot_stats.files = ram_file_count;
+    snapshot_stats.bytes = bytes;
+    snapshot_stats.ms = snap_elapsed_ms(start);
+    snapshot_stats.restored = true;
+    return true;
+}
+
+bool unifs_load_snapshot() {
+    // Every intact slot on every device, tried newest first until one
+    // restores completely
+    struct Candidate { BlockDevice* dev; int slot; UniFSSnapshotHeader header; bool tried; };
+    Candidate found[BLOCK_MAX_DEVICES * SNAP_SLOTS];
+    int count = 0;
+    for (int i = 0; i < block_count() && count < BLOCK_MAX_DEVICES * SNAP_SLOTS; i++) {
+        BlockDevice* dev = block_get(i);
+        if (!dev || !snap_slot_sectors(dev)) continue;
+        for (int slot = 0; slot < SNAP_SLOTS; slot++) {
+            Candidate* c = &found[count];
+            if (!snap_read_header(dev, slot, &c->header)) continue;
+            c->dev = dev;
+            c->slot = slot;
+            c->tried = false;
+            count++;
+        }
+    }
+    
+    for (int attempt = 0; attempt < count; attempt++) {
+        Candidate* best = nullptr;
+        for (int i = 0; i < count; i++) {
+            if (!found[i].tried && (!best || found[i].header.sequence > best->header.sequence)) best = &found[i];
+        }
+        best->tried = true;
+        if (snap_restore(best->dev, best->slot, &best->header)) {
+            DEBUG_INFO("unifs: Restored snapshot %lu from %s (%lu files, %lu KB in %lu ms)",
+                       best->header.sequence, best->dev->name, snapshot_stats.files,
+                       snapshot_stats.bytes / 1024, snapshot_stats.ms);
+            return true;
+        }
+        DEBUG_WARN("unifs: Snapshot %lu on %s is damaged", best->header.sequence, best->dev->name);
+    }
+    return false;
+}
+
+void unifs_get_snapshot_stats(UniFSSnapshotStats* out) {
+    *out = snapshot_stats;
+    out->device = snapshot_dev ? snapshot_dev->name : nullptr;
+    out->dirty = snapshot_dev && next_generation != snapshot_generation;
+}
+
+// ============================================================================
+// Disk Volume
+// ============================================================================
+
+void unifs_mount_disks() {
+    for (int i = 0; i < block_count() && !disk_volume; i++) {
+        disk_volume = unifs_disk_mount(block_get(i));
+    }
+    invalidate_listing();
+}
+
+int unifs_format_disk(BlockDevice* dev) {
+    if (!dev) return UNIFS_ERR_NOT_FOUND;
+    if (disk_volume && unifs_disk_device(disk_volume) == dev) return UNIFS_ERR_IN_USE;
+    
+    snap_erase(dev);    // Or a snapshot in the second slot would outlive the format
+    int result = unifs_disk_format(dev);
+    if (result == UNIFS_OK && !disk_volume) {
+        disk_volume = unifs_disk_mount(dev);
+        if (!disk_volume) result = UNIFS_ERR_IO;
+        invalidate_listing();
+        vfs_invalidate();  // Files now come from the new volume
+    }
+    return result;
+}
+
+UniFSVolume* unifs_get_disk_volume() {
+    return disk_volume;
+}
+
+int unifs_sync() {
+    int result = disk_volume ? unifs_disk_sync(disk_volume) : UNIFS_OK;
+    if (snapshot_dev && next_generation != snapshot_generation) {
+        int status = unifs_snapshot(snapshot_dev);
+        if (status != UNIFS_OK) result = status;
+    }
+    return result;
+}
+
 // ============================================================================
 // Stats
 // ============================================================================
@@ -427,9 +1730,9 @@ uint64_t unifs_get_total_size() {
     }
     
     // RAM files
-    for (int i = 0; i < UNIFS_MAX_FILES; i++) {
-        if (ram_files[i].used) {
-            total += ram_files[i].size;
+    for (uint32_t i = 0; i < ram_file_slots; i++) {
+        if (ram_files[i]) {
+            total += ram_files[i]->size;
         }
     }
     
@@ -440,15 +1743,166 @@ uint64_t unifs_get_used_size() {
     return unifs_get_total_size();  // Same as total for now
 }
 
-uint64_t unifs_get_free_slots() {
-    uint64_t used = 0;
-    for (int i = 0; i < UNIFS_MAX_FILES; i++) {
-        if (ram_files[i].used) used++;
+uint64_t unifs_get_boot_file_count() {
+    return mounted ? boot_header->file_count : 0;
+}
+
+uint64_t unifs_get_boot_compressed_count() {
+    return mounted ? boot_compressed : 0;
+}
+
+bool unifs_boot_is_indexed() {
+    return mounted && boot_indexed;
+}
+
+uint64_t unifs_get_ram_file_count() {
+    return ram_file_count;
+}
+
+// ============================================================================
+// VFS Driver
+// ============================================================================
+// The merged tree above, mounted at "/". Node ids: disk inode numbers, or a
+// tagged RAM slot / boot entry index.
+
+#define VFS_ID_ROOT     (3ULL << 32)
+#define VFS_ID_RAM      (1ULL << 32)
+#define VFS_ID_BOOT     (2ULL << 32)
+
+static bool unifs_vfs_lookup(void*, const char* path, VfsNodeInfo* out) {
+    if (!path[0]) {
+        out->id = VFS_ID_ROOT;
+        out->kind = VFS_NODE_DIR;
+        out->size = 0;
+        out->generation = 0;
+        return true;
+    }
+    
+    uint32_t inode = find_disk_inode(path);
+    if (inode) {
+        UniFSStat st;
+        if (unifs_disk_stat(disk_volume, inode, &st) != UNIFS_OK) return false;
+        out->id = inode;
+        out->kind = st.type == UNIFS2_TYPE_DIR ? VFS_NODE_DIR : VFS_NODE_FILE;
+        out->size = st.size;
+        out->generation = st.version;
+        return true;
+    }
+    
+    uint32_t slot = table_find(&ram_names, path);
+    if (slot != NAME_NONE) {
+        out->id = VFS_ID_RAM | slot;
+        out->kind = VFS_NODE_FILE;
+        out->size = ram_files[slot]->size;
+        out->generation = ram_files[slot]->generation;
+        return true;
     }
-    return UNIFS_MAX_FILES - used;
+    
+    UniFSEntry* entry = find_boot_entry(path);
+    if (entry) {
+        out->id = VFS_ID_BOOT | (uint64_t)(entry - boot_entries);
+        out->kind = VFS_NODE_FILE;
+        out->size = entry->size;
+        out->generation = 0;
+        return true;
+    }
+    return false;
 }
 
-uint64_t unifs_get_boot_file_count() {
-    return mounted ? boot_header->file_count : 0;
+static bool unifs_vfs_open(void*, const char* path, UniFSFile* out) {
+    return unifs_open_into(path, out);
+}
+
+// Reads by node id, so open files skip the name lookup
+static int64_t unifs_vfs_read(void*, uint64_t id, uint64_t offset, void* buf, uint64_t len) {
+    if (id == VFS_ID_ROOT) {
+        return UNIFS_ERR_IS_DIR;
+    } else if ((id >> 32) == 0) {
+        if (!disk_volume) return UNIFS_ERR_NOT_FOUND;
+        return unifs_disk_read(disk_volume, (uint32_t)id, offset, buf, len);
+    } else if ((id & ~0xFFFFFFFFULL) == VFS_ID_RAM) {
+        uint32_t slot = (uint32_t)id;
+        if (slot >= ram_file_slots || !ram_files[slot]) return UNIFS_ERR_NOT_FOUND;
+        RAMFile* file = ram_files[slot];
+        if (offset >= file->size) return 0;
+        if (len > file->size - offset) len = file->size - offset;
+        ram_copy_out(file, offset, (uint8_t*)buf, len);
+        return (int64_t)len;
+    } else {
+        uint32_t index = (uint32_t)id;
+        if (!mounted || index >= boot_header->file_count) return UNIFS_ERR_NOT_FOUND;
+        return boot_read(&boot_entries[index], offset, (uint8_t*)buf, len);
+    }
+}
+
+// Only disk files have anything to prefetch
+static void unifs_vfs_readahead(void*, uint64_t id, uint64_t offset, uint64_t len) {
+    if ((id >> 32) == 0 && disk_volume) unifs_disk_readahead(disk_volume, (uint32_t)id, offset, len);
+}
+
+static int unifs_vfs_content_type(void*, const char* path) {
+    return unifs_get_file_type(path);
+}
+
+static int unifs_vfs_create(void*, const char* path, bool dir) {
+    return dir ? unifs_mkdir(path) : unifs_create(path);
+}
+
+static int unifs_vfs_write(void*, const char* path, const void* data, uint64_t size, bool append) {
+    return append ? unifs_append(path, data, size) : unifs_write(path, data, size);
 }
 
+static int unifs_vfs_remove(void*, const char* path) {
+    return unifs_delete(path);
+}
+
+// Root: the merged listing. Below it: disk directories.
+static uint64_t unifs_vfs_dir_count(void*, const char* path) {
+    if (!path[0]) return unifs_get_file_count();
+    uint32_t inode = find_disk_inode(path);
+    return inode ? unifs_disk_dir_count(disk_volume, inode) : 0;
+}
+
+static const char* unifs_vfs_dir_name(void*, const char* path, uint64_t index) {
+    if (!path[0]) return unifs_get_file_name(index);
+    uint32_t inode = find_disk_inode(path);
+    UniFSDirInfo info;
+    if (!inode || !unifs_disk_readdir(disk_volume, inode, (uint32_t)index, &info)) return nullptr;
+    return info.name;
+}
+
+static int unifs_vfs_sync(void*) {
+    return unifs_sync();
+}
+
+// Uncompressed boot files are mapped in place; everything else can change
+static const uint8_t* unifs_vfs_map(void*, uint64_t id) {
+    if ((id & ~0xFFFFFFFFULL) != VFS_ID_BOOT) return nullptr;
+    uint32_t index = (uint32_t)id;
+    if (!mounted || index >= boot_header->file_count || boot_is_lz4(&boot_entries[index])) return nullptr;
+    return boot_check(index) ? boot_data(&boot_entries[index]) : nullptr;
+}
+
+// Only disk files can be resized in place, and they have no holes to punch
+static int unifs_vfs_truncate(void*, const char* path, uint64_t size) {
+    uint32_t inode = find_disk_inode(path);
+    return inode ? unifs_disk_truncate(disk_volume, inode, size) : UNIFS_ERR_INVALID;
+}
+
+const VfsOps unifs_vfs_ops = {
+    "unifs",
+    unifs_vfs_lookup,
+    unifs_vfs_open,
+    unifs_vfs_read,
+    unifs_vfs_readahead,
+    unifs_vfs_content_type,
+    unifs_vfs_create,
+    unifs_vfs_write,
+    unifs_vfs_remove,
+    unifs_vfs_dir_count,
+    unifs_vfs_dir_name,
+    unifs_vfs_sync,
+    unifs_vfs_map,
+    unifs_vfs_truncate,
+    nullptr,
+};
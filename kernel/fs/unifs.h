@@ -10,18 +10,51 @@
 // - Entry:  64-byte name + 8-byte offset + 8-byte size
 // - Data:   Raw file contents concatenated
 //
-// Note: Runtime file modifications are stored in RAM only.
-// Changes are lost on reboot (no persistent storage driver yet).
+// With mkunifs.py --compress, files that shrink are stored LZ4-compressed:
+// the entry's offset has UNIFS_ENTRY_LZ4 set and points at a UniFSLz4Header,
+// a table of block_count + 1 offsets (from the header) and the blocks, each
+// an LZ4 block of UNIFS_LZ4_BLOCK_SIZE bytes (less for the last) decoded
+// on its own. A block whose stored length equals its decoded length is
+// stored raw. size is always the decoded size.
+//
+// mkunifs.py --aligned writes the UNIFS_MAGIC_ALIGNED layout instead:
+// Header + UniFSIndex + Entries[] sorted by name + hash table + data, with
+// every file's data starting on a UNIFS_DATA_ALIGN boundary. The hash table
+// holds entry index + 1 (0 = empty) in slots probed linearly from
+// unifs2_name_hash(name), so the kernel looks names up in the image without
+// building anything, and program pages can be mapped straight from it.
+//
+// mkunifs.py ends every image with a UniFSCrcTrailer (unless --no-crc):
+// the CRC32C of the metadata (header through hash table) and a table with
+// the CRC32C of each entry's stored bytes (the LZ4 frame if compressed).
+// The metadata is checked at mount. A file is checked the first time it is
+// read, opened or mapped, or earlier by the background verifier; a file that
+// fails cannot be opened and reads return UNIFS_ERR_IO.
+//
+// unifs_snapshot() saves the boot image and every RAM file to a block
+// device, which is split into two slots used in turn. Each slot starts with
+// a UniFSSnapshotHeader in its first UNIFS_SNAPSHOT_ALIGN bytes, then the
+// boot image verbatim, then a UniFSSnapshotFile table and the RAM file data,
+// each piece starting on a UNIFS_SNAPSHOT_ALIGN boundary. The header is
+// written last, so a slot is either complete or fails its checksums.
+//
+// This flat format is the read-only boot image. When a block device holds a
+// uniFS v2 volume (unifs_disk.h) it is mounted at boot and runtime changes
+// go there and persist; without one they are kept in RAM, lost on reboot
+// unless a snapshot saves them.
 // ============================================================================
 
 // uniFS magic signature
 #define UNIFS_MAGIC "UNIFS v1"
+#define UNIFS_MAGIC_ALIGNED "UNIFS va"
+#define UNIFS_DATA_ALIGN    4096
 
 // File type detection (based on extension/content)
 #define UNIFS_TYPE_UNKNOWN  0
 #define UNIFS_TYPE_TEXT     1
 #define UNIFS_TYPE_BINARY   2
 #define UNIFS_TYPE_ELF      3
+#define UNIFS_TYPE_DIR      4   // Disk volumes only
 
 // Error codes
 #define UNIFS_OK            0
@@ -32,11 +65,15 @@
 #define UNIFS_ERR_NAME_TOO_LONG -5
 #define UNIFS_ERR_READONLY  -6
 #define UNIFS_ERR_IN_USE    -7  // File is currently open
+#define UNIFS_ERR_NOT_DIR   -8
+#define UNIFS_ERR_IS_DIR    -9
+#define UNIFS_ERR_NOT_EMPTY -10
+#define UNIFS_ERR_IO        -11
+#define UNIFS_ERR_INVALID   -12
 
-// Limits
-#define UNIFS_MAX_FILES     64
+// Limits (RAM files are bounded only by free memory)
 #define UNIFS_MAX_FILENAME  63
-#define UNIFS_MAX_FILE_SIZE (1024 * 1024)  // 1 MB per file
+#define UNIFS_MAX_FLAT_SIZE (1024 * 1024)  // Largest RAM file unifs_open_into() returns
 
 // On-disk structures
 struct UniFSHeader {
@@ -44,12 +81,63 @@ struct UniFSHeader {
     uint64_t file_count;  // Number of files
 } __attribute__((packed));
 
+// Follows the header in UNIFS_MAGIC_ALIGNED images
+struct UniFSIndex {
+    uint64_t table_offset;  // uint32_t slots[table_slots] from the image start
+    uint32_t table_slots;   // Power of two, more than file_count
+    uint32_t data_align;    // UNIFS_DATA_ALIGN
+} __attribute__((packed));
+
 struct UniFSEntry {
     char name[64];        // Null-terminated filename
-    uint64_t offset;      // Offset from start of filesystem
+    uint64_t offset;      // Offset from start of filesystem (| UNIFS_ENTRY_LZ4)
     uint64_t size;        // File size in bytes
 } __attribute__((packed));
 
+#define UNIFS_ENTRY_LZ4       (1ULL << 63)    // Data is an LZ4 frame
+#define UNIFS_LZ4_MAGIC       "ULZ4"
+#define UNIFS_LZ4_BLOCK_SIZE  65536
+
+struct UniFSLz4Header {
+    char magic[4];        // UNIFS_LZ4_MAGIC
+    uint32_t block_size;  // UNIFS_LZ4_BLOCK_SIZE
+    uint32_t block_count;
+    uint32_t reserved;
+} __attribute__((packed));
+
+#define UNIFS_CRC_MAGIC       "UNIFSCRC"
+
+// Last bytes of the image
+struct UniFSCrcTrailer {
+    uint64_t table_offset;  // uint32_t crcs[file_count], entry order
+    uint64_t meta_size;     // Bytes [0, meta_size) covered by meta_crc
+    uint32_t file_count;
+    uint32_t meta_crc;
+    char magic[8];          // UNIFS_CRC_MAGIC
+} __attribute__((packed));
+
+#define UNIFS_SNAPSHOT_MAGIC  "UNIFSSNP"
+#define UNIFS_SNAPSHOT_ALIGN  4096
+
+struct UniFSSnapshotHeader {
+    char magic[8];          // UNIFS_SNAPSHOT_MAGIC
+    uint64_t sequence;      // Higher is newer
+    uint64_t image_size;    // Boot image at UNIFS_SNAPSHOT_ALIGN (0 = none)
+    uint64_t files_offset;  // UniFSSnapshotFile[file_count], from the slot start
+    uint32_t file_count;
+    uint32_t image_crc;     // CRC32C of the boot image
+    uint32_t files_crc;     // CRC32C of the file table
+    uint32_t header_crc;    // CRC32C of the fields above
+} __attribute__((packed));
+
+struct UniFSSnapshotFile {
+    char name[64];
+    uint64_t offset;        // From the slot start, UNIFS_SNAPSHOT_ALIGN aligned
+    uint64_t size;
+    uint32_t crc;           // CRC32C of the data
+    uint32_t reserved;
+} __attribute__((packed));
+
 // In-memory file handle
 struct UniFSFile {
     const char* name;
@@ -61,19 +149,26 @@ struct UniFSFile {
 // Read API
 // ============================================================================
 
-// Initialize filesystem from memory address (typically from Limine module)
-void unifs_init(void* start_addr);
+// Initialize filesystem from memory address (typically from Limine module).
+// size is the image length, needed to find the checksum trailer and to
+// bounds-check an aligned image's index.
+void unifs_init(void* start_addr, uint64_t size);
 
 // Check if filesystem is mounted and valid
 bool unifs_is_mounted();
 
+// True if [data, data + size) lies in the boot image itself, which stays
+// mapped and unchanged for the life of the system
+bool unifs_is_boot_data(const void* data, uint64_t size);
+
 // Open a file by name (returns nullptr if not found)
 // WARNING: This uses a static buffer - NOT thread-safe for concurrent access
 [[deprecated("Use unifs_open_into() instead - this function is not thread-safe")]]
 const UniFSFile* unifs_open(const char* name);
 
 // Thread-safe open: fills caller-provided buffer
-// Returns true if file found, false otherwise
+// Returns true if file found, false otherwise (or if it is a RAM file
+// larger than UNIFS_MAX_FLAT_SIZE)
 bool unifs_open_into(const char* name, UniFSFile* out_file);
 
 // Check if a file exists
@@ -85,6 +180,9 @@ uint64_t unifs_get_file_size(const char* name);
 // Get file type (UNIFS_TYPE_*)
 int unifs_get_file_type(const char* name);
 
+// Type of contents starting with data (the first 256 bytes are enough)
+int unifs_detect_type(const uint8_t* data, uint64_t size);
+
 // Get total number of files
 uint64_t unifs_get_file_count();
 
@@ -94,9 +192,14 @@ const char* unifs_get_file_name(uint64_t index);
 // Get file size by index
 uint64_t unifs_get_file_size_by_index(uint64_t index);
 
+// Content generation: changes whenever a RAM or disk file is written,
+// appended or recreated. Boot files never change and report 0.
+uint64_t unifs_get_file_generation(const char* name);
+
 // ============================================================================
-// Write API (RAM-only - changes lost on reboot)
+// Write API (disk volume if mounted, else RAM - lost on reboot)
 // ============================================================================
+// With a disk volume, names may be '/'-separated paths.
 
 // Create a new empty file
 // Returns: UNIFS_OK on success, or error code
@@ -110,13 +213,96 @@ int unifs_write(const char* name, const void* data, uint64_t size);
 // Returns: UNIFS_OK on success, or error code
 int unifs_append(const char* name, const void* data, uint64_t size);
 
-// Delete a file
+// Delete a file (or an empty directory on disk)
 // Returns: UNIFS_OK on success, or error code
 int unifs_delete(const char* name);
 
+// Create a directory (disk volume only)
+int unifs_mkdir(const char* name);
+
+// ============================================================================
+// VFS
+// ============================================================================
+// Everything above, boot + RAM + disk merged, as a filesystem driver. kmain
+// mounts it at "/"; other code should go through vfs.h rather than call
+// unifs_* directly.
+
+struct VfsOps;
+extern const VfsOps unifs_vfs_ops;
+
+// ============================================================================
+// Disk Volume
+// ============================================================================
+
+struct UniFSVolume;
+struct BlockDevice;
+
+// Mount the first block device holding a uniFS v2 volume (after bcache_init)
+void unifs_mount_disks();
+
+// Format dev as an empty v2 volume and mount it if no volume is mounted.
+// Fails with UNIFS_ERR_IN_USE for the mounted device.
+int unifs_format_disk(BlockDevice* dev);
+
+// Mounted volume, or nullptr
+UniFSVolume* unifs_get_disk_volume();
+
+// Write all changes to the disk volume, and RAM files to the snapshot
+// device if they changed since the last snapshot
+int unifs_sync();
+
 // Get filesystem stats
 uint64_t unifs_get_total_size();
 uint64_t unifs_get_used_size();
-uint64_t unifs_get_free_slots();
 uint64_t unifs_get_boot_file_count();
+uint64_t unifs_get_boot_compressed_count();
+bool unifs_boot_is_indexed();   // Aligned image with a usable hash table
+uint64_t unifs_get_ram_file_count();
+
+// Boot image checksums
+struct UniFSVerifyStats {
+    bool has_checksums;         // Image carries a UniFSCrcTrailer
+    bool hardware;              // crc32 instruction (else slicing-by-8)
+    uint64_t files;
+    uint64_t verified;          // Checked and good
+    uint64_t bad;
+    uint64_t bytes;             // Checked so far
+    uint64_t mb_per_s;          // Checksum throughput, 0 if unknown
+    bool done;                  // Background verifier finished
+};
+
+// Check every boot file in a background task (after scheduler_init)
+void unifs_start_verify();
+
+// Reap the verifier task once it has finished; call from the task that
+// started it
+void unifs_reap_verify();
+void unifs_get_verify_stats(UniFSVerifyStats* out);
+
+// ============================================================================
+// Snapshots
+// ============================================================================
+
+struct UniFSSnapshotStats {
+    const char* device;         // Snapshot device name, nullptr if none
+    uint64_t sequence;          // Of the last snapshot written or restored
+    uint64_t files;
+    uint64_t bytes;             // Written (or read) by it
+    uint64_t ms;
+    bool restored;              // Booted from it
+    bool dirty;                 // RAM files changed since
+};
+
+// Boot from the newest valid snapshot on any block device: the boot image
+// and RAM files it holds replace the Limine module. Call instead of
+// unifs_init() (after the block drivers, before unifs_mount_disks()).
+// False if there is none, leaving the filesystem untouched.
+bool unifs_load_snapshot();
+
+// Write the boot image and all RAM files to dev, into the slot not holding
+// its newest snapshot, and make dev the device unifs_sync() snapshots to.
+// UNIFS_ERR_IN_USE for the device holding the disk volume,
+// UNIFS_ERR_FULL if the snapshot does not fit in half the device.
+int unifs_snapshot(BlockDevice* dev);
 
+void unifs_get_snapshot_stats(UniFSSnapshotStats* out);
@@ -0,0 +1,1209 @@
+#include "unifs_disk.h"
+#include "unifs.h"
+#include "bcache.h"
+#include "journal.h"
+#include "heap.h"
+#include "timer.h"
+#include "scheduler.h"
+#include "mutex.h"
+#include "kstring.h"
+#include "debug.h"
+
+#define BITS_PER_BLOCK          (UNIFS2_BLOCK_SIZE * 8)
+#define NO_BIT                  (~0ULL)
+#define VOLUME_DIR_BUCKETS      64
+#define DIR_MIN_BUCKETS         64
+#define MAX_FORMAT_INODES       262144
+
+// In-memory index of one directory: hash chains for lookup, an array for
+// listing by position, and the free on-disk slots for new entries
+struct DirNode {
+    uint32_t hash;
+    uint32_t inode;
+    uint32_t slot;              // Entry position in the directory file
+    uint32_t list_pos;          // Position in DirIndex::list
+    uint8_t type;
+    char name[UNIFS2_MAX_NAME + 1];
+    DirNode* next;              // Hash chain
+};
+
+struct DirIndex {
+    uint32_t dir;
+    uint32_t bucket_count;      // Power of two
+    DirNode** buckets;
+    DirNode** list;
+    uint32_t count;
+    uint32_t list_capacity;
+    uint32_t* free_slots;
+    uint32_t free_count;
+    uint32_t free_capacity;
+    DirIndex* next;             // Volume cache chain
+};
+
+// Blocks freed by the running transaction; released when it commits so
+// nothing can overwrite them while the old metadata is still current
+struct PendingFree {
+    uint64_t start;
+    uint64_t count;
+    bool metadata;              // Was journaled: revoke old log copies
+};
+
+struct UniFSVolume {
+    BlockDevice* dev;
+    UniFS2Superblock sb;
+    Buffer* sb_buf;             // Block 0, referenced while mounted
+    Journal* journal;
+    Mutex lock;
+    uint64_t block_hint;        // Where the next block search starts
+    uint64_t inode_hint;
+    DirIndex* dirs[VOLUME_DIR_BUCKETS];
+    PendingFree* pending;
+    uint32_t pending_count;
+    uint32_t pending_capacity;
+    UniFSVolume* next;          // Mounted volumes, for the commit task
+};
+
+static UniFSVolume* volumes = nullptr;
+
+// ============================================================================
+// Superblock / Bitmaps (called with vol->lock held)
+// ============================================================================
+
+// Metadata block about to change: make it part of the running transaction
+static inline void meta_access(UniFSVolume* v, Buffer* b) {
+    journal_access(v->journal, b);
+}
+
+static void sb_update(UniFSVolume* v) {
+    meta_access(v, v->sb_buf);
+    kstring::memcpy(v->sb_buf->data, &v->sb, sizeof(v->sb));
+}
+
+// First clear bit in [from, to), or NO_BIT
+static uint64_t find_clear(UniFSVolume* v, uint64_t bitmap_start, uint64_t from, uint64_t to) {
+    uint64_t i = from;
+    while (i < to) {
+        uint64_t blk = i / BITS_PER_BLOCK;
+        uint64_t end = (blk + 1) * BITS_PER_BLOCK;
+        if (end > to) end = to;
+
+        Buffer* b = bcache_read(v->dev, bitmap_start + blk);
+        if (!b) return NO_BIT;
+        const uint64_t* words = (const uint64_t*)b->data;
+
+        while (i < end) {
+            uint64_t word = words[(i % BITS_PER_BLOCK) / 64] | ((1ULL << (i % 64)) - 1);
+            if (word == ~0ULL) {
+                i = (i | 63) + 1;
+                continue;
+            }
+            uint64_t bit = (i & ~63ULL) + __builtin_ctzll(~word);
+            bcache_release(b);
+            return bit < end ? bit : NO_BIT;
+        }
+        bcache_release(b);
+    }
+    return NO_BIT;
+}
+
+// Clear bits starting at bit, at most max (stops at limit)
+static uint32_t clear_run(UniFSVolume* v, uint64_t bitmap_start, uint64_t bit, uint32_t max, uint64_t limit) {
+    uint32_t n = 0;
+    Buffer* b = nullptr;
+    uint64_t cur_blk = NO_BIT;
+    while (n < max && bit + n < limit) {
+        uint64_t i = bit + n;
+        uint64_t blk = i / BITS_PER_BLOCK;
+        if (blk != cur_blk) {
+            if (b) bcache_release(b);
+            b = bcache_read(v->dev, bitmap_start + blk);
+            if (!b) return n;
+            cur_blk = blk;
+        }
+        uint64_t off = i % BITS_PER_BLOCK;
+        if (b->data[off / 8] & (1u << (off % 8))) break;
+        n++;
+    }
+    if (b) bcache_release(b);
+    return n;
+}
+
+static bool bitmap_set(UniFSVolume* v, uint64_t bitmap_start, uint64_t bit, uint64_t count, bool value) {
+    while (count > 0) {
+        uint64_t blk = bit / BITS_PER_BLOCK;
+        Buffer* b = bcache_read(v->dev, bitmap_start + blk);
+        if (!b) return false;
+        meta_access(v, b);
+        while (count > 0 && bit / BITS_PER_BLOCK == blk) {
+            uint64_t off = bit % BITS_PER_BLOCK;
+            if (value) {
+                b->data[off / 8] |= (uint8_t)(1u << (off % 8));
+            } else {
+                b->data[off / 8] &= (uint8_t)~(1u << (off % 8));
+            }
+            bit++;
+            count--;
+        }
+        bcache_release(b);
+    }
+    return true;
+}
+
+// Allocate up to want contiguous blocks, preferring goal. Returns the first
+// block (0 if the disk is full) and the run length in *got.
+static uint64_t alloc_blocks(UniFSVolume* v, uint64_t goal, uint32_t want, uint32_t* got) {
+    const UniFS2Superblock& sb = v->sb;
+    if (goal < sb.data_start || goal >= sb.block_count) goal = v->block_hint;
+    if (goal < sb.data_start || goal >= sb.block_count) goal = sb.data_start;
+
+    uint64_t start = find_clear(v, sb.block_bitmap_start, goal, sb.block_count);
+    if (start == NO_BIT) start = find_clear(v, sb.block_bitmap_start, sb.data_start, goal);
+    if (start == NO_BIT) return 0;
+
+    *got = clear_run(v, sb.block_bitmap_start, start, want, sb.block_count);
+    if (!bitmap_set(v, sb.block_bitmap_start, start, *got, true)) return 0;
+    v->sb.free_blocks -= *got;
+    v->block_hint = start + *got;
+    sb_update(v);
+    return start;
+}
+
+// Give back blocks allocated earlier in this transaction and not yet used
+static void unallocate_blocks(UniFSVolume* v, uint64_t start, uint64_t count) {
+    if (count == 0) return;
+    bitmap_set(v, v->sb.block_bitmap_start, start, count, false);
+    v->sb.free_blocks += count;
+    sb_update(v);
+}
+
+// Free blocks at the next commit (see PendingFree)
+static void free_blocks(UniFSVolume* v, uint64_t start, uint64_t count, bool metadata) {
+    if (count == 0) return;
+    if (v->pending_count == v->pending_capacity) {
+        uint32_t cap = v->pending_capacity ? v->pending_capacity * 2 : 64;
+        PendingFree* bigger = (PendingFree*)malloc(cap * sizeof(PendingFree));
+        if (!bigger) {
+            // Leaked until fsck rather than risking reuse too early
+            DEBUG_WARN("unifs: Out of memory, %lu blocks at %lu leaked", count, start);
+            return;
+        }
+        if (v->pending) {
+            kstring::memcpy(bigger, v->pending, v->pending_count * sizeof(PendingFree));
+            free(v->pending);
+        }
+        v->pending = bigger;
+        v->pending_capacity = cap;
+    }
+    v->pending[v->pending_count++] = {start, count, metadata};
+}
+
+static void apply_pending_frees(UniFSVolume* v) {
+    for (uint32_t i = 0; i < v->pending_count; i++) {
+        const PendingFree& f = v->pending[i];
+        if (f.metadata) {
+            for (uint64_t b = 0; b < f.count; b++) journal_revoke(v->journal, f.start + b);
+        }
+        bitmap_set(v, v->sb.block_bitmap_start, f.start, f.count, false);
+        v->sb.free_blocks += f.count;
+    }
+    if (v->pending_count) sb_update(v);
+    v->pending_count = 0;
+}
+
+static int commit_locked(UniFSVolume* v) {
+    apply_pending_frees(v);
+    return journal_commit(v->journal) == BLOCK_OK ? UNIFS_OK : UNIFS_ERR_IO;
+}
+
+// Start of a modifying operation: commit first if the transaction is due,
+// so one operation never straddles two transactions
+static void begin_op(UniFSVolume* v) {
+    if (journal_should_commit(v->journal, UNIFS2_COMMIT_INTERVAL_MS)) commit_locked(v);
+}
+
+static uint32_t alloc_inode(UniFSVolume* v) {
+    const UniFS2Superblock& sb = v->sb;
+    uint64_t ino = find_clear(v, sb.inode_bitmap_start, v->inode_hint, sb.inode_count);
+    if (ino == NO_BIT) ino = find_clear(v, sb.inode_bitmap_start, 1, v->inode_hint);
+    if (ino == NO_BIT || ino == 0) return 0;
+
+    bitmap_set(v, sb.inode_bitmap_start, ino, 1, true);
+    v->sb.free_inodes--;
+    v->inode_hint = ino + 1;
+    sb_update(v);
+    return (uint32_t)ino;
+}
+
+static void free_inode(UniFSVolume* v, uint32_t ino) {
+    bitmap_set(v, v->sb.inode_bitmap_start, ino, 1, false);
+    v->sb.free_inodes++;
+    if (ino < v->inode_hint) v->inode_hint = ino;
+    sb_update(v);
+}
+
+// ============================================================================
+// Inodes and Extents (called with vol->lock held)
+// ============================================================================
+
+static bool inode_read(UniFSVolume* v, uint32_t ino, UniFS2Inode* out) {
+    if (ino == 0 || ino >= v->sb.inode_count) return false;
+    Buffer* b = bcache_read(v->dev, v->sb.inode_table_start + ino / UNIFS2_INODES_PER_BLOCK);
+    if (!b) return false;
+    kstring::memcpy(out, b->data + (ino % UNIFS2_INODES_PER_BLOCK) * UNIFS2_INODE_SIZE, sizeof(*out));
+    bcache_release(b);
+    return true;
+}
+
+static bool inode_write(UniFSVolume* v, uint32_t ino, const UniFS2Inode* in) {
+    Buffer* b = bcache_read(v->dev, v->sb.inode_table_start + ino / UNIFS2_INODES_PER_BLOCK);
+    if (!b) return false;
+    meta_access(v, b);
+    kstring::memcpy(b->data + (ino % UNIFS2_INODES_PER_BLOCK) * UNIFS2_INODE_SIZE, in, sizeof(*in));
+    bcache_release(b);
+    return true;
+}
+
+static bool extent_get(UniFSVolume* v, const UniFS2Inode* inode, uint32_t i, UniFS2Extent* out) {
+    if (i < UNIFS2_INLINE_EXTENTS) {
+        *out = inode->extents[i];
+        return true;
+    }
+    Buffer* b = bcache_read(v->dev, inode->extent_block);
+    if (!b) return false;
+    kstring::memcpy(out, b->data + (i - UNIFS2_INLINE_EXTENTS) * sizeof(UniFS2Extent), sizeof(*out));
+    bcache_release(b);
+    return true;
+}
+
+static bool extent_put(UniFSVolume* v, UniFS2Inode* inode, uint32_t i, const UniFS2Extent* e) {
+    if (i < UNIFS2_INLINE_EXTENTS) {
+        inode->extents[i] = *e;
+        return true;
+    }
+
+    Buffer* b;
+    if (inode->extent_block == 0) {
+        uint32_t got;
+        uint64_t blk = alloc_blocks(v, v->block_hint, 1, &got);
+        if (!blk) return false;
+        b = bcache_get(v->dev, blk);
+        if (!b) {
+            unallocate_blocks(v, blk, 1);
+            return false;
+        }
+        meta_access(v, b);
+        kstring::zero_memory(b->data, UNIFS2_BLOCK_SIZE);
+        bcache_mark_dirty(b);  // Pinned: only marks the contents valid
+        inode->extent_block = blk;
+    } else {
+        b = bcache_read(v->dev, inode->extent_block);
+        if (!b) return false;
+        meta_access(v, b);
+    }
+    kstring::memcpy(b->data + (i - UNIFS2_INLINE_EXTENTS) * sizeof(UniFS2Extent), e, sizeof(*e));
+    bcache_release(b);
+    return true;
+}
+
+// Index of the last extent starting at or before fb (-1 if none).
+// Extents are kept sorted by file_block, so this is a binary search.
+static int extent_find(UniFSVolume* v, const UniFS2Inode* inode, uint32_t fb, UniFS2Extent* out) {
+    int lo = 0, hi = (int)inode->extent_count - 1, found = -1;
+    UniFS2Extent e;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (!extent_get(v, inode, mid, &e)) return -1;
+        if (e.file_block <= fb) {
+            found = mid;
+            *out = e;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+// Physical block for file block fb (0 = hole); *run = mapped blocks from fb
+static uint64_t map_block(UniFSVolume* v, const UniFS2Inode* inode, uint32_t fb, uint32_t* run) {
+    UniFS2Extent e;
+    int idx = extent_find(v, inode, fb, &e);
+    if (idx >= 0 && fb < e.file_block + e.length) {
+        if (run) *run = e.file_block + e.length - fb;
+        return e.start + (fb - e.file_block);
+    }
+    if (run) {
+        // Length of the hole, up to the next extent
+        UniFS2Extent next;
+        *run = 0xFFFFFFFF;
+        if ((uint32_t)(idx + 1) < inode->extent_count && extent_get(v, inode, idx + 1, &next)) {
+            *run = next.file_block - fb;
+        }
+    }
+    return 0;
+}
+
+// Map file block fb, allocating up to want blocks if it is a hole.
+// Returns the physical block (0 when full); *run = contiguous blocks
+// available from there and *fresh says whether they were just allocated.
+static uint64_t map_alloc(UniFSVolume* v, UniFS2Inode* inode, uint32_t fb, uint32_t want,
+                          uint32_t* run, bool* fresh) {
+    UniFS2Extent e;
+    int idx = extent_find(v, inode, fb, &e);
+    if (idx >= 0 && fb < e.file_block + e.length) {
+        uint32_t avail = e.file_block + e.length - fb;
+        *run = avail < want ? avail : want;
+        *fresh = false;
+        return e.start + (fb - e.file_block);
+    }
+
+    // Do not run into the next extent
+    UniFS2Extent next;
+    if ((uint32_t)(idx + 1) < inode->extent_count && extent_get(v, inode, idx + 1, &next)) {
+        if (next.file_block - fb < want) want = next.file_block - fb;
+    }
+
+    uint64_t goal = (idx >= 0) ? e.start + (fb - e.file_block) : v->block_hint;
+    uint32_t got = 0;
+    uint64_t start = alloc_blocks(v, goal, want, &got);
+    if (!start) return 0;
+
+    if (idx >= 0 && e.file_block + e.length == fb && e.start + e.length == start &&
+        (uint64_t)e.length + got <= 0xFFFFFFFF) {
+        e.length += got;  // Grew the last run in place
+        extent_put(v, inode, idx, &e);
+    } else {
+        if (inode->extent_count >= UNIFS2_MAX_EXTENTS) {
+            unallocate_blocks(v, start, got);
+            return 0;
+        }
+        // Shift later extents up to keep the list sorted
+        for (int i = (int)inode->extent_count - 1; i > idx; i--) {
+            UniFS2Extent moved;
+            if (!extent_get(v, inode, i, &moved) || !extent_put(v, inode, i + 1, &moved)) {
+                unallocate_blocks(v, start, got);
+                return 0;
+            }
+        }
+        UniFS2Extent fresh_ext = {fb, got, start};
+        if (!extent_put(v, inode, idx + 1, &fresh_ext)) {
+            unallocate_blocks(v, start, got);
+            return 0;
+        }
+        inode->extent_count++;
+    }
+
+    *run = got;
+    *fresh = true;
+    return start;
+}
+
+static uint64_t now_seconds() {
+    uint32_t freq = timer_get_frequency();
+    return freq ? timer_get_ticks() / freq : 0;
+}
+
+// Release blocks past new_size and zero the tail of the last partial block
+static int truncate_locked(UniFSVolume* v, uint32_t ino, UniFS2Inode* inode, uint64_t new_size) {
+    uint64_t keep_blocks = (new_size + UNIFS2_BLOCK_SIZE - 1) / UNIFS2_BLOCK_SIZE;
+    bool metadata = inode->type == UNIFS2_TYPE_DIR;
+
+    while (inode->extent_count > 0) {
+        UniFS2Extent e;
+        uint32_t last = inode->extent_count - 1;
+        if (!extent_get(v, inode, last, &e)) return UNIFS_ERR_IO;
+        if (e.file_block + (uint64_t)e.length <= keep_blocks) break;
+
+        if (e.file_block >= keep_blocks) {
+            free_blocks(v, e.start, e.length, metadata);
+            inode->extent_count--;
+        } else {
+            uint32_t keep = (uint32_t)(keep_blocks - e.file_block);
+            free_blocks(v, e.start + keep, e.length - keep, metadata);
+            e.length = keep;
+            extent_put(v, inode, last, &e);
+            break;
+        }
+    }
+    if (inode->extent_count <= UNIFS2_INLINE_EXTENTS && inode->extent_block) {
+        free_blocks(v, inode->extent_block, 1, true);
+        inode->extent_block = 0;
+    }
+
+    if (new_size % UNIFS2_BLOCK_SIZE && new_size < inode->size) {
+        uint64_t phys = map_block(v, inode, (uint32_t)(new_size / UNIFS2_BLOCK_SIZE), nullptr);
+        Buffer* b = phys ? bcache_read(v->dev, phys) : nullptr;
+        if (b) {
+            uint32_t off = new_size % UNIFS2_BLOCK_SIZE;
+            kstring::zero_memory(b->data + off, UNIFS2_BLOCK_SIZE - off);
+            bcache_mark_dirty(b);
+            journal_add_data(v->journal, b);
+        }
+    }
+
+    inode->size = new_size;
+    inode->version++;
+    inode->mtime = now_seconds();
+    return inode_write(v, ino, inode) ? UNIFS_OK : UNIFS_ERR_IO;
+}
+
+static int64_t read_locked(UniFSVolume* v, const UniFS2Inode* inode, uint64_t offset, uint8_t* buf, uint64_t len) {
+    if (offset >= inode->size) return 0;
+    if (len > inode->size - offset) len = inode->size - offset;
+
+    uint64_t done = 0;
+    while (done < len) {
+        uint64_t pos = offset + done;
+        uint32_t fb = (uint32_t)(pos / UNIFS2_BLOCK_SIZE);
+        uint32_t off = pos % UNIFS2_BLOCK_SIZE;
+        uint64_t chunk = UNIFS2_BLOCK_SIZE - off;
+        if (chunk > len - done) chunk = len - done;
+
+        uint32_t run;
+        uint64_t phys = map_block(v, inode, fb, &run);
+        if (phys == 0) {
+            kstring::zero_memory(buf + done, chunk);
+        } else {
+            // Queue the rest of this run so it goes out as merged commands
+            uint64_t remaining = (len - done + off + UNIFS2_BLOCK_SIZE - 1) / UNIFS2_BLOCK_SIZE;
+            if (run > 1 && remaining > 1) {
+                bcache_prefetch(v->dev, phys + 1, (uint32_t)(remaining - 1 < run - 1 ? remaining - 1 : run - 1));
+            }
+            Buffer* b = bcache_read(v->dev, phys);
+            if (!b) return done ? (int64_t)done : UNIFS_ERR_IO;
+            kstring::memcpy(buf + done, b->data + off, chunk);
+            bcache_release(b);
+        }
+        done += chunk;
+    }
+    return (int64_t)done;
+}
+
+static int64_t write_locked(UniFSVolume* v, uint32_t ino, UniFS2Inode* inode, uint64_t offset,
+                            const uint8_t* buf, uint64_t len) {
+    if (offset + len > (uint64_t)0xFFFFFFFF * UNIFS2_BLOCK_SIZE) return UNIFS_ERR_FULL;
+
+    uint64_t done = 0;
+    int64_t result = 0;
+    while (done < len) {
+        uint64_t pos = offset + done;
+        uint32_t fb = (uint32_t)(pos / UNIFS2_BLOCK_SIZE);
+        uint64_t blocks_left = (pos % UNIFS2_BLOCK_SIZE + (len - done) + UNIFS2_BLOCK_SIZE - 1) / UNIFS2_BLOCK_SIZE;
+        uint32_t want = blocks_left > 0xFFFF ? 0xFFFF : (uint32_t)blocks_left;
+
+        uint32_t run;
+        bool fresh;
+        uint64_t phys = map_alloc(v, inode, fb, want, &run, &fresh);
+        if (!phys) {
+            result = UNIFS_ERR_FULL;
+            break;
+        }
+
+        for (uint32_t i = 0; i < run && done < len; i++) {
+            uint32_t off = (offset + done) % UNIFS2_BLOCK_SIZE;
+            uint64_t chunk = UNIFS2_BLOCK_SIZE - off;
+            if (chunk > len - done) chunk = len - done;
+
+            // Whole-block and fresh writes need not read the old contents
+            bool whole = (off == 0 && chunk == UNIFS2_BLOCK_SIZE);
+            Buffer* b = (whole || fresh) ? bcache_get(v->dev, phys + i) : bcache_read(v->dev, phys + i);
+            if (!b) {
+                result = UNIFS_ERR_IO;
+                break;
+            }
+            if (fresh && !whole) kstring::zero_memory(b->data, UNIFS2_BLOCK_SIZE);
+            kstring::memcpy(b->data + off, buf + done, chunk);
+            bcache_mark_dirty(b);
+            journal_add_data(v->journal, b);
+            done += chunk;
+        }
+        if (result) break;
+    }
+
+    if (done > 0) {
+        if (offset + done > inode->size) inode->size = offset + done;
+        inode->version++;
+        inode->mtime = now_seconds();
+    }
+    if (!inode_write(v, ino, inode)) return UNIFS_ERR_IO;
+    return done > 0 ? (int64_t)done : result;
+}
+
+// ============================================================================
+// Directory Index (called with vol->lock held)
+// ============================================================================
+
+static void index_insert_hash(DirIndex* idx, DirNode* node) {
+    uint32_t b = node->hash & (idx->bucket_count - 1);
+    node->next = idx->buckets[b];
+    idx->buckets[b] = node;
+}
+
+static bool index_grow(DirIndex* idx) {
+    uint32_t new_count = idx->bucket_count * 2;
+    DirNode** buckets = (DirNode**)malloc(new_count * sizeof(DirNode*));
+    if (!buckets) return false;
+    kstring::zero_memory(buckets, new_count * sizeof(DirNode*));
+
+    free(idx->buckets);
+    idx->buckets = buckets;
+    idx->bucket_count = new_count;
+    for (uint32_t i = 0; i < idx->count; i++) index_insert_hash(idx, idx->list[i]);
+    return true;
+}
+
+static bool push_free_slot(DirIndex* idx, uint32_t slot) {
+    if (idx->free_count == idx->free_capacity) {
+        uint32_t cap = idx->free_capacity ? idx->free_capacity * 2 : UNIFS2_DIRENTS_PER_BLOCK;
+        uint32_t* slots = (uint32_t*)malloc(cap * sizeof(uint32_t));
+        if (!slots) return false;
+        if (idx->free_slots) {
+            kstring::memcpy(slots, idx->free_slots, idx->free_count * sizeof(uint32_t));
+            free(idx->free_slots);
+        }
+        idx->free_slots = slots;
+        idx->free_capacity = cap;
+    }
+    idx->free_slots[idx->free_count++] = slot;
+    return true;
+}
+
+static DirNode* index_add(DirIndex* idx, const char* name, uint32_t len, uint32_t hash,
+                          uint32_t inode, uint8_t type, uint32_t slot) {
+    if (idx->count == idx->list_capacity) {
+        uint32_t cap = idx->list_capacity ? idx->list_capacity * 2 : 16;
+        DirNode** list = (DirNode**)malloc(cap * sizeof(DirNode*));
+        if (!list) return nullptr;
+        if (idx->list) {
+            kstring::memcpy(list, idx->list, idx->count * sizeof(DirNode*));
+            free(idx->list);
+        }
+        idx->list = list;
+        idx->list_capacity = cap;
+    }
+    if (idx->count >= idx->bucket_count * 2) index_grow(idx);
+
+    DirNode* node = (DirNode*)malloc(sizeof(DirNode));
+    if (!node) return nullptr;
+    node->hash = hash;
+    node->inode = inode;
+    node->slot = slot;
+    node->type = type;
+    kstring::memcpy(node->name, name, len);
+    node->name[len] = '\0';
+    node->list_pos = idx->count;
+    idx->list[idx->count++] = node;
+    index_insert_hash(idx, node);
+    return node;
+}
+
+static DirNode* index_find(DirIndex* idx, const char* name, uint32_t len, uint32_t hash) {
+    for (DirNode* n = idx->buckets[hash & (idx->bucket_count - 1)]; n; n = n->next) {
+        if (n->hash == hash && kstring::strncmp(n->name, name, len) == 0 && n->name[len] == '\0') {
+            return n;
+        }
+    }
+    return nullptr;
+}
+
+static void index_remove(DirIndex* idx, DirNode* node) {
+    DirNode** link = &idx->buckets[node->hash & (idx->bucket_count - 1)];
+    while (*link && *link != node) link = &(*link)->next;
+    if (*link) *link = node->next;
+
+    // Swap-remove keeps listing O(1) per entry; order is not significant
+    DirNode* last = idx->list[--idx->count];
+    idx->list[node->list_pos] = last;
+    last->list_pos = node->list_pos;
+
+    push_free_slot(idx, node->slot);
+    free(node);
+}
+
+static void index_free(DirIndex* idx) {
+    for (uint32_t i = 0; i < idx->count; i++) free(idx->list[i]);
+    free(idx->list);
+    free(idx->buckets);
+    free(idx->free_slots);
+    free(idx);
+}
+
+// Read a directory into a fresh index
+static DirIndex* index_load(UniFSVolume* v, uint32_t dir) {
+    UniFS2Inode inode;
+    if (!inode_read(v, dir, &inode) || inode.type != UNIFS2_TYPE_DIR) return nullptr;
+
+    DirIndex* idx = (DirIndex*)malloc(sizeof(DirIndex));
+    if (!idx) return nullptr;
+    kstring::zero_memory(idx, sizeof(*idx));
+    idx->dir = dir;
+
+    uint32_t blocks = (uint32_t)(inode.size / UNIFS2_BLOCK_SIZE);
+    uint32_t estimate = blocks * UNIFS2_DIRENTS_PER_BLOCK;
+    idx->bucket_count = DIR_MIN_BUCKETS;
+    while (idx->bucket_count < estimate) idx->bucket_count *= 2;
+    idx->buckets = (DirNode**)malloc(idx->bucket_count * sizeof(DirNode*));
+    if (!idx->buckets) {
+        free(idx);
+        return nullptr;
+    }
+    kstring::zero_memory(idx->buckets, idx->bucket_count * sizeof(DirNode*));
+
+    for (uint32_t fb = 0; fb < blocks; fb++) {
+        uint64_t phys = map_block(v, &inode, fb, nullptr);
+        Buffer* b = phys ? bcache_read(v->dev, phys) : nullptr;
+        for (uint32_t i = 0; i < UNIFS2_DIRENTS_PER_BLOCK; i++) {
+            uint32_t slot = fb * UNIFS2_DIRENTS_PER_BLOCK + i;
+            const UniFS2Dirent* d = b ? (const UniFS2Dirent*)(b->data + i * UNIFS2_DIRENT_SIZE) : nullptr;
+            if (!d || d->inode == 0 || d->name_len == 0 || d->name_len > UNIFS2_MAX_NAME) {
+                push_free_slot(idx, slot);
+                continue;
+            }
+            index_add(idx, d->name, d->name_len, d->hash, d->inode, d->type, slot);
+        }
+        if (b) bcache_release(b);
+    }
+    // Hand out low slots first
+    for (uint32_t i = 0; i < idx->free_count / 2; i++) {
+        uint32_t t = idx->free_slots[i];
+        idx->free_slots[i] = idx->free_slots[idx->free_count - 1 - i];
+        idx->free_slots[idx->free_count - 1 - i] = t;
+    }
+    return idx;
+}
+
+static DirIndex* dir_index(UniFSVolume* v, uint32_t dir) {
+    DirIndex** chain = &v->dirs[dir % VOLUME_DIR_BUCKETS];
+    for (DirIndex* idx = *chain; idx; idx = idx->next) {
+        if (idx->dir == dir) return idx;
+    }
+    DirIndex* idx = index_load(v, dir);
+    if (!idx) return nullptr;
+    idx->next = *chain;
+    *chain = idx;
+    return idx;
+}
+
+static void dir_index_drop(UniFSVolume* v, uint32_t dir) {
+    DirIndex** link = &v->dirs[dir % VOLUME_DIR_BUCKETS];
+    while (*link && (*link)->dir != dir) link = &(*link)->next;
+    if (!*link) return;
+    DirIndex* idx = *link;
+    *link = idx->next;
+    index_free(idx);
+}
+
+static bool write_dirent(UniFSVolume* v, const UniFS2Inode* dir_inode, uint32_t slot, const UniFS2Dirent* d) {
+    uint64_t phys = map_block(v, dir_inode, slot / UNIFS2_DIRENTS_PER_BLOCK, nullptr);
+    if (!phys) return false;
+    Buffer* b = bcache_read(v->dev, phys);
+    if (!b) return false;
+    meta_access(v, b);
+    kstring::memcpy(b->data + (slot % UNIFS2_DIRENTS_PER_BLOCK) * UNIFS2_DIRENT_SIZE, d, sizeof(*d));
+    bcache_release(b);
+    return true;
+}
+
+// Free slot for a new entry, growing the directory by a block if needed
+static bool take_slot(UniFSVolume* v, DirIndex* idx, uint32_t dir, UniFS2Inode* dir_inode, uint32_t* slot) {
+    if (idx->free_count == 0) {
+        uint32_t fb = (uint32_t)(dir_inode->size / UNIFS2_BLOCK_SIZE);
+        uint32_t run;
+        bool fresh;
+        uint64_t phys = map_alloc(v, dir_inode, fb, 1, &run, &fresh);
+        if (!phys) return false;
+        Buffer* b = bcache_get(v->dev, phys);
+        if (!b) return false;
+        meta_access(v, b);
+        kstring::zero_memory(b->data, UNIFS2_BLOCK_SIZE);
+        bcache_mark_dirty(b);  // Pinned: only marks the contents valid
+        bcache_release(b);
+
+        dir_inode->size += UNIFS2_BLOCK_SIZE;
+        if (!inode_write(v, dir, dir_inode)) return false;
+        for (int i = UNIFS2_DIRENTS_PER_BLOCK - 1; i >= 0; i--) {
+            push_free_slot(idx, fb * UNIFS2_DIRENTS_PER_BLOCK + i);
+        }
+    }
+    *slot = idx->free_slots[--idx->free_count];
+    return true;
+}
+
+static bool valid_name(const char* name, uint32_t len) {
+    if (len == 0 || len > UNIFS2_MAX_NAME) return false;
+    if (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.'))) return false;
+    for (uint32_t i = 0; i < len; i++) {
+        if (name[i] == '/') return false;
+    }
+    return true;
+}
+
+static uint32_t lookup_locked(UniFSVolume* v, uint32_t dir, const char* name, uint32_t len) {
+    if (len == 1 && name[0] == '.') return dir;
+    if (len == 2 && name[0] == '.' && name[1] == '.') {
+        UniFS2Inode inode;
+        return inode_read(v, dir, &inode) ? inode.parent : 0;
+    }
+    DirIndex* idx = dir_index(v, dir);
+    if (!idx) return 0;
+    DirNode* node = index_find(idx, name, len, unifs2_name_hash(name, len));
+    return node ? node->inode : 0;
+}
+
+// ============================================================================
+// Format / Mount
+// ============================================================================
+
+static bool zero_blocks(BlockDevice* dev, uint64_t start, uint64_t count) {
+    for (uint64_t i = 0; i < count; i++) {
+        Buffer* b = bcache_get(dev, start + i);
+        if (!b) return false;
+        kstring::zero_memory(b->data, UNIFS2_BLOCK_SIZE);
+        bcache_mark_dirty(b);
+        bcache_release(b);
+    }
+    return true;
+}
+
+int unifs_disk_format(BlockDevice* dev) {
+    if (!dev || dev->read_only) return UNIFS_ERR_READONLY;
+    uint64_t blocks = bcache_block_count(dev);
+    if (blocks < 128) return UNIFS_ERR_INVALID;
+
+    UniFS2Superblock sb;
+    kstring::zero_memory(&sb, sizeof(sb));
+    kstring::memcpy(sb.magic, UNIFS2_MAGIC, 8);
+    sb.version = UNIFS2_VERSION;
+    sb.block_size = UNIFS2_BLOCK_SIZE;
+    sb.block_count = blocks;
+
+    uint64_t inodes = blocks * UNIFS2_BLOCK_SIZE / UNIFS2_BYTES_PER_INODE;
+    if (inodes < 64) inodes = 64;
+    if (inodes > MAX_FORMAT_INODES) inodes = MAX_FORMAT_INODES;
+    inodes = (inodes + UNIFS2_INODES_PER_BLOCK - 1) / UNIFS2_INODES_PER_BLOCK * UNIFS2_INODES_PER_BLOCK;
+    sb.inode_count = inodes;
+
+    sb.inode_bitmap_start = 1;
+    sb.inode_bitmap_blocks = (inodes + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK;
+    sb.block_bitmap_start = sb.inode_bitmap_start + sb.inode_bitmap_blocks;
+    sb.block_bitmap_blocks = (blocks + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK;
+    sb.inode_table_start = sb.block_bitmap_start + sb.block_bitmap_blocks;
+    sb.inode_table_blocks = inodes / UNIFS2_INODES_PER_BLOCK;
+    sb.journal_start = sb.inode_table_start + sb.inode_table_blocks;
+    sb.journal_blocks = blocks / UNIFS2_JOURNAL_DIVISOR;
+    if (sb.journal_blocks < JOURNAL_MIN_BLOCKS) sb.journal_blocks = JOURNAL_MIN_BLOCKS;
+    if (sb.journal_blocks > UNIFS2_JOURNAL_MAX_BLOCKS) sb.journal_blocks = UNIFS2_JOURNAL_MAX_BLOCKS;
+    sb.data_start = sb.journal_start + sb.journal_blocks;
+    if (sb.data_start + 16 > blocks) return UNIFS_ERR_INVALID;
+    sb.free_blocks = blocks - sb.data_start;
+    sb.free_inodes = inodes - 2;  // Inode 0 (reserved) and the root
+
+    // The log needs no zeroing: journal_format picks a fresh sequence
+    if (!zero_blocks(dev, 0, sb.journal_start)) return UNIFS_ERR_NO_MEMORY;
+
+    // Metadata blocks are allocated; so are inodes 0 and 1
+    for (uint64_t bit = 0; bit < sb.data_start; bit++) {
+        Buffer* b = bcache_read(dev, sb.block_bitmap_start + bit / BITS_PER_BLOCK);
+        if (!b) return UNIFS_ERR_IO;
+        uint64_t off = bit % BITS_PER_BLOCK;
+        b->data[off / 8] |= (uint8_t)(1u << (off % 8));
+        bcache_mark_dirty(b);
+        bcache_release(b);
+    }
+    Buffer* b = bcache_read(dev, sb.inode_bitmap_start);
+    if (!b) return UNIFS_ERR_IO;
+    b->data[0] |= 0x3;
+    bcache_mark_dirty(b);
+    bcache_release(b);
+
+    UniFS2Inode root;
+    kstring::zero_memory(&root, sizeof(root));
+    root.type = UNIFS2_TYPE_DIR;
+    root.links = 2;
+    root.version = 1;
+    root.parent = UNIFS2_ROOT_INODE;
+    b = bcache_read(dev, sb.inode_table_start);
+    if (!b) return UNIFS_ERR_IO;
+    kstring::memcpy(b->data + UNIFS2_ROOT_INODE * UNIFS2_INODE_SIZE, &root, sizeof(root));
+    bcache_mark_dirty(b);
+    bcache_release(b);
+
+    b = bcache_read(dev, 0);
+    if (!b) return UNIFS_ERR_IO;
+    kstring::memcpy(b->data, &sb, sizeof(sb));
+    bcache_mark_dirty(b);
+    bcache_release(b);
+
+    if (journal_format(dev, sb.journal_start, sb.journal_blocks) != BLOCK_OK) return UNIFS_ERR_IO;
+
+    int status = bcache_sync(dev);
+    DEBUG_INFO("unifs: Formatted %s (%lu blocks, %lu inodes, %lu-block journal)", dev->name, blocks,
+        inodes, sb.journal_blocks);
+    return status == BLOCK_OK ? UNIFS_OK : UNIFS_ERR_IO;
+}
+
+// Commits transactions that went idle: an operation only commits a due
+// transaction when the next one starts
+static void commit_task() {
+    for (;;) {
+        scheduler_sleep_ms(UNIFS2_COMMIT_INTERVAL_MS);
+        for (UniFSVolume* v = volumes; v; v = v->next) {
+            mutex_lock(&v->lock);
+            if (journal_should_commit(v->journal, UNIFS2_COMMIT_INTERVAL_MS)) commit_locked(v);
+            mutex_unlock(&v->lock);
+        }
+    }
+}
+
+UniFSVolume* unifs_disk_mount(BlockDevice* dev) {
+    if (!dev || dev->sector_size > UNIFS2_BLOCK_SIZE) return nullptr;
+
+    Buffer* b = bcache_read(dev, 0);
+    if (!b) return nullptr;
+
+    UniFS2Superblock sb;
+    kstring::memcpy(&sb, b->data, sizeof(sb));
+    if (kstring::memcmp(sb.magic, UNIFS2_MAGIC, 8) != 0 || sb.version != UNIFS2_VERSION ||
+        sb.block_size != UNIFS2_BLOCK_SIZE || sb.block_count > bcache_block_count(dev) ||
+        sb.data_start >= sb.block_count || sb.inode_count <= UNIFS2_ROOT_INODE ||
+        sb.journal_start + sb.journal_blocks > sb.data_start) {
+        bcache_release(b);
+        return nullptr;
+    }
+
+    // Replay may rewrite any metadata block, the superblock included
+    Journal* journal = journal_open(dev, sb.journal_start, sb.journal_blocks);
+    if (!journal) {
+        DEBUG_ERROR("unifs: %s has an unusable journal", dev->name);
+        bcache_release(b);
+        return nullptr;
+    }
+    kstring::memcpy(&sb, b->data, sizeof(sb));
+
+    UniFSVolume* v = (UniFSVolume*)malloc(sizeof(UniFSVolume));
+    if (!v) {
+        journal_close(journal);
+        bcache_release(b);
+        return nullptr;
+    }
+    kstring::zero_memory(v, sizeof(*v));
+    v->dev = dev;
+    v->sb = sb;
+    v->sb_buf = b;
+    v->journal = journal;
+    mutex_init(&v->lock);
+    v->block_hint = sb.data_start;
+    v->inode_hint = UNIFS2_ROOT_INODE + 1;
+
+    UniFS2Inode root;
+    if (!inode_read(v, UNIFS2_ROOT_INODE, &root) || root.type != UNIFS2_TYPE_DIR) {
+        DEBUG_ERROR("unifs: %s has no root directory", dev->name);
+        journal_close(journal);
+        bcache_release(b);
+        free(v);
+        return nullptr;
+    }
+
+    if (!dev->read_only) {
+        v->sb.mount_count++;
+        sb_update(v);
+        commit_locked(v);
+    }
+
+    static bool commit_task_started = false;
+    v->next = volumes;
+    volumes = v;
+    if (!commit_task_started) {
+        commit_task_started = true;
+        scheduler_create_task(commit_task);
+    }
+
+    JournalStats js;
+    journal_get_stats(journal, &js);
+    DEBUG_INFO("unifs: Mounted %s (v2, %lu/%lu blocks free, %lu inodes free, %lu transactions replayed)",
+        dev->name, v->sb.free_blocks, v->sb.block_count, v->sb.free_inodes, js.replayed);
+    return v;
+}
+
+int unifs_disk_sync(UniFSVolume* vol) {
+    if (!vol) return UNIFS_ERR_INVALID;
+    mutex_lock(&vol->lock);
+    apply_pending_frees(vol);
+    int status = journal_checkpoint(vol->journal);
+    mutex_unlock(&vol->lock);
+    return status == BLOCK_OK ? UNIFS_OK : UNIFS_ERR_IO;
+}
+
+BlockDevice* unifs_disk_device(UniFSVolume* vol) {
+    return vol ? vol->dev : nullptr;
+}
+
+void unifs_disk_statfs(UniFSVolume* vol, UniFSVolumeStats* out) {
+    mutex_lock(&vol->lock);
+    out->block_count = vol->sb.block_count;
+    out->free_blocks = vol->sb.free_blocks;
+    out->inode_count = vol->sb.inode_count;
+    out->free_inodes = vol->sb.free_inodes;
+    JournalStats js;
+    journal_get_stats(vol->journal, &js);
+    out->commits = js.commits;
+    out->logged_blocks = js.logged_blocks;
+    out->replayed = js.replayed;
+    mutex_unlock(&vol->lock);
+}
+
+// ============================================================================
+// Namespace
+// ============================================================================
+
+uint32_t unifs_disk_lookup(UniFSVolume* vol, uint32_t dir, const char* name) {
+    if (!vol || !name) return 0;
+    mutex_lock(&vol->lock);
+    uint32_t ino = lookup_locked(vol, dir, name, kstring::strlen(name));
+    mutex_unlock(&vol->lock);
+    return ino;
+}
+
+uint32_t unifs_disk_resolve(UniFSVolume* vol, const char* path) {
+    if (!vol || !path) return 0;
+    mutex_lock(&vol->lock);
+    uint32_t ino = UNIFS2_ROOT_INODE;
+    const char* p = path;
+    while (*p && ino) {
+        while (*p == '/') p++;
+        if (!*p) break;
+        const char* end = p;
+        while (*end && *end != '/') end++;
+        ino = lookup_locked(vol, ino, p, (uint32_t)(end - p));
+        p = end;
+    }
+    mutex_unlock(&vol->lock);
+    return ino;
+}
+
+int unifs_disk_stat(UniFSVolume* vol, uint32_t inode, UniFSStat* out) {
+    if (!vol || !out) return UNIFS_ERR_INVALID;
+    mutex_lock(&vol->lock);
+    UniFS2Inode in;
+    if (!inode_read(vol, inode, &in) || in.type == UNIFS2_TYPE_FREE) {
+        mutex_unlock(&vol->lock);
+        return UNIFS_ERR_NOT_FOUND;
+    }
+    out->inode = inode;
+    out->type = in.type;
+    out->size = in.size;
+    out->version = in.version;
+    out->blocks = 0;
+    for (uint32_t i = 0; i < in.extent_count; i++) {
+        UniFS2Extent e;
+        if (extent_get(vol, &in, i, &e)) out->blocks += e.length;
+    }
+    mutex_unlock(&vol->lock);
+    return UNIFS_OK;
+}
+
+uint32_t unifs_disk_dir_count(UniFSVolume* vol, uint32_t dir) {
+    if (!vol) return 0;
+    mutex_lock(&vol->lock);
+    DirIndex* idx = dir_index(vol, dir);
+    uint32_t count = idx ? idx->count : 0;
+    mutex_unlock(&vol->lock);
+    return count;
+}
+
+bool unifs_disk_readdir(UniFSVolume* vol, uint32_t dir, uint32_t index, UniFSDirInfo* out) {
+    if (!vol || !out) return false;
+    mutex_lock(&vol->lock);
+    DirIndex* idx = dir_index(vol, dir);
+    bool ok = idx && index < idx->count;
+    if (ok) {
+        DirNode* node = idx->list[index];
+        out->name = node->name;
+        out->inode = node->inode;
+        out->type = node->type;
+    }
+    mutex_unlock(&vol->lock);
+    return ok;
+}
+
+int unifs_disk_create(UniFSVolume* vol, uint32_t dir, const char* name, uint16_t type, uint32_t* out_inode) {
+    if (!vol || !name) return UNIFS_ERR_INVALID;
+    if (vol->dev->read_only) return UNIFS_ERR_READONLY;
+    uint32_t len = kstring::strlen(name);
+    if (len > UNIFS2_MAX_NAME) return UNIFS_ERR_NAME_TOO_LONG;
+    if (!valid_name(name, len)) return UNIFS_ERR_INVALID;
+
+    mutex_lock(&vol->lock);
+    begin_op(vol);
+    int result = UNIFS_OK;
+    UniFS2Inode dir_inode;
+    DirIndex* idx = nullptr;
+    uint32_t hash = unifs2_name_hash(name, len);
+    uint32_t ino = 0, slot = 0;
+
+    if (!inode_read(vol, dir, &dir_inode) || dir_inode.type != UNIFS2_TYPE_DIR) {
+        result = UNIFS_ERR_NOT_DIR;
+    } else if (!(idx = dir_index(vol, dir))) {
+        result = UNIFS_ERR_NO_MEMORY;
+    } else if (index_find(idx, name, len, hash)) {
+        result = UNIFS_ERR_EXISTS;
+    } else if (!(ino = alloc_inode(vol))) {
+        result = UNIFS_ERR_FULL;
+    } else if (!take_slot(vol, idx, dir, &dir_inode, &slot)) {
+        free_inode(vol, ino);
+        result = UNIFS_ERR_FULL;
+    }
+
+    if (result == UNIFS_OK) {
+        UniFS2Inode inode;
+        kstring::zero_memory(&inode, sizeof(inode));
+        inode.type = type;
+        inode.links = (type == UNIFS2_TYPE_DIR) ? 2 : 1;
+        inode.version = 1;
+        inode.mtime = now_seconds();
+        inode.parent = dir;
+        inode_write(vol, ino, &inode);
+
+        UniFS2Dirent d;
+        kstring::zero_memory(&d, sizeof(d));
+        d.inode = ino;
+        d.hash = hash;
+        d.type = (uint8_t)type;
+        d.name_len = (uint8_t)len;
+        kstring::memcpy(d.name, name, len);
+        write_dirent(vol, &dir_inode, slot, &d);
+
+        dir_inode.version++;
+        dir_inode.mtime = inode.mtime;
+        inode_write(vol, dir, &dir_inode);
+
+        if (!index_add(idx, name, len, hash, ino, (uint8_t)type, slot)) {
+            dir_index_drop(vol, dir);  // Reloaded from disk next time
+        }
+        if (out_inode) *out_inode = ino;
+    }
+    mutex_unlock(&vol->lock);
+    return result;
+}
+
+int unifs_disk_unlink(UniFSVolume* vol, uint32_t dir, const char* name) {
+    if (!vol || !name) return UNIFS_ERR_INVALID;
+    if (vol->dev->read_only) return UNIFS_ERR_READONLY;
+    uint32_t len = kstring::strlen(name);
+
+    mutex_lock(&vol->lock);
+    begin_op(vol);
+    int result = UNIFS_OK;
+    UniFS2Inode dir_inode, inode;
+    DirIndex* idx = dir_index(vol, dir);
+    DirNode* node = idx ? index_find(idx, name, len, unifs2_name_hash(name, len)) : nullptr;
+
+    if (!node || !inode_read(vol, dir, &dir_inode) || !inode_read(vol, node->inode, &inode)) {
+        result = UNIFS_ERR_NOT_FOUND;
+    } else if (inode.type == UNIFS2_TYPE_DIR) {
+        DirIndex* child = dir_index(vol, node->inode);
+        if (child && child->count > 0) result = UNIFS_ERR_NOT_EMPTY;
+    }
+
+    if (result == UNIFS_OK) {
+        uint32_t ino = node->inode;
+        truncate_locked(vol, ino, &inode, 0);
+        kstring::zero_memory(&inode, sizeof(inode));
+        inode_write(vol, ino, &inode);
+        free_inode(vol, ino);
+        dir_index_drop(vol, ino);
+
+        UniFS2Dirent d;
+        kstring::zero_memory(&d, sizeof(d));
+        write_dirent(vol, &dir_inode, node->slot, &d);
+        index_remove(idx, node);
+
+        dir_inode.version++;
+        dir_inode.mtime = now_seconds();
+        inode_write(vol, dir, &dir_inode);
+    }
+    mutex_unlock(&vol->lock);
+    return result;
+}
+
+// ============================================================================
+// File Data
+// ============================================================================
+
+int64_t unifs_disk_read(UniFSVolume* vol, uint32_t inode, uint64_t offset, void* buf, uint64_t len) {
+    if (!vol || (!buf && len)) return UNIFS_ERR_INVALID;
+    mutex_lock(&vol->lock);
+    UniFS2Inode in;
+    int64_t result;
+    if (!inode_read(vol, inode, &in) || in.type == UNIFS2_TYPE_FREE) {
+        result = UNIFS_ERR_NOT_FOUND;
+    } else if (in.type == UNIFS2_TYPE_DIR) {
+        result = UNIFS_ERR_IS_DIR;
+    } else {
+        result = read_locked(vol, &in, offset, (uint8_t*)buf, len);
+    }
+    mutex_unlock(&vol->lock);
+    return result;
+}
+
+void unifs_disk_readahead(UniFSVolume* vol, uint32_t inode, uint64_t offset, uint64_t len) {
+    if (!vol || len == 0) return;
+    // Only a hint: skip it rather than wait behind a commit
+    if (!mutex_try_lock(&vol->lock)) return;
+    UniFS2Inode in;
+    if (inode_read(vol, inode, &in) && in.type == UNIFS2_TYPE_FILE && offset < in.size) {
+        if (len > in.size - offset) len = in.size - offset;
+        uint32_t fb = (uint32_t)(offset / UNIFS2_BLOCK_SIZE);
+        uint32_t end = (uint32_t)((offset + len + UNIFS2_BLOCK_SIZE - 1) / UNIFS2_BLOCK_SIZE);
+        while (fb < end) {
+            uint32_t run;
+            uint64_t phys = map_block(vol, &in, fb, &run);
+            if (run > end - fb) run = end - fb;
+            if (phys) bcache_prefetch(vol->dev, phys, run);
+            fb += run;
+        }
+    }
+    mutex_unlock(&vol->lock);
+}
+
+int64_t unifs_disk_write(UniFSVolume* vol, uint32_t inode, uint64_t offset, const void* buf, uint64_t len) {
+    if (!vol || (!buf && len)) return UNIFS_ERR_INVALID;
+    if (vol->dev->read_only) return UNIFS_ERR_READONLY;
+    if (len == 0) return 0;
+    mutex_lock(&vol->lock);
+    begin_op(vol);
+    UniFS2Inode in;
+    int64_t result;
+    if (!inode_read(vol, inode, &in) || in.type == UNIFS2_TYPE_FREE) {
+        result = UNIFS_ERR_NOT_FOUND;
+    } else if (in.type == UNIFS2_TYPE_DIR) {
+        result = UNIFS_ERR_IS_DIR;
+    } else {
+        result = write_locked(vol, inode, &in, offset, (const uint8_t*)buf, len);
+    }
+    mutex_unlock(&vol->lock);
+    return result;
+}
+
+int unifs_disk_truncate(UniFSVolume* vol, uint32_t inode, uint64_t size) {
+    if (!vol) return UNIFS_ERR_INVALID;
+    if (vol->dev->read_only) return UNIFS_ERR_READONLY;
+    mutex_lock(&vol->lock);
+    begin_op(vol);
+    UniFS2Inode in;
+    int result;
+    if (!inode_read(vol, inode, &in) || in.type == UNIFS2_TYPE_FREE) {
+        result = UNIFS_ERR_NOT_FOUND;
+    } else if (in.type == UNIFS2_TYPE_DIR) {
+        result = UNIFS_ERR_IS_DIR;
+    } else if (size > in.size) {
+        // Growing leaves a hole; reads return zeros
+        in.size = size;
+        in.version++;
+        result = inode_write(vol, inode, &in) ? UNIFS_OK : UNIFS_ERR_IO;
+    } else {
+        result = truncate_locked(vol, inode, &in, size);
+    }
+    mutex_unlock(&vol->lock);
+    return result;
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include <stdint.h>
+#include "blockdev.h"
+
+// ============================================================================
+// uniFS v2 - On-Disk Format
+// ============================================================================
+// Persistent, writable uniFS for block devices (built by mkunifs.py --v2 or
+// formatted in place with the `mkfs` shell command). All I/O goes through
+// the buffer cache in 4KB blocks:
+//
+//   Block 0                 Superblock
+//   inode_bitmap_start      1 bit per inode (1 = in use)
+//   block_bitmap_start      1 bit per block (1 = in use, metadata included)
+//   inode_table_start       256-byte inodes, 16 per block
+//   journal_start           Metadata write-ahead log (journal.h)
+//   data_start              File and directory data
+//
+// Every metadata block (superblock, bitmaps, inodes, extent blocks,
+// directories) changes through the journal. File data is written before
+// the transaction that references it commits (ordered mode). Transactions
+// group many operations and commit every UNIFS2_COMMIT_INTERVAL_MS, when
+// they grow large, or on sync. Blocks freed by a transaction are only
+// reused after it commits.
+//
+// File data is described by extents (runs of contiguous blocks): 13 in the
+// inode and up to 256 more in one extent block. The allocator extends the
+// last run when it can, so sequentially written files stay in few extents.
+//
+// Directories are files of 80-byte entries (51 per block, never straddling
+// a block). Each entry carries an FNV-1a hash of its name; the driver keeps
+// an in-memory hash index per directory so lookups do not scan.
+//
+// Inode 0 means "none"; the root directory is inode 1.
+// ============================================================================
+
+#define UNIFS2_MAGIC                "UNIFSv2"   // 8 bytes with the NUL
+#define UNIFS2_VERSION              2
+#define UNIFS2_BLOCK_SIZE           4096
+#define UNIFS2_INODE_SIZE           256
+#define UNIFS2_INODES_PER_BLOCK     (UNIFS2_BLOCK_SIZE / UNIFS2_INODE_SIZE)
+#define UNIFS2_ROOT_INODE           1
+#define UNIFS2_INLINE_EXTENTS       13
+#define UNIFS2_EXTENTS_PER_BLOCK    (UNIFS2_BLOCK_SIZE / 16)
+#define UNIFS2_MAX_EXTENTS          (UNIFS2_INLINE_EXTENTS + UNIFS2_EXTENTS_PER_BLOCK)
+#define UNIFS2_DIRENT_SIZE          80
+#define UNIFS2_DIRENTS_PER_BLOCK    (UNIFS2_BLOCK_SIZE / UNIFS2_DIRENT_SIZE)
+#define UNIFS2_MAX_NAME             63
+#define UNIFS2_BYTES_PER_INODE      32768   // Default inode density for mkfs
+#define UNIFS2_JOURNAL_DIVISOR      32      // mkfs: journal = 1/32 of the disk...
+#define UNIFS2_JOURNAL_MAX_BLOCKS   8192    // ...up to 32 MB
+#define UNIFS2_COMMIT_INTERVAL_MS   1000
+
+// Inode types
+#define UNIFS2_TYPE_FREE            0
+#define UNIFS2_TYPE_FILE            1
+#define UNIFS2_TYPE_DIR             2
+
+struct UniFS2Superblock {
+    char magic[8];              // UNIFS2_MAGIC
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t block_count;
+    uint64_t inode_count;
+    uint64_t inode_bitmap_start;
+    uint64_t inode_bitmap_blocks;
+    uint64_t block_bitmap_start;
+    uint64_t block_bitmap_blocks;
+    uint64_t inode_table_start;
+    uint64_t inode_table_blocks;
+    uint64_t journal_start;
+    uint64_t journal_blocks;
+    uint64_t data_start;
+    uint64_t free_blocks;
+    uint64_t free_inodes;
+    uint64_t mount_count;
+} __attribute__((packed));
+
+struct UniFS2Extent {
+    uint32_t file_block;        // First logical block covered
+    uint32_t length;            // Blocks
+    uint64_t start;             // First physical block
+} __attribute__((packed));
+
+struct UniFS2Inode {
+    uint16_t type;              // UNIFS2_TYPE_*
+    uint16_t flags;
+    uint32_t links;
+    uint64_t size;              // Bytes (directories: whole blocks)
+    uint64_t version;           // Bumped on every content change
+    uint64_t mtime;             // Seconds since boot of last change (no RTC epoch yet)
+    uint32_t extent_count;      // Inline plus extent block
+    uint32_t parent;            // Containing directory
+    uint64_t extent_block;      // Overflow extents, 0 if none
+    UniFS2Extent extents[UNIFS2_INLINE_EXTENTS];
+} __attribute__((packed));
+
+struct UniFS2Dirent {
+    uint32_t inode;             // 0 = free slot
+    uint32_t hash;              // unifs2_name_hash(name)
+    uint8_t type;               // UNIFS2_TYPE_* of the target
+    uint8_t name_len;
+    uint8_t reserved[6];
+    char name[64];              // NUL-terminated
+} __attribute__((packed));
+
+// FNV-1a over the name bytes (mkunifs.py computes the same)
+static inline uint32_t unifs2_name_hash(const char* name, uint32_t len) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < len; i++) {
+        h ^= (uint8_t)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// ============================================================================
+// Volume API
+// ============================================================================
+// Functions return UNIFS_OK / UNIFS_ERR_* (unifs.h) or a byte count. Inode
+// numbers are 32-bit; 0 is never a valid result.
+
+struct UniFSVolume;
+
+struct UniFSStat {
+    uint32_t inode;
+    uint16_t type;
+    uint64_t size;
+    uint64_t version;
+    uint64_t blocks;            // Data blocks allocated
+};
+
+struct UniFSDirInfo {
+    const char* name;           // Valid until the entry is removed
+    uint32_t inode;
+    uint8_t type;
+};
+
+struct UniFSVolumeStats {
+    uint64_t block_count;
+    uint64_t free_blocks;
+    uint64_t inode_count;
+    uint64_t free_inodes;
+    uint64_t commits;           // Journal transactions
+    uint64_t logged_blocks;
+    uint64_t replayed;          // Transactions recovered at mount
+};
+
+// Write an empty filesystem to dev
+int unifs_disk_format(BlockDevice* dev);
+
+// Mount dev if it holds a uniFS v2 superblock, else nullptr
+UniFSVolume* unifs_disk_mount(BlockDevice* dev);
+
+// Commit the journal, write back everything and flush the device cache
+int unifs_disk_sync(UniFSVolume* vol);
+
+BlockDevice* unifs_disk_device(UniFSVolume* vol);
+void unifs_disk_statfs(UniFSVolume* vol, UniFSVolumeStats* out);
+
+// Name lookup in one directory, or a '/'-separated path from the root.
+// Return the inode number, 0 if not found.
+uint32_t unifs_disk_lookup(UniFSVolume* vol, uint32_t dir, const char* name);
+uint32_t unifs_disk_resolve(UniFSVolume* vol, const char* path);
+
+int unifs_disk_stat(UniFSVolume* vol, uint32_t inode, UniFSStat* out);
+
+// Directory entries by position (stable while the directory is unchanged)
+uint32_t unifs_disk_dir_count(UniFSVolume* vol, uint32_t dir);
+bool unifs_disk_readdir(UniFSVolume* vol, uint32_t dir, uint32_t index, UniFSDirInfo* out);
+
+// Create a file or directory; *out_inode receives the new inode
+int unifs_disk_create(UniFSVolume* vol, uint32_t dir, const char* name, uint16_t type, uint32_t* out_inode);
+
+// Remove an entry (directories must be empty) and free its blocks
+int unifs_disk_unlink(UniFSVolume* vol, uint32_t dir, const char* name);
+
+// File contents. Reads of holes return zeros; writes allocate as needed.
+int64_t unifs_disk_read(UniFSVolume* vol, uint32_t inode, uint64_t offset, void* buf, uint64_t len);
+int64_t unifs_disk_write(UniFSVolume* vol, uint32_t inode, uint64_t offset, const void* buf, uint64_t len);
+int unifs_disk_truncate(UniFSVolume* vol, uint32_t inode, uint64_t size);
+
+// Start reading the blocks behind [offset, offset + len) into the buffer
+// cache and return without waiting (a hint: skipped while a commit runs)
+void unifs_disk_readahead(UniFSVolume* vol, uint32_t inode, uint64_t offset, uint64_t len);
@@ -0,0 +1,739 @@
+#include "vfs.h"
+#include "heap.h"
+#include "mutex.h"
+#include "spinlock.h"
+#include "waitqueue.h"
+#include "scheduler.h"
+#include "kstring.h"
+#include "debug.h"
+
+// ============================================================================
+// State
+// ============================================================================
+
+#define DENTRY_BUCKETS  512
+#define NODE_BUCKETS    256
+
+struct Mount {
+    char path[VFS_MAX_PATH];    // Canonical, "" for the root
+    uint32_t len;
+    const VfsOps* ops;
+    void* ctx;
+};
+
+// Cached inode: one per (mount, id), shared by the dentries naming it
+struct VfsNode {
+    Mount* mount;
+    uint64_t id;
+    uint8_t kind;
+    uint64_t size;
+    uint64_t generation;
+    int content_type;           // Valid if type_known
+    bool type_known;
+    uint32_t refs;              // Dentries and open files pointing here
+    uint32_t opens;             // Open files
+    VfsNode* next;              // Hash chain
+};
+
+struct Dentry {
+    char* path;                 // Canonical, stored after the struct
+    uint32_t hash;
+    Mount* mount;
+    const char* rel;            // path within the mount
+    VfsNode* node;              // nullptr = negative (does not exist)
+    Dentry* next;               // Hash chain
+    Dentry* lru_prev;           // Most recently used first
+    Dentry* lru_next;
+};
+
+struct VfsFile {
+    VfsNode* node;              // Referenced while open
+    char path[VFS_MAX_PATH];
+
+    // Read-ahead state
+    uint64_t next_offset;       // Where a sequential read would start
+    uint64_t ra_start;          // Current window
+    uint64_t ra_size;           // 0 = none (not sequential yet)
+};
+
+static Mount mounts[VFS_MAX_MOUNTS];
+static uint32_t mount_count = 0;
+
+static Dentry* dentry_buckets[DENTRY_BUCKETS];
+static Dentry* lru_head = nullptr;
+static Dentry* lru_tail = nullptr;
+static VfsNode* node_buckets[NODE_BUCKETS];
+
+static Mutex vfs_lock = MUTEX_INIT;
+static VfsStats stats;
+
+// Asynchronous reads waiting for the I/O task
+static Mutex io_lock = MUTEX_INIT;
+static WaitQueue io_queued = WAIT_QUEUE_INIT;   // I/O task waits for requests
+static WaitQueue io_done = WAIT_QUEUE_INIT;     // vfs_io_wait() callers
+static VfsIoRequest* io_head = nullptr;
+static VfsIoRequest* io_tail = nullptr;
+static uint64_t io_completed = 0;
+static bool io_task_started = false;
+
+// ============================================================================
+// Paths and Mounts
+// ============================================================================
+
+static uint32_t path_hash(const char* path) {
+    uint32_t h = 2166136261u;
+    while (*path) {
+        h ^= (uint8_t)*path++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Canonical form of path in out (VFS_MAX_PATH bytes); false if too long
+static bool canonicalize(const char* path, char* out) {
+    uint32_t len = 0;
+    const char* p = path ? path : "";
+    while (*p) {
+        while (*p == '/') p++;
+        if (!*p) break;
+        const char* end = p;
+        while (*end && *end != '/') end++;
+        uint32_t n = (uint32_t)(end - p);
+
+        if (n == 1 && p[0] == '.') {
+            // Skip
+        } else if (n == 2 && p[0] == '.' && p[1] == '.') {
+            while (len > 0 && out[len - 1] != '/') len--;
+            if (len > 0) len--;
+        } else {
+            if (len + (len ? 1 : 0) + n >= VFS_MAX_PATH) return false;
+            if (len) out[len++] = '/';
+            kstring::memcpy(out + len, p, n);
+            len += n;
+        }
+        p = end;
+    }
+    out[len] = '\0';
+    return true;
+}
+
+// Mount serving a canonical path (longest prefix); *rel = path inside it
+static Mount* find_mount(const char* path, const char** rel) {
+    Mount* best = nullptr;
+    for (uint32_t i = 0; i < mount_count; i++) {
+        Mount* m = &mounts[i];
+        if (best && m->len <= best->len) continue;
+        if (m->len == 0 || (kstring::strncmp(path, m->path, m->len) == 0 &&
+                            (path[m->len] == '\0' || path[m->len] == '/'))) {
+            best = m;
+        }
+    }
+    if (best) {
+        *rel = path + best->len;
+        if (**rel == '/') (*rel)++;
+    }
+    return best;
+}
+
+// ============================================================================
+// Inode Cache
+// ============================================================================
+
+static VfsNode* node_get(Mount* m, const VfsNodeInfo* info) {
+    uint32_t b = (uint32_t)((info->id ^ (info->id >> 32) ^ (uint64_t)m) % NODE_BUCKETS);
+    VfsNode* node = node_buckets[b];
+    while (node && (node->mount != m || node->id != info->id)) node = node->next;
+
+    if (!node) {
+        node = (VfsNode*)malloc(sizeof(VfsNode));
+        if (!node) return nullptr;
+        kstring::zero_memory(node, sizeof(VfsNode));
+        node->mount = m;
+        node->id = info->id;
+        node->next = node_buckets[b];
+        node_buckets[b] = node;
+        stats.nodes++;
+    }
+    if (node->generation != info->generation || node->kind != info->kind) node->type_known = false;
+    node->kind = info->kind;
+    node->size = info->size;
+    node->generation = info->generation;
+    node->refs++;
+    return node;
+}
+
+static void node_put(VfsNode* node) {
+    if (--node->refs > 0) return;
+    uint32_t b = (uint32_t)((node->id ^ (node->id >> 32) ^ (uint64_t)node->mount) % NODE_BUCKETS);
+    VfsNode** link = &node_buckets[b];
+    while (*link != node) link = &(*link)->next;
+    *link = node->next;
+    free(node);
+    stats.nodes--;
+}
+
+// ============================================================================
+// Dentry Cache
+// ============================================================================
+
+static void lru_unlink(Dentry* d) {
+    if (d->lru_prev) d->lru_prev->lru_next = d->lru_next; else lru_head = d->lru_next;
+    if (d->lru_next) d->lru_next->lru_prev = d->lru_prev; else lru_tail = d->lru_prev;
+}
+
+static void lru_push(Dentry* d) {
+    d->lru_prev = nullptr;
+    d->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = d; else lru_tail = d;
+    lru_head = d;
+}
+
+static void dentry_free(Dentry* d) {
+    Dentry** link = &dentry_buckets[d->hash % DENTRY_BUCKETS];
+    while (*link != d) link = &(*link)->next;
+    *link = d->next;
+    lru_unlink(d);
+    if (d->node) node_put(d->node);
+    free(d);
+    stats.dentries--;
+}
+
+static Dentry* dentry_find(const char* path, uint32_t hash) {
+    Dentry* d = dentry_buckets[hash % DENTRY_BUCKETS];
+    while (d && (d->hash != hash || kstring::strcmp(d->path, path) != 0)) d = d->next;
+    return d;
+}
+
+// Dentry for a canonical path, asking the driver on a miss. nullptr only if
+// no filesystem serves the path or memory ran out.
+static Dentry* lookup_locked(const char* path) {
+    stats.lookups++;
+    uint32_t hash = path_hash(path);
+    Dentry* d = dentry_find(path, hash);
+    if (d) {
+        stats.hits++;
+        if (!d->node) stats.negative_hits++;
+        lru_unlink(d);
+        lru_push(d);
+        return d;
+    }
+
+    const char* rel;
+    Mount* m = find_mount(path, &rel);
+    if (!m) return nullptr;
+
+    uint32_t len = kstring::strlen(path);
+    d = (Dentry*)malloc(sizeof(Dentry) + len + 1);
+    if (!d) return nullptr;
+    d->path = (char*)(d + 1);
+    kstring::memcpy(d->path, path, len + 1);
+    d->hash = hash;
+    d->mount = m;
+    d->rel = d->path + (rel - path);
+    d->node = nullptr;
+
+    VfsNodeInfo info;
+    if (m->ops->lookup(m->ctx, d->rel, &info)) {
+        d->node = node_get(m, &info);
+        if (!d->node) {
+            free(d);
+            return nullptr;
+        }
+    }
+
+    if (stats.dentries >= VFS_DENTRY_MAX && lru_tail) dentry_free(lru_tail);
+    d->next = dentry_buckets[hash % DENTRY_BUCKETS];
+    dentry_buckets[hash % DENTRY_BUCKETS] = d;
+    lru_push(d);
+    stats.dentries++;
+    return d;
+}
+
+// The path changed: drop its dentry, and with prefix those below it too
+static void forget_locked(const char* path, bool prefix) {
+    Dentry* d = dentry_find(path, path_hash(path));
+    if (d) dentry_free(d);
+    if (!prefix) return;
+
+    uint32_t len = kstring::strlen(path);
+    Dentry* next;
+    for (d = lru_head; d; d = next) {
+        next = d->lru_next;
+        if (kstring::strncmp(d->path, path, len) == 0 && (len == 0 || d->path[len] == '/')) {
+            dentry_free(d);
+        }
+    }
+}
+
+static void invalidate_locked() {
+    while (lru_head) dentry_free(lru_head);
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void vfs_init() {
+    mount_count = 0;
+    kstring::zero_memory(dentry_buckets, sizeof(dentry_buckets));
+    kstring::zero_memory(node_buckets, sizeof(node_buckets));
+    kstring::zero_memory(&stats, sizeof(stats));
+    lru_head = lru_tail = nullptr;
+    mutex_init(&vfs_lock);
+}
+
+int vfs_mount(const char* path, const VfsOps* ops, void* ctx) {
+    char canon[VFS_MAX_PATH];
+    if (!ops || !canonicalize(path, canon)) return UNIFS_ERR_INVALID;
+
+    mutex_lock(&vfs_lock);
+    int result = UNIFS_OK;
+    for (uint32_t i = 0; i < mount_count; i++) {
+        if (kstring::strcmp(mounts[i].path, canon) == 0) result = UNIFS_ERR_IN_USE;
+    }
+    if (result == UNIFS_OK && mount_count == VFS_MAX_MOUNTS) result = UNIFS_ERR_FULL;
+    if (result == UNIFS_OK && canon[0] && mount_count == 0) result = UNIFS_ERR_NOT_FOUND;  // Root first
+
+    if (result == UNIFS_OK) {
+        Mount* m = &mounts[mount_count++];
+        kstring::strcpy(m->path, canon);
+        m->len = kstring::strlen(canon);
+        m->ops = ops;
+        m->ctx = ctx;
+        stats.mounts = mount_count;
+        invalidate_locked();  // Paths below the mount point now resolve elsewhere
+        DEBUG_INFO("vfs: Mounted %s at /%s", ops->name, canon);
+    }
+    mutex_unlock(&vfs_lock);
+    return result;
+}
+
+void vfs_invalidate() {
+    mutex_lock(&vfs_lock);
+    invalidate_locked();
+    mutex_unlock(&vfs_lock);
+}
+
+bool vfs_open(const char* path, UniFSFile* out) {
+    char canon[VFS_MAX_PATH];
+    if (!out || !canonicalize(path, canon)) return false;
+
+    mutex_lock(&vfs_lock);
+    Dentry* d = lookup_locked(canon);
+    bool ok = d && d->node && d->node->kind == VFS_NODE_FILE && d->mount->ops->open &&
+              d->mount->ops->open(d->mount->ctx, d->rel, out);
+    mutex_unlock(&vfs_lock);
+    return ok;
+}
+
+bool vfs_exists(const char* path) {
+    char canon[VFS_MAX_PATH];
+    if (!canonicalize(path, canon)) return false;
+
+    mutex_lock(&vfs_lock);
+    Dentry* d = lookup_locked(canon);
+    bool exists = d && d->node;
+    mutex_unlock(&vfs_lock);
+    return exists;
+}
+
+uint64_t vfs_get_size(const char* path) {
+    char canon[VFS_MAX_PATH];
+    if (!canonicalize(path, canon)) return 0;
+
+    mutex_lock(&vfs_lock);
+    Dentry* d = lookup_locked(canon);
+    uint64_t size = d && d->node ? d->node->size : 0;
+    mutex_unlock(&vfs_lock);
+    return size;
+}
+
+int vfs_get_type(const char* path) {
+    char canon[VFS_MAX_PATH];
+    if (!canonicalize(path, canon)) return UNIFS_TYPE_UNKNOWN;
+
+    mutex_lock(&vfs_lock);
+    int type = UNIFS_TYPE_UNKNOWN;
+    Dentry* d = lookup_locked(canon);
+    if (d && d->node) {
+        VfsNode* node = d->node;
+        if (node->kind == VFS_NODE_DIR) {
+            type = UNIFS_TYPE_DIR;
+        } else {
+            // Detected once per generation
+            if (!node->type_known) {
+                node->content_type = d->mount->ops->content_type(d->mount->ctx, d->rel);
+                node->type_known = true;
+            }
+            type = node->content_type;
+        }
+    }
+    mutex_unlock(&vfs_lock);
+    return type;
+}
+
+uint64_t vfs_get_generation(const char* path) {
+    char canon[VFS_MAX_PATH];
+    if (!canonicalize(path, canon)) return 0;
+
+    mutex_lock(&vfs_lock);
+    Dentry* d = lookup_locked(canon);
+    uint64_t generation = d && d->node ? d->node->generation : 0;
+    mutex_unlock(&vfs_lock);
+    return generation;
+}
+
+// Mount points directly below the canonical directory path
+static bool is_child_mount(const Mount* m, const char* dir, uint32_t dir_len) {
+    if (m->len == 0 || m->len <= dir_len) return false;
+    if (dir_len && (kstring::strncmp(m->path, dir, dir_len) != 0 || m->path[dir_len] != '/')) return false;
+    const char* rest = m->path + dir_len + (dir_len ? 1 : 0);
+    for (const char* p = rest; *p; p++) {
+        if (*p == '/') return false;
+    }
+    return true;
+}
+
+uint64_t vfs_dir_count(const char* path) {
+    char canon[VFS_MAX_PATH];
+    if (!canonicalize(path, canon)) return 0;
+
+    mutex_lock(&vfs_lock);
+    uint64_t count = 0;
+    const char* rel;
+    Mount* m = find_mount(canon, &rel);
+    if (m) count = m->ops->dir_count(m->ctx, rel);
+    uint32_t len = kstring::strlen(canon);
+    for (uint32_t i = 0; i < mount_count; i++) {
+        if (is_child_mount(&mounts[i], canon, len)) count++;
+    }
+    mutex_unlock(&vfs_lock);
+    return count;
+}
+
+const char* vfs_dir_name(const char* path, uint64_t index) {
+    char canon[VFS_MAX_PATH];
+    if (!canonicalize(path, canon)) return nullptr;
+
+    mutex_lock(&vfs_lock);
+    const char* name = nullptr;
+    const char* rel;
+    Mount* m = find_mount(canon, &rel);
+    uint64_t count = m ? m->ops->dir_count(m->ctx, rel) : 0;
+    if (index < count) {
+        name = m->ops->dir_name(m->ctx, rel, index);
+    } else {
+        index -= count;
+        uint32_t len = kstring::strlen(canon);
+        for (uint32_t i = 0; i < mount_count && !name; i++) {
+            if (is_child_mount(&mounts[i], canon, len) && index-- == 0) {
+                name = mounts[i].path + len + (len ? 1 : 0);
+            }
+        }
+    }
+    mutex_unlock(&vfs_lock);
+    return name;
+}
+
+static int create_node(const char* path, bool dir) {
+    char canon[VFS_MAX_PATH];
+    if (!path) return UNIFS_ERR_NOT_FOUND;
+    if (!canonicalize(path, canon)) return UNIFS_ERR_NAME_TOO_LONG;
+
+    mutex_lock(&vfs_lock);
+    int result;
+    const char* rel;
+    Mount* m = find_mount(canon, &rel);
+    if (!m) {
+        result = UNIFS_ERR_NOT_FOUND;
+    } else if (!*rel) {
+        result = UNIFS_ERR_EXISTS;  // Mount point
+    } else {
+        result = m->ops->create(m->ctx, rel, dir);
+        forget_locked(canon, false);
+    }
+    mutex_unlock(&vfs_lock);
+    return result;
+}
+
+int vfs_create(const char* path) {
+    return create_node(path, false);
+}
+
+int vfs_mkdir(const char* path) {
+    return create_node(path, true);
+}
+
+static int write_file(const char* path, const void* data, uint64_t size, bool append) {
+    char canon[VFS_MAX_PATH];
+    if (!path) return UNIFS_ERR_NOT_FOUND;
+    if (!canonicalize(path, canon)) return UNIFS_ERR_NAME_TOO_LONG;
+
+    mutex_lock(&vfs_lock);
+    int result;
+    const char* rel;
+    Mount* m = find_mount(canon, &rel);
+    if (!m) {
+        result = UNIFS_ERR_NOT_FOUND;
+    } else if (!*rel) {
+        result = UNIFS_ERR_IS_DIR;
+    } else {
+        result = m->ops->write(m->ctx, rel, data, size, append);
+        forget_locked(canon, false);
+    }
+    mutex_unlock(&vfs_lock);
+    return result;
+}
+
+int vfs_write(const char* path, const void* data, uint64_t size) {
+    return write_file(path, data, size, false);
+}
+
+int vfs_append(const char* path, const void* data, uint64_t size) {
+    return write_file(path, data, size, true);
+}
+
+int vfs_delete(const char* path) {
+    char canon[VFS_MAX_PATH];
+    if (!path || !canonicalize(path, canon)) return UNIFS_ERR_NOT_FOUND;
+
+    mutex_lock(&vfs_lock);
+    int result;
+    const char* rel;
+    Mount* m = find_mount(canon, &rel);
+    if (!m) {
+        result = UNIFS_ERR_NOT_FOUND;
+    } else if (!*rel) {
+        result = UNIFS_ERR_IN_USE;  // Mount point
+    } else {
+        Dentry* d = lookup_locked(canon);
+        if (d && d->node && d->node->opens) {
+            result = UNIFS_ERR_IN_USE;
+        } else {
+            result = m->ops->remove(m->ctx, rel);
+            forget_locked(canon, true);
+        }
+    }
+    mutex_unlock(&vfs_lock);
+    return result;
+}
+
+// Size-changing operations: the driver's hook if it has one
+static int resize_file(const char* path, bool punch, uint64_t offset, uint64_t len) {
+    char canon[VFS_MAX_PATH];
+    if (!path) return UNIFS_ERR_NOT_FOUND;
+    if (!canonicalize(path, canon)) return UNIFS_ERR_NAME_TOO_LONG;
+
+    mutex_lock(&vfs_lock);
+    int result;
+    Dentry* d = lookup_locked(canon);
+    if (!d || !d->node) {
+        result = UNIFS_ERR_NOT_FOUND;
+    } else if (d->node->kind != VFS_NODE_FILE) {
+        result = UNIFS_ERR_IS_DIR;
+    } else {
+        const VfsOps* ops = d->mount->ops;
+        void* ctx = d->mount->ctx;
+        const char* rel = d->rel;
+        if (punch) {
+            result = ops->punch_hole ? ops->punch_hole(ctx, rel, offset, len) : UNIFS_ERR_INVALID;
+        } else {
+            result = ops->truncate ? ops->truncate(ctx, rel, len) : UNIFS_ERR_INVALID;
+        }
+        forget_locked(canon, false);
+    }
+    mutex_unlock(&vfs_lock);
+    return result;
+}
+
+int vfs_truncate(const char* path, uint64_t size) {
+    return resize_file(path, false, 0, size);
+}
+
+int vfs_punch_hole(const char* path, uint64_t offset, uint64_t len) {
+    return resize_file(path, true, offset, len);
+}
+
+int vfs_sync() {
+    mutex_lock(&vfs_lock);
+    int result = UNIFS_OK;
+    for (uint32_t i = 0; i < mount_count; i++) {
+        if (!mounts[i].ops->sync) continue;
+        int status = mounts[i].ops->sync(mounts[i].ctx);
+        if (status != UNIFS_OK) result = status;
+    }
+    mutex_unlock(&vfs_lock);
+    return result;
+}
+
+void vfs_get_stats(VfsStats* out) {
+    mutex_lock(&vfs_lock);
+    *out = stats;
+    mutex_unlock(&vfs_lock);
+    mutex_lock(&io_lock);
+    out->async_reads = io_completed;
+    mutex_unlock(&io_lock);
+}
+
+// ============================================================================
+// Open Files and Read-Ahead
+// ============================================================================
+
+// Called before each read of [offset, offset + len)
+static void readahead_locked(VfsFile* file, uint64_t offset, uint64_t len) {
+    VfsNode* node = file->node;
+    const VfsOps* ops = node->mount->ops;
+    bool sequential = offset == file->next_offset;
+    file->next_offset = offset + len;
+    if (!ops->readahead) return;
+
+    if (!sequential) {
+        file->ra_size = 0;
+        return;
+    }
+
+    uint64_t end = offset + len;
+    if (file->ra_size == 0) {
+        // New stream: the first window covers this read and as much again
+        uint64_t size = len * 2;
+        if (size < VFS_RA_MIN_BYTES) size = VFS_RA_MIN_BYTES;
+        if (size > VFS_RA_MAX_BYTES) size = VFS_RA_MAX_BYTES;
+        file->ra_start = offset;
+        file->ra_size = size;
+    } else if (end > file->ra_start + file->ra_size / 2) {
+        // Halfway through the window: issue the next, twice as large
+        uint64_t start = file->ra_start + file->ra_size;
+        if (start < end) start = end;
+        file->ra_start = start;
+        file->ra_size = file->ra_size * 2 > VFS_RA_MAX_BYTES ? VFS_RA_MAX_BYTES : file->ra_size * 2;
+    } else {
+        return;
+    }
+
+    if (file->ra_start >= node->size) return;
+    ops->readahead(node->mount->ctx, node->id, file->ra_start, file->ra_size);
+    stats.readahead_windows++;
+    stats.readahead_bytes += file->ra_size;
+}
+
+VfsFile* vfs_file_open(const char* path) {
+    char canon[VFS_MAX_PATH];
+    if (!canonicalize(path, canon)) return nullptr;
+
+    VfsFile* file = (VfsFile*)malloc(sizeof(VfsFile));
+    if (!file) return nullptr;
+    kstring::zero_memory(file, sizeof(VfsFile));
+    kstring::strcpy(file->path, canon);
+
+    mutex_lock(&vfs_lock);
+    Dentry* d = lookup_locked(canon);
+    if (d && d->node && d->node->kind == VFS_NODE_FILE && d->mount->ops->read) {
+        file->node = d->node;
+        file->node->refs++;
+        file->node->opens++;
+        stats.open_files++;
+    }
+    mutex_unlock(&vfs_lock);
+
+    if (!file->node) {
+        free(file);
+        return nullptr;
+    }
+    return file;
+}
+
+int64_t vfs_file_read(VfsFile* file, uint64_t offset, void* buf, uint64_t len) {
+    if (!file || (!buf && len)) return UNIFS_ERR_INVALID;
+    if (len == 0) return 0;
+
+    mutex_lock(&vfs_lock);
+    VfsNode* node = file->node;
+    readahead_locked(file, offset, len);
+    int64_t result = node->mount->ops->read(node->mount->ctx, node->id, offset, buf, len);
+    mutex_unlock(&vfs_lock);
+    return result;
+}
+
+uint64_t vfs_file_size(VfsFile* file) {
+    if (!file) return 0;
+    mutex_lock(&vfs_lock);
+    lookup_locked(file->path);  // Refreshes the node if the file changed
+    uint64_t size = file->node->size;
+    mutex_unlock(&vfs_lock);
+    return size;
+}
+
+const char* vfs_file_path(VfsFile* file) {
+    return file ? file->path : nullptr;
+}
+
+const uint8_t* vfs_file_map(VfsFile* file) {
+    if (!file) return nullptr;
+    mutex_lock(&vfs_lock);
+    VfsNode* node = file->node;
+    const uint8_t* data = node->mount->ops->map ? node->mount->ops->map(node->mount->ctx, node->id) : nullptr;
+    mutex_unlock(&vfs_lock);
+    return data;
+}
+
+void vfs_file_close(VfsFile* file) {
+    if (!file) return;
+    mutex_lock(&vfs_lock);
+    file->node->opens--;
+    stats.open_files--;
+    node_put(file->node);
+    mutex_unlock(&vfs_lock);
+    free(file);
+}
+
+// ============================================================================
+// Asynchronous Reads
+// ============================================================================
+// One kernel task runs queued reads in order. Its reads go through
+// vfs_file_read(), so a stream of async requests gets read-ahead too. The
+// task sleeps on io_queued while there is nothing to do; waiters for a
+// request sleep on io_done, which every completion wakes.
+
+static void io_task() {
+    for (;;) {
+        mutex_lock(&io_lock);
+        while (!io_head) wait_queue_wait(&io_queued, &io_lock);
+        VfsIoRequest* req = io_head;
+        io_head = req->next;
+        if (!io_head) io_tail = nullptr;
+        mutex_unlock(&io_lock);
+
+        req->result = vfs_file_read(req->file, req->offset, req->buffer, req->length);
+        if (req->complete) req->complete(req);
+        mutex_lock(&io_lock);
+        io_completed++;
+        req->done = true;  // Last: the owner may reuse req from here on
+        wait_queue_wake_all(&io_done);
+        mutex_unlock(&io_lock);
+    }
+}
+
+bool vfs_submit_read(VfsIoRequest* req) {
+    if (!req || !req->file || (!req->buffer && req->length)) return false;
+    req->done = false;
+    req->result = 0;
+    req->next = nullptr;
+
+    mutex_lock(&io_lock);
+    if (io_tail) io_tail->next = req; else io_head = req;
+    io_tail = req;
+    bool start = !io_task_started;
+    io_task_started = true;
+    wait_queue_wake_one(&io_queued);
+    mutex_unlock(&io_lock);
+
+    if (start) scheduler_create_task(io_task);
+    return true;
+}
+
+int64_t vfs_io_wait(VfsIoRequest* req) {
+    mutex_lock(&io_lock);
+    while (!req->done) wait_queue_wait(&io_done, &io_lock);
+    mutex_unlock(&io_lock);
+    return req->result;
+}
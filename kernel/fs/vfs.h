@@ -0,0 +1,180 @@
+#pragma once
+#include <stdint.h>
+#include "unifs.h"
+
+// ============================================================================
+// Virtual File System
+// ============================================================================
+// Callers (shell, syscalls, drivers) name files by path and never talk to a
+// filesystem driver directly. A filesystem implements VfsOps and is mounted
+// at a directory; the mount with the longest matching prefix serves a path,
+// which reaches the driver relative to its mount point.
+//
+// Paths are canonicalized first: leading, repeated and trailing '/' and "."
+// components are dropped and ".." removes the previous component, so "a",
+// "/a" and "./x/../a" are the same file. "" (or "/") is the root.
+//
+// Lookups go through a dentry cache keyed by canonical path. A positive
+// dentry points at a cached inode (VfsNode) holding type, size, generation
+// and the detected content type; a negative dentry remembers that the path
+// does not exist. Both are dropped when the path changes through the VFS, so
+// repeated lookups of an unchanged path never reach the driver.
+//
+// Streaming readers open a VfsFile and read at offsets. Each open file
+// watches its access pattern: reads that continue where the last one ended
+// grow a read-ahead window (VFS_RA_MIN_BYTES doubling up to VFS_RA_MAX_BYTES)
+// that the driver starts fetching without waiting, and the next window is
+// issued once the reader is halfway through the current one. Any other
+// read resets the window. vfs_submit_read() runs a read on the VFS I/O task
+// and reports completion through the request, like a BlockRequest.
+//
+// Errors and types reuse the uniFS vocabulary: UNIFS_OK / UNIFS_ERR_* and
+// UNIFS_TYPE_*. vfs_open() gives a flat UniFSFile view, as from uniFS, of
+// files whose driver has one.
+// ============================================================================
+
+#define VFS_MAX_MOUNTS      8
+#define VFS_MAX_PATH        256     // Canonical path, NUL included
+#define VFS_DENTRY_MAX      1024    // Cached dentries before LRU eviction
+#define VFS_RA_MIN_BYTES    (16 * 1024)     // First read-ahead window
+#define VFS_RA_MAX_BYTES    (256 * 1024)    // Largest read-ahead window
+
+// Node kinds reported by VfsOps::lookup
+#define VFS_NODE_FILE       1
+#define VFS_NODE_DIR        2
+
+struct VfsNodeInfo {
+    uint64_t id;                // Unique within the mount while the node exists
+    uint8_t kind;               // VFS_NODE_*
+    uint64_t size;
+    uint64_t generation;        // Changes with the contents (0 = never changes)
+};
+
+// Filesystem driver. Paths are relative to the mount point ("" = its root).
+// Calls are serialized by the VFS.
+struct VfsOps {
+    const char* name;
+
+    // Fill *out for an existing path; false if there is none
+    bool (*lookup)(void* ctx, const char* path, VfsNodeInfo* out);
+
+    // Flat view of a file's contents. May be null (files are only read
+    // through read, vfs_open() fails)
+    bool (*open)(void* ctx, const char* path, UniFSFile* out);
+
+    // Read file bytes at offset by node id; bytes read or UNIFS_ERR_*
+    int64_t (*read)(void* ctx, uint64_t id, uint64_t offset, void* buf, uint64_t len);
+
+    // Start fetching [offset, offset + len) and return without waiting.
+    // May be null (nothing to fetch, e.g. memory-backed files)
+    void (*readahead)(void* ctx, uint64_t id, uint64_t offset, uint64_t len);
+
+    // UNIFS_TYPE_* of a file's contents
+    int (*content_type)(void* ctx, const char* path);
+
+    int (*create)(void* ctx, const char* path, bool dir);
+    int (*write)(void* ctx, const char* path, const void* data, uint64_t size, bool append);
+    int (*remove)(void* ctx, const char* path);
+
+    // Directory entries by position
+    uint64_t (*dir_count)(void* ctx, const char* path);
+    const char* (*dir_name)(void* ctx, const char* path, uint64_t index);
+
+    // Write back cached changes. May be null
+    int (*sync)(void* ctx);
+
+    // Address of a file's contents if they stay in memory, unchanged, for
+    // as long as the system runs (boot image data), else nullptr. Lets
+    // senders hand out references instead of copies. May be null
+    const uint8_t* (*map)(void* ctx, uint64_t id);
+
+    // Set a file's size; growing adds zeros (a hole if the driver can).
+    // May be null
+    int (*truncate)(void* ctx, const char* path, uint64_t size);
+
+    // Make [offset, offset + len) of a file a hole: it reads as zeros and
+    // its storage is freed. The size does not change. May be null
+    int (*punch_hole)(void* ctx, const char* path, uint64_t offset, uint64_t len);
+};
+
+struct VfsStats {
+    uint64_t lookups;
+    uint64_t hits;              // Served from the dentry cache
+    uint64_t negative_hits;     // ...by a negative dentry
+    uint32_t dentries;
+    uint32_t nodes;
+    uint32_t mounts;
+    uint32_t open_files;
+    uint64_t readahead_windows; // Windows issued to drivers
+    uint64_t readahead_bytes;
+    uint64_t async_reads;       // Requests completed by the I/O task
+};
+
+// Open file (opaque). The file cannot be deleted while it is open.
+struct VfsFile;
+
+struct VfsIoRequest;
+typedef void (*VfsIoCompletion)(VfsIoRequest* req);
+
+// Asynchronous read. Like a BlockRequest, it must stay valid (not on a
+// stack that goes away) until done is set; done is set last, after the
+// completion callback has returned.
+struct VfsIoRequest {
+    VfsFile* file;
+    uint64_t offset;
+    void* buffer;
+    uint64_t length;
+    volatile bool done;         // Set once result is valid
+    int64_t result;             // Bytes read or UNIFS_ERR_*
+    VfsIoCompletion complete;   // Runs on the I/O task once result is set, may be null
+    void* ctx;                  // For the completion callback
+
+    // Owned by the VFS
+    VfsIoRequest* next;
+};
+
+void vfs_init();
+
+// Mount ops at path; "/" must come first. The mount point need not exist
+// in the parent filesystem, it is listed there regardless. Returns UNIFS_OK
+// or UNIFS_ERR_*.
+int vfs_mount(const char* path, const VfsOps* ops, void* ctx);
+
+// Forget every cached dentry and inode (a driver changed behind the VFS)
+void vfs_invalidate();
+
+// Read API
+bool vfs_open(const char* path, UniFSFile* out);
+bool vfs_exists(const char* path);
+uint64_t vfs_get_size(const char* path);
+int vfs_get_type(const char* path);
+uint64_t vfs_get_generation(const char* path);
+
+// Open files: positioned reads with sequential read-ahead
+VfsFile* vfs_file_open(const char* path);
+int64_t vfs_file_read(VfsFile* file, uint64_t offset, void* buf, uint64_t len);
+uint64_t vfs_file_size(VfsFile* file);
+const char* vfs_file_path(VfsFile* file);   // Canonical
+const uint8_t* vfs_file_map(VfsFile* file); // VfsOps::map of the file, or nullptr
+void vfs_file_close(VfsFile* file);
+
+// Queue req; false if it is malformed. vfs_io_wait() sleeps until done and
+// returns the result.
+bool vfs_submit_read(VfsIoRequest* req);
+int64_t vfs_io_wait(VfsIoRequest* req);
+
+// Directory listing (mount points below the directory are included)
+uint64_t vfs_dir_count(const char* path);
+const char* vfs_dir_name(const char* path, uint64_t index);
+
+// Write API
+int vfs_create(const char* path);
+int vfs_mkdir(const char* path);
+int vfs_write(const char* path, const void* data, uint64_t size);
+int vfs_append(const char* path, const void* data, uint64_t size);
+int vfs_delete(const char* path);
+int vfs_truncate(const char* path, uint64_t size);
+int vfs_punch_hole(const char* path, uint64_t offset, uint64_t len);
+int vfs_sync();
+
+void vfs_get_stats(VfsStats* out);
@@ -27,6 +27,30 @@ static uint64_t total_memory = 0;
 static uint64_t free_memory = 0;
 static uint64_t highest_page = 0;
 
+#define PMM_MAX_RECLAIMERS 4
+static PmmReclaimFn reclaimers[PMM_MAX_RECLAIMERS];
+static int reclaimer_count = 0;
+static volatile bool reclaiming = false;
+
+// Ask registered caches to give frames back. Runs without pmm_lock held
+// since reclaimers free through pmm_free_frame().
+static bool run_reclaim(uint64_t pages) {
+    if (reclaiming) return false;  // Reclaimer itself ran out
+    reclaiming = true;
+    uint64_t freed = 0;
+    for (int i = 0; i < reclaimer_count && freed < pages; i++) {
+        freed += reclaimers[i](pages - freed);
+    }
+    reclaiming = false;
+    return freed > 0;
+}
+
+bool pmm_register_reclaim(PmmReclaimFn fn) {
+    if (!fn || reclaimer_count >= PMM_MAX_RECLAIMERS) return false;
+    reclaimers[reclaimer_count++] = fn;
+    return true;
+}
+
 void pmm_init() {
     if (memmap_request.response == nullptr) {
         return;
@@ -77,7 +101,7 @@ void pmm_init() {
                (bitmap_bits * 4096ULL) / 1024 / 1024);
 }
 
-void* pmm_alloc_frame() {
+static void* try_alloc_frame() {
     spinlock_acquire(&pmm_lock);
     
     size_t frame_idx = pmm_bitmap.find_first_free();
@@ -93,7 +117,7 @@ void* pmm_alloc_frame() {
     return nullptr; // Out of memory
 }
 
-void* pmm_alloc_frames(size_t count) {
+static void* try_alloc_frames(size_t count) {
     spinlock_acquire(&pmm_lock);
     
     size_t frame_idx = pmm_bitmap.find_first_free_sequence(count);
@@ -109,6 +133,19 @@ void* pmm_alloc_frames(size_t count) {
     return nullptr; // Out of memory
 }
 
+void* pmm_alloc_frame() {
+    void* frame = try_alloc_frame();
+    if (!frame && run_reclaim(1)) frame = try_alloc_frame();
+    return frame;
+}
+
+void* pmm_alloc_frames(size_t count) {
+    void* frames = try_alloc_frames(count);
+    // Reclaimed frames need not be contiguous, so ask for a margin
+    if (!frames && run_reclaim(count * 4)) frames = try_alloc_frames(count);
+    return frames;
+}
+
 void pmm_free_frame(void* frame) {
     spinlock_acquire(&pmm_lock);
     
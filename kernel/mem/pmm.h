@@ -8,3 +8,10 @@ void* pmm_alloc_frames(size_t count);
 void pmm_free_frame(void* frame);
 uint64_t pmm_get_free_memory();
 uint64_t pmm_get_total_memory();
+
+// Memory-pressure reclaim: caches register a callback that frees up to
+// `pages` frames it owns and returns how many it freed. Callbacks run when
+// an allocation would otherwise fail, possibly from IRQ context or with the
+// caller's locks held, so they must only trylock.
+typedef uint64_t (*PmmReclaimFn)(uint64_t pages);
+bool pmm_register_reclaim(PmmReclaimFn fn);
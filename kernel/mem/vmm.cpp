@@ -192,6 +192,31 @@ void vmm_map_page_in(uint64_t* target_pml4, uint64_t virt, uint64_t phys, uint64
     pt[pt_index] = phys | flags;
 }
 
+uint64_t vmm_unmap_page_in(uint64_t* target_pml4, uint64_t virt) {
+    uint64_t pml4_index = (virt >> 39) & 0x1FF;
+    uint64_t pdpt_index = (virt >> 30) & 0x1FF;
+    uint64_t pd_index   = (virt >> 21) & 0x1FF;
+    uint64_t pt_index   = (virt >> 12) & 0x1FF;
+
+    uint64_t* pdpt = get_next_level_in(target_pml4, pml4_index, false);
+    if (!pdpt) return 0;
+
+    uint64_t* pd = get_next_level_in(pdpt, pdpt_index, false);
+    if (!pd) return 0;
+
+    uint64_t* pt = get_next_level_in(pd, pd_index, false);
+    if (!pt) return 0;
+
+    if (!(pt[pt_index] & PTE_PRESENT)) return 0;
+
+    uint64_t phys = pt[pt_index] & 0x000FFFFFFFFFF000ULL;
+    pt[pt_index] = 0;
+
+    // Only the active address space can have stale TLB entries
+    asm volatile("invlpg (%0)" :: "r"(virt) : "memory");
+    return phys;
+}
+
 uint64_t* vmm_create_address_space() {
     // Allocate a new PML4
     void* frame = pmm_alloc_frame();
@@ -207,6 +232,9 @@ uint64_t* vmm_create_address_space() {
         new_pml4[i] = pml4[i];
     }
     
+    // Kernel stack slot is per-process (filled in by the scheduler)
+    new_pml4[KERNEL_STACK_PML4_INDEX] = 0;
+    
     return new_pml4;
 }
 
@@ -227,6 +255,12 @@ static void clone_page_table_level(uint64_t* src, uint64_t* dst, int level) {
         uint64_t flags = src[i] & 0xFFF;
         
         if (level == 1) {
+            // Shared frames (e.g. cached program text) are mapped, not copied
+            if (src[i] & PTE_SHARED) {
+                dst[i] = src[i];
+                continue;
+            }
+            
             // Level 1 = PT (Page Table): Copy the actual physical page
             void* new_frame = pmm_alloc_frame();
             if (!new_frame) {
@@ -283,6 +317,9 @@ uint64_t* vmm_clone_address_space(uint64_t* src_pml4) {
         new_pml4[i] = src_pml4[i];
     }
     
+    // Except the kernel stack slot, which must not alias the parent's stack
+    new_pml4[KERNEL_STACK_PML4_INDEX] = 0;
+    
     // Deep copy user mappings (lower half - indices 0-255)
     for (int i = 0; i < 256; i++) {
         if (!(src_pml4[i] & PTE_PRESENT)) {
@@ -322,8 +359,8 @@ static void free_page_table_level(uint64_t* table, int level) {
         uint64_t phys = table[i] & 0x000FFFFFFFFFF000ULL;
         
         if (level == 1) {
-            // Level 1 = PT: Free the physical page
-            pmm_free_frame((void*)phys);
+            // Level 1 = PT: Free the physical page (unless someone else owns it)
+            if (!(table[i] & PTE_SHARED)) pmm_free_frame((void*)phys);
         } else {
             // Levels 2-3: Recurse then free table
             uint64_t* sub_table = (uint64_t*)(phys + hhdm_offset);
@@ -333,6 +370,18 @@ static void free_page_table_level(uint64_t* table, int level) {
     }
 }
 
+// Helper: Free intermediate tables only, leaving the mapped pages alone
+static void free_table_tree(uint64_t* table, int level) {
+    if (level == 1) return;
+    for (int i = 0; i < 512; i++) {
+        if (!(table[i] & PTE_PRESENT)) continue;
+        
+        uint64_t phys = table[i] & 0x000FFFFFFFFFF000ULL;
+        free_table_tree((uint64_t*)(phys + hhdm_offset), level - 1);
+        pmm_free_frame((void*)phys);
+    }
+}
+
 // Free all user-space pages in an address space
 void vmm_free_address_space(uint64_t* target_pml4) {
     if (!target_pml4) return;
@@ -349,6 +398,14 @@ void vmm_free_address_space(uint64_t* target_pml4) {
         pmm_free_frame((void*)phys);
     }
     
+    // Free the private kernel stack tables (stack pages are owned by the scheduler)
+    uint64_t stack_slot = target_pml4[KERNEL_STACK_PML4_INDEX];
+    if ((stack_slot & PTE_PRESENT) && stack_slot != pml4[KERNEL_STACK_PML4_INDEX]) {
+        uint64_t phys = stack_slot & 0x000FFFFFFFFFF000ULL;
+        free_table_tree((uint64_t*)(phys + hhdm_offset), 3);
+        pmm_free_frame((void*)phys);
+    }
+    
     // Free the PML4 itself
     uint64_t pml4_phys = (uint64_t)target_pml4 - hhdm_offset;
     pmm_free_frame((void*)pml4_phys);
@@ -9,6 +9,7 @@
 #define PTE_PWT       (1ull << 3)  // Page Write-Through
 #define PTE_PCD       (1ull << 4)  // Page Cache Disable
 #define PTE_PAT       (1ull << 7)  // PAT bit (for 4KB pages)
+#define PTE_SHARED    (1ull << 9)  // Software bit: frame owned elsewhere (not freed/copied with the address space)
 #define PTE_NX        (1ull << 63)
 
 // Combined flags for MMIO (uncacheable)
@@ -20,6 +21,8 @@
 void vmm_init();
 void vmm_map_page(uint64_t virt, uint64_t phys, uint64_t flags);
 void vmm_map_page_in(uint64_t* pml4, uint64_t virt, uint64_t phys, uint64_t flags);
+// Remove a mapping from an address space; returns the physical page (0 if unmapped)
+uint64_t vmm_unmap_page_in(uint64_t* pml4, uint64_t virt);
 uint64_t vmm_virt_to_phys(uint64_t virt);
 uint64_t vmm_phys_to_virt(uint64_t phys);
 uint64_t* vmm_create_address_space();
@@ -31,6 +34,10 @@ uint64_t* vmm_get_kernel_pml4();
 #define KERNEL_STACK_TOP  0xFFFFFF8000000000ULL
 #define KERNEL_STACK_SIZE 16384  // 16KB per process
 
+// PML4 slot holding the kernel stack. Every address space gets a private
+// table for this slot so mapping one process's stack never touches another's.
+#define KERNEL_STACK_PML4_INDEX (((KERNEL_STACK_TOP - KERNEL_STACK_SIZE) >> 39) & 0x1FF)
+
 // Clone an address space (deep copy user pages, share kernel pages)
 uint64_t* vmm_clone_address_space(uint64_t* src_pml4);
 
@@ -6,7 +6,8 @@
 #include "timer.h"
 #include "debug.h"
 #include "scheduler.h"
-#include "heap.h"
+#include "netbuf.h"
+#include "kstring.h"
 
 // DHCP state
 static uint32_t dhcp_xid = 0;
@@ -88,68 +89,47 @@ static uint16_t dhcp_build_packet(DhcpPacket* pkt, uint8_t msg_type) {
 // Send DHCP packet via UDP to broadcast
 static bool dhcp_send(DhcpPacket* pkt, uint16_t length) {
     // Build UDP + IP packet manually since we don't have an IP yet
-    // Actually, we need to send with src_ip=0 and dst_ip=broadcast
-    
-    // Allocate frame on heap to prevent stack overflow
-    uint8_t* frame = (uint8_t*)malloc(1500);
-    if (!frame) {
+    // (src_ip=0, dst_ip=broadcast, no ARP). The message goes into a netbuf
+    // and the headers are prepended in front of it.
+    NetBuf* nb = netbuf_alloc(NETBUF_HEADROOM);
+    if (!nb) {
         DEBUG_ERROR("DHCP: Failed to allocate frame buffer");
         return false;
     }
+    kstring::memcpy(netbuf_append(nb, length), pkt, length);
     
     // Build UDP header
-    struct {
+    struct UdpHdr {
         uint16_t src_port;
         uint16_t dst_port;
         uint16_t length;
         uint16_t checksum;
-    } __attribute__((packed)) udp;
+    } __attribute__((packed));
     
-    udp.src_port = htons(DHCP_CLIENT_PORT);
-    udp.dst_port = htons(DHCP_SERVER_PORT);
-    udp.length = htons(8 + length);
-    udp.checksum = 0;  // Optional for UDP
+    UdpHdr* udp = (UdpHdr*)netbuf_push(nb, 8);
+    udp->src_port = htons(DHCP_CLIENT_PORT);
+    udp->dst_port = htons(DHCP_SERVER_PORT);
+    udp->length = htons(8 + length);
+    udp->checksum = 0;  // Optional for UDP
     
     // Build IP header
-    struct {
-        uint8_t ihl_version;
-        uint8_t tos;
-        uint16_t total_length;
-        uint16_t identification;
-        uint16_t flags_fragment;
-        uint8_t ttl;
-        uint8_t protocol;
-        uint16_t checksum;
-        uint32_t src_ip;
-        uint32_t dst_ip;
-    } __attribute__((packed)) ip;
-    
-    ip.ihl_version = 0x45;
-    ip.tos = 0;
-    ip.total_length = htons(20 + 8 + length);
-    ip.identification = 0;
-    ip.flags_fragment = 0;
-    ip.ttl = 64;
-    ip.protocol = 17;  // UDP
-    ip.checksum = 0;
-    ip.src_ip = 0;
-    ip.dst_ip = 0xFFFFFFFF;  // Broadcast
+    IPv4Header* ip = (IPv4Header*)netbuf_push(nb, IPV4_HEADER_SIZE);
+    ip->ihl_version = 0x45;
+    ip->tos = 0;
+    ip->total_length = htons(20 + 8 + length);
+    ip->identification = 0;
+    ip->flags_fragment = 0;
+    ip->ttl = 64;
+    ip->protocol = 17;  // UDP
+    ip->checksum = 0;
+    ip->src_ip = 0;
+    ip->dst_ip = 0xFFFFFFFF;  // Broadcast
     
     // Calculate IP checksum
-    ip.checksum = ipv4_checksum(&ip, 20);
-    
-    // Assemble frame
-    uint8_t* p = frame;
-    for (int i = 0; i < 20; i++) p[i] = ((uint8_t*)&ip)[i];
-    p += 20;
-    for (int i = 0; i < 8; i++) p[i] = ((uint8_t*)&udp)[i];
-    p += 8;
-    for (int i = 0; i < length; i++) p[i] = ((uint8_t*)pkt)[i];
+    ip->checksum = ipv4_checksum(ip, 20);
     
     // Send via Ethernet broadcast
-    bool result = ethernet_send(ETH_BROADCAST_MAC, ETH_TYPE_IPV4, frame, 20 + 8 + length);
-    free(frame);
-    return result;
+    return ethernet_send_buf(ETH_BROADCAST_MAC, ETH_TYPE_IPV4, nb);
 }
 
 
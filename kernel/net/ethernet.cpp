@@ -3,7 +3,8 @@
 #include "arp.h"
 #include "ipv4.h"
 #include "debug.h"
-#include "heap.h"
+#include "netbuf.h"
+#include "kstring.h"
 
 // Broadcast MAC
 const uint8_t ETH_BROADCAST_MAC[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
@@ -50,23 +51,22 @@ void ethernet_init() {
 
 }
 
-// Send Ethernet frame
-bool ethernet_send(const uint8_t* dst_mac, uint16_t ethertype, const void* data, uint16_t length) {
-    if (length > ETH_DATA_LEN) {
-        DEBUG_WARN("Ethernet: Payload too large (%d > %d)", length, ETH_DATA_LEN);
+// Send Ethernet frame: the header is prepended in the netbuf's headroom
+bool ethernet_send_buf(const uint8_t* dst_mac, uint16_t ethertype, NetBuf* nb) {
+    if (!nb) return false;
+    if (nb->len > ETH_DATA_LEN) {
+        DEBUG_WARN("Ethernet: Payload too large (%d > %d)", nb->len, ETH_DATA_LEN);
+        netbuf_release(nb);
         return false;
     }
     
-    // Allocate frame on heap to prevent stack overflow
-    // (Network call chains can be deep: socket -> tcp -> ipv4 -> ethernet -> driver)
-    uint8_t* frame = (uint8_t*)malloc(ETH_FRAME_LEN);
-    if (!frame) {
-        DEBUG_WARN("Ethernet: Failed to allocate frame buffer");
+    EthernetHeader* hdr = (EthernetHeader*)netbuf_push(nb, ETH_HLEN);
+    if (!hdr) {
+        DEBUG_WARN("Ethernet: No headroom for header");
+        netbuf_release(nb);
         return false;
     }
     
-    EthernetHeader* hdr = (EthernetHeader*)frame;
-    
     // Set destination MAC
     eth_mac_copy(hdr->dst_mac, dst_mac);
     
@@ -76,21 +76,28 @@ bool ethernet_send(const uint8_t* dst_mac, uint16_t ethertype, const void* data,
     // Set EtherType (network byte order)
     hdr->ethertype = htons(ethertype);
     
-    // Copy payload
-    uint8_t* payload = frame + ETH_HLEN;
-    const uint8_t* src = (const uint8_t*)data;
-    for (uint16_t i = 0; i < length; i++) {
-        payload[i] = src[i];
+    // Send via unified NIC layer
+    return net_send_buf(nb);
+}
+
+// Send Ethernet frame from a flat buffer (copied once into a netbuf)
+bool ethernet_send(const uint8_t* dst_mac, uint16_t ethertype, const void* data, uint16_t length) {
+    if (length > ETH_DATA_LEN) {
+        DEBUG_WARN("Ethernet: Payload too large (%d > %d)", length, ETH_DATA_LEN);
+        return false;
     }
     
-    // Send via unified NIC layer
-    bool result = net_send_raw(frame, ETH_HLEN + length);
-    free(frame);
-    return result;
+    NetBuf* nb = netbuf_alloc(NETBUF_HEADROOM);
+    if (!nb) {
+        DEBUG_WARN("Ethernet: Failed to allocate frame buffer");
+        return false;
+    }
+    kstring::memcpy(netbuf_append(nb, length), data, length);
+    return ethernet_send_buf(dst_mac, ethertype, nb);
 }
 
 // Process received Ethernet frame
-void ethernet_receive(const void* frame, uint16_t length) {
+void ethernet_receive(const void* frame, uint16_t length, uint8_t csum) {
     if (length < ETH_HLEN) {
         return; // Too short
     }
@@ -116,7 +123,7 @@ void ethernet_receive(const void* frame, uint16_t length) {
             arp_receive(payload, payload_len, hdr->src_mac);
             break;
         case ETH_TYPE_IPV4:
-            ipv4_receive(payload, payload_len);
+            ipv4_receive(payload, payload_len, csum);
             break;
         default:
             // Unknown protocol, ignore
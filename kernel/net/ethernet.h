@@ -1,6 +1,8 @@
 #pragma once
 #include <stdint.h>
 
+struct NetBuf;
+
 // Ethernet frame constants
 #define ETH_ALEN            6       // MAC address length
 #define ETH_HLEN            14      // Ethernet header length
@@ -31,7 +33,8 @@ uint32_t ntohl(uint32_t value);
 // Ethernet functions
 void ethernet_init();
 bool ethernet_send(const uint8_t* dst_mac, uint16_t ethertype, const void* data, uint16_t length);
-void ethernet_receive(const void* frame, uint16_t length);
+bool ethernet_send_buf(const uint8_t* dst_mac, uint16_t ethertype, NetBuf* nb);  // Consumes nb
+void ethernet_receive(const void* frame, uint16_t length, uint8_t csum);  // csum: NETBUF_RX_CSUM_*
 
 // MAC address helpers
 bool eth_mac_equals(const uint8_t* mac1, const uint8_t* mac2);
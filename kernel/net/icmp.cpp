@@ -3,6 +3,8 @@
 #include "ethernet.h"
 #include "timer.h"
 #include "debug.h"
+#include "netbuf.h"
+#include "kstring.h"
 
 // Ping tracking
 static ping_callback_t g_ping_callback = nullptr;
@@ -34,9 +36,11 @@ void icmp_receive(const void* data, uint16_t length, uint32_t src_ip) {
     switch (hdr->type) {
         case ICMP_TYPE_ECHO_REQUEST: {
             // Reply to ping
-            uint8_t reply[1500];
-            IcmpHeader* reply_hdr = (IcmpHeader*)reply;
+            NetBuf* nb = netbuf_alloc(NETBUF_HEADROOM);
+            if (!nb) break;
+            if (payload_len > 1480 - ICMP_HEADER_SIZE) payload_len = 1480 - ICMP_HEADER_SIZE;
             
+            IcmpHeader* reply_hdr = (IcmpHeader*)netbuf_append(nb, ICMP_HEADER_SIZE);
             reply_hdr->type = ICMP_TYPE_ECHO_REPLY;
             reply_hdr->code = 0;
             reply_hdr->checksum = 0;
@@ -44,15 +48,13 @@ void icmp_receive(const void* data, uint16_t length, uint32_t src_ip) {
             reply_hdr->sequence = hdr->sequence;
             
             // Copy payload
-            for (uint16_t i = 0; i < payload_len && i < 1500 - ICMP_HEADER_SIZE; i++) {
-                reply[ICMP_HEADER_SIZE + i] = payload[i];
-            }
+            kstring::memcpy(netbuf_append(nb, payload_len), payload, payload_len);
             
             // Calculate checksum
-            reply_hdr->checksum = ipv4_checksum(reply, ICMP_HEADER_SIZE + payload_len);
+            reply_hdr->checksum = ipv4_checksum(reply_hdr, nb->len);
             
             // Send reply
-            ipv4_send(src_ip, IP_PROTO_ICMP, reply, ICMP_HEADER_SIZE + payload_len);
+            ipv4_send_buf(src_ip, IP_PROTO_ICMP, nb);
             break;
         }
         
@@ -80,8 +82,10 @@ void icmp_receive(const void* data, uint16_t length, uint32_t src_ip) {
 
 // Send echo request (ping)
 bool icmp_send_echo_request(uint32_t dst_ip, uint16_t id, uint16_t seq) {
-    uint8_t packet[64];
-    IcmpHeader* hdr = (IcmpHeader*)packet;
+    NetBuf* nb = netbuf_alloc(NETBUF_HEADROOM);
+    if (!nb) return false;
+    
+    IcmpHeader* hdr = (IcmpHeader*)netbuf_append(nb, ICMP_HEADER_SIZE);
     
     hdr->type = ICMP_TYPE_ECHO_REQUEST;
     hdr->code = 0;
@@ -90,18 +94,18 @@ bool icmp_send_echo_request(uint32_t dst_ip, uint16_t id, uint16_t seq) {
     hdr->sequence = htons(seq);
     
     // Add some payload data
-    uint8_t* payload = packet + ICMP_HEADER_SIZE;
+    uint8_t* payload = netbuf_append(nb, 56);
     for (int i = 0; i < 56; i++) {
         payload[i] = (uint8_t)i;
     }
     
     // Calculate checksum
-    hdr->checksum = ipv4_checksum(packet, ICMP_HEADER_SIZE + 56);
+    hdr->checksum = ipv4_checksum(hdr, ICMP_HEADER_SIZE + 56);
     
     // Track for RTT calculation
     g_ping_id = id;
     g_ping_seq = seq;
     g_ping_sent_time = timer_get_ticks();
     
-    return ipv4_send(dst_ip, IP_PROTO_ICMP, packet, ICMP_HEADER_SIZE + 56);
+    return ipv4_send_buf(dst_ip, IP_PROTO_ICMP, nb);
 }
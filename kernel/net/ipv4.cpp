@@ -6,7 +6,8 @@
 #include "tcp.h"
 #include "net.h"
 #include "debug.h"
-#include "heap.h"
+#include "netbuf.h"
+#include "kstring.h"
 
 static uint16_t ip_id_counter = 0;
 
@@ -38,6 +39,35 @@ uint16_t ipv4_checksum(const void* data, uint16_t length) {
     return (uint16_t)~sum;
 }
 
+uint32_t ipv4_checksum_add(uint32_t sum, const void* data, uint16_t length) {
+    const uint16_t* ptr = (const uint16_t*)data;
+    while (length > 1) {
+        sum += *ptr++;
+        length -= 2;
+    }
+    if (length > 0) {
+        sum += *(const uint8_t*)ptr;
+    }
+    return sum;
+}
+
+// Sum of the pseudo-header TCP and UDP checksums cover
+uint32_t ipv4_pseudo_sum(uint32_t src_ip, uint32_t dst_ip, uint8_t protocol, uint16_t length) {
+    uint32_t sum = 0;
+    sum += (src_ip & 0xFFFF) + (src_ip >> 16);
+    sum += (dst_ip & 0xFFFF) + (dst_ip >> 16);
+    sum += htons(protocol);
+    sum += htons(length);
+    return sum;
+}
+
+uint16_t ipv4_checksum_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
 // Create IP address from bytes
 uint32_t ip_make(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
     return (uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24);
@@ -64,7 +94,7 @@ void ip_format(uint32_t ip, char* buf) {
 }
 
 // Receive IPv4 packet
-void ipv4_receive(const void* data, uint16_t length) {
+void ipv4_receive(const void* data, uint16_t length, uint8_t csum) {
     if (length < IPV4_HEADER_SIZE) {
         return;
     }
@@ -83,20 +113,11 @@ void ipv4_receive(const void* data, uint16_t length) {
         return;
     }
     
-    // Verify checksum
-    uint16_t orig_checksum = hdr->checksum;
-    if (orig_checksum != 0) {
-        // Calculate checksum over header
-        uint8_t header_copy[60];
-        for (int i = 0; i < ihl; i++) {
-            header_copy[i] = ((const uint8_t*)data)[i];
-        }
-        ((IPv4Header*)header_copy)->checksum = 0;
-        
-        if (ipv4_checksum(header_copy, ihl) != orig_checksum) {
-            DEBUG_WARN("IPv4: Bad checksum");
-            return;
-        }
+    // Verify checksum in place unless the NIC already did: summed with
+    // its checksum field, a good header folds to zero
+    if (!(csum & NETBUF_RX_CSUM_IP) && hdr->checksum != 0 && ipv4_checksum(data, ihl) != 0) {
+        DEBUG_WARN("IPv4: Bad checksum");
+        return;
     }
     
     // Check if packet is for us
@@ -121,10 +142,10 @@ void ipv4_receive(const void* data, uint16_t length) {
             icmp_receive(payload, payload_len, hdr->src_ip);
             break;
         case IP_PROTO_UDP:
-            udp_receive(payload, payload_len, hdr->src_ip, hdr->dst_ip);
+            udp_receive(payload, payload_len, hdr->src_ip, hdr->dst_ip, csum);
             break;
         case IP_PROTO_TCP:
-            tcp_receive(payload, payload_len, hdr->src_ip, hdr->dst_ip);
+            tcp_receive(payload, payload_len, hdr->src_ip, hdr->dst_ip, csum);
             break;
         default:
             // Unknown protocol
@@ -132,22 +153,23 @@ void ipv4_receive(const void* data, uint16_t length) {
     }
 }
 
-// Send IPv4 packet
-bool ipv4_send(uint32_t dst_ip, uint8_t protocol, const void* data, uint16_t length) {
+// Send IPv4 packet: the header is prepended in the netbuf's headroom
+bool ipv4_send_buf(uint32_t dst_ip, uint8_t protocol, NetBuf* nb) {
+    if (!nb) return false;
+    uint16_t length = nb->len;
     if (length > 1480) {  // MTU - IP header
         DEBUG_WARN("IPv4: Payload too large");
+        netbuf_release(nb);
         return false;
     }
     
-    // Allocate packet buffer on heap to avoid stack overflow in deep call chains
-    uint8_t* packet = (uint8_t*)malloc(1500);
-    if (!packet) {
-        DEBUG_WARN("IPv4: Failed to allocate packet buffer");
+    IPv4Header* hdr = (IPv4Header*)netbuf_push(nb, IPV4_HEADER_SIZE);
+    if (!hdr) {
+        DEBUG_WARN("IPv4: No headroom for header");
+        netbuf_release(nb);
         return false;
     }
     
-    IPv4Header* hdr = (IPv4Header*)packet;
-    
     hdr->ihl_version = 0x45;  // Version 4, IHL 5 (20 bytes)
     hdr->tos = 0;
     hdr->total_length = htons(IPV4_HEADER_SIZE + length);
@@ -159,14 +181,11 @@ bool ipv4_send(uint32_t dst_ip, uint8_t protocol, const void* data, uint16_t len
     hdr->src_ip = net_get_ip();
     hdr->dst_ip = dst_ip;
     
-    // Calculate header checksum
-    hdr->checksum = ipv4_checksum(hdr, IPV4_HEADER_SIZE);
-    
-    // Copy payload
-    uint8_t* payload = packet + IPV4_HEADER_SIZE;
-    const uint8_t* src = (const uint8_t*)data;
-    for (uint16_t i = 0; i < length; i++) {
-        payload[i] = src[i];
+    // Calculate header checksum, or leave it to the NIC
+    if (net_tx_csum_offload()) {
+        nb->csum |= NETBUF_TX_CSUM_IP;
+    } else {
+        hdr->checksum = ipv4_checksum(hdr, IPV4_HEADER_SIZE);
     }
     
     // Resolve MAC address
@@ -193,12 +212,26 @@ bool ipv4_send(uint32_t dst_ip, uint8_t protocol, const void* data, uint16_t len
         DEBUG_WARN("IPv4: Failed to resolve MAC for %d.%d.%d.%d",
             resolve_ip & 0xFF, (resolve_ip >> 8) & 0xFF,
             (resolve_ip >> 16) & 0xFF, (resolve_ip >> 24) & 0xFF);
-        free(packet);
+        netbuf_release(nb);
         return false;
     }
     
     // Send via Ethernet
-    bool result = ethernet_send(dst_mac, ETH_TYPE_IPV4, packet, IPV4_HEADER_SIZE + length);
-    free(packet);
-    return result;
+    return ethernet_send_buf(dst_mac, ETH_TYPE_IPV4, nb);
+}
+
+// Send IPv4 packet from a flat buffer (copied once into a netbuf)
+bool ipv4_send(uint32_t dst_ip, uint8_t protocol, const void* data, uint16_t length) {
+    if (length > 1480) {  // MTU - IP header
+        DEBUG_WARN("IPv4: Payload too large");
+        return false;
+    }
+    
+    NetBuf* nb = netbuf_alloc(NETBUF_HEADROOM);
+    if (!nb) {
+        DEBUG_WARN("IPv4: Failed to allocate packet buffer");
+        return false;
+    }
+    kstring::memcpy(netbuf_append(nb, length), data, length);
+    return ipv4_send_buf(dst_ip, protocol, nb);
 }
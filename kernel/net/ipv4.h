@@ -1,6 +1,8 @@
 #pragma once
 #include <stdint.h>
 
+struct NetBuf;
+
 // IP Protocol numbers
 #define IP_PROTO_ICMP   1
 #define IP_PROTO_TCP    6
@@ -25,10 +27,18 @@ struct IPv4Header {
 
 // IPv4 functions
 void ipv4_init();
-void ipv4_receive(const void* data, uint16_t length);
+void ipv4_receive(const void* data, uint16_t length, uint8_t csum);  // csum: NETBUF_RX_CSUM_*
 bool ipv4_send(uint32_t dst_ip, uint8_t protocol, const void* data, uint16_t length);
+bool ipv4_send_buf(uint32_t dst_ip, uint8_t protocol, NetBuf* nb);  // Payload in nb; consumes it
 uint16_t ipv4_checksum(const void* data, uint16_t length);
 
+// Pieces of the Internet checksum, for TCP/UDP and their pseudo-header:
+// add up the parts, then fold. ~ipv4_checksum_fold(sum) is the checksum to
+// store; over a segment that includes its checksum it is 0 if that is valid.
+uint32_t ipv4_checksum_add(uint32_t sum, const void* data, uint16_t length);
+uint32_t ipv4_pseudo_sum(uint32_t src_ip, uint32_t dst_ip, uint8_t protocol, uint16_t length);
+uint16_t ipv4_checksum_fold(uint32_t sum);
+
 // IP address helpers
 uint32_t ip_make(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
 void ip_format(uint32_t ip, char* buf);
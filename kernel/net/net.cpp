@@ -9,7 +9,13 @@
 #include "tcp.h"
 #include "dhcp.h"
 #include "dns.h"
+#include "netbuf.h"
 #include "debug.h"
+#include "kstring.h"
+#include "mutex.h"
+#include "waitqueue.h"
+#include "scheduler.h"
+#include "process.h"
 
 // Global network configuration
 static NetConfig g_net_config = {0, 0, 0, 0, false};
@@ -22,23 +28,46 @@ enum NicType {
 };
 static NicType g_active_nic = NIC_NONE;
 
-// RX buffer for polling
-static uint8_t rx_buffer[2048];
-
-// Unified NIC functions
-static bool nic_send(const void* data, uint16_t length) {
+// Unified NIC functions. Both take and return netbufs: the e1000 DMAs
+// straight to and from them, the RTL8139 copies once between a netbuf and
+// its own fixed TX buffers and RX ring.
+static bool nic_send(NetBuf* nb) {
     switch (g_active_nic) {
-        case NIC_E1000:   return e1000_send(data, length);
-        case NIC_RTL8139: return rtl8139_send(data, length);
-        default:          return false;
+        case NIC_E1000:
+            return e1000_send_buf(nb);
+        case NIC_RTL8139: {
+            bool sent = rtl8139_send(netbuf_data(nb), nb->len);
+            netbuf_release(nb);
+            return sent;
+        }
+        default:
+            netbuf_release(nb);
+            return false;
     }
 }
 
-static int nic_receive(void* buffer, uint16_t max_length) {
+// Up to max received frames into out[]; returns how many
+static int nic_receive_batch(NetBuf** out, int max) {
     switch (g_active_nic) {
-        case NIC_E1000:   return e1000_receive(buffer, max_length);
-        case NIC_RTL8139: return rtl8139_receive(buffer, max_length);
-        default:          return 0;
+        case NIC_E1000:
+            return e1000_receive_batch(out, max);
+        case NIC_RTL8139: {
+            int count = 0;
+            while (count < max) {
+                NetBuf* nb = netbuf_alloc(0);
+                if (!nb) break;
+                int len = rtl8139_receive(netbuf_data(nb), netbuf_tailroom(nb));
+                if (len <= 0) {
+                    netbuf_release(nb);
+                    break;
+                }
+                nb->len = (uint16_t)len;
+                out[count++] = nb;
+            }
+            return count;
+        }
+        default:
+            return 0;
     }
 }
 
@@ -66,8 +95,140 @@ static void nic_poll() {
     }
 }
 
-bool net_init() {
+// ============================================================================
+// Receive Processing
+// ============================================================================
+// Frames are handled in task context. When the NIC has an interrupt the
+// network task owns receive; otherwise whoever polls handles them: the
+// main loop or a task waiting on the network. Only one task processes at
+// a time; the same one may re-enter (an ARP lookup made while handling a
+// frame polls for the reply).
+//
+// The network task works like NAPI. The RX interrupt masks itself and
+// wakes the task, which polls in rounds of NET_RX_BUDGET frames while RX
+// interrupts stay masked. A round that uses its whole budget means more is
+// waiting, so the task yields and polls again; a round that comes up
+// short means the ring is drained, so RX interrupts are re-armed and the
+// task sleeps until the next one.
+
+static Mutex poll_lock = MUTEX_INIT;
+static Process* poll_owner = nullptr;
+static int poll_depth = 0;
+
+static WaitQueue rx_wait = WAIT_QUEUE_INIT;
+static volatile bool rx_pending = false;
+static bool rx_task = false;        // net_task receives; net_poll() leaves frames to it
+static NetRxStats rx_stats;
+
+static bool poll_enter() {
+    Process* self = process_get_current();
+    if (poll_depth > 0 && poll_owner == self) {
+        poll_depth++;
+        return true;
+    }
+    if (!mutex_try_lock(&poll_lock)) return false;
+    poll_owner = self;
+    poll_depth = 1;
+    return true;
+}
+
+static void poll_leave() {
+    if (--poll_depth == 0) {
+        poll_owner = nullptr;
+        mutex_unlock(&poll_lock);
+    }
+}
+
+void net_lock() {
+    Process* self = process_get_current();
+    if (poll_depth > 0 && poll_owner == self) {
+        poll_depth++;
+        return;
+    }
+    mutex_lock(&poll_lock);
+    poll_owner = self;
+    poll_depth = 1;
+}
 
+void net_unlock() {
+    poll_leave();
+}
+
+// Handle up to budget received frames; returns how many. Does nothing if
+// another task is already processing.
+static uint32_t net_service(uint32_t budget) {
+    if (!poll_enter()) return 0;
+    
+    // Poll the active NIC
+    nic_poll();
+    
+    // Receive packets in batches; each is handled in the buffer the NIC
+    // put it in
+    uint32_t done = 0;
+    NetBuf* batch[NET_RX_BATCH];
+    while (done < budget) {
+        uint32_t want = budget - done < NET_RX_BATCH ? budget - done : NET_RX_BATCH;
+        int n = nic_receive_batch(batch, (int)want);
+        for (int i = 0; i < n; i++) {
+            ethernet_receive(netbuf_data(batch[i]), batch[i]->len, batch[i]->csum);
+            netbuf_release(batch[i]);
+        }
+        done += n;
+        if ((uint32_t)n < want) break;
+    }
+    rx_stats.frames += done;
+    
+    // Retransmit what the peers have not ACKed in time
+    tcp_poll();
+    
+    poll_leave();
+    return done;
+}
+
+// RX interrupt (IRQ context, RX interrupts now masked)
+static void net_rx_interrupt() {
+    rx_pending = true;
+    wait_queue_wake_one(&rx_wait);
+}
+
+static void net_task() {
+    for (;;) {
+        uint64_t flags = interrupts_save_disable();
+        while (!rx_pending) wait_queue_wait(&rx_wait, nullptr);
+        rx_pending = false;
+        interrupts_restore(flags);
+        rx_stats.wakeups++;
+        
+        while (net_service(NET_RX_BUDGET) == NET_RX_BUDGET) {
+            rx_stats.busy_rounds++;
+            scheduler_yield();
+        }
+        
+        e1000_rx_irq_enable();
+    }
+}
+
+// With the network task receiving, the main loop and waiters only reclaim
+// TX and run TCP timers here; draining the ring themselves would bypass
+// its budget. The exception is the task already processing (waiting on
+// an ARP reply mid-frame), since nobody else would pick the reply up.
+void net_poll() {
+    bool receive = !rx_task || (poll_depth > 0 && poll_owner == process_get_current());
+    net_service(receive ? UINT32_MAX : 0);
+}
+
+void net_get_rx_stats(NetRxStats* out) {
+    *out = rx_stats;
+    out->interrupt_driven = g_active_nic == NIC_E1000 && e1000_has_irq();
+    out->interrupts = g_active_nic == NIC_E1000 ? e1000_get_interrupts() : 0;
+    out->dropped = g_active_nic == NIC_E1000 ? e1000_get_device()->rx_dropped : 0;
+}
+
+bool net_init() {
+    // Drivers post netbufs to their RX rings during init
+    if (!netbuf_init(E1000_NUM_RX_DESC + E1000_NUM_TX_DESC + NETBUF_SPARE)) {
+        return false;
+    }
     
     // Try Intel e1000 first (most common in VMs and laptops)
     if (e1000_init()) {
@@ -100,19 +261,15 @@ bool net_init() {
     g_net_config.gateway = 0;
     g_net_config.configured = false;
     
-
-    return true;
-}
-
-void net_poll() {
-    // Poll the active NIC
-    nic_poll();
-    
-    // Receive packets
-    int len;
-    while ((len = nic_receive(rx_buffer, sizeof(rx_buffer))) > 0) {
-        ethernet_receive(rx_buffer, len);
+    // Interrupt-driven receive where the NIC can do it; the main loop's
+    // net_poll() covers the rest
+    if (g_active_nic == NIC_E1000 && e1000_has_irq()) {
+        scheduler_create_task(net_task);
+        rx_task = true;
+        e1000_set_rx_notify(net_rx_interrupt);
     }
+    
+    return true;
 }
 
 // Configuration getters
@@ -161,7 +318,32 @@ bool net_link_up() {
 
 // Export unified NIC functions for use by other modules
 bool net_send_raw(const void* data, uint16_t length) {
-    return nic_send(data, length);
+    NetBuf* nb = netbuf_alloc(0);
+    if (!nb) return false;
+    uint8_t* p = netbuf_append(nb, length);
+    if (!p) {
+        netbuf_release(nb);
+        return false;
+    }
+    kstring::memcpy(p, data, length);
+    return nic_send(nb);
+}
+
+bool net_send_buf(NetBuf* nb) {
+    if (!nb) return false;
+    return nic_send(nb);
+}
+
+bool net_tx_csum_offload() {
+    return g_active_nic == NIC_E1000 && e1000_csum_offload();
+}
+
+void net_tx_plug() {
+    if (g_active_nic == NIC_E1000) e1000_tx_plug();
+}
+
+void net_tx_unplug() {
+    if (g_active_nic == NIC_E1000) e1000_tx_unplug();
 }
 
 void net_get_mac(uint8_t* out_mac) {
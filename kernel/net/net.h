@@ -1,6 +1,8 @@
 #pragma once
 #include <stdint.h>
 
+struct NetBuf;
+
 // Network configuration
 struct NetConfig {
     uint32_t ip;
@@ -10,10 +12,29 @@ struct NetConfig {
     bool configured;
 };
 
+#define NET_RX_BUDGET 64    // Frames per polling round of the network task
+#define NET_RX_BATCH 32     // Frames taken off the NIC at a time
+
+struct NetRxStats {
+    bool interrupt_driven;      // NIC interrupts wake the network task
+    uint64_t interrupts;
+    uint64_t wakeups;           // Times the network task went from idle to polling
+    uint64_t busy_rounds;       // Rounds that used the whole budget (stayed polling)
+    uint64_t frames;
+    uint64_t dropped;           // RX errors, or no netbuf to refill the ring with
+};
+
 // Network initialization
 bool net_init();
 void net_poll();
 
+// Hold off the network task (and any other poller) while a socket call
+// changes state that receive processing also changes. Reentrant, and the
+// holder's own net_poll() still works; may block, so not from IRQs.
+void net_lock();
+void net_unlock();
+void net_get_rx_stats(NetRxStats* out);
+
 // Configuration getters/setters
 uint32_t net_get_ip();
 uint32_t net_get_netmask();
@@ -31,4 +52,12 @@ bool net_link_up();
 
 // Unified NIC access (for lower layers)
 bool net_send_raw(const void* data, uint16_t length);
+bool net_send_buf(NetBuf* nb);     // Whole frame in nb; consumes the reference
+bool net_tx_csum_offload();        // NIC fills in NETBUF_TX_CSUM_* checksums
 void net_get_mac(uint8_t* out_mac);
+
+// Frames sent between plug and unplug reach the NIC as one batch (a single
+// tail-register write on the e1000). Plugs nest; net_poll() sends whatever
+// is held back, so waiting on the network inside a plug cannot stall.
+void net_tx_plug();
+void net_tx_unplug();
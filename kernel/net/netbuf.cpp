@@ -0,0 +1,125 @@
+#include "netbuf.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "spinlock.h"
+#include "debug.h"
+
+static NetBuf* pool = nullptr;
+static NetBuf* free_list = nullptr;
+static NetBufStats stats;
+
+// Free list and counters are touched with interrupts off; pages are never
+// allocated or freed inside that window, so the reclaim callback cannot
+// find the list half-updated.
+
+// Give cached pages of free buffers back to the PMM. The buffers stay on
+// the free list and get a fresh page when next handed out.
+static uint64_t netbuf_reclaim(uint64_t pages) {
+    uint64_t freed = 0;
+    uint64_t flags = interrupts_save_disable();
+    for (NetBuf* nb = free_list; nb && freed < pages; nb = nb->next) {
+        if (!nb->page) continue;
+        pmm_free_frame((void*)nb->phys);
+        nb->page = nullptr;
+        nb->phys = 0;
+        stats.cached--;
+        freed++;
+    }
+    stats.reclaimed += freed;
+    interrupts_restore(flags);
+    return freed;
+}
+
+bool netbuf_init(uint32_t count) {
+    // Descriptors come from the PMM rather than the heap: big rings need
+    // thousands of them
+    uint64_t pages = ((uint64_t)count * sizeof(NetBuf) + 4095) / 4096;
+    void* phys = pmm_alloc_frames(pages);
+    if (!phys) {
+        DEBUG_ERROR("Netbuf: Failed to allocate pool of %u buffers", count);
+        return false;
+    }
+    pool = (NetBuf*)vmm_phys_to_virt((uint64_t)phys);
+    
+    free_list = nullptr;
+    for (int64_t i = (int64_t)count - 1; i >= 0; i--) {
+        pool[i].page = nullptr;
+        pool[i].phys = 0;
+        pool[i].refs = 0;
+        pool[i].next = free_list;
+        free_list = &pool[i];
+    }
+    stats.total = count;
+    pmm_register_reclaim(netbuf_reclaim);
+    DEBUG_INFO("Netbuf: Pool of %u buffers", count);
+    return true;
+}
+
+NetBuf* netbuf_alloc(uint16_t headroom) {
+    if (headroom > NETBUF_SIZE) return nullptr;
+
+    uint64_t flags = interrupts_save_disable();
+    NetBuf* nb = free_list;
+    if (nb) {
+        free_list = nb->next;
+        if (nb->page) stats.cached--;
+        stats.in_use++;
+    } else {
+        stats.failures++;
+    }
+    interrupts_restore(flags);
+    if (!nb) return nullptr;
+
+    if (!nb->page) {
+        void* phys = pmm_alloc_frame();
+        if (!phys) {
+            flags = interrupts_save_disable();
+            nb->next = free_list;
+            free_list = nb;
+            stats.in_use--;
+            stats.failures++;
+            interrupts_restore(flags);
+            return nullptr;
+        }
+        nb->phys = (uint64_t)phys;
+        nb->page = (uint8_t*)vmm_phys_to_virt(nb->phys);
+    }
+
+    nb->head = headroom;
+    nb->len = 0;
+    nb->refs = 1;
+    nb->csum = 0;
+    nb->next = nullptr;
+    stats.allocs++;
+    return nb;
+}
+
+NetBuf* netbuf_ref(NetBuf* nb) {
+    uint64_t flags = interrupts_save_disable();
+    nb->refs++;
+    interrupts_restore(flags);
+    return nb;
+}
+
+void netbuf_release(NetBuf* nb) {
+    if (!nb) return;
+    uint64_t flags = interrupts_save_disable();
+    if (nb->refs == 0) {
+        interrupts_restore(flags);
+        DEBUG_WARN("Netbuf: Released a free buffer");
+        return;
+    }
+    if (--nb->refs == 0) {
+        nb->next = free_list;
+        free_list = nb;
+        stats.in_use--;
+        stats.cached++;
+    }
+    interrupts_restore(flags);
+}
+
+void netbuf_get_stats(NetBufStats* out) {
+    uint64_t flags = interrupts_save_disable();
+    *out = stats;
+    interrupts_restore(flags);
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <stdint.h>
+
+// ============================================================================
+// Network Buffers
+// ============================================================================
+// A netbuf is one PMM page holding one frame. Transmit buffers start
+// NETBUF_HEADROOM bytes into the page: the protocol appends its payload, then
+// each layer below prepends its header in place with netbuf_push() (TCP, then
+// IPv4, then Ethernet), and the NIC reads the finished frame straight out of
+// the page. Receive buffers start at the page and are posted to the NIC as
+// they are, so a received frame is handed up without being copied either.
+//
+// Buffers are reference counted. netbuf_alloc() returns one reference; the
+// *_send_buf() functions consume the caller's reference whether or not the
+// frame went out, and a driver that keeps a buffer past the call (hardware
+// still reading it) takes its own with netbuf_ref(). The last
+// netbuf_release() returns the buffer to the pool.
+//
+// The pool is sized at init for what the NIC rings hold plus
+// NETBUF_SPARE for frames being built or handled. Pages of released
+// buffers stay cached for the next allocation until memory runs short;
+// then the PMM reclaim callback gives them back.
+// ============================================================================
+
+#define NETBUF_SIZE         4096
+#define NETBUF_HEADROOM     128     // Ethernet + IPv4 + TCP with room to spare
+#define NETBUF_SPARE        256     // Buffers beyond what the NIC rings hold
+
+// Checksum offload (NetBuf::csum). On TX the sender asks the NIC to fill
+// in these checksums; a TCP/UDP checksum field must then hold the folded
+// pseudo-header sum. On RX the NIC reports which ones it found correct.
+#define NETBUF_TX_CSUM_IP   0x01
+#define NETBUF_TX_CSUM_TCP  0x02
+#define NETBUF_TX_CSUM_UDP  0x04
+#define NETBUF_RX_CSUM_IP   0x10    // IPv4 header checksum verified
+#define NETBUF_RX_CSUM_L4   0x20    // TCP/UDP checksum verified
+
+struct NetBuf {
+    uint8_t* page;          // HHDM mapping of the page (nullptr until first use)
+    uint64_t phys;
+    uint16_t head;          // Offset of the first byte of the frame
+    uint16_t len;           // Bytes from head
+    uint16_t refs;
+    uint8_t csum;           // NETBUF_TX_CSUM_* / NETBUF_RX_CSUM_*
+    NetBuf* next;           // Free list
+};
+
+struct NetBufStats {
+    uint32_t total;         // Pool size
+    uint32_t in_use;        // Buffers handed out
+    uint32_t cached;        // Free buffers that still hold a page
+    uint64_t allocs;
+    uint64_t failures;      // Pool exhausted or no page
+    uint64_t reclaimed;     // Cached pages given back under memory pressure
+};
+
+// Set up a pool of count buffers and register with memory-pressure reclaim
+bool netbuf_init(uint32_t count);
+
+// Empty buffer with headroom bytes free in front; nullptr if none is left
+NetBuf* netbuf_alloc(uint16_t headroom);
+
+NetBuf* netbuf_ref(NetBuf* nb);
+void netbuf_release(NetBuf* nb);
+
+static inline uint8_t* netbuf_data(NetBuf* nb) {
+    return nb->page + nb->head;
+}
+
+static inline uint64_t netbuf_phys(const NetBuf* nb) {
+    return nb->phys + nb->head;
+}
+
+static inline uint16_t netbuf_tailroom(const NetBuf* nb) {
+    return (uint16_t)(NETBUF_SIZE - nb->head - nb->len);
+}
+
+// Grow the frame at the front by n bytes and return the new start;
+// nullptr if the headroom is used up
+static inline uint8_t* netbuf_push(NetBuf* nb, uint16_t n) {
+    if (nb->head < n) return nullptr;
+    nb->head -= n;
+    nb->len += n;
+    return nb->page + nb->head;
+}
+
+// Strip n bytes off the front (a header that has been handled)
+static inline uint8_t* netbuf_pull(NetBuf* nb, uint16_t n) {
+    if (nb->len < n) return nullptr;
+    nb->head += n;
+    nb->len -= n;
+    return nb->page + nb->head;
+}
+
+// Grow the frame at the end by n bytes and return where they go;
+// nullptr if the page is full
+static inline uint8_t* netbuf_append(NetBuf* nb, uint16_t n) {
+    if (netbuf_tailroom(nb) < n) return nullptr;
+    uint8_t* p = nb->page + nb->head + nb->len;
+    nb->len += n;
+    return p;
+}
+
+void netbuf_get_stats(NetBufStats* out);
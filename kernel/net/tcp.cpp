@@ -9,6 +9,9 @@
  *   - Connection establishment (3-way handshake)
  *   - Data transmission with sequence numbers
  *   - Acknowledgement and basic retransmission
+ *   - Zero-copy transmit queue: segments are built from references to
+ *     the caller's memory (boot image files, pipe pages, file pages),
+ *     held until the peer ACKs them (tcp_sendfile, tcp_splice)
  *   - Connection teardown
  *
  * TCP State Machine:
@@ -36,67 +39,62 @@
 #include "heap.h"
 #include "scheduler.h"
 #include "spinlock.h"
+#include "kstring.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "vfs.h"
+#include "pipe.h"
+#include "netbuf.h"
+
+#define TCP_TX_PAGE_SIZE 4096   // File data is read into PMM frames
 
 static TcpSocket sockets[TCP_MAX_SOCKETS];
 static uint16_t next_ephemeral_port = 49152;
+static TcpStats stats;
+
+// Sequence number comparison modulo 2^32
+static inline bool seq_lt(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+static inline bool seq_le(uint32_t a, uint32_t b) { return (int32_t)(a - b) <= 0; }
+
+// Fresh transmit state for a socket taking a new connection
+static void tcp_reset_tx(TcpSocket* s) {
+    s->tx_head = s->tx_tail = nullptr;
+    s->tx_queued = 0;
+    s->send_window = TCP_WINDOW_SIZE;
+    s->retries = 0;
+}
 
 void tcp_init() {
     for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
         sockets[i].in_use = false;
         sockets[i].state = TCP_CLOSED;
+        tcp_reset_tx(&sockets[i]);
     }
     DEBUG_INFO("TCP: Layer initialized (%d sockets)", TCP_MAX_SOCKETS);
 }
 
-// Pseudo-header for checksum
-struct TcpPseudoHeader {
-    uint32_t src_ip;
-    uint32_t dst_ip;
-    uint8_t zero;
-    uint8_t protocol;
-    uint16_t tcp_length;
-} __attribute__((packed));
-
-// Static lock for tcp_checksum buffer
-static Spinlock tcp_checksum_lock;
-
-// Calculate TCP checksum
+// Calculate TCP checksum. The pseudo-header is summed on its own, so the
+// segment is not staged into a scratch buffer first. Over a received
+// segment, checksum field included, a good one gives 0.
 static uint16_t tcp_checksum(uint32_t src_ip, uint32_t dst_ip, const void* tcp_data, uint16_t length) {
-    // Use static buffer to avoid heap allocation overhead per packet
-    // Protected by spinlock in case of preemption between tasks
-    static uint8_t buffer[1600];
-    
-    spinlock_acquire(&tcp_checksum_lock);
-    
-    TcpPseudoHeader* pseudo = (TcpPseudoHeader*)buffer;
-    
-    pseudo->src_ip = src_ip;
-    pseudo->dst_ip = dst_ip;
-    pseudo->zero = 0;
-    pseudo->protocol = IP_PROTO_TCP;
-    pseudo->tcp_length = htons(length);
-    
-    const uint8_t* src = (const uint8_t*)tcp_data;
-    for (uint16_t i = 0; i < length; i++) {
-        buffer[sizeof(TcpPseudoHeader) + i] = src[i];
-    }
-    
-    uint16_t result = ipv4_checksum(buffer, sizeof(TcpPseudoHeader) + length);
-    spinlock_release(&tcp_checksum_lock);
-    return result;
+    uint32_t sum = ipv4_pseudo_sum(src_ip, dst_ip, IP_PROTO_TCP, length);
+    sum = ipv4_checksum_add(sum, tcp_data, length);
+    return (uint16_t)~ipv4_checksum_fold(sum);
 }
 
-// Send TCP segment
-static bool tcp_send_segment(TcpSocket* sock, uint8_t flags, const void* data, uint16_t length) {
-    // Allocate packet buffer on heap to avoid stack overflow
-    uint8_t* packet = (uint8_t*)malloc(1500);
-    if (!packet) return false;
+// Send one TCP segment with sequence number seq. The segment is built in
+// a netbuf behind the headroom IPv4 and Ethernet prepend into, so the
+// payload is copied once, from the transmit queue, and the NIC sends it
+// from there.
+static bool tcp_send_segment_at(TcpSocket* sock, uint32_t seq, uint8_t flags, const void* data, uint16_t length) {
+    NetBuf* nb = netbuf_alloc(NETBUF_HEADROOM);
+    if (!nb) return false;
     
-    TcpHeader* hdr = (TcpHeader*)packet;
+    TcpHeader* hdr = (TcpHeader*)netbuf_append(nb, TCP_HEADER_SIZE);
     
     hdr->src_port = htons(sock->local_port);
     hdr->dst_port = htons(sock->remote_port);
-    hdr->seq_num = htonl(sock->send_next);
+    hdr->seq_num = htonl(seq);
     hdr->ack_num = (flags & TCP_FLAG_ACK) ? htonl(sock->ack_num) : 0;
     hdr->data_offset = (TCP_HEADER_SIZE / 4) << 4;  // 5 * 4 = 20 bytes
     hdr->flags = flags;
@@ -106,16 +104,31 @@ static bool tcp_send_segment(TcpSocket* sock, uint8_t flags, const void* data, u
     
     // Copy payload
     if (data && length > 0) {
-        uint8_t* payload = packet + TCP_HEADER_SIZE;
-        const uint8_t* src = (const uint8_t*)data;
-        for (uint16_t i = 0; i < length; i++) {
-            payload[i] = src[i];
+        uint8_t* payload = netbuf_append(nb, length);
+        if (!payload) {
+            netbuf_release(nb);
+            return false;
         }
+        kstring::memcpy(payload, data, length);
     }
     
-    // Calculate checksum
-    uint16_t total_len = TCP_HEADER_SIZE + length;
-    hdr->checksum = tcp_checksum(net_get_ip(), sock->remote_ip, packet, total_len);
+    // Calculate checksum. With offload the NIC sums the segment and adds
+    // it to the pseudo-header sum left in the field.
+    if (net_tx_csum_offload()) {
+        hdr->checksum = ipv4_checksum_fold(ipv4_pseudo_sum(net_get_ip(), sock->remote_ip, IP_PROTO_TCP, nb->len));
+        nb->csum |= NETBUF_TX_CSUM_TCP;
+    } else {
+        hdr->checksum = tcp_checksum(net_get_ip(), sock->remote_ip, hdr, nb->len);
+    }
+    
+    sock->last_activity = timer_get_ticks();
+    
+    return ipv4_send_buf(sock->remote_ip, IP_PROTO_TCP, nb);
+}
+
+// Send TCP segment at send_next
+static bool tcp_send_segment(TcpSocket* sock, uint8_t flags, const void* data, uint16_t length) {
+    uint32_t seq = sock->send_next;
     
     // Update sequence number for data and SYN/FIN
     if (length > 0) {
@@ -125,11 +138,189 @@ static bool tcp_send_segment(TcpSocket* sock, uint8_t flags, const void* data, u
         sock->send_next++;
     }
     
-    sock->last_activity = timer_get_ticks();
+    return tcp_send_segment_at(sock, seq, flags, data, length);
+}
+
+// ============================================================================
+// Transmit Queue
+// ============================================================================
+// Queued data is sent from its TcpTxRef and only copied into each outgoing
+// packet. Socket send state (send_next, send_una, the window, the list) is
+// also changed by ACKs arriving on whichever task handles frames, so the
+// socket calls below change it under net_lock(). The list itself is only
+// touched with interrupts off, for tcp_get_stats().
+
+static bool tcp_can_send(const TcpSocket* s) {
+    return s->state == TCP_ESTABLISHED || s->state == TCP_CLOSE_WAIT;
+}
+
+// Drop the references the peer has ACKed (every one if all is set) and run
+// their release callbacks once the list is consistent again
+static void tcp_release_refs(TcpSocket* s, bool all) {
+    TcpTxRef* done = nullptr;
+    TcpTxRef** done_tail = &done;
+    
+    uint64_t flags = interrupts_save_disable();
+    while (s->tx_head && (all || seq_le(s->tx_head->seq + s->tx_head->length, s->send_una))) {
+        TcpTxRef* ref = s->tx_head;
+        s->tx_head = ref->next;
+        s->tx_queued -= ref->length;
+        stats.tx_refs--;
+        stats.tx_ref_bytes -= ref->length;
+        if (!all) stats.bytes_acked += ref->length;
+        ref->next = nullptr;
+        *done_tail = ref;
+        done_tail = &ref->next;
+    }
+    if (!s->tx_head) s->tx_tail = nullptr;
+    interrupts_restore(flags);
+    
+    while (done) {
+        TcpTxRef* ref = done;
+        done = ref->next;
+        if (ref->release) ref->release(ref->ctx);
+        free(ref);
+    }
+}
+
+// Queued bytes at seq: where they are and how many (up to max) are contiguous
+static const uint8_t* tcp_queued_at(TcpSocket* s, uint32_t seq, uint32_t max, uint32_t* len) {
+    const uint8_t* data = nullptr;
+    uint64_t flags = interrupts_save_disable();
+    for (TcpTxRef* ref = s->tx_head; ref; ref = ref->next) {
+        uint32_t off = seq - ref->seq;
+        if (off < ref->length) {
+            data = ref->data + off;
+            *len = ref->length - off < max ? ref->length - off : max;
+            break;
+        }
+    }
+    interrupts_restore(flags);
+    return data;
+}
+
+// Send unsent data while the peer's window has room. Segments never span
+// two references, and the NIC is told about them once, as a batch.
+static void tcp_push(TcpSocket* s) {
+    net_tx_plug();
+    while (seq_lt(s->send_next, s->tx_end)) {
+        uint32_t in_flight = s->send_next - s->send_una;
+        // A zero window still gets a one-byte probe while nothing is in flight
+        uint32_t window = s->send_window ? s->send_window : 1;
+        if (in_flight >= window) break;
+        
+        uint32_t room = window - in_flight;
+        uint32_t len;
+        const uint8_t* data = tcp_queued_at(s, s->send_next, room < TCP_MSS ? room : TCP_MSS, &len);
+        if (!data) break;
+        
+        if (in_flight == 0) s->rto_start = timer_get_ticks();
+        if (!tcp_send_segment(s, TCP_FLAG_ACK | TCP_FLAG_PSH, data, (uint16_t)len)) break;
+    }
+    net_tx_unplug();
+}
+
+// Send everything in flight again (go-back-N)
+static void tcp_retransmit(TcpSocket* s) {
+    uint32_t end = seq_lt(s->send_next, s->tx_end) ? s->send_next : s->tx_end;
+    uint32_t seq = s->send_una;
+    net_tx_plug();
+    while (seq_lt(seq, end)) {
+        uint32_t left = end - seq;
+        uint32_t len;
+        const uint8_t* data = tcp_queued_at(s, seq, left < TCP_MSS ? left : TCP_MSS, &len);
+        if (!data) break;
+        tcp_send_segment_at(s, seq, TCP_FLAG_ACK | TCP_FLAG_PSH, data, (uint16_t)len);
+        stats.retransmits++;
+        seq += len;
+    }
+    net_tx_unplug();
+}
+
+// Take an ACK: update the window, advance send_una and drop what it covers
+static void tcp_process_ack(TcpSocket* s, uint32_t ack, uint16_t window) {
+    if (seq_lt(ack, s->send_una) || seq_lt(s->send_next, ack)) {
+        return;  // Old, or for data never sent
+    }
+    s->send_window = window;
+    if (ack == s->send_una) return;
     
-    bool result = ipv4_send(sock->remote_ip, IP_PROTO_TCP, packet, total_len);
-    free(packet);
-    return result;
+    s->send_una = ack;
+    s->retries = 0;
+    s->rto_start = timer_get_ticks();
+    tcp_release_refs(s, false);
+}
+
+// Append a reference to the queue and send what the window allows
+static bool tcp_queue(TcpSocket* s, const uint8_t* data, uint32_t length,
+                      TcpTxRelease release, void* ctx, bool copied) {
+    if (length == 0 || length > TCP_TX_REF_MAX || s->tx_queued + length > TCP_TX_QUEUE_MAX) {
+        return false;
+    }
+    TcpTxRef* ref = (TcpTxRef*)malloc(sizeof(TcpTxRef));
+    if (!ref) return false;
+    ref->data = data;
+    ref->length = length;
+    ref->release = release;
+    ref->ctx = ctx;
+    ref->next = nullptr;
+    
+    net_lock();
+    uint64_t flags = interrupts_save_disable();
+    if (!s->tx_head) s->tx_end = s->send_next;  // Everything before was ACKed
+    ref->seq = s->tx_end;
+    if (s->tx_tail) s->tx_tail->next = ref;
+    else s->tx_head = ref;
+    s->tx_tail = ref;
+    s->tx_end += length;
+    s->tx_queued += length;
+    stats.tx_refs++;
+    stats.tx_ref_bytes += length;
+    if (copied) stats.copied_bytes += length;
+    else stats.zero_copy_bytes += length;
+    interrupts_restore(flags);
+    
+    tcp_push(s);
+    net_unlock();
+    return true;
+}
+
+// Poll the network until the queue has room for length more bytes; false
+// once the socket can no longer send
+static bool tcp_wait_room(TcpSocket* s, uint32_t length) {
+    while (tcp_can_send(s) && s->tx_queued + length > TCP_TX_QUEUE_MAX) {
+        net_poll();
+        scheduler_yield();
+    }
+    return tcp_can_send(s);
+}
+
+// Release callback for file and pipe pages (HHDM addresses)
+static void tcp_free_page(void* page) {
+    pmm_free_frame((void*)((uint64_t)page - vmm_get_hhdm_offset()));
+}
+
+void tcp_poll() {
+    uint64_t now = timer_get_ticks();
+    for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
+        TcpSocket* s = &sockets[i];
+        if (!s->in_use || !s->tx_head || s->send_una == s->send_next) continue;
+        
+        uint64_t rto = ((uint64_t)TCP_RTO_MS << s->retries) * timer_get_frequency() / 1000;
+        if (now - s->rto_start < rto) continue;
+        
+        if (++s->retries > TCP_MAX_RETRIES) {
+            DEBUG_WARN("TCP: No ACK from port %d, dropping connection", s->remote_port);
+            // Sockets their owner already closed are not coming back for cleanup
+            bool orphaned = !tcp_can_send(s);
+            s->state = TCP_CLOSED;
+            tcp_release_refs(s, true);
+            if (orphaned) s->in_use = false;
+            continue;
+        }
+        tcp_retransmit(s);
+        s->rto_start = now;
+    }
 }
 
 // Find socket for incoming segment
@@ -158,16 +349,23 @@ static TcpSocket* tcp_find_socket(uint32_t src_ip, uint16_t src_port, uint16_t d
 }
 
 // Receive TCP segment
-void tcp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t dst_ip) {
+void tcp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t dst_ip, uint8_t csum) {
     if (length < TCP_HEADER_SIZE) {
         return;
     }
     
+    // Verify checksum unless the NIC already did
+    if (!(csum & NETBUF_RX_CSUM_L4) && tcp_checksum(src_ip, dst_ip, data, length) != 0) {
+        DEBUG_WARN("TCP: Bad checksum");
+        return;
+    }
+    
     const TcpHeader* hdr = (const TcpHeader*)data;
     uint16_t src_port = ntohs(hdr->src_port);
     uint16_t dst_port = ntohs(hdr->dst_port);
     uint32_t seq = ntohl(hdr->seq_num);
     uint32_t ack = ntohl(hdr->ack_num);
+    uint16_t window = ntohs(hdr->window);
     uint8_t flags = hdr->flags;
     uint8_t header_len = (hdr->data_offset >> 4) * 4;
     
@@ -184,6 +382,11 @@ void tcp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t ds
         return;
     }
     
+    // ACKs free transmit references and open the window
+    if ((flags & TCP_FLAG_ACK) && sock->state != TCP_LISTEN) {
+        tcp_process_ack(sock, ack, window);
+    }
+    
     switch (sock->state) {
         case TCP_LISTEN:
             if (flags & TCP_FLAG_SYN) {
@@ -205,7 +408,10 @@ void tcp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t ds
                     new_sock->ack_num = seq + 1;
                     new_sock->seq_num = timer_get_ticks() & 0xFFFFFFFF;
                     new_sock->send_next = new_sock->seq_num;
+                    new_sock->send_una = new_sock->seq_num;
                     new_sock->rx_head = new_sock->rx_tail = 0;
+                    tcp_reset_tx(new_sock);
+                    new_sock->send_window = window;
                     
                     // Send SYN-ACK
                     tcp_send_segment(new_sock, TCP_FLAG_SYN | TCP_FLAG_ACK, nullptr, 0);
@@ -294,6 +500,7 @@ void tcp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t ds
         case TCP_LAST_ACK:
             if (flags & TCP_FLAG_ACK) {
                 sock->state = TCP_CLOSED;
+                tcp_release_refs(sock, true);
                 sock->in_use = false;
             }
             break;
@@ -309,20 +516,29 @@ void tcp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t ds
             break;
     }
     
+    // The ACK may have opened room for more queued data
+    if (tcp_can_send(sock)) {
+        tcp_push(sock);
+    }
+    
     (void)dst_ip;
-    (void)ack;
 }
 
 // Create TCP socket
 int tcp_socket() {
+    // A SYN on a listening socket claims free slots too
+    net_lock();
     for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
         if (!sockets[i].in_use) {
             sockets[i].in_use = true;
             sockets[i].state = TCP_CLOSED;
             sockets[i].rx_head = sockets[i].rx_tail = 0;
+            tcp_reset_tx(&sockets[i]);
+            net_unlock();
             return i;
         }
     }
+    net_unlock();
     return -1;
 }
 
@@ -371,15 +587,18 @@ bool tcp_connect(int sock, uint32_t dst_ip, uint16_t dst_port) {
     }
     
     TcpSocket* s = &sockets[sock];
+    net_lock();
     s->remote_ip = dst_ip;
     s->remote_port = dst_port;
     s->local_port = next_ephemeral_port++;
     s->seq_num = timer_get_ticks() & 0xFFFFFFFF;
     s->send_next = s->seq_num;
+    s->send_una = s->seq_num;
     s->state = TCP_SYN_SENT;
     
     // Send SYN
     tcp_send_segment(s, TCP_FLAG_SYN, nullptr, 0);
+    net_unlock();
     
     // Wait for connection (with timeout)
     uint64_t start = timer_get_ticks();
@@ -393,22 +612,37 @@ bool tcp_connect(int sock, uint32_t dst_ip, uint16_t dst_port) {
     return s->state == TCP_ESTABLISHED;
 }
 
-// Send data
+// Send data (queues a copy; returns how much fit, 0 if the queue is full)
 int tcp_send(int sock, const void* data, uint16_t length) {
     if (sock < 0 || sock >= TCP_MAX_SOCKETS || 
-        !sockets[sock].in_use || sockets[sock].state != TCP_ESTABLISHED) {
+        !sockets[sock].in_use || !tcp_can_send(&sockets[sock])) {
         return -1;
     }
     
     TcpSocket* s = &sockets[sock];
     
-    // Simple: send all at once (no segmentation)
-    uint16_t send_len = length;
-    if (send_len > 1400) send_len = 1400;  // MSS
+    // ACKs only shrink the queue, but the room and the queueing go together
+    net_lock();
+    uint32_t room = TCP_TX_QUEUE_MAX - s->tx_queued;
+    uint16_t send_len = length < room ? length : (uint16_t)room;
+    if (send_len == 0) {
+        net_unlock();
+        return 0;
+    }
     
-    if (!tcp_send_segment(s, TCP_FLAG_ACK | TCP_FLAG_PSH, data, send_len)) {
+    // The caller may reuse its buffer at once, so the queue gets a copy
+    uint8_t* copy = (uint8_t*)malloc(send_len);
+    if (!copy) {
+        net_unlock();
+        return -1;
+    }
+    kstring::memcpy(copy, data, send_len);
+    if (!tcp_queue(s, copy, send_len, free, copy, true)) {
+        net_unlock();
+        free(copy);
         return -1;
     }
+    net_unlock();
     
     return send_len;
 }
@@ -439,6 +673,13 @@ void tcp_close(int sock) {
     
     TcpSocket* s = &sockets[sock];
     
+    // The FIN goes after everything queued, so let that out first
+    while (tcp_can_send(s) && seq_lt(s->send_next, s->tx_end)) {
+        net_poll();
+        scheduler_yield();
+    }
+    
+    net_lock();
     switch (s->state) {
         case TCP_ESTABLISHED:
             s->state = TCP_FIN_WAIT_1;
@@ -450,9 +691,11 @@ void tcp_close(int sock) {
             break;
         default:
             s->state = TCP_CLOSED;
+            tcp_release_refs(s, true);
             s->in_use = false;
             break;
     }
+    net_unlock();
 }
 
 // Get socket state
@@ -462,3 +705,115 @@ TcpState tcp_get_state(int sock) {
     }
     return sockets[sock].state;
 }
+
+// ============================================================================
+// Zero-Copy Transmit
+// ============================================================================
+
+bool tcp_send_ref(int sock, const uint8_t* data, uint32_t length, TcpTxRelease release, void* ctx) {
+    if (sock < 0 || sock >= TCP_MAX_SOCKETS || 
+        !sockets[sock].in_use || !tcp_can_send(&sockets[sock])) {
+        return false;
+    }
+    return tcp_queue(&sockets[sock], data, length, release, ctx, false);
+}
+
+int64_t tcp_sendfile(int sock, const char* path, uint64_t offset, uint64_t length) {
+    if (sock < 0 || sock >= TCP_MAX_SOCKETS || 
+        !sockets[sock].in_use || !tcp_can_send(&sockets[sock])) {
+        return -1;
+    }
+    TcpSocket* s = &sockets[sock];
+    
+    VfsFile* file = vfs_file_open(path);
+    if (!file) return -1;
+    uint64_t size = vfs_file_size(file);
+    if (offset >= size) length = 0;
+    else if (length > size - offset) length = size - offset;
+    
+    // Boot image files never change, so the queue can point straight at them
+    const uint8_t* mapped = vfs_file_map(file);
+    
+    uint64_t queued = 0;
+    while (queued < length) {
+        uint64_t left = length - queued;
+        if (mapped) {
+            uint32_t n = left < TCP_TX_REF_MAX ? (uint32_t)left : TCP_TX_REF_MAX;
+            if (!tcp_wait_room(s, n) ||
+                !tcp_queue(s, mapped + offset + queued, n, nullptr, nullptr, false)) {
+                break;
+            }
+            queued += n;
+            continue;
+        }
+        
+        // Anything else can change under the queue: read it into a page the
+        // socket owns until the peer ACKs it
+        uint32_t n = left < TCP_TX_PAGE_SIZE ? (uint32_t)left : TCP_TX_PAGE_SIZE;
+        if (!tcp_wait_room(s, n)) break;
+        void* frame = pmm_alloc_frame();
+        if (!frame) break;
+        uint8_t* page = (uint8_t*)frame + vmm_get_hhdm_offset();
+        int64_t got = vfs_file_read(file, offset + queued, page, n);
+        if (got <= 0 || !tcp_queue(s, page, (uint32_t)got, tcp_free_page, page, true)) {
+            pmm_free_frame(frame);
+            break;
+        }
+        queued += (uint64_t)got;
+    }
+    
+    vfs_file_close(file);
+    if (queued == 0 && length > 0) return -1;
+    return (int64_t)queued;
+}
+
+int64_t tcp_splice(int sock, int pipe_id) {
+    if (sock < 0 || sock >= TCP_MAX_SOCKETS || 
+        !sockets[sock].in_use || !tcp_can_send(&sockets[sock])) {
+        return -1;
+    }
+    TcpSocket* s = &sockets[sock];
+    
+    uint64_t queued = 0;
+    bool failed = false;
+    while (!failed) {
+        if (!tcp_wait_room(s, PIPE_PAGE_SIZE)) {
+            failed = true;
+            break;
+        }
+        uint8_t* page;
+        int64_t n = pipe_read_page(pipe_id, &page);
+        if (n <= 0) {
+            failed = n < 0;
+            break;
+        }
+        // Only a page the ring gave away comes back full; partial ones were copied
+        if (!tcp_queue(s, page, (uint32_t)n, tcp_free_page, page, n < PIPE_PAGE_SIZE)) {
+            tcp_free_page(page);
+            failed = true;
+            break;
+        }
+        queued += (uint64_t)n;
+    }
+    
+    if (queued == 0 && failed) return -1;
+    return (int64_t)queued;
+}
+
+bool tcp_flush(int sock) {
+    if (sock < 0 || sock >= TCP_MAX_SOCKETS || !sockets[sock].in_use) {
+        return false;
+    }
+    TcpSocket* s = &sockets[sock];
+    while (s->tx_head && s->state != TCP_CLOSED) {
+        net_poll();
+        scheduler_yield();
+    }
+    return s->state != TCP_CLOSED;
+}
+
+void tcp_get_stats(TcpStats* out) {
+    uint64_t flags = interrupts_save_disable();
+    *out = stats;
+    interrupts_restore(flags);
+}
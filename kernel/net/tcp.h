@@ -41,6 +41,36 @@ struct TcpHeader {
 #define TCP_MAX_SOCKETS 16
 #define TCP_WINDOW_SIZE 4096
 #define TCP_RX_BUFFER_SIZE 4096
+#define TCP_MSS 1400
+#define TCP_TX_QUEUE_MAX (256 * 1024)   // Bytes a socket holds (unsent + unacked)
+#define TCP_TX_REF_MAX (64 * 1024)      // Largest single transmit reference
+#define TCP_RTO_MS 500                  // First retransmission timeout, doubled per retry
+#define TCP_MAX_RETRIES 8               // Then the connection is dropped
+
+// Transmit reference. Queued data is not copied into the socket: segments
+// are built straight from data, which must stay valid and unchanged until
+// the peer has ACKed all of it (or the connection is gone). Then
+// release(ctx) runs, if set, to return the memory (a page, a heap buffer);
+// boot image data needs no release.
+typedef void (*TcpTxRelease)(void* ctx);
+
+struct TcpTxRef {
+    const uint8_t* data;
+    uint32_t length;
+    uint32_t seq;           // Sequence number of data[0]
+    TcpTxRelease release;
+    void* ctx;
+    TcpTxRef* next;
+};
+
+struct TcpStats {
+    uint32_t tx_refs;           // Transmit references held
+    uint64_t tx_ref_bytes;      // ...and the bytes behind them
+    uint64_t bytes_acked;
+    uint64_t zero_copy_bytes;   // Queued by reference (boot image, whole pipe pages)
+    uint64_t copied_bytes;      // Queued by copying (tcp_send, file reads, partial pipe pages)
+    uint64_t retransmits;       // Segments sent again
+};
 
 // TCP Control Block (connection state)
 struct TcpSocket {
@@ -56,6 +86,16 @@ struct TcpSocket {
     
     uint32_t send_next;     // Next seq to send
     uint32_t send_una;      // Oldest unacked seq
+    uint16_t send_window;   // Peer's advertised window
+    
+    // Transmit queue, oldest first. [send_una, send_next) is in flight,
+    // [send_next, tx_end) not sent yet.
+    TcpTxRef* tx_head;
+    TcpTxRef* tx_tail;
+    uint32_t tx_end;        // Seq after the last queued byte
+    uint32_t tx_queued;     // Bytes referenced by the queue
+    uint64_t rto_start;     // When the oldest unacked data was last sent
+    uint8_t retries;
     
     // Receive buffer
     uint8_t rx_buffer[TCP_RX_BUFFER_SIZE];
@@ -69,7 +109,8 @@ struct TcpSocket {
 
 // TCP functions
 void tcp_init();
-void tcp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t dst_ip);
+void tcp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t dst_ip, uint8_t csum);
+void tcp_poll();    // Retransmission timers (called by net_poll)
 
 // Socket-like API
 int tcp_socket();
@@ -81,3 +122,21 @@ int tcp_send(int sock, const void* data, uint16_t length);
 int tcp_recv(int sock, void* buffer, uint16_t max_len);
 void tcp_close(int sock);
 TcpState tcp_get_state(int sock);
+
+// Zero-copy transmit. tcp_send_ref queues data by reference (see TcpTxRef);
+// false if the socket cannot send or the queue is full. The others block
+// while the queue is full and return bytes queued, or -1 if nothing could be.
+bool tcp_send_ref(int sock, const uint8_t* data, uint32_t length, TcpTxRelease release, void* ctx);
+
+// [offset, offset + length) of a file. Boot image files are referenced in
+// place; other files are read into pages that the socket then owns.
+int64_t tcp_sendfile(int sock, const char* path, uint64_t offset, uint64_t length);
+
+// Everything written to a pipe until its write end closes. Full pipe pages
+// move to the socket instead of being copied (pipe_read_page).
+int64_t tcp_splice(int sock, int pipe_id);
+
+// Block until everything queued is ACKed; false if the connection failed
+bool tcp_flush(int sock);
+
+void tcp_get_stats(TcpStats* out);
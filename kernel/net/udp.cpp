@@ -3,7 +3,8 @@
 #include "ethernet.h"
 #include "net.h"
 #include "debug.h"
-#include "heap.h"
+#include "netbuf.h"
+#include "kstring.h"
 
 static UdpSocket sockets[UDP_MAX_SOCKETS];
 
@@ -15,42 +16,17 @@ void udp_init() {
     DEBUG_INFO("UDP: Layer initialized (%d sockets)", UDP_MAX_SOCKETS);
 }
 
-// Pseudo-header for checksum
-struct UdpPseudoHeader {
-    uint32_t src_ip;
-    uint32_t dst_ip;
-    uint8_t zero;
-    uint8_t protocol;
-    uint16_t udp_length;
-} __attribute__((packed));
-
-// Calculate UDP checksum with pseudo-header
-static uint16_t udp_checksum(uint32_t src_ip, uint32_t dst_ip, const void* udp_data, uint16_t length) {
-    // Allocate buffer on heap to avoid stack overflow
-    uint8_t* buffer = (uint8_t*)malloc(1600);
-    if (!buffer) return 0;
-    
-    UdpPseudoHeader* pseudo = (UdpPseudoHeader*)buffer;
-    
-    pseudo->src_ip = src_ip;
-    pseudo->dst_ip = dst_ip;
-    pseudo->zero = 0;
-    pseudo->protocol = IP_PROTO_UDP;
-    pseudo->udp_length = htons(length);
-    
-    // Copy UDP header and data
-    const uint8_t* src = (const uint8_t*)udp_data;
-    for (uint16_t i = 0; i < length; i++) {
-        buffer[sizeof(UdpPseudoHeader) + i] = src[i];
-    }
-    
-    uint16_t result = ipv4_checksum(buffer, sizeof(UdpPseudoHeader) + length);
-    free(buffer);
-    return result;
+// Calculate UDP checksum with pseudo-header, summed on its own so the
+// datagram is not staged into a scratch buffer. Over a received datagram,
+// checksum field included, a good one gives 0.
+static uint16_t udp_checksum(uint32_t src_ip, uint32_t dst_ip, const void* data, uint16_t length) {
+    uint32_t sum = ipv4_pseudo_sum(src_ip, dst_ip, IP_PROTO_UDP, length);
+    sum = ipv4_checksum_add(sum, data, length);
+    return (uint16_t)~ipv4_checksum_fold(sum);
 }
 
 // Receive UDP packet
-void udp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t dst_ip) {
+void udp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t dst_ip, uint8_t csum) {
     if (length < UDP_HEADER_SIZE) {
         return;
     }
@@ -64,6 +40,14 @@ void udp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t ds
         return;
     }
     
+    // Verify checksum unless the NIC already did; 0 means the sender
+    // did not compute one
+    if (!(csum & NETBUF_RX_CSUM_L4) && hdr->checksum != 0 &&
+        udp_checksum(src_ip, dst_ip, data, udp_len) != 0) {
+        DEBUG_WARN("UDP: Bad checksum");
+        return;
+    }
+    
     // Find socket bound to this port
     for (int i = 0; i < UDP_MAX_SOCKETS; i++) {
         if (sockets[i].bound && sockets[i].port == dst_port) {
@@ -91,8 +75,6 @@ void udp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t ds
         uint16_t payload_len = udp_len - UDP_HEADER_SIZE;
         dhcp_receive(payload, payload_len, src_ip);
     }
-    
-    (void)dst_ip; // Unused
 }
 
 // Send UDP packet
@@ -101,11 +83,10 @@ bool udp_send(uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, const void*
         return false;
     }
     
-    // Allocate packet buffer on heap to avoid stack overflow
-    uint8_t* packet = (uint8_t*)malloc(1500);
-    if (!packet) return false;
+    NetBuf* nb = netbuf_alloc(NETBUF_HEADROOM);
+    if (!nb) return false;
     
-    UdpHeader* hdr = (UdpHeader*)packet;
+    UdpHeader* hdr = (UdpHeader*)netbuf_append(nb, UDP_HEADER_SIZE);
     
     hdr->src_port = htons(src_port);
     hdr->dst_port = htons(dst_port);
@@ -113,21 +94,20 @@ bool udp_send(uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, const void*
     hdr->checksum = 0;
     
     // Copy payload
-    uint8_t* payload = packet + UDP_HEADER_SIZE;
-    const uint8_t* src = (const uint8_t*)data;
-    for (uint16_t i = 0; i < length; i++) {
-        payload[i] = src[i];
-    }
-    
-    // Calculate checksum
-    hdr->checksum = udp_checksum(net_get_ip(), dst_ip, packet, UDP_HEADER_SIZE + length);
-    if (hdr->checksum == 0) {
-        hdr->checksum = 0xFFFF;  // 0 means no checksum, use 0xFFFF instead
+    kstring::memcpy(netbuf_append(nb, length), data, length);
+    
+    // Calculate checksum, or seed it with the pseudo-header sum for the NIC
+    if (net_tx_csum_offload()) {
+        hdr->checksum = ipv4_checksum_fold(ipv4_pseudo_sum(net_get_ip(), dst_ip, IP_PROTO_UDP, nb->len));
+        nb->csum |= NETBUF_TX_CSUM_UDP;
+    } else {
+        hdr->checksum = udp_checksum(net_get_ip(), dst_ip, hdr, nb->len);
+        if (hdr->checksum == 0) {
+            hdr->checksum = 0xFFFF;  // 0 means no checksum, use 0xFFFF instead
+        }
     }
     
-    bool result = ipv4_send(dst_ip, IP_PROTO_UDP, packet, UDP_HEADER_SIZE + length);
-    free(packet);
-    return result;
+    return ipv4_send_buf(dst_ip, IP_PROTO_UDP, nb);
 }
 
 // Create UDP socket
@@ -27,7 +27,7 @@ struct UdpSocket {
 
 // UDP functions
 void udp_init();
-void udp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t dst_ip);
+void udp_receive(const void* data, uint16_t length, uint32_t src_ip, uint32_t dst_ip, uint8_t csum);
 bool udp_send(uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, const void* data, uint16_t length);
 
 // Socket-like API
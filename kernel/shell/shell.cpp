@@ -15,10 +15,21 @@
 #include "net/icmp.h"
 #include "net/dhcp.h"
 #include "net/dns.h"
+#include "net/tcp.h"
+#include "net/netbuf.h"
 #include "core/kstring.h"
 #include "mem/heap.h"
 #include "core/version.h"
 #include "core/scheduler.h"
+#include "core/process.h"
+#include "core/image_cache.h"
+#include "drivers/block/blockdev.h"
+#include "drivers/block/blockbench.h"
+#include "fs/bcache.h"
+#include "fs/unifs_disk.h"
+#include "fs/vfs.h"
+#include "fs/pipe.h"
+#include "fs/tmpfs.h"
 #include <stddef.h>
 
 #include "ac97.h"
@@ -40,7 +51,7 @@ enum CmdType {
 
 typedef void (*CmdHandlerNone)();
 typedef void (*CmdHandlerArgs)(const char*);
-typedef void (*CmdHandlerPiped)(const char*, const char*);
+typedef void (*CmdHandlerPiped)(const char*, int);   // args, input pipe (-1 = none)
 
 struct CommandEntry {
     const char* name;
@@ -50,13 +61,13 @@ struct CommandEntry {
     CmdHandlerPiped handler_piped;
 };
 
-// Piping support
-#define PIPE_BUFFER_SIZE 4096
-static char pipe_buffer_a[PIPE_BUFFER_SIZE];
-static char pipe_buffer_b[PIPE_BUFFER_SIZE];
+// Pipelines: each stage but the last runs as its own task, writing into a
+// kernel pipe that the next stage reads
+#define PIPELINE_MAX_STAGES 16
+#define PIPELINE_OUT_BUFFER 512     // Stage output is batched into pipe writes
 
 // Forward declaration for piped command execution
-static bool execute_single_command(const char* cmd, const char* piped_input);
+static bool execute_single_command(const char* cmd, int input_pipe);
 
 
 static char cmd_buffer[256];
@@ -722,7 +733,7 @@ static bool execute_script_line(const char* line) {
         expand_variables(trimmed, expanded, sizeof(expanded));
     }
     
-    bool result = execute_single_command(expanded, nullptr);
+    bool result = execute_single_command(expanded, -1);
     // Only set exit status to 1 if command wasn't recognized
     // Commands like true, false, test set their own exit status
     if (!result) {
@@ -731,35 +742,50 @@ static bool execute_script_line(const char* line) {
     return true;
 }
 
+// Read an open file into a new heap buffer with a NUL after the data
+// (caller frees). nullptr if memory is short or the read fails.
+static char* read_file_copy(VfsFile* file, uint64_t size) {
+    char* data = (char*)malloc(size + 1);
+    if (!data) return nullptr;
+    
+    uint64_t done = 0;
+    while (done < size) {
+        int64_t got = vfs_file_read(file, done, data + done, size - done);
+        if (got <= 0) {
+            free(data);
+            return nullptr;
+        }
+        done += (uint64_t)got;
+    }
+    data[size] = '\0';
+    return data;
+}
+
 // run <script> - execute a script file
 static void cmd_run(const char* filename) {
     // Skip leading spaces
     while (*filename == ' ') filename++;
     
-    // Use unifs_open_into with local buffer to avoid race conditions
-    UniFSFile file;
-    if (!unifs_open_into(filename, &file)) {
+    VfsFile* file = vfs_file_open(filename);
+    if (!file) {
         error_file_not_found(filename);
         last_exit_status = 1;
         return;
     }
     
-    // CRITICAL: Make a heap copy of the script data
-    // This is necessary because script commands (cat, grep, etc.) may call
-    // unifs_open, which would overwrite the static buffer if we used unifs_open.
-    // Even with unifs_open_into, the file->data pointer may point to underlying
-    // storage that could be affected by nested file operations.
-    char* script_data = (char*)malloc(file.size + 1);
+    // CRITICAL: Run from a heap copy of the script data
+    // This is necessary because script commands (cat, grep, etc.) may
+    // write or delete files, including the script itself.
+    uint64_t size = vfs_file_size(file);
+    char* script_data = read_file_copy(file, size);
+    vfs_file_close(file);
     if (!script_data) {
         g_terminal.write_line("Out of memory for script");
         last_exit_status = 1;
         return;
     }
-    kstring::memcpy(script_data, file.data, file.size);
-    script_data[file.size] = '\0';
     
     // Parse script_data into lines
-    uint64_t size = file.size;
     
     script_line_count = 0;
     const char* line_start = script_data;
@@ -821,6 +847,51 @@ static void cmd_run(const char* filename) {
     last_exit_status = 0;
 }
 
+// exec <program> - run a user-space ELF binary and wait for it to exit
+static void cmd_exec(const char* filename) {
+    while (*filename == ' ') filename++;
+    if (*filename == '\0') {
+        error_usage("exec <program>");
+        last_exit_status = 1;
+        return;
+    }
+    
+    VfsFile* file = vfs_file_open(filename);
+    if (!file) {
+        error_file_not_found(filename);
+        last_exit_status = 1;
+        return;
+    }
+    
+    // Boot image files are used in place, so their pages can be mapped
+    // straight from the image. Anything else is read into a copy that only
+    // has to last until the loader has copied (or cached) the segments.
+    uint64_t size = vfs_file_size(file);
+    const uint8_t* data = vfs_file_map(file);
+    char* copy = nullptr;
+    if (!data) {
+        copy = read_file_copy(file, size);
+        data = (const uint8_t*)copy;
+    }
+    int64_t pid = data ? process_exec(vfs_file_path(file), data, size) : -1;
+    if (copy) free(copy);
+    vfs_file_close(file);
+    if (!data) {
+        g_terminal.write_line("exec: cannot read program");
+        last_exit_status = 1;
+        return;
+    }
+    if (pid < 0) {
+        g_terminal.write_line("exec: not a valid x86-64 ELF executable");
+        last_exit_status = 1;
+        return;
+    }
+    
+    int32_t status = 0;
+    process_waitpid(pid, &status);
+    last_exit_status = status;
+}
+
 static void cmd_help() {
     g_terminal.write_line("File Commands:");
     g_terminal.write_line("  ls        - List files with sizes");
@@ -831,7 +902,13 @@ static void cmd_help() {
     g_terminal.write_line("  rm <f>    - Delete file");
     g_terminal.write_line("  write <f> <text> - Write text to file");
     g_terminal.write_line("  append <f> <text> - Append text to file");
+    g_terminal.write_line("  truncate <f> <size> - Set file size");
+    g_terminal.write_line("  punch <f> <off> <len> - Free a range of a /tmp file");
     g_terminal.write_line("  df        - Show filesystem stats");
+    g_terminal.write_line("  mkdir <d> - Create directory (disk volume)");
+    g_terminal.write_line("  sync      - Write disk changes out now");
+    g_terminal.write_line("  snapshot [dev] - Save boot + RAM files to dev, booted next time");
+    g_terminal.write_line("  mkfs <dev> - Format block device as uniFS v2");
     g_terminal.write_line("");
     g_terminal.write_line("System Commands:");
     g_terminal.write_line("  mem       - Show memory usage");
@@ -841,11 +918,15 @@ static void cmd_help() {
     g_terminal.write_line("  uname     - System information");
     g_terminal.write_line("  cpuinfo   - CPU information");
     g_terminal.write_line("  lspci     - List PCI devices");
+    g_terminal.write_line("  lsblk     - List block devices and I/O stats");
+    g_terminal.write_line("  blkbench [dev] - Block IOPS/latency at QD 1-64");
+    g_terminal.write_line("  exec <f>  - Run user program (ELF)");
     g_terminal.write_line("");
     g_terminal.write_line("Network Commands:");
     g_terminal.write_line("  ifconfig  - Show network config");
     g_terminal.write_line("  dhcp      - Request IP via DHCP");
     g_terminal.write_line("  ping <ip> - Ping an IP address");
+    g_terminal.write_line("  sendfile <host> <port> <f> - Send file over TCP");
     g_terminal.write_line("");
     g_terminal.write_line("Audio Commands:");
     g_terminal.write_line("  audio status  - Show AC97 driver status");
@@ -907,7 +988,7 @@ static void cmd_help() {
 }
 
 static void cmd_ls() {
-    uint64_t count = unifs_get_file_count();
+    uint64_t count = vfs_dir_count("/");
     
     if (count == 0) {
         g_terminal.write_line("No files.");
@@ -915,9 +996,9 @@ static void cmd_ls() {
     }
     
     for (uint64_t i = 0; i < count; i++) {
-        const char* name = unifs_get_file_name(i);
-        uint64_t size = unifs_get_file_size_by_index(i);
-        int type = unifs_get_file_type(name);
+        const char* name = vfs_dir_name("/", i);
+        uint64_t size = name ? vfs_get_size(name) : 0;
+        int type = name ? vfs_get_type(name) : UNIFS_TYPE_UNKNOWN;
         
         if (name) {
             // Format size (right-aligned in 8 chars)
@@ -945,6 +1026,7 @@ static void cmd_ls() {
                 case UNIFS_TYPE_TEXT: type_str = "[TXT]"; break;
                 case UNIFS_TYPE_ELF:  type_str = "[ELF]"; break;
                 case UNIFS_TYPE_BINARY: type_str = "[BIN]"; break;
+                case UNIFS_TYPE_DIR:  type_str = "[DIR]"; break;
                 default: type_str = "[???]"; break;
             }
             
@@ -962,13 +1044,13 @@ static void cmd_ls() {
 }
 
 static void cmd_stat(const char* filename) {
-    if (!unifs_file_exists(filename)) {
+    if (!vfs_exists(filename)) {
         error_file_not_found(filename);
         return;
     }
     
-    uint64_t size = unifs_get_file_size(filename);
-    int type = unifs_get_file_type(filename);
+    uint64_t size = vfs_get_size(filename);
+    int type = vfs_get_type(filename);
     
     g_terminal.write("  File: ");
     g_terminal.write_line(filename);
@@ -995,19 +1077,24 @@ static void cmd_stat(const char* filename) {
         case UNIFS_TYPE_TEXT: g_terminal.write_line("Text file"); break;
         case UNIFS_TYPE_ELF: g_terminal.write_line("ELF executable"); break;
         case UNIFS_TYPE_BINARY: g_terminal.write_line("Binary file"); break;
+        case UNIFS_TYPE_DIR: g_terminal.write_line("Directory"); break;
         default: g_terminal.write_line("Unknown"); break;
     }
 }
 
 static void cmd_hexdump(const char* filename) {
-    UniFSFile file;
-    if (!unifs_open_into(filename, &file)) {
+    VfsFile* file = vfs_file_open(filename);
+    if (!file) {
         error_file_not_found(filename);
         return;
     }
     
-    // Limit output to 256 bytes for readability
-    uint64_t display_size = (file.size < 256) ? file.size : 256;
+    // Limit output to 256 bytes for readability; only those are read
+    uint8_t data[256];
+    uint64_t file_size = vfs_file_size(file);
+    int64_t got = vfs_file_read(file, 0, data, sizeof(data));
+    vfs_file_close(file);
+    uint64_t display_size = got > 0 ? (uint64_t)got : 0;
     const char* hex = "0123456789abcdef";
     
     for (uint64_t offset = 0; offset < display_size; offset += 16) {
@@ -1024,8 +1111,8 @@ static void cmd_hexdump(const char* filename) {
         
         // Hex bytes
         for (int i = 0; i < 16; i++) {
-            if (offset + i < file.size) {
-                uint8_t b = file.data[offset + i];
+            if (offset + i < display_size) {
+                uint8_t b = data[offset + i];
                 line[li++] = hex[b >> 4];
                 line[li++] = hex[b & 0xF];
             } else {
@@ -1040,8 +1127,8 @@ static void cmd_hexdump(const char* filename) {
         line[li++] = '|';
         
         // ASCII representation
-        for (int i = 0; i < 16 && offset + i < file.size; i++) {
-            uint8_t b = file.data[offset + i];
+        for (int i = 0; i < 16 && offset + i < display_size; i++) {
+            uint8_t b = data[offset + i];
             line[li++] = (b >= 32 && b < 127) ? b : '.';
         }
         
@@ -1050,27 +1137,42 @@ static void cmd_hexdump(const char* filename) {
         g_terminal.write_line(line);
     }
     
-    if (file.size > 256) {
+    if (file_size > 256) {
         g_terminal.write_line("... (truncated, showing first 256 bytes)");
     }
 }
 
 static void cmd_cat(const char* filename) {
-    UniFSFile file;
-    if (unifs_open_into(filename, &file)) {
-        // Check if it's a text file
-        if (unifs_get_file_type(filename) != UNIFS_TYPE_TEXT) {
-            g_terminal.write_line("Binary file, use 'hexdump' instead.");
-            return;
-        }
-        
-        int row_count = 0;
-        const int max_rows = 20;  // Pause every 20 lines
+    VfsFile* file = vfs_file_open(filename);
+    if (!file) {
+        error_file_not_found(filename);
+        return;
+    }
+    
+    // Check if it's a text file
+    if (vfs_get_type(filename) != UNIFS_TYPE_TEXT) {
+        vfs_file_close(file);
+        g_terminal.write_line("Binary file, use 'hexdump' instead.");
+        return;
+    }
+    
+    // Stream in chunks; sequential reads get read-ahead from the VFS
+    char chunk[1024];
+    uint64_t offset = 0;
+    int row_count = 0;
+    const int max_rows = 20;  // Pause every 20 lines
+    bool paged = !g_terminal.is_redirected();  // Not when feeding a pipeline
+    bool quit = false;
+    
+    while (!quit) {
+        int64_t got = vfs_file_read(file, offset, chunk, sizeof(chunk));
+        if (got <= 0) break;
+        offset += got;
         
-        for (uint64_t i = 0; i < file.size; i++) {
-            g_terminal.put_char(file.data[i]);
+        for (int64_t i = 0; i < got; i++) {
+            g_terminal.put_char(chunk[i]);
             
-            if (file.data[i] == '\n') {
+            if (chunk[i] == '\n' && paged) {
                 row_count++;
                 if (row_count >= max_rows) {
                     g_terminal.write("-- More (q to quit) --");
@@ -1088,22 +1190,21 @@ static void cmd_cat(const char* filename) {
                     
                     // Allow quitting with 'q'
                     if (c == 'q' || c == 'Q') {
-                        g_terminal.write("\n");
-                        return;
+                        quit = true;
+                        break;
                     }
                     
                     row_count = 0;
                 }
             }
         }
-        g_terminal.write("\n");
-    } else {
-        error_file_not_found(filename);
     }
+    g_terminal.write("\n");
+    vfs_file_close(file);
 }
 
 static void cmd_touch(const char* filename) {
-    int result = unifs_create(filename);
+    int result = vfs_create(filename);
     switch (result) {
         case UNIFS_OK:
             g_terminal.write("Created: ");
@@ -1118,13 +1219,106 @@ static void cmd_touch(const char* filename) {
         case UNIFS_ERR_NAME_TOO_LONG:
             g_terminal.write_line("Filename too long (max 63 chars).");
             break;
+        case UNIFS_ERR_NOT_FOUND:
+        case UNIFS_ERR_NOT_DIR:
+            g_terminal.write_line("No such directory.");
+            break;
         default:
             g_terminal.write_line("Error creating file.");
     }
 }
 
+static void cmd_mkdir(const char* dirname) {
+    int result = vfs_mkdir(dirname);
+    switch (result) {
+        case UNIFS_OK:
+            g_terminal.write("Created: ");
+            g_terminal.write_line(dirname);
+            break;
+        case UNIFS_ERR_EXISTS:
+            g_terminal.write_line("File already exists.");
+            break;
+        case UNIFS_ERR_READONLY:
+            g_terminal.write_line("Directories need a disk volume (see mkfs).");
+            break;
+        case UNIFS_ERR_NOT_FOUND:
+        case UNIFS_ERR_NOT_DIR:
+            g_terminal.write_line("No such directory.");
+            break;
+        case UNIFS_ERR_NAME_TOO_LONG:
+            g_terminal.write_line("Name too long (max 63 chars).");
+            break;
+        default:
+            g_terminal.write_line("Error creating directory.");
+    }
+}
+
+// Byte count with an optional K or M suffix; advances args past it
+static bool parse_size_arg(const char*& args, uint64_t* out) {
+    while (*args == ' ') args++;
+    if (*args < '0' || *args > '9') return false;
+    uint64_t value = 0;
+    while (*args >= '0' && *args <= '9') value = value * 10 + (*args++ - '0');
+    if (*args == 'K' || *args == 'k') {
+        value *= 1024;
+        args++;
+    } else if (*args == 'M' || *args == 'm') {
+        value *= 1024 * 1024;
+        args++;
+    }
+    *out = value;
+    return *args == '\0' || *args == ' ';
+}
+
+// truncate <file> <size> and punch <file> <offset> <length>
+static void resize_command(const char* args, bool punch) {
+    char path[VFS_MAX_PATH];
+    while (*args == ' ') args++;
+    int n = 0;
+    while (*args && *args != ' ' && n < VFS_MAX_PATH - 1) path[n++] = *args++;
+    path[n] = '\0';
+    
+    uint64_t offset = 0, length = 0;
+    bool ok = n > 0 && (!punch || parse_size_arg(args, &offset)) && parse_size_arg(args, &length);
+    if (!ok) {
+        error_usage(punch ? "punch <file> <offset> <length>" : "truncate <file> <size>");
+        last_exit_status = 1;
+        return;
+    }
+    
+    int result = punch ? vfs_punch_hole(path, offset, length) : vfs_truncate(path, length);
+    last_exit_status = result == UNIFS_OK ? 0 : 1;
+    switch (result) {
+        case UNIFS_OK:
+            break;
+        case UNIFS_ERR_NOT_FOUND:
+            error_file_not_found(path);
+            break;
+        case UNIFS_ERR_IS_DIR:
+            g_terminal.write_line("Is a directory.");
+            break;
+        case UNIFS_ERR_FULL:
+            g_terminal.write_line("File too large.");
+            break;
+        case UNIFS_ERR_INVALID:
+            g_terminal.write_line(punch ? "Filesystem cannot punch holes (try /tmp)."
+                                        : "Filesystem cannot resize this file.");
+            break;
+        default:
+            g_terminal.write_line("Error resizing file.");
+    }
+}
+
+static void cmd_truncate(const char* args) {
+    resize_command(args, false);
+}
+
+static void cmd_punch(const char* args) {
+    resize_command(args, true);
+}
+
 static void cmd_rm(const char* filename) {
-    int result = unifs_delete(filename);
+    int result = vfs_delete(filename);
     switch (result) {
         case UNIFS_OK:
             g_terminal.write("Deleted: ");
@@ -1139,6 +1333,9 @@ static void cmd_rm(const char* filename) {
         case UNIFS_ERR_IN_USE:
             g_terminal.write_line("Cannot delete: file is currently open.");
             break;
+        case UNIFS_ERR_NOT_EMPTY:
+            g_terminal.write_line("Cannot delete: directory is not empty.");
+            break;
         default:
             g_terminal.write_line("Error deleting file.");
     }
@@ -1223,7 +1420,7 @@ static void cmd_write(const char* args) {
         processed = nullptr;  // Don't double-free
     }
     
-    int result = unifs_write(filename, final_text, processed_len);
+    int result = vfs_write(filename, final_text, processed_len);
     free(final_text);
     if (processed) free(processed);
     
@@ -1236,7 +1433,7 @@ static void cmd_write(const char* args) {
             g_terminal.write_line("Cannot write to boot file (read-only).");
             break;
         case UNIFS_ERR_NO_MEMORY:
-            g_terminal.write_line("Out of memory or file too large.");
+            g_terminal.write_line("Out of memory.");
             break;
         case UNIFS_ERR_FULL:
             g_terminal.write_line("Filesystem full.");
@@ -1293,7 +1490,7 @@ static void cmd_append(const char* args) {
         processed = nullptr;  // Don't double-free
     }
     
-    int result = unifs_append(filename, final_text, processed_len);
+    int result = vfs_append(filename, final_text, processed_len);
     free(final_text);
     if (processed) free(processed);
     
@@ -1306,7 +1503,7 @@ static void cmd_append(const char* args) {
             g_terminal.write_line("Cannot append to boot file (read-only).");
             break;
         case UNIFS_ERR_NO_MEMORY:
-            g_terminal.write_line("Out of memory or file too large.");
+            g_terminal.write_line("Out of memory.");
             break;
         default:
             g_terminal.write_line("Error appending to file.");
@@ -1315,8 +1512,6 @@ static void cmd_append(const char* args) {
 
 static void cmd_df() {
     uint64_t total = unifs_get_total_size();
-    uint64_t free_slots = unifs_get_free_slots();
-    uint64_t file_count = unifs_get_file_count();
     
     char buf[128];
     int i = 0;
@@ -1329,9 +1524,8 @@ static void cmd_df() {
         while (j-- > 0) buf[i++] = tmp[j];
     };
     
-    // Calculate boot vs RAM files (boot files have is_boot flag in uniFS)
     uint64_t boot_file_count = unifs_get_boot_file_count();
-    uint64_t ram_file_count = file_count > boot_file_count ? file_count - boot_file_count : 0;
+    uint64_t ram_file_count = unifs_get_ram_file_count();
     
     // Filesystem summary
     g_terminal.write_line("uniFS Status:");
@@ -1339,19 +1533,54 @@ static void cmd_df() {
     i = 0;
     append_str("  Boot:  ");
     append_num(boot_file_count);
-    append_str(" files (read-only)");
+    append_str(" files (read-only, ");
+    append_num(unifs_get_boot_compressed_count());
+    append_str(" LZ4)");
+    buf[i] = 0;
+    g_terminal.write_line(buf);
+    
+    UniFSVerifyStats verify;
+    unifs_get_verify_stats(&verify);
+    i = 0;
+    append_str("  Check: ");
+    if (!verify.has_checksums) {
+        append_str("no checksums in image");
+    } else {
+        append_num(verify.verified + verify.bad);
+        append_str(" / ");
+        append_num(verify.files);
+        append_str(" files, ");
+        append_num(verify.bad);
+        append_str(" bad, ");
+        append_num(verify.bytes / 1024);
+        append_str(" KB at ");
+        append_num(verify.mb_per_s);
+        append_str(verify.hardware ? " MB/s (crc32)" : " MB/s (slicing-by-8)");
+    }
     buf[i] = 0;
     g_terminal.write_line(buf);
     
     i = 0;
     append_str("  RAM:   ");
     append_num(ram_file_count);
-    append_str(" / ");
-    append_num(64);  // UNIFS_MAX_FILES
     append_str(" files");
     buf[i] = 0;
     g_terminal.write_line(buf);
     
+    UniFSSnapshotStats snap;
+    unifs_get_snapshot_stats(&snap);
+    if (snap.device) {
+        i = 0;
+        append_str("  Snap:  #");
+        append_num(snap.sequence);
+        append_str(" on ");
+        append_str(snap.device);
+        append_str(snap.restored ? " (booted from it)" : "");
+        append_str(snap.dirty ? ", RAM changed since" : ", up to date");
+        buf[i] = 0;
+        g_terminal.write_line(buf);
+    }
+    
     i = 0;
     append_str("  Used:  ");
     if (total >= 1024) {
@@ -1363,6 +1592,200 @@ static void cmd_df() {
     }
     buf[i] = 0;
     g_terminal.write_line(buf);
+    
+    BcacheStats cache;
+    bcache_get_stats(&cache);
+    i = 0;
+    append_str("  Cache: ");
+    append_num(cache.buffers * (BCACHE_BLOCK_SIZE / 1024));
+    append_str(" KB (");
+    append_num(cache.dirty);
+    append_str(" dirty), ");
+    append_num(cache.hits);
+    append_str(" hits, ");
+    append_num(cache.misses);
+    append_str(" misses");
+    buf[i] = 0;
+    g_terminal.write_line(buf);
+    
+    VfsStats vfs;
+    vfs_get_stats(&vfs);
+    i = 0;
+    append_str("  VFS:   ");
+    append_num(vfs.mounts);
+    append_str(" mounts, ");
+    append_num(vfs.dentries);
+    append_str(" dentries, ");
+    append_num(vfs.hits);
+    append_str(" / ");
+    append_num(vfs.lookups);
+    append_str(" lookups cached");
+    buf[i] = 0;
+    g_terminal.write_line(buf);
+    
+    i = 0;
+    append_str("  Read:  ");
+    append_num(vfs.open_files);
+    append_str(" open, ");
+    append_num(vfs.readahead_bytes / 1024);
+    append_str(" KB read ahead in ");
+    append_num(vfs.readahead_windows);
+    append_str(" windows, ");
+    append_num(vfs.async_reads);
+    append_str(" async reads");
+    buf[i] = 0;
+    g_terminal.write_line(buf);
+    
+    TmpfsStats tmp;
+    tmpfs_get_stats(&tmp);
+    i = 0;
+    append_str("  tmpfs: /tmp, ");
+    append_num(tmp.data_pages * (TMPFS_PAGE_SIZE / 1024));
+    append_str(" / ");
+    append_num(tmp.quota_pages * (TMPFS_PAGE_SIZE / 1024));
+    append_str(" KB used (");
+    append_num(tmp.bytes / 1024);
+    append_str(" KB in ");
+    append_num(tmp.files);
+    append_str(" files), ");
+    append_num(tmp.index_pages);
+    append_str(" index pages");
+    buf[i] = 0;
+    g_terminal.write_line(buf);
+    
+    UniFSVolume* vol = unifs_get_disk_volume();
+    if (vol) {
+        UniFSVolumeStats vs;
+        unifs_disk_statfs(vol, &vs);
+        i = 0;
+        append_str("  Disk:  ");
+        append_str(unifs_disk_device(vol)->name);
+        append_str(", ");
+        append_num((vs.block_count - vs.free_blocks) * (UNIFS2_BLOCK_SIZE / 1024));
+        append_str(" / ");
+        append_num(vs.block_count * (UNIFS2_BLOCK_SIZE / 1024));
+        append_str(" KB used, ");
+        append_num(vs.free_inodes);
+        append_str(" inodes free");
+        buf[i] = 0;
+        g_terminal.write_line(buf);
+
+        i = 0;
+        append_str("  Journal: ");
+        append_num(vs.commits);
+        append_str(" commits, ");
+        append_num(vs.logged_blocks);
+        append_str(" blocks logged, ");
+        append_num(vs.replayed);
+        append_str(" replayed at mount");
+        buf[i] = 0;
+        g_terminal.write_line(buf);
+    }
+}
+
+static void cmd_sync() {
+    UniFSSnapshotStats snap;
+    unifs_get_snapshot_stats(&snap);
+    if (!unifs_get_disk_volume() && !snap.device) {
+        g_terminal.write_line("No disk volume or snapshot device (see mkfs, snapshot).");
+        return;
+    }
+    if (vfs_sync() != UNIFS_OK) {
+        g_terminal.write_line("sync: write error");
+    }
+}
+
+static void cmd_snapshot(const char* args) {
+    while (args && *args == ' ') args++;
+    UniFSSnapshotStats snap;
+    if (args && *args) {
+        BlockDevice* dev = block_find(args);
+        if (!dev) {
+            g_terminal.write_line("snapshot: no such device (see lsblk)");
+            return;
+        }
+        switch (unifs_snapshot(dev)) {
+            case UNIFS_OK:
+                break;
+            case UNIFS_ERR_IN_USE:
+                g_terminal.write_line("snapshot: device holds the mounted volume");
+                return;
+            case UNIFS_ERR_READONLY:
+                g_terminal.write_line("snapshot: device is read-only");
+                return;
+            case UNIFS_ERR_INVALID:
+                g_terminal.write_line("snapshot: unsupported sector size or device too small");
+                return;
+            case UNIFS_ERR_FULL:
+                g_terminal.write_line("snapshot: does not fit in half the device");
+                return;
+            case UNIFS_ERR_NO_MEMORY:
+                g_terminal.write_line("Out of memory.");
+                return;
+            default:
+                g_terminal.write_line("snapshot: write error");
+                return;
+        }
+    }
+    
+    unifs_get_snapshot_stats(&snap);
+    if (!snap.device) {
+        g_terminal.write_line("No snapshot device. Usage: snapshot <dev> (see lsblk)");
+        return;
+    }
+    
+    char buf[128];
+    int i = 0;
+    auto append_str = [&](const char* s) { while (*s) buf[i++] = *s++; };
+    auto append_num = [&](uint64_t n) {
+        if (n == 0) { buf[i++] = '0'; return; }
+        char tmp[20]; int j = 0;
+        while (n > 0) { tmp[j++] = '0' + (n % 10); n /= 10; }
+        while (j-- > 0) buf[i++] = tmp[j];
+    };
+    append_str("Snapshot #");
+    append_num(snap.sequence);
+    append_str(snap.restored ? " restored from " : " written to ");
+    append_str(snap.device);
+    append_str(": ");
+    append_num(snap.files);
+    append_str(" files, ");
+    append_num(snap.bytes / 1024);
+    append_str(" KB in ");
+    append_num(snap.ms);
+    append_str(" ms");
+    if (snap.dirty) append_str(" (RAM changed since)");
+    buf[i] = 0;
+    g_terminal.write_line(buf);
+}
+
+static void cmd_mkfs(const char* args) {
+    while (args && *args == ' ') args++;
+    BlockDevice* dev = (args && *args) ? block_find(args) : nullptr;
+    if (!dev) {
+        g_terminal.write_line("Usage: mkfs <dev> (see lsblk)");
+        return;
+    }
+
+    switch (unifs_format_disk(dev)) {
+        case UNIFS_OK:
+            g_terminal.write("Formatted ");
+            g_terminal.write(dev->name);
+            g_terminal.write_line(unifs_disk_device(unifs_get_disk_volume()) == dev ?
+                                  " (mounted)" : " (another volume stays mounted)");
+            break;
+        case UNIFS_ERR_IN_USE:
+            g_terminal.write_line("mkfs: device holds the mounted volume");
+            break;
+        case UNIFS_ERR_READONLY:
+            g_terminal.write_line("mkfs: device is read-only");
+            break;
+        case UNIFS_ERR_INVALID:
+            g_terminal.write_line("mkfs: device too small");
+            break;
+        default:
+            g_terminal.write_line("mkfs: write error");
+    }
 }
 
 static void cmd_mem() {
@@ -1374,7 +1797,7 @@ static void cmd_mem() {
     uint64_t total_kb = total_bytes / 1024;
     uint64_t used_kb = used_bytes / 1024;
     
-    char buf[128];
+    char buf[256];
     int i = 0;
     
     auto append_str = [&](const char* s) {
@@ -1397,6 +1820,30 @@ static void cmd_mem() {
     
     append_str("  Free:  "); append_num(free_kb); append_str(" KB\n");
     
+    ImageCacheStats image_stats;
+    image_cache_get_stats(&image_stats);
+    append_str("  Exec cache: "); append_num(image_stats.images); append_str(" images, ");
+    append_num(image_stats.shared_pages * 4); append_str(" KB shared, ");
+    append_num(image_stats.direct_pages * 4); append_str(" KB mapped from boot image (");
+    append_num(image_stats.hits); append_str(" hits, ");
+    append_num(image_stats.misses); append_str(" misses)\n");
+    
+    PipeStats pipe_stats;
+    pipe_get_stats(&pipe_stats);
+    append_str("  Pipes: "); append_num(pipe_stats.pipes); append_str(" open, ");
+    append_num(pipe_stats.buffer_bytes / 1024); append_str(" KB buffers (");
+    append_num(pipe_stats.read_waits); append_str(" read waits, ");
+    append_num(pipe_stats.write_waits); append_str(" write waits, ");
+    append_num(pipe_stats.pages_spliced); append_str(" pages spliced)\n");
+    
+    BcacheStats cache;
+    bcache_get_stats(&cache);
+    append_str("  Buffer cache: "); append_num(cache.buffers * (BCACHE_BLOCK_SIZE / 1024));
+    append_str(" / "); append_num(cache.max_buffers * (BCACHE_BLOCK_SIZE / 1024));
+    append_str(" KB ("); append_num(cache.hits); append_str(" hits, ");
+    append_num(cache.misses); append_str(" misses, ");
+    append_num(cache.reclaimed * 4); append_str(" KB reclaimed)\n");
+    
     buf[i] = 0;
     g_terminal.write(buf);
 }
@@ -1524,7 +1971,7 @@ static void cmd_time(const char* cmd) {
     }
     
     uint64_t start = timer_get_ticks();
-    execute_single_command(cmd, nullptr);
+    execute_single_command(cmd, -1);
     uint64_t end = timer_get_ticks();
     
     uint64_t elapsed_ticks = end - start;
@@ -1626,7 +2073,7 @@ static void cmd_test(const char* args) {
         while (*fname == ' ') fname++;
         char expanded[64];
         expand_variables(fname, expanded, 64);
-        last_exit_status = unifs_file_exists(expanded) ? 0 : 1;
+        last_exit_status = vfs_exists(expanded) ? 0 : 1;
         return;
     }
     
@@ -1725,35 +2172,175 @@ static void cmd_source(const char* filename) {
 // Better than Unix: cleaner output, smarter defaults, works with pipes
 // =============================================================================
 
-// wc - Word/line/character count with formatted output
-// Usage: wc [file] or pipe: ls | wc
-static void cmd_wc(const char* filename, const char* piped_input) {
-    const char* data = nullptr;
-    uint64_t data_len = 0;
+// Text input: a file argument or the previous pipeline stage, read a chunk
+// at a time so input of any size streams through in bounded memory. Only
+// sort and tac hold all of it.
+
+struct TextInput {
+    VfsFile* file;          // File argument, or...
+    int pipe_id;            // ...the previous stage's pipe
+    uint64_t offset;        // File position
+    char chunk[512];
+    uint32_t pos;
+    uint32_t len;
+};
+
+// Open the file argument, else the piped input. With neither, prints usage
+// and returns false.
+static bool input_open(TextInput* in, const char* filename, int input_pipe, const char* usage) {
+    in->file = nullptr;
+    in->pipe_id = -1;
+    in->offset = 0;
+    in->pos = in->len = 0;
     
-    // Get data from file or piped input
     if (filename && filename[0]) {
-        const UniFSFile* file = unifs_open(filename);
-        if (!file) {
+        in->file = vfs_file_open(filename);
+        if (!in->file) {
             error_file_not_found(filename);
-            return;
+            return false;
         }
-        data = (const char*)file->data;
-        data_len = file->size;
-    } else if (piped_input) {
-        data = piped_input;
-        data_len = strlen(piped_input);
+    } else if (input_pipe >= 0) {
+        in->pipe_id = input_pipe;
     } else {
-        g_terminal.write_line("Usage: wc <file> or pipe input");
-        return;
+        g_terminal.write_line(usage);
+        return false;
+    }
+    return true;
+}
+
+static void input_close(TextInput* in) {
+    if (in->file) vfs_file_close(in->file);
+    in->file = nullptr;
+}
+
+// Next byte, or -1 at the end of the input
+static int input_getc(TextInput* in) {
+    if (in->pos == in->len) {
+        int64_t got = in->file ? vfs_file_read(in->file, in->offset, in->chunk, sizeof(in->chunk))
+                               : pipe_read(in->pipe_id, in->chunk, sizeof(in->chunk));
+        if (got <= 0) return -1;
+        in->offset += got;
+        in->pos = 0;
+        in->len = (uint32_t)got;
+    }
+    return (uint8_t)in->chunk[in->pos++];
+}
+
+// Line buffer that grows to the longest line seen
+struct TextLine {
+    char* data;
+    uint64_t len;
+    uint64_t cap;
+};
+
+// Read the next line, without its '\n'. A last line without one counts.
+// False at the end of the input. Out of memory, the rest of the line is cut.
+static bool input_read_line(TextInput* in, TextLine* line) {
+    line->len = 0;
+    int c = input_getc(in);
+    if (c < 0) return false;
+    
+    for (; c >= 0 && c != '\n'; c = input_getc(in)) {
+        if (line->len == line->cap) {
+            uint64_t cap = line->cap ? line->cap * 2 : 128;
+            char* bigger = (char*)malloc(cap);
+            if (!bigger) continue;
+            if (line->data) {
+                kstring::memcpy(bigger, line->data, line->len);
+                free(line->data);
+            }
+            line->data = bigger;
+            line->cap = cap;
+        }
+        line->data[line->len++] = (char)c;
+    }
+    return true;
+}
+
+static void line_free(TextLine* line) {
+    if (line->data) free(line->data);
+    line->data = nullptr;
+    line->len = line->cap = 0;
+}
+
+static void write_line_n(const char* data, uint64_t len) {
+    for (uint64_t i = 0; i < len; i++) {
+        g_terminal.put_char(data[i]);
+    }
+    g_terminal.put_char('\n');
+}
+
+// The whole input in one heap buffer, for the commands that need all of it.
+// nullptr if it is empty or does not fit in memory.
+static char* input_read_all(TextInput* in, uint64_t* out_len) {
+    char* data = nullptr;
+    uint64_t len = 0, cap = 0;
+    for (int c; (c = input_getc(in)) >= 0; ) {
+        if (len == cap) {
+            uint64_t grown = cap ? cap * 2 : 4096;
+            char* bigger = (char*)malloc(grown);
+            if (!bigger) {
+                g_terminal.write_line("Error: input too large");
+                if (data) free(data);
+                return nullptr;
+            }
+            if (data) {
+                kstring::memcpy(bigger, data, len);
+                free(data);
+            }
+            data = bigger;
+            cap = grown;
+        }
+        data[len++] = (char)c;
+    }
+    *out_len = len;
+    return data;
+}
+
+// Non-empty lines of data as (start, length) pairs in a heap array
+struct LineSpan {
+    const char* start;
+    uint64_t len;
+};
+
+static LineSpan* split_lines(const char* data, uint64_t data_len, uint64_t* out_count) {
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < data_len; i++) {
+        if (data[i] == '\n') count++;
+    }
+    LineSpan* spans = (LineSpan*)malloc((count + 1) * sizeof(LineSpan));
+    if (!spans) {
+        g_terminal.write_line("Error: input too large");
+        return nullptr;
+    }
+    
+    uint64_t n = 0, line_start = 0;
+    for (uint64_t i = 0; i <= data_len; i++) {
+        if (i == data_len || data[i] == '\n') {
+            if (i > line_start) {  // Skip empty lines
+                spans[n].start = data + line_start;
+                spans[n].len = i - line_start;
+                n++;
+            }
+            line_start = i + 1;
+        }
     }
+    *out_count = n;
+    return spans;
+}
+
+// wc - Word/line/character count with formatted output
+// Usage: wc [file] or pipe: ls | wc
+static void cmd_wc(const char* filename, int input_pipe) {
+    TextInput in;
+    if (!input_open(&in, filename, input_pipe, "Usage: wc <file> or pipe input")) return;
     
     // Count statistics
     uint64_t lines = 0, words = 0, chars = 0;
     bool in_word = false;
+    int last = '\n';
     
-    for (uint64_t i = 0; i < data_len; i++) {
-        char c = data[i];
+    for (int c; (c = input_getc(&in)) >= 0; last = c) {
         chars++;
         
         if (c == '\n') lines++;
@@ -1765,9 +2352,10 @@ static void cmd_wc(const char* filename, const char* piped_input) {
             words++;
         }
     }
+    input_close(&in);
     
     // Add 1 to lines if data doesn't end with newline
-    if (data_len > 0 && data[data_len - 1] != '\n') lines++;
+    if (last != '\n') lines++;
     
     // Output in clean format
     char buf[128];
@@ -1787,19 +2375,15 @@ static void cmd_wc(const char* filename, const char* piped_input) {
     g_terminal.write_line(buf);
 }
 
-// head - Show first N lines (default 10)
-// Usage: head [n] [file] or pipe: ls | head 5
-static void cmd_head(const char* args, const char* piped_input) {
-    int n = 10;  // Smart default
+// Parse "[n] [file]" for head/tail
+static const char* parse_count_args(const char* args, int* n) {
     const char* filename = nullptr;
-    
-    // Parse args: could be "5", "5 file.txt", "file.txt", or empty
     if (args && args[0]) {
         if (args[0] >= '0' && args[0] <= '9') {
-            n = 0;
+            *n = 0;
             const char* p = args;
             while (*p >= '0' && *p <= '9') {
-                n = n * 10 + (*p - '0');
+                *n = *n * 10 + (*p - '0');
                 p++;
             }
             while (*p == ' ') p++;
@@ -1808,108 +2392,69 @@ static void cmd_head(const char* args, const char* piped_input) {
             filename = args;
         }
     }
+    return filename;
+}
+
+// head - Show first N lines (default 10)
+// Usage: head [n] [file] or pipe: ls | head 5
+static void cmd_head(const char* args, int input_pipe) {
+    int n = 10;  // Smart default
+    const char* filename = parse_count_args(args, &n);
     
-    const char* data = nullptr;
-    uint64_t data_len = 0;
-    
-    if (filename && filename[0]) {
-        const UniFSFile* file = unifs_open(filename);
-        if (!file) {
-            error_file_not_found(filename);
-            return;
-        }
-        data = (const char*)file->data;
-        data_len = file->size;
-    } else if (piped_input) {
-        data = piped_input;
-        data_len = strlen(piped_input);
-    } else {
-        g_terminal.write_line("Usage: head [n] <file> or pipe input");
-        return;
-    }
+    TextInput in;
+    if (!input_open(&in, filename, input_pipe, "Usage: head [n] <file> or pipe input")) return;
     
-    // Output first n lines
+    // Output first n lines; stop reading there
     int line_count = 0;
-    for (uint64_t i = 0; i < data_len && line_count < n; i++) {
-        g_terminal.put_char(data[i]);
-        if (data[i] == '\n') line_count++;
+    int last = '\n';
+    while (line_count < n) {
+        int c = input_getc(&in);
+        if (c < 0) break;
+        g_terminal.put_char((char)c);
+        last = c;
+        if (c == '\n') line_count++;
     }
+    input_close(&in);
     
     // Add newline if last line didn't have one
-    if (data_len > 0 && data[data_len - 1] != '\n' && line_count < n) {
+    if (last != '\n') {
         g_terminal.put_char('\n');
     }
 }
 
 // tail - Show last N lines (default 10)
 // Usage: tail [n] [file] or pipe: ls | tail 3
-static void cmd_tail(const char* args, const char* piped_input) {
+static void cmd_tail(const char* args, int input_pipe) {
     int n = 10;  // Smart default
-    const char* filename = nullptr;
+    const char* filename = parse_count_args(args, &n);
+    if (n <= 0) return;
     
-    // Parse args: could be "5", "5 file.txt", "file.txt", or empty
-    if (args && args[0]) {
-        if (args[0] >= '0' && args[0] <= '9') {
-            n = 0;
-            const char* p = args;
-            while (*p >= '0' && *p <= '9') {
-                n = n * 10 + (*p - '0');
-                p++;
-            }
-            while (*p == ' ') p++;
-            if (*p) filename = p;
-        } else {
-            filename = args;
-        }
+    TextInput in;
+    if (!input_open(&in, filename, input_pipe, "Usage: tail [n] <file> or pipe input")) return;
+    
+    // Ring of the last n lines; buffers are reused as it wraps
+    TextLine* ring = (TextLine*)malloc(n * sizeof(TextLine));
+    if (!ring) {
+        input_close(&in);
+        g_terminal.write_line("Error: out of memory");
+        return;
     }
+    kstring::zero_memory(ring, n * sizeof(TextLine));
     
-    const char* data = nullptr;
-    uint64_t data_len = 0;
-    
-    if (filename && filename[0]) {
-        const UniFSFile* file = unifs_open(filename);
-        if (!file) {
-            error_file_not_found(filename);
-            return;
-        }
-        data = (const char*)file->data;
-        data_len = file->size;
-    } else if (piped_input) {
-        data = piped_input;
-        data_len = strlen(piped_input);
-    } else {
-        g_terminal.write_line("Usage: tail [n] <file> or pipe input");
-        return;
-    }
-    
-    // Count total lines
-    int total_lines = 0;
-    for (uint64_t i = 0; i < data_len; i++) {
-        if (data[i] == '\n') total_lines++;
+    uint64_t total = 0;
+    while (input_read_line(&in, &ring[total % n])) {
+        total++;
     }
-    if (data_len > 0 && data[data_len - 1] != '\n') total_lines++;
+    input_close(&in);
     
-    // Find start position for last n lines
-    int skip_lines = (total_lines > n) ? (total_lines - n) : 0;
-    int line_count = 0;
-    uint64_t start = 0;
-    
-    for (uint64_t i = 0; i < data_len && line_count < skip_lines; i++) {
-        if (data[i] == '\n') {
-            line_count++;
-            start = i + 1;
-        }
+    uint64_t first = total > (uint64_t)n ? total - n : 0;
+    for (uint64_t i = first; i < total; i++) {
+        write_line_n(ring[i % n].data, ring[i % n].len);
     }
-    
-    // Output from start position
-    for (uint64_t i = start; i < data_len; i++) {
-        g_terminal.put_char(data[i]);
-    }
-    
-    // Add newline if needed
-    if (data_len > 0 && data[data_len - 1] != '\n') {
-        g_terminal.put_char('\n');
+    for (int i = 0; i < n; i++) {
+        line_free(&ring[i]);
     }
+    free(ring);
 }
 
 // Helper: case-insensitive character comparison
@@ -1920,7 +2465,7 @@ static char to_lower(char c) {
 // grep - Search for pattern in text
 // Usage: grep pattern [file] or pipe: ls | grep elf
 // Case-insensitive by default (modern approach)
-static void cmd_grep(const char* args, const char* piped_input) {
+static void cmd_grep(const char* args, int input_pipe) {
     if (!args || !args[0]) {
         g_terminal.write_line("Usage: grep <pattern> [file]");
         return;
@@ -1942,348 +2487,208 @@ static void cmd_grep(const char* args, const char* piped_input) {
     while (*p == ' ') p++;
     if (*p) filename = p;
     
-    const char* data = nullptr;
-    uint64_t data_len = 0;
-    
-    UniFSFile file_data;
-    if (filename && filename[0]) {
-        if (!unifs_open_into(filename, &file_data)) {
-            error_file_not_found(filename);
-            return;
-        }
-        data = (const char*)file_data.data;
-        data_len = file_data.size;
-    } else if (piped_input) {
-        data = piped_input;
-        data_len = strlen(piped_input);
-    } else {
-        g_terminal.write_line("Usage: grep <pattern> <file> or pipe input");
-        return;
-    }
-    
-    int pattern_len = strlen(pattern);
+    uint64_t pattern_len = strlen(pattern);
     if (pattern_len == 0) return;
     
+    TextInput in;
+    if (!input_open(&in, filename, input_pipe, "Usage: grep <pattern> <file> or pipe input")) return;
+    
     // Process line by line
-    uint64_t line_start = 0;
+    TextLine line = {};
     int matches = 0;
     
-    for (uint64_t i = 0; i <= data_len; i++) {
-        bool is_end = (i == data_len) || (data[i] == '\n');
+    while (input_read_line(&in, &line)) {
+        // Check if this line contains the pattern (case-insensitive)
+        bool found = false;
         
-        if (is_end) {
-            // Check if this line contains the pattern (case-insensitive)
-            bool found = false;
-            
-            for (uint64_t j = line_start; j + pattern_len <= i && !found; j++) {
-                bool match = true;
-                for (int k = 0; k < pattern_len && match; k++) {
-                    if (to_lower(data[j + k]) != to_lower(pattern[k])) {
-                        match = false;
-                    }
-                }
-                if (match) found = true;
-            }
-            
-            // Output matching line
-            if (found) {
-                matches++;
-                for (uint64_t j = line_start; j < i; j++) {
-                    g_terminal.put_char(data[j]);
+        for (uint64_t j = 0; j + pattern_len <= line.len && !found; j++) {
+            bool match = true;
+            for (uint64_t k = 0; k < pattern_len && match; k++) {
+                if (to_lower(line.data[j + k]) != to_lower(pattern[k])) {
+                    match = false;
                 }
-                g_terminal.put_char('\n');
             }
-            
-            line_start = i + 1;
+            if (match) found = true;
+        }
+        
+        // Output matching line
+        if (found) {
+            matches++;
+            write_line_n(line.data, line.len);
         }
     }
+    line_free(&line);
+    input_close(&in);
     
     if (matches == 0) {
         g_terminal.write_line("No matches found.");
     }
 }
 
+// Byte-wise line order, shorter first on a tie
+static bool line_less(const LineSpan& a, const LineSpan& b) {
+    uint64_t min_len = a.len < b.len ? a.len : b.len;
+    for (uint64_t k = 0; k < min_len; k++) {
+        if (a.start[k] != b.start[k]) return (uint8_t)a.start[k] < (uint8_t)b.start[k];
+    }
+    return a.len < b.len;
+}
+
 // sort - Sort lines alphabetically
 // Usage: sort [file] or pipe: ls | sort
-static void cmd_sort(const char* filename, const char* piped_input) {
-    const char* data = nullptr;
+static void cmd_sort(const char* filename, int input_pipe) {
+    TextInput in;
+    if (!input_open(&in, filename, input_pipe, "Usage: sort <file> or pipe input")) return;
     uint64_t data_len = 0;
-    
-    UniFSFile file_data;
-    if (filename && filename[0]) {
-        if (!unifs_open_into(filename, &file_data)) {
-            error_file_not_found(filename);
-            return;
+    char* data = input_read_all(&in, &data_len);
+    input_close(&in);
+    if (!data) return;
+    
+    uint64_t count = 0;
+    LineSpan* lines = split_lines(data, data_len, &count);
+    LineSpan* tmp = lines ? (LineSpan*)malloc((count + 1) * sizeof(LineSpan)) : nullptr;
+    if (!tmp) {
+        if (lines) {
+            free(lines);
+            g_terminal.write_line("Error: input too large");
         }
-        data = (const char*)file_data.data;
-        data_len = file_data.size;
-    } else if (piped_input) {
-        data = piped_input;
-        data_len = strlen(piped_input);
-    } else {
-        g_terminal.write_line("Usage: sort <file> or pipe input");
+        free(data);
         return;
     }
     
-    if (data_len == 0) return;
-    
-    // Count lines and store pointers
-    const int MAX_LINES = 256;
-    const char* lines[MAX_LINES];
-    int line_lens[MAX_LINES];
-    int line_count = 0;
-    
-    uint64_t line_start = 0;
-    for (uint64_t i = 0; i <= data_len && line_count < MAX_LINES; i++) {
-        if (i == data_len || data[i] == '\n') {
-            if (i > line_start) {  // Skip empty lines
-                lines[line_count] = data + line_start;
-                line_lens[line_count] = i - line_start;
-                line_count++;
-            }
-            line_start = i + 1;
-        }
-    }
-    
-    // Bubble sort (simple, works for small datasets)
-    for (int i = 0; i < line_count - 1; i++) {
-        for (int j = 0; j < line_count - i - 1; j++) {
-            // Compare lines
-            int min_len = (line_lens[j] < line_lens[j+1]) ? line_lens[j] : line_lens[j+1];
-            bool swap = false;
-            for (int k = 0; k < min_len; k++) {
-                if (lines[j][k] > lines[j+1][k]) { swap = true; break; }
-                if (lines[j][k] < lines[j+1][k]) break;
-            }
-            if (!swap && line_lens[j] > line_lens[j+1]) swap = true;
-            
-            if (swap) {
-                const char* tmp = lines[j];
-                lines[j] = lines[j+1];
-                lines[j+1] = tmp;
-                int tmp_len = line_lens[j];
-                line_lens[j] = line_lens[j+1];
-                line_lens[j+1] = tmp_len;
-            }
+    // Bottom-up merge sort (stable, n log n for large inputs)
+    for (uint64_t width = 1; width < count; width *= 2) {
+        for (uint64_t lo = 0; lo < count; lo += 2 * width) {
+            uint64_t mid = lo + width < count ? lo + width : count;
+            uint64_t hi = lo + 2 * width < count ? lo + 2 * width : count;
+            uint64_t a = lo, b = mid, out = lo;
+            while (a < mid && b < hi) tmp[out++] = line_less(lines[b], lines[a]) ? lines[b++] : lines[a++];
+            while (a < mid) tmp[out++] = lines[a++];
+            while (b < hi) tmp[out++] = lines[b++];
         }
+        LineSpan* swap = lines;
+        lines = tmp;
+        tmp = swap;
     }
     
     // Output sorted lines
-    for (int i = 0; i < line_count; i++) {
-        for (int j = 0; j < line_lens[i]; j++) {
-            g_terminal.put_char(lines[i][j]);
-        }
-        g_terminal.put_char('\n');
+    for (uint64_t i = 0; i < count; i++) {
+        write_line_n(lines[i].start, lines[i].len);
     }
+    free(tmp);
+    free(lines);
+    free(data);
 }
 
 // uniq - Remove consecutive duplicate lines
 // Usage: uniq [file] or pipe: sort data.txt | uniq
-static void cmd_uniq(const char* filename, const char* piped_input) {
-    const char* data = nullptr;
-    uint64_t data_len = 0;
-    
-    if (filename && filename[0]) {
-        const UniFSFile* file = unifs_open(filename);
-        if (!file) {
-            error_file_not_found(filename);
-            return;
-        }
-        data = (const char*)file->data;
-        data_len = file->size;
-    } else if (piped_input) {
-        data = piped_input;
-        data_len = strlen(piped_input);
-    } else {
-        g_terminal.write_line("Usage: uniq <file> or pipe input");
-        return;
-    }
-    
-    if (data_len == 0) return;
+static void cmd_uniq(const char* filename, int input_pipe) {
+    TextInput in;
+    if (!input_open(&in, filename, input_pipe, "Usage: uniq <file> or pipe input")) return;
     
-    const char* prev_line = nullptr;
-    int prev_len = 0;
-    uint64_t line_start = 0;
+    TextLine lines[2] = {};
+    int curr = 0;
+    bool have_prev = false;
     
-    for (uint64_t i = 0; i <= data_len; i++) {
-        if (i == data_len || data[i] == '\n') {
-            const char* curr_line = data + line_start;
-            int curr_len = i - line_start;
-            
-            // Check if different from previous
-            bool is_dup = false;
-            if (prev_line && curr_len == prev_len) {
-                is_dup = true;
-                for (int j = 0; j < curr_len; j++) {
-                    if (curr_line[j] != prev_line[j]) {
-                        is_dup = false;
-                        break;
-                    }
-                }
-            }
-            
-            if (!is_dup && curr_len > 0) {
-                for (int j = 0; j < curr_len; j++) {
-                    g_terminal.put_char(curr_line[j]);
-                }
-                g_terminal.put_char('\n');
-            }
-            
-            prev_line = curr_line;
-            prev_len = curr_len;
-            line_start = i + 1;
+    while (input_read_line(&in, &lines[curr])) {
+        const TextLine& line = lines[curr];
+        const TextLine& prev = lines[curr ^ 1];
+        
+        // Check if different from previous
+        bool is_dup = have_prev && line.len == prev.len;
+        for (uint64_t j = 0; is_dup && j < line.len; j++) {
+            if (line.data[j] != prev.data[j]) is_dup = false;
+        }
+        
+        if (!is_dup && line.len > 0) {
+            write_line_n(line.data, line.len);
         }
+        
+        have_prev = true;
+        curr ^= 1;
     }
+    line_free(&lines[0]);
+    line_free(&lines[1]);
+    input_close(&in);
 }
 
 // rev - Reverse characters in each line
 // Usage: rev [file] or pipe: echo hello | rev → olleh
-static void cmd_rev(const char* filename, const char* piped_input) {
-    const char* data = nullptr;
-    uint64_t data_len = 0;
-    
-    if (filename && filename[0]) {
-        const UniFSFile* file = unifs_open(filename);
-        if (!file) {
-            error_file_not_found(filename);
-            return;
-        }
-        data = (const char*)file->data;
-        data_len = file->size;
-    } else if (piped_input) {
-        data = piped_input;
-        data_len = strlen(piped_input);
-    } else {
-        g_terminal.write_line("Usage: rev <file> or pipe input");
-        return;
-    }
-    
-    if (data_len == 0) return;
-    
-    uint64_t line_start = 0;
-    for (uint64_t i = 0; i <= data_len; i++) {
-        if (i == data_len || data[i] == '\n') {
-            // Reverse this line
-            for (int64_t j = i - 1; j >= (int64_t)line_start; j--) {
-                g_terminal.put_char(data[j]);
-            }
-            g_terminal.put_char('\n');
-            line_start = i + 1;
+static void cmd_rev(const char* filename, int input_pipe) {
+    TextInput in;
+    if (!input_open(&in, filename, input_pipe, "Usage: rev <file> or pipe input")) return;
+    
+    TextLine line = {};
+    while (input_read_line(&in, &line)) {
+        // Reverse this line
+        for (uint64_t j = line.len; j > 0; j--) {
+            g_terminal.put_char(line.data[j - 1]);
         }
+        g_terminal.put_char('\n');
     }
+    line_free(&line);
+    input_close(&in);
 }
 
 // tac - Print lines in reverse order (opposite of cat)
 // Usage: tac [file] or pipe: ls | tac
-static void cmd_tac(const char* filename, const char* piped_input) {
-    const char* data = nullptr;
+static void cmd_tac(const char* filename, int input_pipe) {
+    TextInput in;
+    if (!input_open(&in, filename, input_pipe, "Usage: tac <file> or pipe input")) return;
     uint64_t data_len = 0;
-    
-    if (filename && filename[0]) {
-        const UniFSFile* file = unifs_open(filename);
-        if (!file) {
-            error_file_not_found(filename);
-            return;
-        }
-        data = (const char*)file->data;
-        data_len = file->size;
-    } else if (piped_input) {
-        data = piped_input;
-        data_len = strlen(piped_input);
-    } else {
-        g_terminal.write_line("Usage: tac <file> or pipe input");
-        return;
-    }
-    
-    if (data_len == 0) return;
-    
-    // Store line positions
-    const int MAX_LINES = 256;
-    uint64_t line_starts[MAX_LINES];
-    uint64_t line_ends[MAX_LINES];
-    int line_count = 0;
-    
-    uint64_t line_start = 0;
-    for (uint64_t i = 0; i <= data_len && line_count < MAX_LINES; i++) {
-        if (i == data_len || data[i] == '\n') {
-            if (i > line_start) {
-                line_starts[line_count] = line_start;
-                line_ends[line_count] = i;
-                line_count++;
-            }
-            line_start = i + 1;
+    char* data = input_read_all(&in, &data_len);
+    input_close(&in);
+    if (!data) return;
+    
+    uint64_t count = 0;
+    LineSpan* lines = split_lines(data, data_len, &count);
+    if (lines) {
+        // Print lines in reverse
+        for (uint64_t i = count; i > 0; i--) {
+            write_line_n(lines[i - 1].start, lines[i - 1].len);
         }
+        free(lines);
     }
-    
-    // Print lines in reverse
-    for (int i = line_count - 1; i >= 0; i--) {
-        for (uint64_t j = line_starts[i]; j < line_ends[i]; j++) {
-            g_terminal.put_char(data[j]);
-        }
-        g_terminal.put_char('\n');
-    }
+    free(data);
 }
 
 // nl - Number lines
 // Usage: nl [file] or pipe: cat file.txt | nl
-static void cmd_nl(const char* filename, const char* piped_input) {
-    const char* data = nullptr;
-    uint64_t data_len = 0;
-    
-    if (filename && filename[0]) {
-        const UniFSFile* file = unifs_open(filename);
-        if (!file) {
-            error_file_not_found(filename);
-            return;
-        }
-        data = (const char*)file->data;
-        data_len = file->size;
-    } else if (piped_input) {
-        data = piped_input;
-        data_len = strlen(piped_input);
-    } else {
-        g_terminal.write_line("Usage: nl <file> or pipe input");
-        return;
-    }
-    
-    if (data_len == 0) return;
-    
-    int line_num = 1;
-    uint64_t line_start = 0;
-    
-    for (uint64_t i = 0; i <= data_len; i++) {
-        if (i == data_len || data[i] == '\n') {
-            // Print line number (right-aligned in 6 chars)
-            char num_buf[8];
-            int n = line_num;
-            int pos = 5;
-            num_buf[6] = ' ';
-            num_buf[7] = '\0';
-            while (pos >= 0) {
-                if (n > 0) {
-                    num_buf[pos--] = '0' + (n % 10);
-                    n /= 10;
-                } else {
-                    num_buf[pos--] = ' ';
-                }
-            }
-            g_terminal.write(num_buf);
-            
-            // Print line content
-            for (uint64_t j = line_start; j < i; j++) {
-                g_terminal.put_char(data[j]);
+static void cmd_nl(const char* filename, int input_pipe) {
+    TextInput in;
+    if (!input_open(&in, filename, input_pipe, "Usage: nl <file> or pipe input")) return;
+    
+    TextLine line = {};
+    uint64_t line_num = 1;
+    
+    while (input_read_line(&in, &line)) {
+        // Print line number (right-aligned in 6 chars)
+        char num_buf[8];
+        uint64_t n = line_num;
+        int pos = 5;
+        num_buf[6] = ' ';
+        num_buf[7] = '\0';
+        while (pos >= 0) {
+            if (n > 0) {
+                num_buf[pos--] = '0' + (n % 10);
+                n /= 10;
+            } else {
+                num_buf[pos--] = ' ';
             }
-            g_terminal.put_char('\n');
-            
-            line_num++;
-            line_start = i + 1;
         }
+        g_terminal.write(num_buf);
+        
+        // Print line content
+        write_line_n(line.data, line.len);
+        line_num++;
     }
+    line_free(&line);
+    input_close(&in);
 }
 
 // tr - Translate characters (simple version: tr <from> <to>)
 // Usage: echo hello | tr e a → hallo
-static void cmd_tr(const char* args, const char* piped_input) {
+static void cmd_tr(const char* args, int input_pipe) {
     if (!args || !args[0]) {
         g_terminal.write_line("Usage: tr <from_char> <to_char>");
         return;
@@ -2297,15 +2702,14 @@ static void cmd_tr(const char* args, const char* piped_input) {
     while (*p == ' ') p++;
     if (*p) to_char = *p;
     
-    if (!piped_input) {
-        g_terminal.write_line("tr requires piped input");
-        return;
-    }
+    TextInput in;
+    if (!input_open(&in, nullptr, input_pipe, "tr requires piped input")) return;
     
     // Translate and output
-    for (const char* s = piped_input; *s; s++) {
-        g_terminal.put_char(*s == from_char ? to_char : *s);
+    for (int c; (c = input_getc(&in)) >= 0; ) {
+        g_terminal.put_char((char)c == from_char ? to_char : (char)c);
     }
+    input_close(&in);
 }
 
 
@@ -2449,6 +2853,111 @@ static void cmd_lspci() {
     }
 }
 
+static void cmd_lsblk() {
+    int count = block_count();
+    if (count == 0) {
+        g_terminal.write_line("No block devices.");
+        return;
+    }
+
+    char buf[160];
+    int i = 0;
+    auto append_str = [&](const char* s) { while (*s) buf[i++] = *s++; };
+    auto append_num = [&](uint64_t n) {
+        if (n == 0) { buf[i++] = '0'; return; }
+        char tmp[20]; int j = 0;
+        while (n > 0) { tmp[j++] = '0' + (n % 10); n /= 10; }
+        while (j-- > 0) buf[i++] = tmp[j];
+    };
+
+    for (int d = 0; d < count; d++) {
+        BlockDevice* dev = block_get(d);
+        const BlockStats& st = dev->stats;
+
+        i = 0;
+        append_str("  "); append_str(dev->name); append_str(": ");
+        append_num((dev->sector_count * dev->sector_size) / (1024 * 1024)); append_str(" MB, ");
+        append_num(dev->sector_size); append_str("-byte sectors, queue ");
+        append_num(dev->queue_depth);
+        append_str(dev->irq_driven ? ", IRQ" : ", polled");
+        if (dev->read_only) append_str(", read-only");
+        buf[i] = 0;
+        g_terminal.write_line(buf);
+
+        i = 0;
+        append_str("    reads "); append_num(st.reads);
+        append_str(" ("); append_num(st.sectors_read * dev->sector_size / 1024); append_str(" KB), writes ");
+        append_num(st.writes);
+        append_str(" ("); append_num(st.sectors_written * dev->sector_size / 1024); append_str(" KB)");
+        buf[i] = 0;
+        g_terminal.write_line(buf);
+
+        i = 0;
+        append_str("    commands "); append_num(st.commands);
+        append_str(", merged "); append_num(st.merges);
+        append_str(", irqs "); append_num(st.interrupts);
+        append_str(", errors "); append_num(st.errors);
+        append_str(", max in flight "); append_num(st.max_in_flight);
+        buf[i] = 0;
+        g_terminal.write_line(buf);
+    }
+}
+
+// Random 4KB reads at queue depths 1-64 on a block device
+static void cmd_blkbench(const char* args) {
+    while (args && *args == ' ') args++;
+    BlockDevice* dev = (args && *args) ? block_find(args) : block_get(0);
+    if (!dev) {
+        g_terminal.write_line(block_count() ? "blkbench: no such device (see lsblk)" : "blkbench: no block devices");
+        return;
+    }
+
+    char buf[128];
+    int i = 0;
+    auto append_str = [&](const char* s) { while (*s) buf[i++] = *s++; };
+    auto append_num = [&](uint64_t n, int width) {
+        char tmp[20]; int j = 0;
+        do { tmp[j++] = '0' + (n % 10); n /= 10; } while (n > 0);
+        for (int pad = j; pad < width; pad++) buf[i++] = ' ';
+        while (j-- > 0) buf[i++] = tmp[j];
+    };
+    // Microseconds with one decimal
+    auto append_us = [&](uint64_t ns, int width) {
+        append_num(ns / 1000, width - 2);
+        buf[i++] = '.';
+        buf[i++] = '0' + (ns / 100) % 10;
+    };
+
+    i = 0;
+    append_str("Random 4KB reads on "); append_str(dev->name);
+    append_str(dev->irq_driven ? " (IRQ)" : " (polled)");
+    buf[i] = 0;
+    g_terminal.write_line(buf);
+    g_terminal.write_line("     QD     IOPS   avg us   p50 us   p90 us   p99 us p99.9 us   max us");
+
+    for (uint32_t qd = 1; qd <= 64; qd *= 2) {
+        uint32_t ops = qd < 8 ? 2000 : 250 * qd;
+        BlockBenchResult r;
+        if (!block_bench_run(dev, qd, ops, 4096, &r)) {
+            g_terminal.write_line("blkbench: run failed (out of memory or device too small)");
+            return;
+        }
+
+        i = 0;
+        append_num(qd, 7);
+        append_num(r.iops, 9);
+        append_us(r.avg_ns, 9);
+        append_us(r.p50_ns, 9);
+        append_us(r.p90_ns, 9);
+        append_us(r.p99_ns, 9);
+        append_us(r.p999_ns, 9);
+        append_us(r.max_ns, 9);
+        if (r.errors) { append_str("  ("); append_num(r.errors, 0); append_str(" errors)"); }
+        buf[i] = 0;
+        g_terminal.write_line(buf);
+    }
+}
+
 // Parse IP address from string (e.g., "10.0.2.2")
 static uint32_t parse_ip(const char* str) {
     uint32_t ip = 0;
@@ -2481,7 +2990,7 @@ static void cmd_ifconfig() {
     uint8_t mac[6];
     net_get_mac(mac);
     
-    char buf[80];
+    char buf[128];
     int i = 0;
     
     auto append_str = [&](const char* s) {
@@ -2536,6 +3045,54 @@ static void cmd_ifconfig() {
     
     // Link status
     g_terminal.write(net_link_up() ? "  Link: UP\n" : "  Link: DOWN\n");
+    
+    // TCP transmit queues
+    TcpStats tcp;
+    tcp_get_stats(&tcp);
+    auto append_num = [&](uint64_t n) {
+        char tmp[20]; int j = 0;
+        do { tmp[j++] = '0' + (n % 10); n /= 10; } while (n > 0);
+        while (j-- > 0) buf[i++] = tmp[j];
+    };
+    i = 0;
+    append_str("  TCP: "); append_num(tcp.tx_ref_bytes / 1024); append_str(" KB awaiting ACK (");
+    append_num(tcp.tx_refs); append_str(" refs), ");
+    append_num(tcp.zero_copy_bytes / 1024); append_str(" KB zero-copy, ");
+    append_num(tcp.copied_bytes / 1024); append_str(" KB copied, ");
+    append_num(tcp.retransmits); append_str(" retransmits");
+    buf[i] = 0;
+    g_terminal.write_line(buf);
+    
+    // Receive path
+    NetRxStats rx;
+    net_get_rx_stats(&rx);
+    i = 0;
+    append_str("  RX: ");
+    if (rx.interrupt_driven) {
+        append_num(rx.interrupts); append_str(" interrupts, ");
+        append_num(rx.wakeups); append_str(" wakeups, ");
+        append_num(rx.busy_rounds); append_str(" busy polls, ");
+    } else {
+        append_str("polled, ");
+    }
+    append_num(rx.frames); append_str(" frames, ");
+    append_num(rx.dropped); append_str(" dropped");
+    buf[i] = 0;
+    g_terminal.write_line(buf);
+    
+    // Packet buffer pool
+    NetBufStats nbs;
+    netbuf_get_stats(&nbs);
+    i = 0;
+    append_str("  Netbufs: "); append_num(nbs.in_use); append_str(" in use, ");
+    append_num(nbs.cached); append_str(" cached (");
+    append_num(nbs.total); append_str(" max), ");
+    append_num(nbs.failures); append_str(" failed allocs");
+    buf[i] = 0;
+    g_terminal.write_line(buf);
+    
+    g_terminal.write_line(net_tx_csum_offload() ? "  Checksums: IP/TCP/UDP offloaded to NIC"
+                                                : "  Checksums: software");
 }
 
 static void cmd_dhcp_request() {
@@ -2661,10 +3218,97 @@ static void cmd_ping(const char* target) {
     g_terminal.write_line(summary);
 }
 
+// Connect to host:port, send a file through the zero-copy path and wait
+// until the peer has ACKed all of it
+static void cmd_sendfile(const char* args) {
+    char host[64], port_str[8], path[VFS_MAX_PATH];
+    auto next_word = [&](char* out, int max) {
+        while (*args == ' ') args++;
+        int n = 0;
+        while (*args && *args != ' ') {
+            if (n < max - 1) out[n++] = *args;
+            args++;
+        }
+        out[n] = 0;
+        return n > 0;
+    };
+    if (!next_word(host, sizeof(host)) || !next_word(port_str, sizeof(port_str)) ||
+        !next_word(path, sizeof(path))) {
+        g_terminal.write_line("Usage: sendfile <host> <port> <file>");
+        return;
+    }
+    uint32_t port = 0;
+    for (const char* c = port_str; *c; c++) {
+        if (*c < '0' || *c > '9') { port = 0; break; }
+        port = port * 10 + (*c - '0');
+    }
+    if (port == 0 || port > 65535) {
+        g_terminal.write_line("sendfile: bad port");
+        return;
+    }
+    if (!vfs_exists(path)) {
+        g_terminal.write_line("sendfile: no such file");
+        return;
+    }
+    if (net_get_ip() == 0) {
+        g_terminal.write_line("Not configured. Run 'dhcp' first.");
+        return;
+    }
+    
+    uint32_t ip = dns_resolve(host);
+    if (ip == 0) {
+        g_terminal.write_line("Could not resolve hostname.");
+        return;
+    }
+    int sock = tcp_socket();
+    if (sock < 0) {
+        g_terminal.write_line("sendfile: no free sockets");
+        return;
+    }
+    if (!tcp_connect(sock, ip, (uint16_t)port)) {
+        g_terminal.write_line("sendfile: connection failed");
+        tcp_close(sock);
+        return;
+    }
+    
+    TcpStats before, after;
+    tcp_get_stats(&before);
+    uint64_t start = timer_get_ticks();
+    int64_t sent = tcp_sendfile(sock, path, 0, vfs_get_size(path));
+    bool acked = sent >= 0 && tcp_flush(sock);
+    uint64_t ms = (timer_get_ticks() - start) * 1000 / timer_get_frequency();
+    tcp_close(sock);
+    tcp_get_stats(&after);
+    
+    if (!acked) {
+        g_terminal.write_line("sendfile: transfer failed");
+        return;
+    }
+    char buf[128];
+    int i = 0;
+    auto append_str = [&](const char* s) { while (*s) buf[i++] = *s++; };
+    auto append_num = [&](uint64_t n) {
+        char tmp[20]; int j = 0;
+        do { tmp[j++] = '0' + (n % 10); n /= 10; } while (n > 0);
+        while (j-- > 0) buf[i++] = tmp[j];
+    };
+    append_str("Sent "); append_num((uint64_t)sent); append_str(" bytes in ");
+    append_num(ms); append_str(" ms (");
+    append_num(after.zero_copy_bytes - before.zero_copy_bytes); append_str(" by reference, ");
+    append_num(after.retransmits - before.retransmits); append_str(" retransmits)");
+    buf[i] = 0;
+    g_terminal.write_line(buf);
+}
+
 // Helper: output piped input (used by cat when no file argument given)
-static void cmd_cat_piped(const char* input) {
-    if (input) {
-        g_terminal.write(input);
+static void cmd_cat_piped(int input_pipe) {
+    if (input_pipe < 0) return;
+    char chunk[512];
+    int64_t got;
+    while ((got = pipe_read(input_pipe, chunk, sizeof(chunk))) > 0) {
+        for (int64_t i = 0; i < got; i++) {
+            g_terminal.put_char(chunk[i]);
+        }
     }
 }
 
@@ -2683,6 +3327,8 @@ static const CommandEntry commands[] = {
     {"uname",    CMD_NONE, cmd_uname, nullptr, nullptr},
     {"cpuinfo",  CMD_NONE, cmd_cpuinfo, nullptr, nullptr},
     {"lspci",    CMD_NONE, cmd_lspci, nullptr, nullptr},
+    {"lsblk",    CMD_NONE, cmd_lsblk, nullptr, nullptr},
+    {"sync",     CMD_NONE, cmd_sync, nullptr, nullptr},
     {"ifconfig", CMD_NONE, cmd_ifconfig, nullptr, nullptr},
     {"dhcp",     CMD_NONE, cmd_dhcp_request, nullptr, nullptr},
     {"env",      CMD_NONE, cmd_env, nullptr, nullptr},
@@ -2694,13 +3340,21 @@ static const CommandEntry commands[] = {
     {"stat",     CMD_ARGS, nullptr, cmd_stat, nullptr},
     {"hexdump",  CMD_ARGS, nullptr, cmd_hexdump, nullptr},
     {"touch",    CMD_ARGS, nullptr, cmd_touch, nullptr},
+    {"mkdir",    CMD_ARGS, nullptr, cmd_mkdir, nullptr},
     {"rm",       CMD_ARGS, nullptr, cmd_rm, nullptr},
+    {"truncate", CMD_ARGS, nullptr, cmd_truncate, nullptr},
+    {"punch",    CMD_ARGS, nullptr, cmd_punch, nullptr},
     {"write",    CMD_ARGS, nullptr, cmd_write, nullptr},
     {"append",   CMD_ARGS, nullptr, cmd_append, nullptr},
     {"run",      CMD_ARGS, nullptr, cmd_run, nullptr},
+    {"exec",     CMD_ARGS, nullptr, cmd_exec, nullptr},
+    {"blkbench", CMD_ARGS, nullptr, cmd_blkbench, nullptr},
+    {"mkfs",     CMD_ARGS, nullptr, cmd_mkfs, nullptr},
+    {"snapshot", CMD_ARGS, nullptr, cmd_snapshot, nullptr},
     {"set",      CMD_ARGS, nullptr, cmd_set, nullptr},
     {"unset",    CMD_ARGS, nullptr, cmd_unset, nullptr},
     {"ping",     CMD_ARGS, nullptr, cmd_ping, nullptr},
+    {"sendfile", CMD_ARGS, nullptr, cmd_sendfile, nullptr},
     {"sleep",    CMD_ARGS, nullptr, cmd_sleep, nullptr},
     {"read",     CMD_ARGS, nullptr, cmd_read, nullptr},
     {"test",     CMD_ARGS, nullptr, cmd_test, nullptr},
@@ -2726,7 +3380,7 @@ static const int NUM_COMMANDS = sizeof(commands) / sizeof(commands[0]);
 
 // Execute a single command, optionally with piped input
 // Returns true if command was recognized, false otherwise
-static bool execute_single_command(const char* cmd, const char* piped_input) {
+static bool execute_single_command(const char* cmd, int input_pipe) {
     // Skip leading whitespace
     while (*cmd == ' ') cmd++;
     
@@ -2783,11 +3437,11 @@ static bool execute_single_command(const char* cmd, const char* piped_input) {
         else if (c.type == CMD_PIPED) {
             // Piped command: supports file arg or piped input
             if (strcmp(local_cmd, c.name) == 0) {
-                c.handler_piped(nullptr, piped_input);
+                c.handler_piped(nullptr, input_pipe);
                 return true;
             }
             if (strncmp(local_cmd, c.name, name_len) == 0 && local_cmd[name_len] == ' ') {
-                c.handler_piped(local_cmd + name_len + 1, piped_input);
+                c.handler_piped(local_cmd + name_len + 1, input_pipe);
                 return true;
             }
         }
@@ -2805,14 +3459,14 @@ static bool execute_single_command(const char* cmd, const char* piped_input) {
     
     // "cat" with no args outputs piped input
     if (strcmp(local_cmd, "cat") == 0) {
-        cmd_cat_piped(piped_input);
+        cmd_cat_piped(input_pipe);
         return true;
     }
     
     // "echo" with no args outputs piped input or newline
     if (strcmp(local_cmd, "echo") == 0) {
-        if (piped_input && piped_input[0]) {
-            g_terminal.write(piped_input);
+        if (input_pipe >= 0) {
+            cmd_cat_piped(input_pipe);
         } else {
             g_terminal.write("\n");
         }
@@ -2984,6 +3638,90 @@ static bool execute_single_command(const char* cmd, const char* piped_input) {
     return false;
 }
 
+// =============================================================================
+// Pipelines
+// =============================================================================
+// Every stage but the last runs in its own task, with its terminal output
+// redirected into a kernel pipe that the next stage reads. Stages run at
+// the same time and data streams through the pipes, so memory use does not
+// depend on how much flows through. The last stage runs in the shell and
+// draws to the screen.
+
+struct PipelineStage {
+    TerminalSink sink;          // First, so the sink callback finds the stage
+    const char* cmd;
+    int input_pipe;             // -1 for the first stage
+    int output_pipe;
+    uint64_t pid;               // 0 if the stage could not start
+    bool broken;                // Reader gone: further output is dropped
+    uint32_t used;
+    char buffer[PIPELINE_OUT_BUFFER];
+};
+
+static void stage_flush(PipelineStage* st) {
+    if (st->used > 0 && !st->broken &&
+        pipe_write(st->output_pipe, st->buffer, st->used) < (int64_t)st->used) {
+        st->broken = true;
+    }
+    st->used = 0;
+}
+
+static void stage_put(TerminalSink* sink, char c) {
+    PipelineStage* st = (PipelineStage*)sink;
+    st->buffer[st->used++] = c;
+    if (st->used == PIPELINE_OUT_BUFFER) stage_flush(st);
+}
+
+static void stage_task(void* arg) {
+    PipelineStage* st = (PipelineStage*)arg;
+    Process* self = process_get_current();
+    self->output = &st->sink;
+    execute_single_command(st->cmd, st->input_pipe);
+    stage_flush(st);
+    self->output = nullptr;
+    
+    // EOF for the next stage; the previous one stops waiting for room
+    pipe_close_write(st->output_pipe);
+    if (st->input_pipe >= 0) pipe_close_read(st->input_pipe);
+}
+
+static void run_pipeline(char** commands, int count) {
+    PipelineStage* stages = (PipelineStage*)malloc((count - 1) * sizeof(PipelineStage));
+    if (!stages) {
+        g_terminal.write_line("Pipeline: out of memory");
+        return;
+    }
+    
+    int input = -1;
+    for (int i = 0; i < count - 1; i++) {
+        PipelineStage* st = &stages[i];
+        st->sink.put = stage_put;
+        st->cmd = commands[i];
+        st->input_pipe = input;
+        st->output_pipe = pipe_create();
+        st->broken = false;
+        st->used = 0;
+        // The stage may run as soon as it is spawned: set everything first
+        st->pid = st->output_pipe >= 0 ? scheduler_spawn(stage_task, st) : 0;
+        
+        if (st->pid == 0) {
+            // The stage before sees its reader gone, the next one sees EOF
+            g_terminal.write_line("Pipeline: cannot start stage");
+            if (input >= 0) pipe_close_read(input);
+            if (st->output_pipe >= 0) pipe_close_write(st->output_pipe);
+        }
+        input = st->output_pipe;
+    }
+    
+    execute_single_command(commands[count - 1], input);
+    if (input >= 0) pipe_close_read(input);
+    
+    for (int i = 0; i < count - 1; i++) {
+        if (stages[i].pid) process_waitpid(stages[i].pid, nullptr);
+    }
+    free(stages);
+}
+
 static void execute_command() {
     cmd_buffer[cmd_len] = 0;
     selection_start = -1;  // Clear any text selection
@@ -3022,24 +3760,16 @@ static void execute_command() {
     
     if (!has_pipe) {
         // Simple case: no pipes, execute directly
-        execute_single_command(cmd_buffer, nullptr);
+        execute_single_command(cmd_buffer, -1);
     } else {
         // Parse and execute pipeline
         // Commands: cmd1 | cmd2 | cmd3 ...
-        // We alternate between pipe_buffer_a and pipe_buffer_b
-        
-        // Clear pipe buffers to prevent stale data
-        pipe_buffer_a[0] = '\0';
-        pipe_buffer_b[0] = '\0';
-        
-        char* current_input = nullptr;
-        char* current_output = pipe_buffer_a;
-        char* commands[16];  // Max 16 commands in pipeline
+        char* commands[PIPELINE_MAX_STAGES];
         int cmd_count = 0;
         
         // Split by pipe character
         char* start = cmd_buffer;
-        for (int i = 0; i <= cmd_len && cmd_count < 16; i++) {
+        for (int i = 0; i <= cmd_len && cmd_count < PIPELINE_MAX_STAGES; i++) {
             if (cmd_buffer[i] == '|' || cmd_buffer[i] == '\0') {
                 cmd_buffer[i] = '\0';
                 commands[cmd_count++] = start;
@@ -3047,25 +3777,7 @@ static void execute_command() {
             }
         }
         
-        // Execute each command in the pipeline
-        for (int i = 0; i < cmd_count; i++) {
-            bool is_last = (i == cmd_count - 1);
-            
-            if (is_last) {
-                // Last command: output to screen normally
-                execute_single_command(commands[i], current_input);
-            } else {
-                // Not last: capture output to buffer
-                current_output[0] = '\0';  // Clear destination buffer
-                g_terminal.start_capture(current_output, PIPE_BUFFER_SIZE - 1);
-                execute_single_command(commands[i], current_input);
-                g_terminal.stop_capture();
-                
-                // Swap buffers for next iteration
-                current_input = current_output;
-                current_output = (current_output == pipe_buffer_a) ? pipe_buffer_b : pipe_buffer_a;
-            }
-        }
+        run_pipeline(commands, cmd_count);
     }
     
     cmd_len = 0;
@@ -3440,13 +4152,13 @@ void shell_process_char(char c) {
             
             if (!handled) {
                 // Filename completion - get partial filename after last space
-                // Search uniFS for matching files
+                // Search the root directory for matching files
                 int matches = 0;
                 const char* last_match = nullptr;
-                uint64_t file_count = unifs_get_file_count();
+                uint64_t file_count = vfs_dir_count("/");
                 
                 for (uint64_t i = 0; i < file_count; i++) {
-                    const char* fname = unifs_get_file_name(i);
+                    const char* fname = vfs_dir_name("/", i);
                     if (fname && strncmp(partial, fname, partial_len) == 0) {
                         matches++;
                         last_match = fname;
@@ -3469,7 +4181,7 @@ void shell_process_char(char c) {
                     // Show matching files
                     g_terminal.write("\n");
                     for (uint64_t i = 0; i < file_count; i++) {
-                        const char* fname = unifs_get_file_name(i);
+                        const char* fname = vfs_dir_name("/", i);
                         if (fname && strncmp(partial, fname, partial_len) == 0) {
                             g_terminal.write(fname);
                             g_terminal.write("  ");
@@ -3486,8 +4198,9 @@ void shell_process_char(char c) {
             // Command completion
             static const char* commands[] = {
                 "help", "ls", "cat", "stat", "hexdump", "touch", "rm", "write", "append", "df",
+                "truncate", "punch",
                 "mem", "date", "uptime", "version", "uname", "cpuinfo", "lspci",
-                "ifconfig", "dhcp", "ping", "clear", "gui", "reboot", "poweroff", "echo",
+                "ifconfig", "dhcp", "ping", "sendfile", "clear", "gui", "reboot", "poweroff", "echo",
                 "wc", "head", "tail", "grep", "sort", "uniq", "rev", "tac", "nl", "tr",
                 // Scripting commands (v0.5.0+)
                 "run", "set", "unset", "env",
@@ -3495,6 +4208,14 @@ void shell_process_char(char c) {
                 "exit", "time", "true", "false", "sleep", "read", "test", "expr", "source",
                 // Audio commands (v0.6.2+)
                 "audio",
+                // User programs (v0.6.3+)
+                "exec",
+                // Block devices (v0.6.5+)
+                "lsblk", "blkbench",
+                // Disk filesystem (v0.6.9+)
+                "mkdir", "sync", "mkfs",
+                // RAM filesystem snapshots (v0.6.22+)
+                "snapshot",
                 nullptr
             };
             
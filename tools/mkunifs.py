@@ -2,57 +2,380 @@ import os
 import struct
 import sys
 
-def create_unifs(source_dir, output_file):
+# ==============================================================================
+# LZ4 (--compress, see kernel/fs/lz4.h and UniFSLz4Header in kernel/fs/unifs.h)
+# ==============================================================================
+
+LZ4_MAGIC = b"ULZ4"
+LZ4_BLOCK_SIZE = 65536
+LZ4_ENTRY_FLAG = 1 << 63
+LZ4_MIN_MATCH = 4
+LZ4_MFLIMIT = 12        # No match starts in the last 12 bytes of a block...
+LZ4_LAST_LITERALS = 5   # ...and the last 5 are always literals
+LZ4_MAX_OFFSET = 65535
+
+def lz4_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+def lz4_sequence(out, literals, offset=0, match_len=0):
+    lit = len(literals)
+    token = min(lit, 15) << 4
+    if offset:
+        token |= min(match_len - LZ4_MIN_MATCH, 15)
+    out.append(token)
+    if lit >= 15:
+        lz4_length(out, lit - 15)
+    out += literals
+    if offset:
+        out += struct.pack("<H", offset)
+        if match_len - LZ4_MIN_MATCH >= 15:
+            lz4_length(out, match_len - LZ4_MIN_MATCH - 15)
+
+def lz4_compress_block(src):
+    """Greedy LZ4 block: match against the last position of the same 4 bytes."""
+    out = bytearray()
+    last_seen = {}
+    n = len(src)
+    anchor = 0
+    i = 0
+    while i < n - LZ4_MFLIMIT:
+        key = src[i:i + LZ4_MIN_MATCH]
+        cand = last_seen.get(key)
+        last_seen[key] = i
+        if cand is None or i - cand > LZ4_MAX_OFFSET:
+            i += 1
+            continue
+        length = LZ4_MIN_MATCH
+        end = n - LZ4_LAST_LITERALS
+        while i + length < end and src[cand + length] == src[i + length]:
+            length += 1
+        lz4_sequence(out, src[anchor:i], i - cand, length)
+        i += length
+        anchor = i
+    lz4_sequence(out, src[anchor:])
+    return bytes(out)
+
+def lz4_frame(content):
+    """Independent blocks behind an offset table; blocks that do not shrink stay raw."""
+    blocks = []
+    for start in range(0, len(content), LZ4_BLOCK_SIZE):
+        raw = content[start:start + LZ4_BLOCK_SIZE]
+        packed = lz4_compress_block(raw)
+        blocks.append(packed if len(packed) < len(raw) else raw)
+
+    header = struct.pack("<4sIII", LZ4_MAGIC, LZ4_BLOCK_SIZE, len(blocks), 0)
+    offsets = []
+    offset = len(header) + 4 * (len(blocks) + 1)
+    for block in blocks:
+        offsets.append(offset)
+        offset += len(block)
+    offsets.append(offset)
+    return header + struct.pack(f"<{len(offsets)}I", *offsets) + b"".join(blocks)
+
+# ==============================================================================
+# CRC32C (checksum trailer, see UniFSCrcTrailer in kernel/fs/unifs.h)
+# ==============================================================================
+
+CRC_MAGIC = b"UNIFSCRC"
+CRC32C_POLY = 0x82F63B78
+
+def crc32c_table():
+    table = []
+    for b in range(256):
+        crc = b
+        for _ in range(8):
+            crc = (crc >> 1) ^ (CRC32C_POLY if crc & 1 else 0)
+        table.append(crc)
+    return table
+
+CRC32C_TABLE = crc32c_table()
+
+def crc32c(data, crc=0):
+    """Same result as the kernel's crc32c(crc, data, len)."""
+    crc ^= 0xFFFFFFFF
+    table = CRC32C_TABLE
+    for b in data:
+        crc = (crc >> 8) ^ table[(crc ^ b) & 0xFF]
+    return crc ^ 0xFFFFFFFF
+
+V1_HEADER_SIZE = 16
+V1_INDEX_SIZE = 16
+V1_ENTRY_SIZE = 80
+V1_DATA_ALIGN = 4096
+
+def align_up(value, alignment):
+    return (value + alignment - 1) // alignment * alignment
+
+def create_unifs(source_dir, output_file, compress=False, aligned=False, checksums=True):
     files = []
     for root, _, filenames in os.walk(source_dir):
         for filename in filenames:
             filepath = os.path.join(root, filename)
-            files.append((filename, filepath))
+            name_bytes = filename.encode('utf-8')
+            if len(name_bytes) > 63:
+                print(f"Warning: Filename {filename} truncated")
+                name_bytes = name_bytes[:63]
+            files.append((name_bytes, filepath))
+
+    # Aligned layout: entries sorted by name (stable, so the first of a
+    # duplicated name still wins), then the hash table, then page-aligned data
+    if aligned:
+        files.sort(key=lambda f: f[0])
 
     # Header: Magic (8 bytes), File Count (8 bytes)
-    magic = b"UNIFS v1"
+    magic = b"UNIFS va" if aligned else b"UNIFS v1"
     file_count = len(files)
     
     header = struct.pack("<8sQ", magic, file_count)
     
     # Calculate offsets
-    # Header size: 16 bytes
+    # Header size: 16 bytes (+ 16-byte index when aligned)
     # Entry size: 64 (name) + 8 (offset) + 8 (size) = 80 bytes
-    current_offset = 16 + (file_count * 80)
+    current_offset = V1_HEADER_SIZE + (file_count * V1_ENTRY_SIZE)
+    index = b""
+    table = b""
+    if aligned:
+        # Open addressing like the kernel's NameTable: slot = entry index + 1
+        slots = 16
+        while slots < file_count * 2 + 1:
+            slots *= 2
+        table_slots = [0] * slots
+        for i, (name_bytes, _) in enumerate(files):
+            slot = name_hash(name_bytes) & (slots - 1)
+            while table_slots[slot] and files[table_slots[slot] - 1][0] != name_bytes:
+                slot = (slot + 1) & (slots - 1)
+            if not table_slots[slot]:
+                table_slots[slot] = i + 1
+        table_offset = current_offset + V1_INDEX_SIZE
+        index = struct.pack("<QII", table_offset, slots, V1_DATA_ALIGN)
+        table = struct.pack(f"<{slots}I", *table_slots)
+        current_offset = align_up(table_offset + len(table), V1_DATA_ALIGN)
     
     entries = []
+    crcs = []
     data_blob = bytearray()
+    compressed = 0
     
-    for name, filepath in files:
+    for name_bytes, filepath in files:
         with open(filepath, "rb") as f:
             content = f.read()
             
         size = len(content)
+        stored = content
+        flags = 0
         
-        # Entry: Name (64s), Offset (Q), Size (Q)
-        # Pad name to 64 bytes
-        name_bytes = name.encode('utf-8')
-        if len(name_bytes) > 63:
-            print(f"Warning: Filename {name} truncated")
-            name_bytes = name_bytes[:63]
-            
-        entry = struct.pack("<64sQQ", name_bytes, current_offset, size)
+        # Keep the LZ4 frame only when it saves at least an eighth. Aligned
+        # images keep programs raw so the kernel can map their pages in place.
+        if compress and size > 0 and not (aligned and content[:4] == b"\x7fELF"):
+            frame = lz4_frame(content)
+            if len(frame) <= size - size // 8:
+                stored = frame
+                flags = LZ4_ENTRY_FLAG
+                compressed += 1
+        
+        # Entry: Name (64s, NUL-padded), Offset (Q), Size (Q)
+        entry = struct.pack("<64sQQ", name_bytes, current_offset | flags, size)
         entries.append(entry)
+        crcs.append(crc32c(stored))
         
-        data_blob.extend(content)
-        current_offset += size
+        data_blob.extend(stored)
+        current_offset += len(stored)
+        if aligned:
+            padding = align_up(current_offset, V1_DATA_ALIGN) - current_offset
+            data_blob.extend(bytes(padding))
+            current_offset += padding
 
+    metadata = header + index + b"".join(entries) + table
     with open(output_file, "wb") as f:
-        f.write(header)
-        for entry in entries:
-            f.write(entry)
+        f.write(metadata)
+        if aligned:
+            f.write(bytes(align_up(f.tell(), V1_DATA_ALIGN) - f.tell()))
         f.write(data_blob)
+        if checksums:
+            # CRC of each entry's stored bytes, then the trailer at the very end
+            table_offset = f.tell()
+            f.write(struct.pack(f"<{file_count}I", *crcs))
+            f.write(struct.pack("<QQII8s", table_offset, len(metadata), file_count,
+                                crc32c(metadata), CRC_MAGIC))
         
-    print(f"Created {output_file} with {file_count} files.")
+    notes = []
+    if compress:
+        notes.append(f"{compressed} LZ4-compressed")
+    if aligned:
+        notes.append("page-aligned")
+    if checksums:
+        notes.append("CRC32C")
+    suffix = f" ({', '.join(notes)})" if notes else ""
+    print(f"Created {output_file} with {file_count} files{suffix}.")
+
+# ==============================================================================
+# uniFS v2 (block device image, see kernel/fs/unifs_disk.h)
+# ==============================================================================
+
+V2_BLOCK_SIZE = 4096
+V2_INODE_SIZE = 256
+V2_INODES_PER_BLOCK = V2_BLOCK_SIZE // V2_INODE_SIZE
+V2_INLINE_EXTENTS = 13
+V2_DIRENT_SIZE = 80
+V2_DIRENTS_PER_BLOCK = V2_BLOCK_SIZE // V2_DIRENT_SIZE
+V2_BYTES_PER_INODE = 32768
+V2_MAX_INODES = 262144          # Same cap as the kernel's mkfs
+V2_TYPE_FILE = 1
+V2_TYPE_DIR = 2
+V2_ROOT_INODE = 1
+V2_JOURNAL_DIVISOR = 32
+V2_JOURNAL_MIN_BLOCKS = 64
+V2_JOURNAL_MAX_BLOCKS = 8192
+JOURNAL_MAGIC = 0x4C4E524A
+JOURNAL_HEADER = 1
+
+def name_hash(name_bytes):
+    # FNV-1a, as unifs2_name_hash()
+    h = 2166136261
+    for b in name_bytes:
+        h ^= b
+        h = (h * 16777619) & 0xFFFFFFFF
+    return h
+
+def create_unifs_v2(source_dir, output_file, size_mb):
+    blocks = size_mb * 1024 * 1024 // V2_BLOCK_SIZE
+    bits_per_block = V2_BLOCK_SIZE * 8
+
+    # Layout, computed exactly as unifs_disk_format() does
+    inode_count = max(blocks * V2_BLOCK_SIZE // V2_BYTES_PER_INODE, 64)
+    inode_count = min(inode_count, V2_MAX_INODES)
+    inode_count = (inode_count + V2_INODES_PER_BLOCK - 1) // V2_INODES_PER_BLOCK * V2_INODES_PER_BLOCK
+    inode_bitmap_start = 1
+    inode_bitmap_blocks = (inode_count + bits_per_block - 1) // bits_per_block
+    block_bitmap_start = inode_bitmap_start + inode_bitmap_blocks
+    block_bitmap_blocks = (blocks + bits_per_block - 1) // bits_per_block
+    inode_table_start = block_bitmap_start + block_bitmap_blocks
+    inode_table_blocks = inode_count // V2_INODES_PER_BLOCK
+    journal_start = inode_table_start + inode_table_blocks
+    journal_blocks = min(max(blocks // V2_JOURNAL_DIVISOR, V2_JOURNAL_MIN_BLOCKS), V2_JOURNAL_MAX_BLOCKS)
+    data_start = journal_start + journal_blocks
+
+    img = bytearray(data_start * V2_BLOCK_SIZE)
+    state = {"next_block": data_start, "next_inode": V2_ROOT_INODE + 1}
+
+    def put_data(content):
+        # Each file gets one contiguous run, i.e. a single extent
+        count = (len(content) + V2_BLOCK_SIZE - 1) // V2_BLOCK_SIZE
+        start = state["next_block"]
+        if start + count > blocks:
+            print(f"Error: {size_mb} MB is too small for {source_dir}")
+            sys.exit(1)
+        end = (start + count) * V2_BLOCK_SIZE
+        if len(img) < end:
+            img.extend(bytes(end - len(img)))
+        img[start * V2_BLOCK_SIZE:start * V2_BLOCK_SIZE + len(content)] = content
+        state["next_block"] += count
+        return start, count
+
+    def put_inode(ino, kind, parent, content):
+        start, count = put_data(content)
+        size = count * V2_BLOCK_SIZE if kind == V2_TYPE_DIR else len(content)
+        extents = struct.pack("<IIQ", 0, count, start) if count else b""
+        inode = struct.pack("<HHIQQQIIQ", kind, 0, 2 if kind == V2_TYPE_DIR else 1,
+                            size, 1, 0, 1 if count else 0, parent, 0) + extents
+        offset = inode_table_start * V2_BLOCK_SIZE + ino * V2_INODE_SIZE
+        img[offset:offset + len(inode)] = inode
+
+    def new_inode():
+        ino = state["next_inode"]
+        if ino >= inode_count:
+            print("Error: out of inodes")
+            sys.exit(1)
+        state["next_inode"] += 1
+        return ino
+
+    def add_dir(path, ino, parent):
+        table = bytearray()
+        slot = 0
+        for name in sorted(os.listdir(path)):
+            full = os.path.join(path, name)
+            name_bytes = name.encode('utf-8')
+            if len(name_bytes) > 63:
+                print(f"Warning: Filename {name} truncated")
+                name_bytes = name_bytes[:63]
+
+            child = new_inode()
+            if os.path.isdir(full):
+                kind = V2_TYPE_DIR
+                add_dir(full, child, ino)
+            else:
+                kind = V2_TYPE_FILE
+                with open(full, "rb") as f:
+                    put_inode(child, kind, ino, f.read())
+
+            # Entries never straddle a block
+            if slot == V2_DIRENTS_PER_BLOCK:
+                table.extend(bytes(V2_BLOCK_SIZE - len(table) % V2_BLOCK_SIZE))
+                slot = 0
+            table.extend(struct.pack("<IIBB6x64s", child, name_hash(name_bytes), kind,
+                                     len(name_bytes), name_bytes))
+            slot += 1
+        put_inode(ino, V2_TYPE_DIR, parent, bytes(table))
+
+    add_dir(source_dir, V2_ROOT_INODE, V2_ROOT_INODE)
+
+    def set_bits(start_block, count):
+        for bit in range(count):
+            img[start_block * V2_BLOCK_SIZE + bit // 8] |= 1 << (bit % 8)
+
+    used_blocks = state["next_block"]
+    used_inodes = state["next_inode"]
+    set_bits(block_bitmap_start, used_blocks)
+    set_bits(inode_bitmap_start, used_inodes)
+
+    sb = struct.pack("<8sII14Q", b"UNIFSv2", 2, V2_BLOCK_SIZE, blocks, inode_count,
+                     inode_bitmap_start, inode_bitmap_blocks,
+                     block_bitmap_start, block_bitmap_blocks,
+                     inode_table_start, inode_table_blocks,
+                     journal_start, journal_blocks, data_start,
+                     blocks - used_blocks, inode_count - used_inodes, 0)
+    img[0:len(sb)] = sb
+
+    # Empty log (journal_format()); a random sequence so stale blocks of an
+    # earlier image never pass for transactions
+    sequence = int.from_bytes(os.urandom(6), "little") + 1
+    header = struct.pack("<IIQQ", JOURNAL_MAGIC, JOURNAL_HEADER, sequence, journal_blocks)
+    img[journal_start * V2_BLOCK_SIZE:journal_start * V2_BLOCK_SIZE + len(header)] = header
+
+    with open(output_file, "wb") as f:
+        f.write(img)
+        f.truncate(blocks * V2_BLOCK_SIZE)
+
+    print(f"Created {output_file} (uniFS v2, {size_mb} MB) with {used_inodes - 2} entries.")
 
 if __name__ == "__main__":
-    if len(sys.argv) < 3:
-        print("Usage: mkunifs.py <source_dir> <output_file>")
+    args = sys.argv[1:]
+    v2 = "--v2" in args
+    if v2:
+        args.remove("--v2")
+    size_mb = 64
+    if "--size" in args:
+        i = args.index("--size")
+        size_mb = int(args[i + 1])
+        del args[i:i + 2]
+    compress = "--compress" in args
+    if compress:
+        args.remove("--compress")
+    aligned = "--aligned" in args
+    if aligned:
+        args.remove("--aligned")
+    checksums = "--no-crc" not in args
+    if not checksums:
+        args.remove("--no-crc")
+
+    if len(args) < 2:
+        print("Usage: mkunifs.py [--v2 [--size MB] | [--compress] [--aligned] [--no-crc]] <source_dir> <output_file>")
         sys.exit(1)
-        
-    create_unifs(sys.argv[1], sys.argv[2])
+
+    if v2:
+        create_unifs_v2(args[0], args[1], size_mb)
+    else:
+        create_unifs(args[0], args[1], compress, aligned, checksums)
@@ -0,0 +1,257 @@
+// bench - kernel microbenchmarks run from ring 3
+//
+// Usage (from the uniOS shell): exec bench
+//
+// Each test reports wall time per operation (timer-tick resolution, so the
+// iteration counts are chosen to run for tens of milliseconds) and TSC
+// cycles per operation. Pipe ping-pong is the round-trip latency of one
+// byte; pipe stream is one-way throughput in 64 KB writes.
+
+#include "libc.h"
+
+#define NULL_SYSCALL_ITERS 200000
+#define FORK_WAIT_ITERS    200
+#define PINGPONG_ITERS     5000
+#define PIPE_STREAM_BYTES  (32 * 1024 * 1024)
+#define PIPE_CHUNK_SIZE    (64 * 1024)
+#define YIELD_ITERS        20000
+#define FILE_READ_BYTES    (16 * 1024 * 1024)
+#define FILE_CHUNK_SIZE    4096
+
+// Read from bench.dat when the image provides it, else from this binary
+static const char* file_candidates[] = { "bench.dat", "bench", nullptr };
+
+struct Measurement {
+    uint64_t start_ns;
+    uint64_t start_tsc;
+};
+
+static Measurement measure_start() {
+    Measurement m;
+    m.start_ns = clock_ns();
+    m.start_tsc = rdtsc();
+    return m;
+}
+
+static void report(const char* name, Measurement m, uint64_t ops, const char* unit) {
+    uint64_t cycles = rdtsc() - m.start_tsc;
+    uint64_t ns = clock_ns() - m.start_ns;
+
+    printf("  %-18s %8lu %-6s %8lu ns/op %10lu cycles/op  (%lu ms total)\n",
+           name, ops, unit, ns / ops, cycles / ops, ns / 1000000);
+}
+
+static void bench_null_syscall() {
+    Measurement m = measure_start();
+    for (int i = 0; i < NULL_SYSCALL_ITERS; i++) {
+        sys_getpid();
+    }
+    report("null syscall", m, NULL_SYSCALL_ITERS, "calls");
+}
+
+static void bench_fork_wait() {
+    fflush_stdout();  // Child must not inherit buffered output
+
+    Measurement m = measure_start();
+    for (int i = 0; i < FORK_WAIT_ITERS; i++) {
+        int64_t pid = sys_fork();
+        if (pid == 0) {
+            sys_exit(0);
+        }
+        if (pid < 0) {
+            printf("  fork+wait: fork failed after %d iterations\n", i);
+            return;
+        }
+        int32_t status;
+        sys_waitpid(pid, &status);
+    }
+    report("fork+wait", m, FORK_WAIT_ITERS, "forks");
+}
+
+static void bench_pipe_pingpong() {
+    int32_t to_child[2], to_parent[2];
+    if (sys_pipe(to_child) < 0 || sys_pipe(to_parent) < 0) {
+        printf("  pipe ping-pong: pipe() failed\n");
+        return;
+    }
+
+    fflush_stdout();
+    int64_t pid = sys_fork();
+    if (pid < 0) {
+        printf("  pipe ping-pong: fork failed\n");
+        return;
+    }
+
+    char byte = 'x';
+    if (pid == 0) {
+        for (int i = 0; i < PINGPONG_ITERS; i++) {
+            if (sys_read(to_child[0], &byte, 1) != 1) break;
+            sys_write(to_parent[1], &byte, 1);
+        }
+        sys_exit(0);
+    }
+
+    Measurement m = measure_start();
+    for (int i = 0; i < PINGPONG_ITERS; i++) {
+        sys_write(to_child[1], &byte, 1);
+        sys_read(to_parent[0], &byte, 1);
+    }
+    report("pipe ping-pong", m, PINGPONG_ITERS, "trips");
+
+    int32_t status;
+    sys_waitpid(pid, &status);
+
+    // The descriptor table is shared, so only the parent closes
+    sys_close(to_child[0]);
+    sys_close(to_child[1]);
+    sys_close(to_parent[0]);
+    sys_close(to_parent[1]);
+}
+
+// One-way throughput: the child drains the pipe in big reads and acks once
+// everything arrived (the shared descriptor table rules out EOF by close)
+static void bench_pipe_stream() {
+    int32_t data[2], ack[2];
+    if (sys_pipe(data) < 0 || sys_pipe(ack) < 0) {
+        printf("  pipe stream: pipe() failed\n");
+        return;
+    }
+
+    char* chunk = (char*)malloc(PIPE_CHUNK_SIZE);
+    if (!chunk) {
+        printf("  pipe stream: out of memory\n");
+        return;
+    }
+    memset(chunk, 'p', PIPE_CHUNK_SIZE);
+
+    fflush_stdout();
+    int64_t pid = sys_fork();
+    if (pid < 0) {
+        printf("  pipe stream: fork failed\n");
+        free(chunk);
+        return;
+    }
+
+    if (pid == 0) {
+        uint64_t total = 0;
+        while (total < PIPE_STREAM_BYTES) {
+            int64_t n = sys_read(data[0], chunk, PIPE_CHUNK_SIZE);
+            if (n <= 0) break;
+            total += (uint64_t)n;
+        }
+        char done = 'd';
+        sys_write(ack[1], &done, 1);
+        sys_exit(0);
+    }
+
+    Measurement m = measure_start();
+    uint64_t sent = 0;
+    while (sent < PIPE_STREAM_BYTES) {
+        int64_t n = sys_write(data[1], chunk, PIPE_CHUNK_SIZE);
+        if (n <= 0) break;
+        sent += (uint64_t)n;
+    }
+    char done;
+    sys_read(ack[0], &done, 1);
+    uint64_t ns = clock_ns() - m.start_ns;
+
+    report("pipe stream (64K)", m, sent / PIPE_CHUNK_SIZE ? sent / PIPE_CHUNK_SIZE : 1, "writes");
+    if (ns > 0) {
+        uint64_t kb_per_s = (sent / 1024) * 1000000ULL / (ns / 1000 ? ns / 1000 : 1);
+        printf("  %-18s %lu KB at %lu MB/s\n", "", sent / 1024, kb_per_s / 1024);
+    }
+
+    int32_t status;
+    sys_waitpid(pid, &status);
+    sys_close(data[0]);
+    sys_close(data[1]);
+    sys_close(ack[0]);
+    sys_close(ack[1]);
+    free(chunk);
+}
+
+static void bench_file_read() {
+    const char* name = nullptr;
+    for (int i = 0; file_candidates[i]; i++) {
+        int fd = sys_open(file_candidates[i]);
+        if (fd >= 0) {
+            sys_close(fd);
+            name = file_candidates[i];
+            break;
+        }
+    }
+    if (!name) {
+        printf("  file read: no input file found\n");
+        return;
+    }
+
+    char* chunk = (char*)malloc(FILE_CHUNK_SIZE);
+    if (!chunk) {
+        printf("  file read: out of memory\n");
+        return;
+    }
+
+    uint64_t total = 0;
+    Measurement m = measure_start();
+    while (total < FILE_READ_BYTES) {
+        int fd = sys_open(name);
+        if (fd < 0) break;
+
+        int64_t n;
+        while ((n = sys_read(fd, chunk, FILE_CHUNK_SIZE)) > 0) {
+            total += (uint64_t)n;
+        }
+        sys_close(fd);
+        if (n < 0) break;
+    }
+    uint64_t ns = clock_ns() - m.start_ns;
+    uint64_t chunks = (total + FILE_CHUNK_SIZE - 1) / FILE_CHUNK_SIZE;
+    if (chunks == 0) chunks = 1;
+
+    report("file read (4K)", m, chunks, "reads");
+    if (ns > 0) {
+        // MB/s = bytes / (ns / 1e9) / 2^20
+        uint64_t kb_per_s = (total / 1024) * 1000000ULL / (ns / 1000 ? ns / 1000 : 1);
+        printf("  %-18s %lu KB from %s at %lu MB/s\n", "", total / 1024, name, kb_per_s / 1024);
+    }
+    free(chunk);
+}
+
+static void bench_context_switch() {
+    fflush_stdout();
+    int64_t pid = sys_fork();
+    if (pid < 0) {
+        printf("  context switch: fork failed\n");
+        return;
+    }
+    if (pid == 0) {
+        for (int i = 0; i < YIELD_ITERS; i++) {
+            sys_sched_yield();
+        }
+        sys_exit(0);
+    }
+
+    Measurement m = measure_start();
+    for (int i = 0; i < YIELD_ITERS; i++) {
+        sys_sched_yield();
+    }
+    // Each round trip is two switches (parent -> child -> parent)
+    report("context switch", m, 2ULL * YIELD_ITERS, "switch");
+
+    int32_t status;
+    sys_waitpid(pid, &status);
+}
+
+int main() {
+    printf("uniOS user-space benchmarks (pid %ld)\n", sys_getpid());
+
+    bench_null_syscall();
+    bench_fork_wait();
+    bench_pipe_pingpong();
+    bench_pipe_stream();
+    bench_file_read();
+    bench_context_switch();
+
+    printf("done\n");
+    return 0;
+}
@@ -6,17 +6,18 @@ section .text
 global _start
 
 _start:
-    ; syscall: write(1, msg, 20)
+    ; syscall: write(1, msg, 16)
     ; RAX = syscall number (1 = SYS_WRITE)
-    ; RBX = string pointer
-    ; RCX = length
+    ; RBX = fd, RCX = buffer, R8 = length
     mov rax, 1              ; SYS_WRITE
-    lea rbx, [rel msg]      ; pointer to message
-    mov rcx, 20             ; length
+    mov rbx, 1              ; stdout
+    lea rcx, [rel msg]      ; pointer to message
+    mov r8, 16              ; length
     int 0x80                ; syscall
     
     ; syscall: exit(0)
     mov rax, 60             ; SYS_EXIT
+    xor rbx, rbx
     int 0x80
     
     ; Should never reach here
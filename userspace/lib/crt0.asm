@@ -0,0 +1,20 @@
+; crt0.asm - Entry point for C/C++ user programs
+; The kernel enters here in ring 3 with RSP at the top of the user stack.
+
+bits 64
+section .text
+global _start
+extern main
+extern exit
+
+_start:
+    xor rbp, rbp            ; Mark the outermost stack frame
+    and rsp, -16            ; SysV ABI: 16-byte aligned before call
+    
+    call main
+    
+    ; exit(main's return value) flushes stdout and never returns
+    mov edi, eax
+    call exit
+    
+    jmp $
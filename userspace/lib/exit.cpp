@@ -0,0 +1,6 @@
+#include "libc.h"
+
+extern "C" [[noreturn]] void exit(int status) {
+    fflush_stdout();
+    sys_exit(status);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include "syscall.h"
+
+// ============================================================================
+// uniOS User Runtime - minimal libc subset
+// ============================================================================
+// Freestanding: no exceptions, no RTTI, no global constructors. Programs are
+// linked with crt0.o and start at main(); returning from main calls exit().
+// ============================================================================
+
+extern "C" {
+
+// --- string.cpp ---
+void* memcpy(void* dst, const void* src, size_t n);
+void* memmove(void* dst, const void* src, size_t n);
+void* memset(void* dst, int c, size_t n);
+int memcmp(const void* s1, const void* s2, size_t n);
+size_t strlen(const char* s);
+int strcmp(const char* s1, const char* s2);
+int strncmp(const char* s1, const char* s2, size_t n);
+char* strcpy(char* dst, const char* src);
+char* strncpy(char* dst, const char* src, size_t n);
+
+// --- stdio.cpp (stdout is line buffered) ---
+int putchar(int c);
+int puts(const char* s);
+int printf(const char* fmt, ...);
+int vprintf(const char* fmt, va_list args);
+int snprintf(char* buf, size_t size, const char* fmt, ...);
+int vsnprintf(char* buf, size_t size, const char* fmt, va_list args);
+void fflush_stdout();
+
+// --- malloc.cpp (bucket allocator over SYS_MMAP) ---
+void* malloc(size_t size);
+void free(void* ptr);
+void* calloc(size_t count, size_t size);
+void* realloc(void* ptr, size_t size);
+
+// --- exit.cpp ---
+[[noreturn]] void exit(int status);
+
+} // extern "C"
+
+// Monotonic time in nanoseconds (timer-tick resolution)
+static inline uint64_t clock_ns() {
+    struct timespec ts;
+    sys_clock_gettime(0, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// CPU timestamp counter (cycle-level resolution)
+static inline uint64_t rdtsc() {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
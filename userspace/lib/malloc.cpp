@@ -0,0 +1,128 @@
+#include "libc.h"
+
+// ============================================================================
+// User Heap
+// ============================================================================
+// Same shape as the kernel heap: power-of-two buckets (16..2048 bytes) carved
+// out of 64KB arenas, large requests mapped directly with SYS_MMAP and
+// returned with SYS_MUNMAP on free.
+
+#define MIN_BUCKET_SIZE 16
+#define MAX_BUCKET_SIZE 2048
+#define NUM_BUCKETS 8
+#define ARENA_SIZE (64 * 1024)
+#define PAGE_SIZE 4096
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct AllocHeader {
+    size_t size;      // Block size including header (bucket size or mapping length)
+    uint64_t magic;
+};
+
+#define HEAP_MAGIC  0xC0FFEE1234567890ULL
+#define LARGE_MAGIC 0xC0FFEE12345678A0ULL
+
+static FreeBlock* buckets[NUM_BUCKETS];
+
+static int get_bucket_index(size_t size) {
+    int index = 0;
+    size_t bucket = MIN_BUCKET_SIZE;
+    while (bucket < size) {
+        bucket <<= 1;
+        index++;
+    }
+    return index < NUM_BUCKETS ? index : -1;
+}
+
+// Split a fresh arena into blocks for one bucket
+static bool refill_bucket(int index) {
+    void* arena = sys_mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_WRITE);
+    if (arena == MAP_FAILED) return false;
+    
+    size_t block_size = (size_t)MIN_BUCKET_SIZE << index;
+    uint8_t* p = (uint8_t*)arena;
+    for (size_t off = 0; off + block_size <= ARENA_SIZE; off += block_size) {
+        FreeBlock* block = (FreeBlock*)(p + off);
+        block->next = buckets[index];
+        buckets[index] = block;
+    }
+    return true;
+}
+
+extern "C" void* malloc(size_t size) {
+    if (size == 0) return nullptr;
+    
+    size_t total_size = size + sizeof(AllocHeader);
+    if (total_size < size) return nullptr;  // Overflow
+    
+    if (total_size > MAX_BUCKET_SIZE) {
+        size_t length = (total_size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+        void* mem = sys_mmap(nullptr, length, PROT_READ | PROT_WRITE);
+        if (mem == MAP_FAILED) return nullptr;
+        
+        AllocHeader* header = (AllocHeader*)mem;
+        header->size = length;
+        header->magic = LARGE_MAGIC;
+        return header + 1;
+    }
+    
+    int index = get_bucket_index(total_size);
+    if (!buckets[index] && !refill_bucket(index)) return nullptr;
+    
+    FreeBlock* block = buckets[index];
+    buckets[index] = block->next;
+    
+    AllocHeader* header = (AllocHeader*)block;
+    header->size = (size_t)MIN_BUCKET_SIZE << index;
+    header->magic = HEAP_MAGIC;
+    return header + 1;
+}
+
+extern "C" void free(void* ptr) {
+    if (!ptr) return;
+    
+    AllocHeader* header = (AllocHeader*)ptr - 1;
+    if (header->magic == LARGE_MAGIC) {
+        header->magic = 0;
+        sys_munmap(header, header->size);
+        return;
+    }
+    if (header->magic != HEAP_MAGIC) return;  // Not ours (or double free)
+    
+    int index = get_bucket_index(header->size);
+    header->magic = 0;
+    
+    FreeBlock* block = (FreeBlock*)header;
+    block->next = buckets[index];
+    buckets[index] = block;
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    size_t total = count * size;
+    if (size && total / size != count) return nullptr;
+    
+    void* ptr = malloc(total);
+    if (ptr) memset(ptr, 0, total);
+    return ptr;
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    if (!ptr) return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return nullptr;
+    }
+    
+    AllocHeader* header = (AllocHeader*)ptr - 1;
+    size_t old_size = header->size - sizeof(AllocHeader);
+    if (size <= old_size) return ptr;
+    
+    void* new_ptr = malloc(size);
+    if (!new_ptr) return nullptr;
+    memcpy(new_ptr, ptr, old_size);
+    free(ptr);
+    return new_ptr;
+}
@@ -0,0 +1,171 @@
+#include "libc.h"
+
+// ============================================================================
+// Formatted output
+// ============================================================================
+// Supports %d %i %u %x %X %p %s %c %% with optional '-', '0', width and the
+// l / ll / z length modifiers. No floating point.
+
+#define STDOUT_BUFFER_SIZE 256
+
+static char stdout_buffer[STDOUT_BUFFER_SIZE];
+static size_t stdout_len = 0;
+
+extern "C" void fflush_stdout() {
+    if (stdout_len > 0) {
+        sys_write(STDOUT_FD, stdout_buffer, stdout_len);
+        stdout_len = 0;
+    }
+}
+
+extern "C" int putchar(int c) {
+    stdout_buffer[stdout_len++] = (char)c;
+    if (c == '\n' || stdout_len == STDOUT_BUFFER_SIZE) {
+        fflush_stdout();
+    }
+    return (unsigned char)c;
+}
+
+extern "C" int puts(const char* s) {
+    while (*s) putchar(*s++);
+    putchar('\n');
+    return 0;
+}
+
+// Output sink: either a bounded buffer or stdout
+struct FormatSink {
+    bool to_stdout;
+    char* buf;
+    size_t size;
+    size_t len;       // Characters produced (may exceed size)
+};
+
+static void sink_put(FormatSink* sink, char c) {
+    if (sink->to_stdout) {
+        putchar(c);
+    } else if (sink->len + 1 < sink->size) {
+        sink->buf[sink->len] = c;
+    }
+    sink->len++;
+}
+
+static void sink_pad(FormatSink* sink, char c, int count) {
+    while (count-- > 0) sink_put(sink, c);
+}
+
+static int format_unsigned(char* tmp, uint64_t value, unsigned base, bool upper) {
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    int n = 0;
+    do {
+        tmp[n++] = digits[value % base];
+        value /= base;
+    } while (value);
+    return n;  // Digits are stored in reverse
+}
+
+static int format_to_sink(FormatSink* sink, const char* fmt, va_list args) {
+    while (*fmt) {
+        if (*fmt != '%') {
+            sink_put(sink, *fmt++);
+            continue;
+        }
+        fmt++;
+        
+        bool left = false, zero = false;
+        while (*fmt == '-' || *fmt == '0') {
+            if (*fmt == '-') left = true;
+            else zero = true;
+            fmt++;
+        }
+        int width = 0;
+        while (*fmt >= '0' && *fmt <= '9') width = width * 10 + (*fmt++ - '0');
+        
+        int longness = 0;
+        while (*fmt == 'l' || *fmt == 'z') { longness++; fmt++; }
+        
+        char tmp[24];
+        int n = 0;
+        bool negative = false;
+        char spec = *fmt ? *fmt++ : '\0';
+        
+        switch (spec) {
+            case 'd':
+            case 'i': {
+                int64_t v = longness ? va_arg(args, int64_t) : va_arg(args, int);
+                uint64_t u = (uint64_t)v;
+                if (v < 0) { negative = true; u = 0 - u; }
+                n = format_unsigned(tmp, u, 10, false);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X': {
+                uint64_t u = longness ? va_arg(args, uint64_t) : va_arg(args, unsigned int);
+                n = format_unsigned(tmp, u, spec == 'u' ? 10 : 16, spec == 'X');
+                break;
+            }
+            case 'p': {
+                uint64_t u = (uint64_t)va_arg(args, void*);
+                n = format_unsigned(tmp, u, 16, false);
+                tmp[n++] = 'x';
+                tmp[n++] = '0';
+                break;
+            }
+            case 'c':
+                tmp[n++] = (char)va_arg(args, int);
+                break;
+            case 's': {
+                const char* s = va_arg(args, const char*);
+                if (!s) s = "(null)";
+                int len = (int)strlen(s);
+                if (!left) sink_pad(sink, ' ', width - len);
+                while (*s) sink_put(sink, *s++);
+                if (left) sink_pad(sink, ' ', width - len);
+                continue;
+            }
+            case '%':
+                tmp[n++] = '%';
+                break;
+            default:
+                continue;
+        }
+        
+        int total = n + (negative ? 1 : 0);
+        if (!left && !zero) sink_pad(sink, ' ', width - total);
+        if (negative) sink_put(sink, '-');
+        if (!left && zero) sink_pad(sink, '0', width - total);
+        while (n > 0) sink_put(sink, tmp[--n]);
+        if (left) sink_pad(sink, ' ', width - total);
+    }
+    
+    if (!sink->to_stdout && sink->size > 0) {
+        sink->buf[sink->len < sink->size ? sink->len : sink->size - 1] = '\0';
+    }
+    return (int)sink->len;
+}
+
+extern "C" int vprintf(const char* fmt, va_list args) {
+    FormatSink sink = {true, nullptr, 0, 0};
+    return format_to_sink(&sink, fmt, args);
+}
+
+extern "C" int printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int ret = vprintf(fmt, args);
+    va_end(args);
+    return ret;
+}
+
+extern "C" int vsnprintf(char* buf, size_t size, const char* fmt, va_list args) {
+    FormatSink sink = {false, buf, size, 0};
+    return format_to_sink(&sink, fmt, args);
+}
+
+extern "C" int snprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int ret = vsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return ret;
+}
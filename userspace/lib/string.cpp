@@ -0,0 +1,82 @@
+#include "libc.h"
+
+// Plain byte loops; the compiler is told not to turn these back into calls
+// to themselves via -fno-builtin / -fno-tree-loop-distribute-patterns.
+
+extern "C" void* memcpy(void* dst, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    
+    // Word copy when both pointers share alignment
+    if ((((uintptr_t)d ^ (uintptr_t)s) & 7) == 0) {
+        while (n && ((uintptr_t)d & 7)) { *d++ = *s++; n--; }
+        uint64_t* dw = (uint64_t*)d;
+        const uint64_t* sw = (const uint64_t*)s;
+        while (n >= 8) { *dw++ = *sw++; n -= 8; }
+        d = (uint8_t*)dw;
+        s = (const uint8_t*)sw;
+    }
+    while (n--) *d++ = *s++;
+    return dst;
+}
+
+extern "C" void* memmove(void* dst, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    
+    if (d < s) {
+        return memcpy(dst, src, n);
+    } else if (d > s) {
+        // Copy backward so overlapping regions are preserved
+        d += n;
+        s += n;
+        while (n--) *--d = *--s;
+    }
+    return dst;
+}
+
+extern "C" void* memset(void* dst, int c, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    while (n--) *d++ = (uint8_t)c;
+    return dst;
+}
+
+extern "C" int memcmp(const void* s1, const void* s2, size_t n) {
+    const uint8_t* p1 = (const uint8_t*)s1;
+    const uint8_t* p2 = (const uint8_t*)s2;
+    while (n--) {
+        if (*p1 != *p2) return *p1 - *p2;
+        p1++; p2++;
+    }
+    return 0;
+}
+
+extern "C" size_t strlen(const char* s) {
+    size_t len = 0;
+    while (*s++) len++;
+    return len;
+}
+
+extern "C" int strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) { s1++; s2++; }
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+extern "C" int strncmp(const char* s1, const char* s2, size_t n) {
+    while (n && *s1 && (*s1 == *s2)) { s1++; s2++; n--; }
+    if (n == 0) return 0;
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+extern "C" char* strcpy(char* dst, const char* src) {
+    char* ret = dst;
+    while ((*dst++ = *src++));
+    return ret;
+}
+
+extern "C" char* strncpy(char* dst, const char* src, size_t n) {
+    char* ret = dst;
+    while (n && (*dst++ = *src++)) n--;
+    while (n--) *dst++ = '\0';
+    return ret;
+}
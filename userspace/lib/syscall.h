@@ -0,0 +1,111 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// uniOS System Call Interface (user side)
+// ============================================================================
+// int 0x80 with RAX = number, RBX/RCX/R8 = arguments, result in RAX.
+// The kernel handler is a normal C function, so every caller-saved register
+// except RAX/RBX may be clobbered. Numbers mirror kernel/core/syscall.h.
+// ============================================================================
+
+#define SYS_READ   0
+#define SYS_WRITE  1
+#define SYS_OPEN   2
+#define SYS_CLOSE  3
+#define SYS_MMAP   9
+#define SYS_MUNMAP 11
+#define SYS_PIPE   22
+#define SYS_SCHED_YIELD 24
+#define SYS_GETPID 39
+#define SYS_FORK   57
+#define SYS_EXIT   60
+#define SYS_WAIT4  61
+#define SYS_CLOCK_GETTIME 228
+
+#define STDIN_FD   0
+#define STDOUT_FD  1
+#define STDERR_FD  2
+
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC  0x4
+
+#define MAP_FAILED ((void*)-1)
+
+struct timespec {
+    int64_t tv_sec;
+    int64_t tv_nsec;
+};
+
+static inline int64_t syscall3(uint64_t num, uint64_t a1, uint64_t a2, uint64_t a3) {
+    register uint64_t r8 asm("r8") = a3;
+    uint64_t ret;
+    asm volatile("int $0x80"
+                 : "=a"(ret), "+c"(a2), "+r"(r8)
+                 : "a"(num), "b"(a1)
+                 : "rdx", "rsi", "rdi", "r9", "r10", "r11", "memory", "cc");
+    return (int64_t)ret;
+}
+
+static inline int64_t syscall0(uint64_t num) { return syscall3(num, 0, 0, 0); }
+static inline int64_t syscall1(uint64_t num, uint64_t a1) { return syscall3(num, a1, 0, 0); }
+static inline int64_t syscall2(uint64_t num, uint64_t a1, uint64_t a2) { return syscall3(num, a1, a2, 0); }
+
+// ============================================================================
+// Typed wrappers
+// ============================================================================
+
+static inline int64_t sys_read(int fd, void* buf, uint64_t count) {
+    return syscall3(SYS_READ, (uint64_t)fd, (uint64_t)buf, count);
+}
+
+static inline int64_t sys_write(int fd, const void* buf, uint64_t count) {
+    return syscall3(SYS_WRITE, (uint64_t)fd, (uint64_t)buf, count);
+}
+
+static inline int sys_open(const char* path) {
+    return (int)syscall1(SYS_OPEN, (uint64_t)path);
+}
+
+static inline int sys_close(int fd) {
+    return (int)syscall1(SYS_CLOSE, (uint64_t)fd);
+}
+
+static inline void* sys_mmap(void* addr, uint64_t length, int prot) {
+    return (void*)syscall3(SYS_MMAP, (uint64_t)addr, length, (uint64_t)prot);
+}
+
+static inline int sys_munmap(void* addr, uint64_t length) {
+    return (int)syscall2(SYS_MUNMAP, (uint64_t)addr, length);
+}
+
+static inline int sys_pipe(int32_t fds[2]) {
+    return (int)syscall1(SYS_PIPE, (uint64_t)fds);
+}
+
+static inline int sys_sched_yield() {
+    return (int)syscall0(SYS_SCHED_YIELD);
+}
+
+static inline int64_t sys_getpid() {
+    return syscall0(SYS_GETPID);
+}
+
+static inline int64_t sys_fork() {
+    return syscall0(SYS_FORK);
+}
+
+[[noreturn]] static inline void sys_exit(int status) {
+    syscall1(SYS_EXIT, (uint64_t)status);
+    for (;;) {}
+}
+
+static inline int64_t sys_waitpid(int64_t pid, int32_t* status) {
+    return syscall2(SYS_WAIT4, (uint64_t)pid, (uint64_t)status);
+}
+
+static inline int sys_clock_gettime(int clock_id, struct timespec* ts) {
+    return (int)syscall2(SYS_CLOCK_GETTIME, (uint64_t)clock_id, (uint64_t)ts);
+}